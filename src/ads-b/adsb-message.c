@@ -0,0 +1,142 @@
+#include <ads-b/adsb-message.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ADSB_CRC_POLYNOMIAL	0xfff409
+#define ADSB_CRC_BITS		24
+#define ADSB_CRC_MASK		((1u << ADSB_CRC_BITS) - 1)
+
+/* The downlink format, in the first five bits, is never corrected */
+#define ADSB_FIXABLE_FIRST_BIT	5
+#define ADSB_NB_SYNDROMES	(ADSB_MESSAGE_MAX_BITS - ADSB_FIXABLE_FIRST_BIT)
+
+struct adsb_syndrome {
+    uint32_t syndrome;
+    int bit;
+};
+
+static uint32_t adsb_crc_table[256];
+static struct adsb_syndrome adsb_syndromes[ADSB_NB_SYNDROMES];
+static int adsb_crc_inited = 0;
+
+static void adsb_crc_init(void);
+static int adsb_syndrome_compare(const void *, const void *);
+
+void
+adsb_message_clear(struct adsb_message *m) {
+    memset(m->bytes, 0, sizeof m->bytes);
+    m->nbits = 0;
+}
+
+/*
+ * Parses a string of '0' and '1', up to ADSB_MESSAGE_MAX_BITS of them.
+ * Returns the number of bits read.
+ */
+int
+adsb_message_from_bitstring(struct adsb_message *m, const char *s) {
+    adsb_message_clear(m);
+
+    for (; m->nbits < ADSB_MESSAGE_MAX_BITS; s++) {
+	if (*s != '0' && *s != '1')
+	    break;
+	adsb_message_append_bit(m, *s == '1');
+    }
+
+    return m->nbits;
+}
+
+/*
+ * buf must hold at least nbits + 1 characters.
+ */
+void
+adsb_message_to_bitstring(const struct adsb_message *m, char *buf) {
+    int i;
+
+    for (i = 0; i < m->nbits; i++)
+	buf[i] = '0' + ((m->bytes[i / 8] >> (7 - i % 8)) & 1);
+    buf[i] = '\0';
+}
+
+static int
+adsb_syndrome_compare(const void *a, const void *b) {
+    uint32_t sa = ((const struct adsb_syndrome *) a)->syndrome;
+    uint32_t sb = ((const struct adsb_syndrome *) b)->syndrome;
+
+    return sa < sb? -1 : sa > sb;
+}
+
+static void
+adsb_crc_init(void) {
+    struct adsb_message m;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+	uint32_t crc = (uint32_t) i << (ADSB_CRC_BITS - 8);
+
+	for (j = 0; j < 8; j++) {
+	    crc <<= 1;
+	    if (crc & (1u << ADSB_CRC_BITS))
+		crc ^= ADSB_CRC_POLYNOMIAL;
+	}
+	adsb_crc_table[i] = crc & ADSB_CRC_MASK;
+    }
+
+    adsb_crc_inited = 1;
+
+    /*
+     * The syndrome of a long message (CRC of its data xor its parity)
+     * with a single bit flipped depends only on the bit's position.
+     */
+    for (i = ADSB_FIXABLE_FIRST_BIT; i < ADSB_MESSAGE_MAX_BITS; i++) {
+	struct adsb_syndrome *s = &adsb_syndromes[i - ADSB_FIXABLE_FIRST_BIT];
+
+	adsb_message_clear(&m);
+	m.bytes[i / 8] = 0x80 >> (i % 8);
+	s->syndrome = adsb_message_compute_crc(&m, 88) ^
+	    adsb_message_get_bits(&m, 88, 24);
+	s->bit = i;
+    }
+
+    qsort(adsb_syndromes, ADSB_NB_SYNDROMES, sizeof adsb_syndromes[0],
+	adsb_syndrome_compare);
+}
+
+uint32_t
+adsb_message_compute_crc(const struct adsb_message *m, int nbits) {
+    uint32_t crc = 0;
+    int i;
+
+    if (!adsb_crc_inited)
+	adsb_crc_init();
+
+    for (i = 0; i < nbits / 8; i++)
+	crc = ((crc << 8) ^
+	    adsb_crc_table[((crc >> (ADSB_CRC_BITS - 8)) ^ m->bytes[i]) & 0xff])
+	    & ADSB_CRC_MASK;
+
+    return crc;
+}
+
+/*
+ * Repairs a long message whose syndrome is that of a single flipped bit.
+ * Returns the position of the bit, or -1 if there is no such bit.
+ */
+int
+adsb_message_fix_single_bit(struct adsb_message *m, uint32_t syndrome) {
+    struct adsb_syndrome key;
+    struct adsb_syndrome *s;
+
+    if (!adsb_crc_inited)
+	adsb_crc_init();
+
+    key.syndrome = syndrome;
+    s = bsearch(&key, adsb_syndromes, ADSB_NB_SYNDROMES,
+	sizeof adsb_syndromes[0], adsb_syndrome_compare);
+    if (s == NULL)
+	return -1;
+
+    m->bytes[s->bit / 8] ^= 0x80 >> (s->bit % 8);
+
+    return s->bit;
+}
@@ -0,0 +1,48 @@
+/*
+ * Mode S / ADS-B message packed as bits, most significant bit first
+ */
+#ifndef ADS_B_ADSB_MESSAGE_H_
+#define ADS_B_ADSB_MESSAGE_H_
+
+#include <inttypes.h>
+
+#define ADSB_MESSAGE_MAX_BITS	112
+#define ADSB_MESSAGE_SHORT_BITS	56
+
+struct adsb_message {
+    /*
+     * Spare bytes, zeroed like the rest, so that a field up to the last
+     * bit is read with one 4-byte load
+     */
+    uint8_t bytes[ADSB_MESSAGE_MAX_BITS / 8 + 4];
+    int nbits;				/* number of bits received */
+};
+
+void adsb_message_clear(struct adsb_message *);
+int adsb_message_from_bitstring(struct adsb_message *, const char *);
+void adsb_message_to_bitstring(const struct adsb_message *, char *);
+
+/* CRC of the first nbits (a multiple of 8) bits */
+uint32_t adsb_message_compute_crc(const struct adsb_message *, int nbits);
+int adsb_message_fix_single_bit(struct adsb_message *, uint32_t syndrome);
+
+static inline void
+adsb_message_append_bit(struct adsb_message *m, int bit) {
+    m->bytes[m->nbits / 8] |= (bit & 1) << (7 - m->nbits % 8);
+    m->nbits++;
+}
+
+/*
+ * Returns the n bits (1 <= n <= 25) starting at bit off, which is less
+ * than ADSB_MESSAGE_MAX_BITS.  Bits past the message read as zeros.
+ */
+static inline uint32_t
+adsb_message_get_bits(const struct adsb_message *m, int off, int n) {
+    const uint8_t *p = m->bytes + off / 8;
+    uint32_t w = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+		(uint32_t) p[2] << 8 | p[3];
+
+    return (w << (off % 8)) >> (32 - n);
+}
+
+#endif /* ADS_B_ADSB_MESSAGE_H_ */
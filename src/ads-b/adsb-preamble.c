@@ -0,0 +1,105 @@
+#include <ads-b/adsb-preamble.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ADSB_PREAMBLE_HAVE_X86
+#include <immintrin.h>
+#endif
+
+typedef size_t (*t_adsb_preamble_detector)(const float *, size_t,
+	uint32_t *);
+
+static size_t adsb_preamble_detect_scalar(const float *, size_t, uint32_t *);
+#ifdef ADSB_PREAMBLE_HAVE_X86
+static size_t adsb_preamble_detect_sse2(const float *, size_t, uint32_t *);
+#endif
+
+static t_adsb_preamble_detector adsb_preamble_detector;
+
+/*
+ * Pulses are expected at 0, 2, 7 and 9 (in 0.5us chips), with quieter
+ * chips around them.
+ */
+#define ADSB_PREAMBLE_MATCHES(m)					\
+    ((m)[1] < (m)[0] && (m)[2] > (m)[1] && (m)[3] < (m)[2] &&		\
+     (m)[4] < (m)[0] && (m)[5] < (m)[0] && (m)[6] < (m)[0] &&		\
+     (m)[8] < (m)[7] && (m)[9] > (m)[8])
+
+static size_t
+adsb_preamble_detect_scalar(const float *mag, size_t n, uint32_t *offsets) {
+    size_t noffsets = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	if (ADSB_PREAMBLE_MATCHES(mag + i))
+	    offsets[noffsets++] = i;
+
+    return noffsets;
+}
+
+#ifdef ADSB_PREAMBLE_HAVE_X86
+/*
+ * Four positions at once: the k-th vector holds mag[i + k .. i + k + 3].
+ */
+__attribute__((target("sse2")))
+static size_t
+adsb_preamble_detect_sse2(const float *mag, size_t n, uint32_t *offsets) {
+    size_t noffsets = 0;
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+	__m128 v0 = _mm_loadu_ps(mag + i);
+	__m128 v1 = _mm_loadu_ps(mag + i + 1);
+	__m128 v2 = _mm_loadu_ps(mag + i + 2);
+	__m128 v3 = _mm_loadu_ps(mag + i + 3);
+	__m128 v4 = _mm_loadu_ps(mag + i + 4);
+	__m128 v5 = _mm_loadu_ps(mag + i + 5);
+	__m128 v6 = _mm_loadu_ps(mag + i + 6);
+	__m128 v7 = _mm_loadu_ps(mag + i + 7);
+	__m128 v8 = _mm_loadu_ps(mag + i + 8);
+	__m128 v9 = _mm_loadu_ps(mag + i + 9);
+	__m128 ok;
+	int mask;
+
+	ok = _mm_and_ps(_mm_cmplt_ps(v1, v0), _mm_cmpgt_ps(v2, v1));
+	ok = _mm_and_ps(ok, _mm_cmplt_ps(v3, v2));
+	ok = _mm_and_ps(ok, _mm_cmplt_ps(v4, v0));
+	ok = _mm_and_ps(ok, _mm_cmplt_ps(v5, v0));
+	ok = _mm_and_ps(ok, _mm_cmplt_ps(v6, v0));
+	ok = _mm_and_ps(ok, _mm_cmplt_ps(v8, v7));
+	ok = _mm_and_ps(ok, _mm_cmpgt_ps(v9, v8));
+
+	mask = _mm_movemask_ps(ok);
+	while (mask != 0) {
+	    int bit = __builtin_ctz(mask);
+
+	    offsets[noffsets++] = i + bit;
+	    mask &= mask - 1;
+	}
+    }
+
+    for (; i < n; i++)
+	if (ADSB_PREAMBLE_MATCHES(mag + i))
+	    offsets[noffsets++] = i;
+
+    return noffsets;
+}
+#endif /* ADSB_PREAMBLE_HAVE_X86 */
+
+/*
+ * Stores into offsets, in increasing order, the positions among 0..n-1
+ * where a preamble starts.  mag must hold n + ADSB_PREAMBLE_SAMPLES - 1
+ * values.  Returns the number of positions found.
+ */
+size_t
+adsb_preamble_detect(const float *mag, size_t n, uint32_t *offsets) {
+    if (adsb_preamble_detector == NULL) {
+	adsb_preamble_detector = adsb_preamble_detect_scalar;
+#ifdef ADSB_PREAMBLE_HAVE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+	    adsb_preamble_detector = adsb_preamble_detect_sse2;
+#endif
+    }
+
+    return adsb_preamble_detector(mag, n, offsets);
+}
@@ -0,0 +1,15 @@
+/*
+ * Detection of Mode S preambles in a block of magnitudes at 2MS/s
+ */
+#ifndef ADS_B_ADSB_PREAMBLE_H_
+#define ADS_B_ADSB_PREAMBLE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Samples needed from a position on to check for a preamble there */
+#define ADSB_PREAMBLE_SAMPLES	10
+
+size_t adsb_preamble_detect(const float *, size_t, uint32_t *);
+
+#endif /* ADS_B_ADSB_PREAMBLE_H_ */
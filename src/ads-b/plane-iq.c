@@ -1,120 +1,102 @@
 #include <ads-b/plane-iq.h>
 
+#include <complex.h>
 #include <math.h>
 
-#include <util/bsd-queue.h>
+#include <ads-b/adsb-preamble.h>
+#include <signal/sample-convert.h>
 #include <util/memory.h>
+#include <util/mirror-buffer.h>
 
 #define ADSB_BUFFER_SIZE 4096
-#define ADSB_MAX_MESSAGE_SIZE 112
-
-struct in_flight_msg {
-    LIST_ENTRY(in_flight_msg) link;
-    unsigned long long position;
-    struct timeval time_stamp;
-    char msg[ADSB_MAX_MESSAGE_SIZE + 1];
-    int msg_i;
-    double amplitude_56;
-    double amplitude;
-    int parity;
-};
+#define ADSB_CHIP_RATE 2000000		/* two chips per bit at 1Mb/s */
+#define ADSB_CONVERT_CHUNK_SIZE 4096
+
+/* Preamble, then two chips per bit */
+#define ADSB_MESSAGE_SAMPLES (16 + 2 * ADSB_MESSAGE_MAX_BITS)
 
 struct plane_iq_state {
-    FILE *f;
-    unsigned long long position;
-    float signal[ADSB_BUFFER_SIZE];
-#if ADSB_BUFFER_SIZE < 10
-#error "ADSB_BUFFER_SIZE must be at least 10 (length of preamble)"
-#endif
-    int signal_i;
+    FILE *f;				/* uc8 at 2MS/s, or... */
+    struct radio *radio;		/* ...anything sampled at k * 2MS/s */
+    unsigned int decimation;		/* k, radio samples per chip */
+    struct samplef *conv;
+    float decim_acc;
+    unsigned int decim_count;
+    int eof;
+    struct timeval start_time;		/* of the first sample */
+    unsigned long long position;	/* of signal[signal_i] */
+    struct mirror_buffer *mirror;
+    float *signal;			/* mirrored, of signal_size floats */
+    size_t signal_size;
+    size_t signal_i;
     size_t signal_len;
-    LIST_HEAD(, in_flight_msg) ifm_inuse;
-    LIST_HEAD(, in_flight_msg) ifm_free;
+    unsigned long long scanned;		/* positions checked for preambles */
+    unsigned long long *candidates;	/* ring of signal_size positions */
+    size_t candidates_first;
+    size_t candidates_count;
+    uint32_t *offsets;			/* of signal_size preamble offsets */
+    struct adsb_message msg;		/* last one demodulated */
 };
 
-
-static struct in_flight_msg *
-plane_iq_ifm_new(struct plane_iq_state *state) {
-    struct in_flight_msg *m = LIST_FIRST(&state->ifm_free);
-
-    if (m != NULL) {
-	LIST_REMOVE(m, link);
-    } else {
-	m = memory_alloc(sizeof *m);
-    }
-
-    (void) gettimeofday(&m->time_stamp, NULL);
-    m->position = state->position;
-    m->parity = 0;
-    m->msg[ADSB_MAX_MESSAGE_SIZE] = '\0';
-    m->msg_i = 0;
-    m->amplitude = 0;
-    m->amplitude_56 = 0;
-    LIST_INSERT_HEAD(&state->ifm_inuse, m, link);
-
-    return m;
-}
-
-static struct in_flight_msg *
-plane_iq_ifms_feed_bit(struct plane_iq_state *state, float s0, float s1) {
-    struct in_flight_msg *m;
-    struct in_flight_msg *ret = NULL;
-    double amplitude = (s0 + s1) / 2;
-
-    LIST_FOREACH(m, &state->ifm_inuse, link) {
-	int bit = s1 <= s0;
-
-	m->parity ^= 1;
-	if (!m->parity)
-	    continue;
-
-	m->amplitude += amplitude;
-	if (m->msg_i < 56)
-	    m->amplitude_56 += amplitude;
-
-	m->msg[m->msg_i++] = '0' + bit;
-	if (m->msg_i == ADSB_MAX_MESSAGE_SIZE)
-	    ret = m;
-    }
-
-    if (ret != NULL) {
-	LIST_REMOVE(ret, link);
-	LIST_INSERT_HEAD(&state->ifm_free, ret, link);
-    }
-
-    return ret;
-}
-
 struct plane_iq_state *
 plane_iq_state_new(FILE *f) {
     struct plane_iq_state *state = memory_alloc(sizeof *state);
 
     state->f = f;
+    state->radio = NULL;
+    state->decimation = 1;
+    state->conv = NULL;
+    state->decim_acc = 0;
+    state->decim_count = 0;
+    state->eof = 0;
+    state->start_time.tv_sec = 0;
+    state->start_time.tv_usec = 0;
     state->position = 0;
+    state->mirror = mirror_buffer_new(ADSB_BUFFER_SIZE * sizeof (float));
+    state->signal = mirror_buffer_get_base(state->mirror);
+    state->signal_size = mirror_buffer_get_size(state->mirror) / sizeof (float);
     state->signal_len = 0;
     state->signal_i = 0;
-
-    LIST_INIT(&state->ifm_inuse);
-    LIST_INIT(&state->ifm_free);
+    state->scanned = 0;
+    state->candidates =
+	memory_alloc(state->signal_size * sizeof *state->candidates);
+    state->candidates_first = 0;
+    state->candidates_count = 0;
+    state->offsets = memory_alloc(state->signal_size * sizeof *state->offsets);
 
     return state;
 }
 
-static void
-plane_iq_state_delete_ifms(struct in_flight_msg *head) {
-    struct in_flight_msg *next;
-
-    for (; head != NULL; head = next) {
-	next = LIST_NEXT(head, link);
-	LIST_REMOVE(head, link);
-	memory_free(head);
+/*
+ * Decode from a radio, already tuned to 1090MHz.  Returns NULL if its
+ * sample rate isn't a multiple of 2MS/s.
+ */
+struct plane_iq_state *
+plane_iq_state_new_radio(struct radio *radio) {
+    struct plane_iq_state *state;
+    unsigned long rate;
+
+    if (radio->m->get_sample_rate(radio, &rate) == -1 ||
+	    rate < ADSB_CHIP_RATE || rate % ADSB_CHIP_RATE != 0) {
+	fprintf(stderr, "ADS-B needs a sample rate multiple of 2MS/s\n");
+	return NULL;
     }
+
+    state = plane_iq_state_new(NULL);
+    state->radio = radio;
+    state->decimation = rate / ADSB_CHIP_RATE;
+    state->conv = memory_alloc(ADSB_CONVERT_CHUNK_SIZE * sizeof *state->conv);
+
+    return state;
 }
 
 void
 plane_iq_state_delete(struct plane_iq_state *state) {
-    plane_iq_state_delete_ifms(LIST_FIRST(&state->ifm_inuse));
-    plane_iq_state_delete_ifms(LIST_FIRST(&state->ifm_free));
+    mirror_buffer_delete(state->mirror);
+    memory_free(state->candidates);
+    memory_free(state->offsets);
+    if (state->conv != NULL)
+	memory_free(state->conv);
     memory_free(state);
 }
 
@@ -138,57 +120,188 @@ plane_iq_read_chunk(float *dest, unsigned int nsamples, FILE *f) {
     return nread / 2;
 }
 
-const char *
-plane_iq_get_next(struct plane_iq_state *state, struct timeval *tvp,
-							double *amplitude) {
-    for (;;) {
-	struct in_flight_msg *m;
-	int i;
-
-	if (state->signal_len < 18) {
-	    size_t nread;
-	    if (state->signal_i + state->signal_len > ADSB_BUFFER_SIZE) {
-		int start = (state->signal_i + state->signal_len) %
-			ADSB_BUFFER_SIZE;
-		nread = plane_iq_read_chunk(state->signal + start,
-			state->signal_i - start, state->f);
-	    } else {
-		int start = state->signal_i + state->signal_len;
-		nread = plane_iq_read_chunk(state->signal + start,
-			ADSB_BUFFER_SIZE - start, state->f);
-		nread += plane_iq_read_chunk(state->signal, state->signal_i,
-			state->f);
+/*
+ * Fills dest with at most nchips magnitudes, each one averaged over
+ * "decimation" radio samples.  Returns -1 on error, 0 at end of stream.
+ */
+static ssize_t
+plane_iq_read_radio_chunk(struct plane_iq_state *state, float *dest,
+							size_t nchips) {
+    struct radio *radio = state->radio;
+    struct radio_buffer rb;
+    const unsigned char *data;
+    size_t sample_size;
+    size_t ndone = 0;
+    size_t i;
+    ssize_t nread;
+
+    /* Only part of a chip may come at once: that's not the end */
+    do {
+	nread = radio->m->acquire_buffer(radio, &rb,
+		nchips * state->decimation - state->decim_count);
+	if (nread <= 0)
+	    return nread;
+
+	data = rb.data;
+	sample_size = sample_encoding_size(rb.encoding);
+
+	for (i = 0; i < rb.nsamples; i += ADSB_CONVERT_CHUNK_SIZE) {
+	    size_t n = rb.nsamples - i;
+	    size_t j;
+
+	    if (n > ADSB_CONVERT_CHUNK_SIZE)
+		n = ADSB_CONVERT_CHUNK_SIZE;
+
+	    if (sample_convert_float(rb.encoding, data + i * sample_size,
+			state->conv, n) == -1) {
+		radio->m->release_buffer(radio, &rb);
+		return -1;
+	    }
+
+	    for (j = 0; j < n; j++) {
+		float complex v = state->conv[j].v;
+
+		state->decim_acc += crealf(v) * crealf(v) +
+		    cimagf(v) * cimagf(v);
+		if (++state->decim_count == state->decimation) {
+		    dest[ndone++] = state->decim_acc / state->decimation;
+		    state->decim_acc = 0;
+		    state->decim_count = 0;
+		}
 	    }
-	    state->signal_len += nread;
 	}
 
-	if (state->signal_len < 18)
-	    return NULL;
+	radio->m->release_buffer(radio, &rb);
+    } while (ndone == 0);
+
+    return ndone;
+}
+
+/*
+ * Looks for preambles at every buffered position not checked yet, and
+ * queues those found as candidates.
+ */
+static void
+plane_iq_scan(struct plane_iq_state *state) {
+    unsigned long long end = state->position + state->signal_len -
+	(ADSB_PREAMBLE_SAMPLES - 1);
+    size_t noffsets;
+    size_t i;
+
+    if (state->scanned >= end)
+	return;
 
-	float tmp[16];
+    noffsets = adsb_preamble_detect(state->signal + state->signal_i +
+	    (state->scanned - state->position), end - state->scanned,
+	    state->offsets);
 
-	for (i = 0; i < (int) (sizeof tmp / sizeof tmp[0]); i++)
-	    tmp[i] = state->signal[(state->signal_i + i) % ADSB_BUFFER_SIZE];
+    for (i = 0; i < noffsets; i++) {
+	size_t last = (state->candidates_first + state->candidates_count) %
+	    state->signal_size;
+
+	state->candidates[last] = state->scanned + state->offsets[i];
+	state->candidates_count++;
+    }
 
-	if (tmp[1] < tmp[0] && tmp[2] > tmp[1] && tmp[3] < tmp[2] &&
-		tmp[4] < tmp[0] && tmp[5] < tmp[0] && tmp[6] < tmp[0] &&
-		tmp[8] < tmp[7] && tmp[9] > tmp[8]) {
-	    plane_iq_ifm_new(state);
+    state->scanned = end;
+}
+
+static void
+plane_iq_advance(struct plane_iq_state *state, size_t n) {
+    state->position += n;
+    state->signal_i = (state->signal_i + n) % state->signal_size;
+    state->signal_len -= n;
+}
+
+/*
+ * Reads until at least n positions are buffered, or the end of stream.
+ */
+static void
+plane_iq_fill(struct plane_iq_state *state, size_t n) {
+    while (!state->eof && state->signal_len < n) {
+	/* Thanks to the mirror, the free space is contiguous */
+	float *dest = state->signal + state->signal_i + state->signal_len;
+	size_t room = state->signal_size - state->signal_len;
+	ssize_t nread;
+
+	if (state->radio != NULL)
+	    nread = plane_iq_read_radio_chunk(state, dest, room);
+	else
+	    nread = plane_iq_read_chunk(dest, room, state->f);
+	if (nread <= 0) {
+	    state->eof = 1;
+	    break;
 	}
 
-	m = plane_iq_ifms_feed_bit(state,
-		state->signal[(state->signal_i + 16) % ADSB_BUFFER_SIZE],
-		state->signal[(state->signal_i + 17) % ADSB_BUFFER_SIZE]);
+	if (state->position == 0 && state->signal_len == 0)
+	    (void) gettimeofday(&state->start_time, NULL);
+	state->signal_len += nread;
+    }
+}
+
+/*
+ * Slices the 112 bits following the preamble at mag[0], and returns the
+ * average amplitude of the first 56 ones.
+ */
+static double
+plane_iq_demodulate(const float *mag, struct adsb_message *msg) {
+    double amplitude_56 = 0;
+    int i;
 
-	state->position++;
-	state->signal_i = (state->signal_i + 1) % ADSB_BUFFER_SIZE;
-	state->signal_len--;
+    adsb_message_clear(msg);
 
-	if (m != NULL) {
-	    *tvp = m->time_stamp;
-	    *amplitude = m->amplitude_56 / 56;
-	    //printf("message at %llu: %s\n", m->position, m->msg);
-	    return m->msg;
+    for (i = 0; i < ADSB_MESSAGE_MAX_BITS; i++) {
+	float s0 = mag[16 + 2 * i];
+	float s1 = mag[17 + 2 * i];
+
+	if (i < ADSB_MESSAGE_SHORT_BITS)
+	    amplitude_56 += (s0 + s1) / 2;
+	adsb_message_append_bit(msg, s1 <= s0);
+    }
+
+    return amplitude_56 / ADSB_MESSAGE_SHORT_BITS;
+}
+
+const struct adsb_message *
+plane_iq_get_next(struct plane_iq_state *state, struct timeval *tvp,
+							double *amplitude) {
+    for (;;) {
+	unsigned long long next;
+	unsigned long long usecs;
+
+	plane_iq_fill(state, ADSB_MESSAGE_SAMPLES);
+	if (state->signal_len < ADSB_PREAMBLE_SAMPLES)
+	    return NULL;
+
+	plane_iq_scan(state);
+
+	/* Drop what is before the next preamble to make room */
+	next = state->candidates_count != 0?
+	    state->candidates[state->candidates_first] : state->scanned;
+	if (next != state->position) {
+	    plane_iq_advance(state, next - state->position);
+	    continue;
 	}
+
+	/* Truncated by the end of stream */
+	if (state->signal_len < ADSB_MESSAGE_SAMPLES)
+	    return NULL;
+
+	state->candidates_first =
+	    (state->candidates_first + 1) % state->signal_size;
+	state->candidates_count--;
+
+	/*
+	 * Later preambles may overlap this message, so the position stays
+	 * here until the next one is considered.
+	 */
+	*amplitude = plane_iq_demodulate(state->signal + state->signal_i,
+	    &state->msg);
+
+	usecs = next / (ADSB_CHIP_RATE / 1000000) + state->start_time.tv_usec;
+	tvp->tv_sec = state->start_time.tv_sec + usecs / 1000000;
+	tvp->tv_usec = usecs % 1000000;
+
+	return &state->msg;
     }
 }
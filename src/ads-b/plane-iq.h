@@ -5,11 +5,15 @@
 
 #include <stdio.h>
 
+#include <ads-b/adsb-message.h>
+#include <radio/radio.h>
+
 struct plane_iq_state;
 
 struct plane_iq_state *plane_iq_state_new(FILE *);
+struct plane_iq_state *plane_iq_state_new_radio(struct radio *);
 void plane_iq_state_delete(struct plane_iq_state *);
-const char *plane_iq_get_next(struct plane_iq_state *, struct timeval *,
-	double *);
+const struct adsb_message *plane_iq_get_next(struct plane_iq_state *,
+	struct timeval *, double *);
 
 #endif /* ADSB_PLANE_IQ_H_ */
@@ -348,18 +348,6 @@ plane_decode_char(uint8_t val) {
     return '?';
 }
 
-static uint64_t
-read_bit_string(const char *s, int off, int sz) {
-    uint64_t val = 0;
-
-    for (int i = 0; i < sz; i++) {
-	val <<= 1;
-	val |= s[off + i] == '1';
-    }
-
-    return val;
-}
-
 #define BITS(x, off, n) (((x) >> (off)) & ((1 << (n)) - 1))
 #define BIT(x, off) BITS((x), (off), 1)
 
@@ -370,20 +358,6 @@ read_bit_string(const char *s, int off, int sz) {
 			(BIT((x),(n) + 2) << 1) | \
 			(BIT((x),(n) + 4) << 2))
 
-static uint32_t
-plane_adsb_compute_crc(const char *msg, int size) {
-    uint32_t val = 0;
-
-    for (int i = 0; i < size; i++) {
-	val ^= read_bit_string(msg, i, 1) << 23;
-	val <<= 1;
-	if (val & (1 << 24))
-	    val ^= 0x1fff409;
-    }
-
-    return val;
-}
-
 void
 plane_decode_cpr(struct plane *plane) {
     int odd;
@@ -455,26 +429,34 @@ const int ac_c_digit_conversion_table[2][8] = {
 };
 
 struct plane *
-plane_set_parse_message(struct plane_set *pset, const char *msg,
-					struct timeval tv, double amplitude) {
+plane_set_parse_message(struct plane_set *pset,
+	const struct adsb_message *msg, struct timeval tv, double amplitude) {
     struct plane *plane = NULL;
-    int fmt = read_bit_string(msg, 0, 5);
+    int fmt = adsb_message_get_bits(msg, 0, 5);
     int long_message = (fmt >= 16 && fmt <= 24);
     uint32_t address;
-    uint32_t ap = read_bit_string(msg, long_message? 88 : 32, 24);
-    uint16_t ac = read_bit_string(msg, 19, 13);
+    uint32_t ap = adsb_message_get_bits(msg, long_message? 88 : 32, 24);
+    uint16_t ac = adsb_message_get_bits(msg, 19, 13);
     uint16_t id = ac;
     uint32_t crc;
+    struct adsb_message fixed_msg;
 
     /*
      * Get address and CRC to lookup the plane involved and validate the message
      */
-    crc = plane_adsb_compute_crc(msg, long_message? 88 : 32);
+    crc = adsb_message_compute_crc(msg, long_message? 88 : 32);
     if (fmt == 11 || fmt == 17 || fmt == 18) {
-	address = read_bit_string(msg, 8, 24);
 	crc ^= ap;
+	if (crc != 0 && (fmt == 17 || fmt == 18)) {
+	    fixed_msg = *msg;
+	    if (adsb_message_fix_single_bit(&fixed_msg, crc) == -1)
+		return plane;
+	    msg = &fixed_msg;
+	    crc = 0;
+	}
 	if (crc != 0 || (fmt == 11 && crc >= 80))
 	    return plane;
+	address = adsb_message_get_bits(msg, 8, 24);
 	plane = plane_set_lookup_create(pset, address);
     } else {
 	address = crc ^ ap;
@@ -488,21 +470,22 @@ plane_set_parse_message(struct plane_set *pset, const char *msg,
 
     if (fmt == 11 || fmt == 17) {
 	if (fmt == 17) {
-	    uint8_t type = read_bit_string(msg, 32, 5);
-	    ap = read_bit_string(msg, 88, 24);
+	    uint8_t type = adsb_message_get_bits(msg, 32, 5);
+	    ap = adsb_message_get_bits(msg, 88, 24);
 	    if (type >= 1 && type <= 4) {
 		int i;
 
 		for (i = 0; i < 8; i++)
 		    plane->flight_id[i] =
-			plane_decode_char(read_bit_string(msg, 40 + i * 6, 6));
+			plane_decode_char(adsb_message_get_bits(msg,
+			    40 + i * 6, 6));
 
 		plane->flight_id[i] = '\0';
 		plane->flags |= PLANE_FLIGHT_ID_AVAILABLE;
 	    }
 	    if (type >= 9 && type <= 18) {
 		int odd;
-		uint32_t alt = read_bit_string(msg, 40, 12);
+		uint32_t alt = adsb_message_get_bits(msg, 40, 12);
 		if (BIT(alt, 4)) {
 		    int32_t altitude = (BITS(alt, 5, 7) << 4) |
 					BITS(alt, 0, 4);
@@ -512,32 +495,32 @@ plane_set_parse_message(struct plane_set *pset, const char *msg,
 //		    printf(", Q = 0");
 		}
 
-		odd = read_bit_string(msg, 53, 1) == 1;
-		plane->enc_latitude[odd] = read_bit_string(msg, 54, 17);
-		plane->enc_longitude[odd] = read_bit_string(msg, 71, 17);
+		odd = adsb_message_get_bits(msg, 53, 1) == 1;
+		plane->enc_latitude[odd] = adsb_message_get_bits(msg, 54, 17);
+		plane->enc_longitude[odd] = adsb_message_get_bits(msg, 71, 17);
 		plane->enc_lat_long_ts[odd] = tv;
 		plane_decode_cpr(plane);
 
-//		printf(", surv = %d", read_bit_string(msg, 37, 2));
+//		printf(", surv = %d", adsb_message_get_bits(msg, 37, 2));
 	    } else if (type == 19) {
-		uint8_t subtype = read_bit_string(msg, 37, 3);
+		uint8_t subtype = adsb_message_get_bits(msg, 37, 3);
 
 		if (subtype == 1 || subtype == 2) {
 		    double w_e_velo;
 		    double s_n_velo;
 
-		    w_e_velo = read_bit_string(msg, 46, 10);
+		    w_e_velo = adsb_message_get_bits(msg, 46, 10);
 		    if (w_e_velo == 0)
 			goto no_velo;
 		    w_e_velo -= 1;
-		    if (read_bit_string(msg, 45, 1) == 1)
+		    if (adsb_message_get_bits(msg, 45, 1) == 1)
 			w_e_velo = -w_e_velo;
 
-		    s_n_velo = read_bit_string(msg, 57, 10);
+		    s_n_velo = adsb_message_get_bits(msg, 57, 10);
 		    if (s_n_velo == 0)
 			goto no_velo;
 		    s_n_velo -= 1;
-		    if (read_bit_string(msg, 56, 1) == 1)
+		    if (adsb_message_get_bits(msg, 56, 1) == 1)
 			s_n_velo = -s_n_velo;
 
 		    if (subtype == 2) {
@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <sys/time.h>
 
+#include <ads-b/adsb-message.h>
 #include <util/iterator.h>
 
 struct plane;
@@ -13,8 +14,8 @@ struct plane_set *plane_set_new(void);
 void plane_set_delete(struct plane_set *);
 void plane_set_free(struct plane_set *);
 struct plane *plane_set_lookup_create(struct plane_set *, uint32_t address);
-struct plane *plane_set_parse_message(struct plane_set *, const char *,
-		struct timeval, double);
+struct plane *plane_set_parse_message(struct plane_set *,
+		const struct adsb_message *, struct timeval, double);
 struct iterator *plane_set_iterate(struct plane_set *);
 
 struct plane *plane_clone(struct plane *);
@@ -9,8 +9,7 @@
 #include <string.h>
 #include <time.h>
 
-#define MAX_MESSAGE_SIZE 112
-#define MAX_LINE_SIZE (MAX_MESSAGE_SIZE + 100)
+#define MAX_LINE_SIZE (ADSB_MESSAGE_MAX_BITS + 100)
 
 static int
 planes_read_ascii_line(FILE *f, char *line_buf, struct timeval *tvp,
@@ -30,7 +29,7 @@ planes_read_ascii_line(FILE *f, char *line_buf, struct timeval *tvp,
 	return 0;
 
     len = at - line_buf - 1;
-    len = len < MAX_MESSAGE_SIZE? len : MAX_MESSAGE_SIZE;
+    len = len < ADSB_MESSAGE_MAX_BITS? len : ADSB_MESSAGE_MAX_BITS;
     line_buf[len] = '\0';
     tvp->tv_sec = strtoll(at + 1, &p, 10);
     tvp->tv_usec = 0;
@@ -46,38 +45,41 @@ planes_read_ascii_line(FILE *f, char *line_buf, struct timeval *tvp,
     return 1;
 }
 
-void
-planes_main_loop(FILE *f, int flags) {
+/*
+ * Messages come from iq_state if it is not NULL, as text lines from f
+ * otherwise.
+ */
+static void
+planes_run(FILE *f, struct plane_iq_state *iq_state, int flags) {
     char line_buf[MAX_LINE_SIZE];
-    const char *line;
+    struct adsb_message ascii_msg;
+    const struct adsb_message *msg;
     struct plane_set *pset = plane_set_new();
     int last_day_displayed = -1;
     struct timeval tv;
     double amplitude = 0;
-    struct plane_iq_state *iq_state = NULL;
-
-    if (flags & PLANES_INPUT_FROM_RAW)
-	iq_state = plane_iq_state_new(f);
 
     for (;;) {
 	struct plane *plane;
 
-	if (flags & PLANES_INPUT_FROM_RAW) {
-	    line = plane_iq_get_next(iq_state, &tv, &amplitude);
-	    if (line == NULL)
+	if (iq_state != NULL) {
+	    msg = plane_iq_get_next(iq_state, &tv, &amplitude);
+	    if (msg == NULL)
 		break;
 	} else {
 	    if (!planes_read_ascii_line(f, line_buf, &tv, &amplitude))
 		break;
-	    line = line_buf;
+	    adsb_message_from_bitstring(&ascii_msg, line_buf);
+	    msg = &ascii_msg;
 	}
 
-	plane = plane_set_parse_message(pset, line, tv, amplitude);
+	plane = plane_set_parse_message(pset, msg, tv, amplitude);
 	if (plane == NULL)
 	    continue;
 
 	if (flags & PLANES_OUTPUT_AS_BITSTRING) {
-	    printf("%s @ %lld,%lld,%llu,%g\n", line, (long long) tv.tv_sec,
+	    adsb_message_to_bitstring(msg, line_buf);
+	    printf("%s @ %lld,%lld,%llu,%g\n", line_buf, (long long) tv.tv_sec,
 		(long long) tv.tv_usec, 0ll, amplitude);
 	}
 
@@ -93,7 +95,34 @@ planes_main_loop(FILE *f, int flags) {
 	    printf("\n");
 	}
     }
+}
+
+void
+planes_main_loop(FILE *f, int flags) {
+    struct plane_iq_state *iq_state = NULL;
 
     if (flags & PLANES_INPUT_FROM_RAW)
+	iq_state = plane_iq_state_new(f);
+
+    planes_run(f, iq_state, flags);
+
+    if (iq_state != NULL)
 	plane_iq_state_delete(iq_state);
 }
+
+/*
+ * Decode straight from a radio tuned to 1090MHz.  Returns -1 if it can't
+ * be used for ADS-B.
+ */
+int
+planes_main_loop_radio(struct radio *radio, int flags) {
+    struct plane_iq_state *iq_state = plane_iq_state_new_radio(radio);
+
+    if (iq_state == NULL)
+	return -1;
+
+    planes_run(NULL, iq_state, flags);
+    plane_iq_state_delete(iq_state);
+
+    return 0;
+}
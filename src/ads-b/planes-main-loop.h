@@ -3,9 +3,16 @@
 
 #include <stdio.h>
 
+#include <radio/radio.h>
+
 void planes_main_loop(FILE *, int flags);
+int planes_main_loop_radio(struct radio *, int flags);
 #define PLANES_INPUT_FROM_RAW		0x01
 #define PLANES_OUTPUT_AS_DECODED	0x10
 #define PLANES_OUTPUT_AS_BITSTRING	0x20
 
+/* Defaults when decoding from a radio */
+#define PLANES_ADSB_FREQUENCY		1090000000
+#define PLANES_ADSB_SAMPLE_RATE		2000000
+
 #endif /* ADS_B_PLANES_MAIN_LOOP_H_ */
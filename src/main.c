@@ -2,8 +2,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -12,22 +15,36 @@
 #include <radio/fcdhid.h>
 #include <radio/radio-audio.h>
 #include <radio/radio-file.h>
+#include <radio/radio-filter.h>
 #include <radio/hackrf.h>
 #include <radio/rtlsdr.h>
 #include <radio/uhd.h>
 #include <radio/xtrx.h>
+#include <record/record-main-loop.h>
+#include <scan/scan-batch.h>
+#include <scan/scan-detector.h>
 #include <scan/scan-main-loop.h>
+#include <scan/scan-output.h>
+#include <scan/sweep-main-loop.h>
+#include <signal/fft-plan.h>
+#include <signal/spectrum.h>
 #include <ui/gtk-ui.h>
 #include <ui/widget-fft.h>
 #include <util/hash.h>
+#include <util/list.h>
 #include <util/memory.h>
+#include <util/thread-pool.h>
 
 enum {
     OPTION_ALSA_NAME = 256,
+    OPTION_CHANNELS, OPTION_DECIMATE,
     OPTION_FCDAUDIO, OPTION_FCDHID,
-    OPTION_FILE_ENCODING, OPTION_FILE_NAME,
-    OPTION_RTLSDR_INDEX,
-    OPTION_SQUELCH,
+    OPTION_FFT_AVERAGE, OPTION_FFT_OVERLAP, OPTION_FFT_PLAN,
+    OPTION_FFT_SIZE, OPTION_FFT_WINDOW,
+    OPTION_FILE_ENCODING, OPTION_FILE_NAME, OPTION_FILE_SEEK,
+    OPTION_RECORD, OPTION_RTLSDR_INDEX, OPTION_SCAN_OUTPUT,
+    OPTION_SCAN_SEGMENT, OPTION_SHIFT, OPTION_SQUELCH, OPTION_SWEEP,
+    OPTION_SWEEP_SPECTRUM,
     OPTION_UHD_ADDR, OPTION_UHD_ANT, OPTION_UHD_SPEC,
 };
 
@@ -41,9 +58,25 @@ int option_adsb_from_raw = 0;
 int option_adsb_to_bitstring = 0;
 int option_do_set_sample_rate = 0;
 int option_do_scan = 0;
+unsigned long long option_scan_segment = 0;	/* in samples */
+int option_scan_output = SCAN_OUTPUT_TEXT;
+int option_do_sweep = 0;
+t_frequency option_sweep_low, option_sweep_high;
+char *option_sweep_spectrum_name = NULL;
 double option_squelch_db = 10;
+int option_fft_window = SPECTRUM_WINDOW_HANN;
+unsigned int option_fft_overlap = 50;		/* percent */
+unsigned int option_fft_average = 1;
+int option_fft_plan = FFT_PLAN_ESTIMATE;
+unsigned long long option_fft_size = SPECTRUM_DEFAULT_SIZE;
+unsigned int option_decimate = 1;
+unsigned int option_channels = 1;
+double option_shift = 0;			/* in Hz */
 const char *option_file_name = NULL;
 int option_file_encoding = 0;
+const char *option_file_seek = NULL;
+const char *option_record_name = NULL;
+int option_record_compress = 0;
 #ifdef HAVE_LIBHACKRF
 int option_use_hackrf_one = 0;
 #endif
@@ -69,6 +102,8 @@ static char *option_fcdaudio_path = NULL;
 static char *option_fcdhid_path = NULL;
 static t_frequency current_frequency;		/* in Hz */
 static t_frequency current_sample_rate;		/* in Hz */
+static int file_has_sample_rate = 0;		/* from its metadata */
+static int file_has_frequency = 0;
 
 struct option options[] = {
     { "adsb-decode", no_argument, NULL, 'd' },
@@ -78,23 +113,38 @@ struct option options[] = {
     { "alsa", no_argument, &option_use_alsa, 1 },
     { "alsa-name", required_argument, NULL, OPTION_ALSA_NAME },
 #endif
+    { "channels", required_argument, NULL, OPTION_CHANNELS },
+    { "compress", no_argument, &option_record_compress, 1 },
+    { "decimate", required_argument, NULL, OPTION_DECIMATE },
     { "fcdaudio", required_argument, NULL, OPTION_FCDAUDIO },
     { "fcdhid", required_argument, NULL, OPTION_FCDHID },
+    { "fft-average", required_argument, NULL, OPTION_FFT_AVERAGE },
+    { "fft-overlap", required_argument, NULL, OPTION_FFT_OVERLAP },
+    { "fft-plan", required_argument, NULL, OPTION_FFT_PLAN },
+    { "fft-size", required_argument, NULL, OPTION_FFT_SIZE },
+    { "fft-window", required_argument, NULL, OPTION_FFT_WINDOW },
     { "file", required_argument, NULL, OPTION_FILE_NAME },
     { "file-encoding", required_argument, NULL, OPTION_FILE_ENCODING },
+    { "file-seek", required_argument, NULL, OPTION_FILE_SEEK },
     { "frequency", required_argument, NULL, 'f' },
     { "gui", no_argument, NULL, 'g' },
 #ifdef HAVE_LIBHACKRF
     { "hackrf-one", no_argument, &option_use_hackrf_one, 1 },
 #endif
     { "quiet", no_argument, NULL, 'q' },
+    { "record", required_argument, NULL, OPTION_RECORD },
 #ifdef HAVE_LIBRTLSDR
     { "rtlsdr", no_argument, &option_use_rtlsdr, 1 },
     { "rtlsdr-index", required_argument, NULL, OPTION_RTLSDR_INDEX },
 #endif
     { "sample-rate", required_argument, NULL, 's' },
     { "scan", no_argument, &option_do_scan, 1 },
+    { "scan-output", required_argument, NULL, OPTION_SCAN_OUTPUT },
+    { "scan-segment", required_argument, NULL, OPTION_SCAN_SEGMENT },
+    { "shift", required_argument, NULL, OPTION_SHIFT },
     { "squelch", required_argument, NULL, OPTION_SQUELCH },
+    { "sweep", required_argument, NULL, OPTION_SWEEP },
+    { "sweep-spectrum", required_argument, NULL, OPTION_SWEEP_SPECTRUM },
 #ifdef HAVE_UHD
     { "uhd", no_argument, &option_use_uhd, 1 },
     { "uhd-addr", required_argument, NULL, OPTION_UHD_ADDR },
@@ -114,9 +164,16 @@ usage(int status, const char *argv0) {
 
     fprintf(out, "usage: %s OPTION ...\n"
 	"Mode of operation\n"
-	"  -d, --adsb-decode          decode ADS-B\n"
+	"  -d, --adsb-decode          decode ADS-B, from the radio front-end\n"
+	"                             if any (1090MHz, 2MS/s by default)\n"
 	"  -g, --gui                  display FFT in realtime\n"
-	"      --scan                 use scan mode\n"
+	"      --record=FILE          record samples as they come to FILE,\n"
+	"                             or stdout if FILE is -, while scanning\n"
+	"                             too with --scan\n"
+	"      --scan [FILE ...]      use scan mode, on all of the recordings\n"
+	"                             given at once if any\n"
+	"      --sweep=LOW:HIGH       scan from LOW to HIGH, retuning the\n"
+	"                             radio in steps\n"
 	"\n"
 	"Radio front-end\n"
 #ifdef USE_ALSA
@@ -143,14 +200,38 @@ usage(int status, const char *argv0) {
 #ifdef USE_ALSA
 	"      --alsa-name=NAME       read from ALSA device NAME\n"
 #endif
+	"      --channels=N           split the band in N channels, scanned\n"
+	"                             each on its own\n"
+	"      --compress             compress what --record writes\n"
+	"      --decimate=N           filter down to 1/N of the band and rate\n"
 	"      --fcdhid=HID           set parameters of FCD on given HID\n"
+	"      --fft-average=N        average N FFTs per scan frame\n"
+	"      --fft-overlap=PERCENT  overlap FFTs by PERCENT (50 by default)\n"
+	"      --fft-plan=EFFORT      search FFT plans with EFFORT, any of\n"
+	"              estimate (default), measure, patient\n"
+	"      --fft-size=N           use FFTs of N points (1024 by default),\n"
+	"                             up to 1048576, on all cores from 65536;\n"
+	"                             any N works, powers of two are fastest\n"
+	"      --fft-window=WINDOW    window FFTs with WINDOW, any of\n"
+	"              rectangular, hann (default), hamming, blackman-harris\n"
 	"      --file-encoding=FORMAT specify encoding of file as FORMAT\n"
 	"              FORMAT can be any of uc8, sc8, sc16, u8, s16\n"
+	"      --file-seek=POS        start reading the file at sample POS, or\n"
+	"                             at the annotation labelled POS\n"
 	"  -q, --quiet                be less verbose\n"
 #ifdef HAVE_LIBRTLSDR
 	"      --rtlsdr-index=INDEX   specify rtl-sdr device index\n"
 #endif
+	"      --scan-output=FORMAT   write whole signals found by scans as\n"
+	"              FORMAT, any of text (hits, the default), csv, json,\n"
+	"              binary\n"
+	"      --scan-segment=N       scan recordings in segments of N samples\n"
+	"                             in parallel\n"
+	"      --shift=FREQ           tune the front-end FREQ (may be negative)\n"
+	"                             below the frequency, filtering it back\n"
 	"      --squelch=DB           squelch value in dB for scan mode\n"
+	"      --sweep-spectrum=FILE  write each sweep's spectrum as CSV to\n"
+	"                             FILE\n"
 #ifdef HAVE_UHD
 	"      --uhd-addr=ARGS        use ARGS as UHD arguments\n"
 	"      --uhd-ant=ANT          use antenna ANT for UHD\n"
@@ -161,15 +242,149 @@ usage(int status, const char *argv0) {
     exit(status);
 }
 
+/*
+ * Seeks as asked by --file-seek, then takes whatever the user did not
+ * specify from the recording's metadata.  The frequency is that of the
+ * capture the first sample read belongs to.  Both are the file's own,
+ * so they are set on it directly rather than through --decimate and
+ * --shift, which then apply to them.
+ */
+static int
+file_configure(struct radio *radio) {
+    const struct signal_desc *desc = radio_file_get_signal_desc(radio);
+    const struct signal_capture *capture;
+    uint64_t start = 0;
+    size_t i;
+
+    if (option_file_seek != NULL) {
+	const struct signal_annotation *a = NULL;
+	char *end;
+
+	start = strtoull(option_file_seek, &end, 10);
+	if (!isdigit((unsigned char) *option_file_seek) || *end != '\0') {
+	    if (desc != NULL)
+		a = signal_desc_find_annotation(desc, option_file_seek);
+	    if (a == NULL) {
+		fprintf(stderr, "no annotation labelled %s\n",
+		    option_file_seek);
+		return -1;
+	    }
+	    start = a->sample_start;
+	}
+
+	if (radio->m->seek(radio, start) == -1) {
+	    fprintf(stderr, "can't seek to sample %" PRIu64 "\n", start);
+	    return -1;
+	}
+    }
+
+    if (desc == NULL)
+	return 0;
+
+    /* radio_file_open() took the rate already */
+    if (desc->flags & SIGNAL_DESC_HAVE_SAMPLE_RATE)
+	file_has_sample_rate = 1;
+
+    capture = signal_desc_capture_at(desc, start);
+    if (capture != NULL && (capture->flags & SIGNAL_CAPTURE_HAVE_FREQUENCY)) {
+	if (radio->m->set_frequency(radio, capture->frequency) == -1) {
+	    fprintf(stderr, "couldn't set frequency\n");
+	    return -1;
+	}
+	file_has_frequency = 1;
+    }
+
+    if (option_verbose)
+	for (i = 0; i < desc->nannotations; i++)
+	    printf("Annotation at sample %" PRIu64 ": %s\n",
+		desc->annotations[i].sample_start,
+		desc->annotations[i].label != NULL?
+		    desc->annotations[i].label : "(no label)");
+
+    return 0;
+}
+
+/*
+ * Counts are plain decimal numbers: frequency_parse() would read 64k as
+ * 64000.  Returns 0 if s isn't one.
+ */
+static int
+count_parse(const char *s, unsigned long long *countp) {
+    char *end;
+
+    if (!isdigit((unsigned char) s[0]))
+	return 0;
+    errno = 0;
+    *countp = strtoull(s, &end, 10);
+
+    return errno == 0 && *end == '\0';
+}
+
+static void
+spectrum_params_fill(struct spectrum_params *params) {
+    params->size = option_fft_size;
+    params->window = option_fft_window;
+    params->overlap = (uint64_t) params->size * option_fft_overlap / 100;
+    params->nthreads = params->size >= SPECTRUM_PARALLEL_SIZE?
+	thread_pool_default_nthreads() : 1;
+}
+
+static void
+scan_params_fill(struct scan_params *params) {
+    spectrum_params_fill(&params->spectrum);
+    params->naverage = option_fft_average;
+    params->threshold_db = option_squelch_db;
+}
+
+/*
+ * Scans the recordings named, and that of --file, in parallel.  What the
+ * user did not specify is taken from each one's metadata.
+ */
+static int
+scan_recordings(int argc, char *argv[]) {
+    struct scan_batch_params params;
+    const char **names = memory_alloc(sizeof *names * (argc + 1));
+    size_t nnames = 0;
+    int i, status;
+
+    if (option_file_seek != NULL || option_decimate != 1 ||
+	    option_shift != 0 || option_channels != 1) {
+	fprintf(stderr, "--file-seek, --decimate, --shift and --channels "
+	    "don't apply to batch scans\n");
+	memory_free(names);
+	return -1;
+    }
+
+    if (option_file_name != NULL)
+	names[nnames++] = option_file_name;
+    for (i = 0; i < argc; i++)
+	names[nnames++] = argv[i];
+
+    params.encoding = option_file_encoding;
+    params.sample_rate = option_do_set_sample_rate? current_sample_rate : 0;
+    params.frequency = option_do_set_frequency? current_frequency : 0;
+    scan_params_fill(&params.scan);
+    params.scan.spectrum.nthreads = 1;		/* segments are shared */
+    params.segment_nsamples = option_scan_segment;
+    params.output = option_scan_output;
+
+    status = nnames == 0? 0 : scan_batch(names, nnames, &params);
+    memory_free(names);
+
+    return status;
+}
+
 int
 main(int argc, char *argv[]) {
     struct radio *radio = NULL;
     int c;
     int ret;
+    int adsb_flags = 0;
     int status = EXIT_SUCCESS;
 
     program_name = argv[0];
     hash_init();
+    list_init();
 
     while ((c = getopt_long(argc, argv, "df:gqs:v", options, NULL)) != -1) {
 	switch (c) {
@@ -206,9 +421,63 @@ main(int argc, char *argv[]) {
 	    option_alsa_name = optarg;
 #endif
 	    break;
+	case OPTION_CHANNELS:
+	    if (atoi(optarg) <= 0) {
+		fprintf(stderr, "'%s' isn't a valid number of channels\n",
+		    optarg);
+		goto err;
+	    }
+	    option_channels = atoi(optarg);
+	    break;
+	case OPTION_DECIMATE:
+	    if (atoi(optarg) <= 0) {
+		fprintf(stderr, "'%s' isn't a valid decimation\n", optarg);
+		goto err;
+	    }
+	    option_decimate = atoi(optarg);
+	    break;
 	case OPTION_FCDAUDIO:
 	    option_fcdaudio_path = optarg;
 	    break;
+	case OPTION_FFT_AVERAGE:
+	    if (atoi(optarg) <= 0) {
+		fprintf(stderr, "'%s' isn't a valid number of FFTs\n",
+		    optarg);
+		goto err;
+	    }
+	    option_fft_average = atoi(optarg);
+	    break;
+	case OPTION_FFT_OVERLAP:
+	    if (atoi(optarg) < 0 || atoi(optarg) > 95) {
+		fprintf(stderr, "'%s' isn't an overlap from 0 to 95%%\n",
+		    optarg);
+		goto err;
+	    }
+	    option_fft_overlap = atoi(optarg);
+	    break;
+	case OPTION_FFT_PLAN:
+	    option_fft_plan = fft_plan_effort_parse(optarg);
+	    if (option_fft_plan == -1) {
+		fprintf(stderr, "unknown planning effort '%s'\n", optarg);
+		goto err;
+	    }
+	    break;
+	case OPTION_FFT_SIZE:
+	    if (!count_parse(optarg, &option_fft_size) ||
+		    option_fft_size < 16 ||
+		    option_fft_size > SPECTRUM_MAX_SIZE) {
+		fprintf(stderr, "'%s' isn't an FFT size from 16 to 1048576\n",
+		    optarg);
+		goto err;
+	    }
+	    break;
+	case OPTION_FFT_WINDOW:
+	    option_fft_window = spectrum_window_parse(optarg);
+	    if (option_fft_window == -1) {
+		fprintf(stderr, "unknown window '%s'\n", optarg);
+		goto err;
+	    }
+	    break;
 	case OPTION_FCDHID:
 	    option_fcdhid_path = optarg;
 	    break;
@@ -229,6 +498,12 @@ main(int argc, char *argv[]) {
 	    else
 		fprintf(stderr, "Unknown encoding %s\n", optarg);
 	    break;
+	case OPTION_FILE_SEEK:
+	    option_file_seek = optarg;
+	    break;
+	case OPTION_RECORD:
+	    option_record_name = optarg;
+	    break;
 	case OPTION_RTLSDR_INDEX:
 #ifdef HAVE_LIBRTLSDR
 	    option_rtlsdr_index = atoi(optarg);
@@ -249,6 +524,52 @@ main(int argc, char *argv[]) {
 	    option_uhd_spec = optarg;
 #endif
 	    break;
+	case OPTION_SHIFT: {
+	    t_frequency shift;
+
+	    if (!frequency_parse(optarg + (optarg[0] == '-'), &shift)) {
+		fprintf(stderr, "'%s' couldn't be parsed as a frequency\n",
+			optarg);
+		goto err;
+	    }
+	    option_shift = optarg[0] == '-'? -(double) shift : shift;
+	    break;
+	}
+	case OPTION_SCAN_OUTPUT:
+	    option_scan_output = scan_output_parse(optarg);
+	    if (option_scan_output == -1) {
+		fprintf(stderr, "unknown scan output '%s'\n", optarg);
+		goto err;
+	    }
+	    break;
+	case OPTION_SCAN_SEGMENT:
+	    if (!count_parse(optarg, &option_scan_segment) ||
+		    option_scan_segment == 0) {
+		fprintf(stderr, "'%s' couldn't be parsed as a number of "
+		    "samples\n", optarg);
+		goto err;
+	    }
+	    break;
+	case OPTION_SWEEP: {
+	    char *colon = strchr(optarg, ':');
+
+	    if (colon == NULL) {
+		fprintf(stderr, "'%s' isn't a range LOW:HIGH\n", optarg);
+		goto err;
+	    }
+	    *colon = '\0';
+	    if (!frequency_parse(optarg, &option_sweep_low) ||
+		    !frequency_parse(colon + 1, &option_sweep_high)) {
+		fprintf(stderr, "'%s:%s' couldn't be parsed as frequencies\n",
+			optarg, colon + 1);
+		goto err;
+	    }
+	    option_do_sweep = 1;
+	    break;
+	}
+	case OPTION_SWEEP_SPECTRUM:
+	    option_sweep_spectrum_name = optarg;
+	    break;
 	case OPTION_SQUELCH:
 	    option_squelch_db = atof(optarg);
 	    break;
@@ -262,20 +583,14 @@ main(int argc, char *argv[]) {
     argc -= optind;
     argv += optind;
 
-    if (option_adsb_decode) {
-	int flags = 0;
-	if (option_adsb_to_bitstring)
-	    flags |= PLANES_OUTPUT_AS_BITSTRING;
-	else
-	    flags |= PLANES_OUTPUT_AS_DECODED;
-	if (option_adsb_from_raw)
-	    flags |= PLANES_INPUT_FROM_RAW;
-	planes_main_loop(stdin, flags);
-	return EXIT_SUCCESS;
-    }
+    fft_plan_init(option_fft_plan);
+    atexit(fft_plan_exit);
 
-    if (argc != 0)
-	usage(EXIT_FAILURE, argv[0]);
+    if (argc != 0 || option_scan_segment != 0) {
+	if (!option_do_scan)
+	    usage(EXIT_FAILURE, program_name);
+	return scan_recordings(argc, argv) == -1? EXIT_FAILURE : EXIT_SUCCESS;
+    }
 
     if (option_fcdhid_path != NULL) {
 	radio = fcdhid_open(option_fcdhid_path, option_fcdaudio_path);
@@ -295,6 +610,8 @@ main(int argc, char *argv[]) {
 	    fprintf(stderr, "can't open file\n");
 	    goto err;
 	}
+	if (file_configure(radio) == -1)
+	    goto err;
     }
 
 #ifdef USE_ALSA
@@ -368,6 +685,38 @@ main(int argc, char *argv[]) {
     }
 #endif
 
+    if (option_decimate != 1 || option_shift != 0) {
+	if (radio == NULL) {
+	    fprintf(stderr, "can't filter without radio\n");
+	    goto err;
+	}
+	radio = radio_filter_open(radio, option_decimate, option_shift);
+    }
+
+    if (option_adsb_decode) {
+	if (option_adsb_to_bitstring)
+	    adsb_flags |= PLANES_OUTPUT_AS_BITSTRING;
+	else
+	    adsb_flags |= PLANES_OUTPUT_AS_DECODED;
+
+	/* Without a radio, read from stdin */
+	if (radio == NULL) {
+	    if (option_adsb_from_raw)
+		adsb_flags |= PLANES_INPUT_FROM_RAW;
+	    planes_main_loop(stdin, adsb_flags);
+	    return EXIT_SUCCESS;
+	}
+
+	if (!option_do_set_frequency && !file_has_frequency) {
+	    current_frequency = PLANES_ADSB_FREQUENCY;
+	    option_do_set_frequency = 1;
+	}
+	if (!option_do_set_sample_rate && !file_has_sample_rate) {
+	    current_sample_rate = PLANES_ADSB_SAMPLE_RATE;
+	    option_do_set_sample_rate = 1;
+	}
+    }
+
     if (option_do_set_sample_rate) {
 	if (radio == NULL) {
 	    fprintf(stderr, "can't set sample rate without radio\n");
@@ -377,7 +726,7 @@ main(int argc, char *argv[]) {
 	    fprintf(stderr, "couldn't set sample rate\n");
 	    goto err;
 	}
-    } else {
+    } else if (!file_has_sample_rate) {
 	fprintf(stderr, "setting the sample rate is mandatory\n");
 	goto err;
     }
@@ -406,31 +755,69 @@ main(int argc, char *argv[]) {
 	}
     }
 
-#if 0
-    if (radio != NULL && !option_gui) {
-	struct sample buf[4096];
+    if (option_record_name != NULL && radio == NULL) {
+	fprintf(stderr, "can't record without radio\n");
+	goto err;
+    }
 
-	for (;;) {
-	    ssize_t nread = radio->m->read(radio, buf, sizeof buf / sizeof buf[0]);
-	    if (nread == -1) {
-		fprintf(stderr, "radio read error\n");
-		goto err;
-	    }
-	    write(1, buf, nread * sizeof buf[0]);
+    if (option_record_name != NULL && !option_do_scan) {
+	if (record_main_loop(radio, option_record_name,
+		option_record_compress? RECORD_COMPRESS : 0) == -1)
+	    goto err;
+	radio->m->close(radio);
+	return EXIT_SUCCESS;
+    }
+
+    if (option_adsb_decode) {
+	if (planes_main_loop_radio(radio, adsb_flags) == -1)
+	    goto err;
+	radio->m->close(radio);
+	return EXIT_SUCCESS;
+    }
+
+    if (option_do_sweep) {
+	struct scan_params params;
+
+	scan_params_fill(&params);
+	if (option_sweep_spectrum_name != NULL &&
+		strcmp(option_sweep_spectrum_name, "-") == 0) {
+	    fprintf(stderr, "can't write the sweep spectrum to stdout, "
+		"where hits go\n");
+	    goto err;
 	}
+	if (sweep_main_loop(radio, option_sweep_low, option_sweep_high,
+		&params, option_sweep_spectrum_name) == -1)
+	    goto err;
+	radio->m->close(radio);
+	return EXIT_SUCCESS;
     }
-#endif
 
     if (option_do_scan) {
-	scan_main_loop(radio, option_squelch_db);
+	struct scan_params params;
+
+	scan_params_fill(&params);
+	if (option_record_name != NULL &&
+		strcmp(option_record_name, "-") == 0) {
+	    fprintf(stderr, "can't record to stdout while scanning\n");
+	    goto err;
+	}
+	if (scan_main_loop(radio, &params, option_scan_output,
+		option_channels, option_record_name,
+		option_record_compress? RECORD_COMPRESS : 0) == -1)
+	    goto err;
+	radio->m->close(radio);
 	return EXIT_SUCCESS;
     }
 
     if (option_gui) {
+	struct spectrum_params params;
 	struct widget *w;
 	if (gtk_gui_setup(&argc, &argv) == -1)
 	    goto err;
-	w = widget_fft_new(radio);
+	spectrum_params_fill(&params);
+	w = widget_fft_new(radio, &params);
+	if (w == NULL)
+	    goto err;
 	gtk_gui_add_widget(w);
 	gtk_gui_run_main();
     }
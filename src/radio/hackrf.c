@@ -1,6 +1,7 @@
 
 #include <radio/hackrf.h>
 
+#include <signal/sample-convert.h>
 #include <util/async-buffer.h>
 #include <util/memory.h>
 
@@ -10,13 +11,23 @@
 
 #include <pthread.h>
 
-#define DEFAULT_BUFFER_SIZE (256 * 1024)
+#define DEFAULT_BUFFER_SIZE (8 * 1024 * 1024)
+#define MAX_READ_SIZE (256 * 1024)
+
+/* libhackrf keeps 4 transfers of 256kB queued, 2 bytes per sample */
+#define HACKRF_IN_FLIGHT_SAMPLES (4 * 256 * 1024 / 2)
 
 static int hackrf_radio_set_frequency(struct radio *, t_frequency);
 static int hackrf_radio_get_frequency(struct radio *, t_frequency *);
 static int hackrf_radio_set_sample_rate(struct radio *, unsigned long);
 static int hackrf_radio_get_sample_rate(struct radio *, unsigned long *);
 static ssize_t hackrf_radio_read(struct radio *, struct sample *, size_t);
+static ssize_t hackrf_radio_read_float(struct radio *, struct samplef *, size_t);
+static ssize_t hackrf_radio_acquire_buffer(struct radio *,
+	struct radio_buffer *, size_t);
+static void hackrf_radio_release_buffer(struct radio *, struct radio_buffer *);
+static unsigned long long hackrf_radio_get_dropped_samples(struct radio *);
+static unsigned long hackrf_radio_get_settling_samples(struct radio *);
 static void hackrf_radio_close(struct radio *);
 static void hackrf_radio_flush(struct radio *);
 
@@ -24,7 +35,7 @@ struct hackrf_radio {
     struct radio radio;
     hackrf_device *dev;
     int reading;
-    struct async_buffer *buffer;
+    struct async_buffer *buffer;	/* of raw sc8 samples */
     t_frequency frequency;
     unsigned long sample_rate;
     int flags;
@@ -38,6 +49,11 @@ static struct radio_methods hackrf_radio_methods = {
     .set_sample_rate = hackrf_radio_set_sample_rate,
     .get_sample_rate = hackrf_radio_get_sample_rate,
     .read = hackrf_radio_read,
+    .read_float = hackrf_radio_read_float,
+    .acquire_buffer = hackrf_radio_acquire_buffer,
+    .release_buffer = hackrf_radio_release_buffer,
+    .get_dropped_samples = hackrf_radio_get_dropped_samples,
+    .get_settling_samples = hackrf_radio_get_settling_samples,
     .close = hackrf_radio_close,
 };
 
@@ -133,55 +149,135 @@ hackrf_radio_get_sample_rate(struct radio *r, unsigned long *sp) {
     return -1;
 }
 
-#define DEFAULT_CONVERSION_CHUNK_SIZE 4096
-
+/*
+ * Samples are queued as they come from the device, conversion happens on
+ * the reader's side (and not at all for acquire_buffer() users).
+ */
 static int
 hackrf_radio_read_callback(hackrf_transfer *transfer) {
     struct hackrf_radio *hrf = transfer->rx_ctx;
-    int8_t *orig_buffer = transfer->buffer;
     size_t valid_length = transfer->valid_length;
-    struct sample buffer[DEFAULT_CONVERSION_CHUNK_SIZE];
-    size_t idx = 0;
 
     if (valid_length % 2)
 	fprintf(stderr, "odd number of bytes in buffer!\n");
 
-    while (valid_length >= 1) {
-	size_t i;
+    /* Overruns are accounted for by the buffer and reported on close */
+    async_buffer_write(hrf->buffer, transfer->buffer,
+	valid_length & ~(size_t) 1);
+
+    return HACKRF_SUCCESS;
+}
 
-	for (i = 0; i < valid_length / 2 && i < DEFAULT_CONVERSION_CHUNK_SIZE;
-		i++, idx++) {
-	    buffer[i].v =
-		(orig_buffer[2*idx] + I * orig_buffer[2*idx+1]) / 128.0;
-	}
+static int
+hackrf_radio_start(struct hackrf_radio *hrf) {
+    int err;
 
-	if (async_buffer_write(hrf->buffer, buffer, i * sizeof buffer[0]) == -1) {
-	    //fprintf(stderr, "O");
-	}
+    if (hrf->reading)
+	return 0;
 
-	valid_length -= 2 * i;
+    err = hackrf_start_rx(hrf->dev, hackrf_radio_read_callback, hrf);
+    if (err != HACKRF_SUCCESS) {
+	fprintf(stderr, "start_rx failed because '%s'\n", hackrf_error_name(err));
+	return -1;
     }
 
-    return HACKRF_SUCCESS;
+    hrf->reading = 1;
+
+    return 0;
+}
+
+/*
+ * Points *datap directly into the ring buffer, which has to be consumed
+ * once the samples are used.  *datap is NULL on error.
+ */
+static ssize_t
+hackrf_radio_read_raw(struct hackrf_radio *hrf, size_t len,
+						const int8_t **datap) {
+    *datap = NULL;
+    if (hackrf_radio_start(hrf) == -1)
+	return -1;
+
+    if (len > MAX_READ_SIZE / 2)
+	len = MAX_READ_SIZE / 2;
+
+    *datap = async_buffer_peek(hrf->buffer, len * 2);
+    if (*datap == NULL)
+	return -1;
+
+    return len;
 }
 
 static ssize_t
 hackrf_radio_read(struct radio *r, struct sample *buf, size_t len) {
     struct hackrf_radio *hrf = (struct hackrf_radio *) r;
+    const int8_t *data;
+    ssize_t nread = hackrf_radio_read_raw(hrf, len, &data);
+
+    if (nread > 0) {
+	sample_convert(SAMPLE_ENCODING_SC8, data, buf, nread);
+	async_buffer_consume(hrf->buffer, nread * 2);
+    }
 
-    if (!hrf->reading) {
-	int err = hackrf_start_rx(hrf->dev, hackrf_radio_read_callback, hrf);
+    return nread;
+}
 
-	if (err != HACKRF_SUCCESS) {
-	    fprintf(stderr, "start_rx failed because '%s'\n", hackrf_error_name(err));
-	    return -1;
-	}
+static ssize_t
+hackrf_radio_read_float(struct radio *r, struct samplef *buf, size_t len) {
+    struct hackrf_radio *hrf = (struct hackrf_radio *) r;
+    const int8_t *data;
+    ssize_t nread = hackrf_radio_read_raw(hrf, len, &data);
 
-	hrf->reading = 1;
+    if (nread > 0) {
+	sample_convert_float(SAMPLE_ENCODING_SC8, data, buf, nread);
+	async_buffer_consume(hrf->buffer, nread * 2);
     }
 
-    return async_buffer_read(hrf->buffer, buf, len * sizeof buf[0]) /
-	sizeof buf[0];
+    return nread;
+}
+
+static ssize_t
+hackrf_radio_acquire_buffer(struct radio *r, struct radio_buffer *rb,
+								size_t len) {
+    struct hackrf_radio *hrf = (struct hackrf_radio *) r;
+    const int8_t *data;
+    ssize_t nread = hackrf_radio_read_raw(hrf, len, &data);
+
+    rb->data = data;
+    rb->nsamples = nread > 0? nread : 0;
+    rb->encoding = SAMPLE_ENCODING_SC8;
+
+    return nread;
+}
+
+static void
+hackrf_radio_release_buffer(struct radio *r, struct radio_buffer *rb) {
+    struct hackrf_radio *hrf = (struct hackrf_radio *) r;
+
+    async_buffer_consume(hrf->buffer, rb->nsamples * 2);
+
+    rb->data = NULL;
+    rb->nsamples = 0;
+}
+
+static unsigned long long
+hackrf_radio_get_dropped_samples(struct radio *r) {
+    struct hackrf_radio *hrf = (struct hackrf_radio *) r;
+
+    return async_buffer_get_dropped_bytes(hrf->buffer) / 2;
+}
+
+/*
+ * Flushing only empties our buffer: the transfers in flight were filled
+ * at the old frequency, then the PLL takes about a millisecond to lock.
+ */
+static unsigned long
+hackrf_radio_get_settling_samples(struct radio *r) {
+    struct hackrf_radio *hrf = (struct hackrf_radio *) r;
+
+    if (!(hrf->flags & HACKRF_RADIO_SAMPLE_RATE_IS_SET))
+	return HACKRF_IN_FLIGHT_SAMPLES;
+
+    return HACKRF_IN_FLIGHT_SAMPLES + hrf->sample_rate / 1000;
 }
 
 static void
@@ -192,6 +288,12 @@ hackrf_radio_close(struct radio *r) {
 	hackrf_stop_rx(hrf->dev);
 
     hackrf_close(hrf->dev);
+
+    if (async_buffer_get_overruns(hrf->buffer) != 0)
+	fprintf(stderr, "hackrf: %llu samples dropped in %lu overruns\n",
+	    async_buffer_get_dropped_bytes(hrf->buffer) / 2,
+	    async_buffer_get_overruns(hrf->buffer));
+
     async_buffer_delete(hrf->buffer);
     memory_free(hrf);
 }
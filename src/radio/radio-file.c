@@ -1,10 +1,20 @@
+#define _DEFAULT_SOURCE			/* for madvise() */
 
 #include <radio/radio-file.h>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
 #include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <signal/iqz.h>
+#include <signal/sample-convert.h>
+#include <signal/sigmf.h>
 #include <util/memory.h>
 
 static int radio_file_set_frequency(struct radio *, t_frequency);
@@ -12,27 +22,131 @@ static int radio_file_get_frequency(struct radio *, t_frequency *);
 static int radio_file_set_sample_rate(struct radio *, unsigned long);
 static int radio_file_get_sample_rate(struct radio *, unsigned long *);
 static ssize_t radio_file_read(struct radio *, struct sample *, size_t);
+static ssize_t radio_file_read_float(struct radio *, struct samplef *, size_t);
+static ssize_t radio_file_acquire_buffer(struct radio *, struct radio_buffer *,
+	size_t);
+static void radio_file_release_buffer(struct radio *, struct radio_buffer *);
 static off_t radio_file_get_file_position(struct radio *);
+static int radio_file_seek(struct radio *, off_t);
 static void radio_file_close(struct radio *);
 
+/* How far ahead of the reading position pages are asked for, in bytes */
+#define RADIO_FILE_READ_AHEAD (16 * 1024 * 1024)
+
+/*
+ * Regular files are mapped whole and samples are lent straight from the
+ * mapping, pipes and the like go through stdio.  Compressed recordings
+ * are lent block by block, as decompressed ahead by their reader.
+ */
 struct radio_file {
     struct radio radio;
     FILE *file;
     t_frequency freq;
     unsigned long rate;
     int encoding;
+    void *raw_buffer;			/* for acquire_buffer() */
+    size_t raw_buffer_size;
+    const unsigned char *map;		/* NULL if not mapped */
+    size_t map_size;
+    size_t map_offset;			/* of the next sample */
+    size_t map_advised;			/* end of the pages asked for */
+    struct signal_desc *desc;		/* from the metadata, or NULL */
+    struct iqz_reader *iqz;		/* NULL if not compressed */
+    const unsigned char *iqz_data;	/* rest of the current block */
+    size_t iqz_left;			/* in samples */
+    uint64_t iqz_position;		/* of the next sample */
 };
 
+static void radio_file_map(struct radio_file *);
+static void radio_file_read_metadata(struct radio_file *, const char *);
+static void radio_file_read_ahead(struct radio_file *);
+
 static struct radio_methods radio_file_methods = {
     .set_frequency = radio_file_set_frequency,
     .get_frequency = radio_file_get_frequency,
     .set_sample_rate = radio_file_set_sample_rate,
     .get_sample_rate = radio_file_get_sample_rate,
     .read = radio_file_read,
+    .read_float = radio_file_read_float,
+    .acquire_buffer = radio_file_acquire_buffer,
+    .release_buffer = radio_file_release_buffer,
     .get_file_position = radio_file_get_file_position,
+    .seek = radio_file_seek,
     .close = radio_file_close,
 };
 
+/*
+ * Falls back to stdio silently, for whatever reason mapping fails.
+ */
+static void
+radio_file_map(struct radio_file *fr) {
+    struct stat st;
+    void *map;
+
+    if (fstat(fileno(fr->file), &st) == -1 || !S_ISREG(st.st_mode) ||
+	    st.st_size == 0 || (uintmax_t) st.st_size > SIZE_MAX)
+	return;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(fr->file), 0);
+    if (map == MAP_FAILED)
+	return;
+
+    (void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    fr->map = map;
+    fr->map_size = st.st_size;
+    fr->map_offset = 0;
+    fr->map_advised = 0;
+    radio_file_read_ahead(fr);
+}
+
+/*
+ * Keep the kernel reading at least half of RADIO_FILE_READ_AHEAD ahead of
+ * us, so that page faults find the data already there.
+ */
+static void
+radio_file_read_ahead(struct radio_file *fr) {
+    size_t len = RADIO_FILE_READ_AHEAD;
+
+    if (fr->map_advised >= fr->map_size ||
+	    fr->map_offset + RADIO_FILE_READ_AHEAD / 2 < fr->map_advised)
+	return;
+
+    if (len > fr->map_size - fr->map_advised)
+	len = fr->map_size - fr->map_advised;
+    (void) madvise((void *) (fr->map + fr->map_advised), len, MADV_WILLNEED);
+    fr->map_advised += len;
+}
+
+/*
+ * A missing metadata file is no error, an unreadable one is only worth a
+ * warning: the user can still say what the data is.
+ */
+static void
+radio_file_read_metadata(struct radio_file *fr, const char *name) {
+    char *meta_name = sigmf_meta_name(name);
+
+    fr->desc = sigmf_read(meta_name);
+    if (fr->desc == NULL && errno != ENOENT)
+	fprintf(stderr, "%s: %s, ignored\n", meta_name,
+	    errno == EINVAL? "invalid SigMF metadata" : strerror(errno));
+    memory_free(meta_name);
+
+    if (fr->desc == NULL)
+	return;
+
+    if (fr->encoding == 0 && (fr->desc->flags & SIGNAL_DESC_HAVE_ENCODING))
+	fr->encoding = fr->desc->encoding;
+    if (fr->desc->flags & SIGNAL_DESC_HAVE_SAMPLE_RATE)
+	fr->rate = fr->desc->sample_rate;
+    if (fr->desc->flags & SIGNAL_DESC_HAVE_TUNER_FREQUENCY)
+	fr->freq = fr->desc->tuner_frequency;
+}
+
+/*
+ * name.sigmf-meta, or base.sigmf-meta for base.sigmf-data, provides
+ * whatever encoding is 0 for, the sample rate and the frequency.
+ */
 struct radio *
 radio_file_open(const char *name, int encoding) {
     struct radio_file *fr = memory_alloc(sizeof *fr);
@@ -51,6 +165,37 @@ radio_file_open(const char *name, int encoding) {
     fr->freq = 0;
     fr->rate = 1;
     fr->encoding = encoding;
+    fr->raw_buffer = NULL;
+    fr->raw_buffer_size = 0;
+    fr->map = NULL;
+    fr->desc = NULL;
+    fr->iqz = NULL;
+    fr->iqz_left = 0;
+    fr->iqz_position = 0;
+
+    if (fr->file != stdin) {
+	radio_file_read_metadata(fr, name);
+
+	if (iqz_fd_is_iqz(fileno(fr->file))) {
+	    fr->iqz = iqz_reader_open(fileno(fr->file), 0);
+	    if (fr->iqz == NULL) {
+		fprintf(stderr, "%s: %s\n", name, errno == EINVAL?
+		    "invalid compressed recording" : strerror(errno));
+		if (fr->desc != NULL)
+		    signal_desc_delete(fr->desc);
+		fclose(fr->file);
+		memory_free(fr);
+		return NULL;
+	    }
+	    fr->encoding = iqz_reader_get_encoding(fr->iqz);
+	} else {
+	    if (fr->desc != NULL &&
+		    (fr->desc->flags & SIGNAL_DESC_COMPRESSED))
+		fprintf(stderr, "%s: not compressed, unlike what its "
+		    "metadata says\n", name);
+	    radio_file_map(fr);
+	}
+    }
 
     radio_init(&fr->radio, &radio_file_methods);
 
@@ -95,73 +240,204 @@ radio_file_get_sample_rate(struct radio *r, unsigned long *sp) {
 
 static ssize_t
 radio_file_read(struct radio *r, struct sample *buf, size_t len) {
+    struct radio_buffer rb;
+    ssize_t nread = radio_file_acquire_buffer(r, &rb, len);
+
+    if (nread > 0)
+	sample_convert(rb.encoding, rb.data, buf, nread);
+
+    return nread;
+}
+
+static ssize_t
+radio_file_read_float(struct radio *r, struct samplef *buf, size_t len) {
+    struct radio_buffer rb;
+    ssize_t nread = radio_file_acquire_buffer(r, &rb, len);
+
+    if (nread > 0)
+	sample_convert_float(rb.encoding, rb.data, buf, nread);
+
+    return nread;
+}
+
+#define RADIO_FILE_RAW_BUFFER_SIZE (256 * 1024)
+
+static ssize_t
+radio_file_acquire_buffer(struct radio *r, struct radio_buffer *rb,
+								size_t len) {
     struct radio_file *fr = (struct radio_file *) r;
-    int bytes_per_sample;
-    int nread;
-    int i;
-
-    switch (fr->encoding) {
-    case RADIO_FILE_ENCODING_UC8:
-    case RADIO_FILE_ENCODING_SC8:
-	bytes_per_sample = 2;
-	break;
-    case RADIO_FILE_ENCODING_SC16:
-	bytes_per_sample = 4;
-	break;
-    case RADIO_FILE_ENCODING_U8:
-	bytes_per_sample = 1;
-	break;
-    case RADIO_FILE_ENCODING_S16:
-	bytes_per_sample = 2;
-	break;
-    default:
+    size_t bytes_per_sample = sample_encoding_size(fr->encoding);
+    ssize_t nread;
+
+    if (bytes_per_sample == 0) {
 	fprintf(stderr, "unsupported encoding\n");
 	return 0;
     }
 
-    nread = fread(buf, bytes_per_sample, len, fr->file);
-    if (nread < 1)
-	return 0;
-
-    for (i = nread - 1; i >= 0; i--) {
-	uint8_t *buf_u8 = (void *) buf;
-	int8_t *buf_s8 = (void *) buf;
-	int16_t *buf_s16 = (void *) buf;
-
-	switch (fr->encoding) {
-	case RADIO_FILE_ENCODING_UC8:
-	    buf[i].v =
-		(buf_u8[2*i] - 128.0 + I*(buf_u8[2*i+1] - 128.0)) / 128.0;
-	    break;
-	case RADIO_FILE_ENCODING_SC8:
-	    buf[i].v = (buf_s8[2*i] + I*buf_s8[2*i+1]) / 128.0;
-	    break;
-	case RADIO_FILE_ENCODING_SC16:
-	    buf[i].v = (buf_s16[2*i] + I*buf_s16[2*i+1]) / 32768.0;
-	    break;
-	case RADIO_FILE_ENCODING_U8:
-	    buf[i].v = (buf_u8[i] - 128.0) / 128.0;
-	    break;
-	case RADIO_FILE_ENCODING_S16:
-	    buf[i].v = buf_s16[i] / 32768.0;
-	    break;
+    if (fr->iqz != NULL) {
+	if (fr->iqz_left == 0) {
+	    const void *data;
+	    ssize_t n = iqz_reader_next(fr->iqz, &data);
+
+	    if (n <= 0) {
+		if (n == -1)
+		    fprintf(stderr, "corrupted compressed recording\n");
+		return n;
+	    }
+	    fr->iqz_data = data;
+	    fr->iqz_left = n;
 	}
+
+	if (len > fr->iqz_left)
+	    len = fr->iqz_left;
+
+	rb->data = fr->iqz_data;
+	rb->nsamples = len;
+	rb->encoding = fr->encoding;
+
+	fr->iqz_data += len * bytes_per_sample;
+	fr->iqz_left -= len;
+	fr->iqz_position += len;
+
+	return len;
     }
 
+    if (fr->map != NULL) {
+	size_t left = (fr->map_size - fr->map_offset) / bytes_per_sample;
+
+	if (len > left)
+	    len = left;
+
+	rb->data = fr->map + fr->map_offset;
+	rb->nsamples = len;
+	rb->encoding = fr->encoding;
+
+	fr->map_offset += len * bytes_per_sample;
+	radio_file_read_ahead(fr);
+
+	return len;
+    }
+
+    if (fr->raw_buffer == NULL) {
+	fr->raw_buffer = memory_alloc(RADIO_FILE_RAW_BUFFER_SIZE);
+	fr->raw_buffer_size = RADIO_FILE_RAW_BUFFER_SIZE;
+    }
+
+    if (len > fr->raw_buffer_size / bytes_per_sample)
+	len = fr->raw_buffer_size / bytes_per_sample;
+
+    nread = fread(fr->raw_buffer, bytes_per_sample, len, fr->file);
+
+    rb->data = fr->raw_buffer;
+    rb->nsamples = nread;
+    rb->encoding = fr->encoding;
+
     return nread;
 }
 
+static void
+radio_file_release_buffer(struct radio *r, struct radio_buffer *rb) {
+    (void) r;
+
+    rb->data = NULL;
+    rb->nsamples = 0;
+}
+
+/*
+ * In the decompressed samples, for compressed recordings.
+ */
 static off_t
 radio_file_get_file_position(struct radio *r) {
     struct radio_file *fr = (struct radio_file *) r;
 
+    if (fr->iqz != NULL)
+	return fr->iqz_position * sample_encoding_size(fr->encoding);
+    if (fr->map != NULL)
+	return fr->map_offset;
+
     return ftello(fr->file);
 }
 
+static int
+radio_file_seek(struct radio *r, off_t sample) {
+    struct radio_file *fr = (struct radio_file *) r;
+    size_t bytes_per_sample = sample_encoding_size(fr->encoding);
+    off_t offset = sample * bytes_per_sample;
+
+    if (sample < 0 || bytes_per_sample == 0)
+	return -1;
+
+    if (fr->iqz != NULL) {
+	if (iqz_reader_seek(fr->iqz, sample) == -1)
+	    return -1;
+	fr->iqz_left = 0;
+	fr->iqz_position = sample;
+	return 0;
+    }
+
+    if (fr->map == NULL)
+	return fseeko(fr->file, offset, SEEK_SET);
+
+    if ((uintmax_t) offset > fr->map_size)
+	return -1;
+
+    fr->map_offset = offset;
+    fr->map_advised = offset - offset % sysconf(_SC_PAGESIZE);
+    radio_file_read_ahead(fr);
+
+    return 0;
+}
+
+/*
+ * Only for radios from radio_file_open().  NULL if the recording has no
+ * metadata.
+ */
+const struct signal_desc *
+radio_file_get_signal_desc(struct radio *r) {
+    struct radio_file *fr = (struct radio_file *) r;
+
+    return fr->desc;
+}
+
+/*
+ * Only for radios from radio_file_open().  Returns -1 for pipes and the
+ * like, whose length is unknown.
+ */
+int
+radio_file_get_nsamples(struct radio *r, uint64_t *np) {
+    struct radio_file *fr = (struct radio_file *) r;
+    size_t bytes_per_sample = sample_encoding_size(fr->encoding);
+    struct stat st;
+
+    if (fr->iqz != NULL) {
+	*np = iqz_reader_get_nsamples(fr->iqz);
+	return 0;
+    }
+    if (bytes_per_sample == 0)
+	return -1;
+    if (fr->map != NULL) {
+	*np = fr->map_size / bytes_per_sample;
+	return 0;
+    }
+    if (fstat(fileno(fr->file), &st) == -1 || !S_ISREG(st.st_mode))
+	return -1;
+    *np = st.st_size / bytes_per_sample;
+
+    return 0;
+}
+
 static void
 radio_file_close(struct radio *r) {
     struct radio_file *fr = (struct radio_file *) r;
 
+    if (fr->map != NULL)
+	munmap((void *) fr->map, fr->map_size);
+    if (fr->iqz != NULL)
+	iqz_reader_close(fr->iqz);
     fclose(fr->file);
+    if (fr->desc != NULL)
+	signal_desc_delete(fr->desc);
+    if (fr->raw_buffer != NULL)
+	memory_free(fr->raw_buffer);
     memory_free(fr);
 }
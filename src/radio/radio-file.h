@@ -1,16 +1,21 @@
 #ifndef RADIO_RADIO_FILE_H_
 #define RADIO_RADIO_FILE_H_
 
+#include <stdint.h>
+
 #include <radio/radio.h>
+#include <signal/signal-desc.h>
 
-#define RADIO_FILE_ENCODING_UC8		1
-#define RADIO_FILE_ENCODING_SC16	2
+#define RADIO_FILE_ENCODING_UC8		SAMPLE_ENCODING_UC8
+#define RADIO_FILE_ENCODING_SC16	SAMPLE_ENCODING_SC16
 
-#define RADIO_FILE_ENCODING_SC8		3
+#define RADIO_FILE_ENCODING_SC8		SAMPLE_ENCODING_SC8
 
-#define RADIO_FILE_ENCODING_U8		32
-#define RADIO_FILE_ENCODING_S16		33
+#define RADIO_FILE_ENCODING_U8		SAMPLE_ENCODING_U8
+#define RADIO_FILE_ENCODING_S16		SAMPLE_ENCODING_S16
 
 struct radio *radio_file_open(const char *, int);
+const struct signal_desc *radio_file_get_signal_desc(struct radio *);
+int radio_file_get_nsamples(struct radio *, uint64_t *);
 
 #endif /* RADIO_RADIO_FILE_H_ */
@@ -0,0 +1,243 @@
+#include <radio/radio-filter.h>
+
+#include <math.h>
+
+#include <signal/fir-decimator.h>
+#include <util/memory.h>
+
+static int radio_filter_set_frequency(struct radio *, t_frequency);
+static int radio_filter_get_frequency(struct radio *, t_frequency *);
+static int radio_filter_set_sample_rate(struct radio *, unsigned long);
+static int radio_filter_get_sample_rate(struct radio *, unsigned long *);
+static ssize_t radio_filter_read_float(struct radio *, struct samplef *,
+	size_t);
+static ssize_t radio_filter_acquire_buffer(struct radio *,
+	struct radio_buffer *, size_t);
+static void radio_filter_release_buffer(struct radio *, struct radio_buffer *);
+static off_t radio_filter_get_file_position(struct radio *);
+static int radio_filter_seek(struct radio *, off_t);
+static unsigned long long radio_filter_get_dropped_samples(struct radio *);
+static unsigned long radio_filter_get_settling_samples(struct radio *);
+static void radio_filter_close(struct radio *);
+
+/* In input samples */
+#define RADIO_FILTER_INPUT_SIZE	65536
+
+/*
+ * The frequency and sample rate are those of the output: the lower radio
+ * is tuned shift below and runs decimation times faster.
+ */
+struct radio_filter {
+    struct radio radio;
+    struct radio *lower;
+    struct fir_decimator *decimator;
+    unsigned int decimation;
+    double shift;			/* in Hz */
+    struct samplef *input;
+    struct samplef *output;		/* for acquire_buffer() */
+};
+
+static struct radio_methods radio_filter_methods = {
+    .set_frequency = radio_filter_set_frequency,
+    .get_frequency = radio_filter_get_frequency,
+    .set_sample_rate = radio_filter_set_sample_rate,
+    .get_sample_rate = radio_filter_get_sample_rate,
+    .read = NULL,
+    .read_float = radio_filter_read_float,
+    .acquire_buffer = radio_filter_acquire_buffer,
+    .release_buffer = radio_filter_release_buffer,
+    .get_file_position = radio_filter_get_file_position,
+    .seek = radio_filter_seek,
+    .get_dropped_samples = radio_filter_get_dropped_samples,
+    .get_settling_samples = radio_filter_get_settling_samples,
+    .close = radio_filter_close,
+};
+
+/*
+ * Keeps the band decimation times narrower than lower, centered shift Hz
+ * away from its tuner frequency.  Closing it closes lower.
+ */
+struct radio *
+radio_filter_open(struct radio *lower, unsigned int decimation,
+							    double shift) {
+    struct radio_filter *rf = memory_alloc(sizeof *rf);
+    unsigned long rate;
+
+    rf->lower = lower;
+    rf->decimator = fir_decimator_new(decimation,
+	FIR_DECIMATOR_DEFAULT_TAPS_PER_PHASE);
+    rf->decimation = decimation;
+    rf->shift = shift;
+    rf->input = memory_alloc(RADIO_FILTER_INPUT_SIZE * sizeof *rf->input);
+    rf->output = memory_alloc((RADIO_FILTER_INPUT_SIZE / decimation + 1) *
+	sizeof *rf->output);
+
+    if (lower->m->get_sample_rate(lower, &rate) == 0 && rate != 0)
+	fir_decimator_set_shift(rf->decimator, shift / rate);
+
+    radio_init(&rf->radio, &radio_filter_methods);
+
+    return &rf->radio;
+}
+
+static int
+radio_filter_set_frequency(struct radio *r, t_frequency f) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    double lower_f = f - rf->shift;
+
+    if (lower_f < 0)
+	return -1;
+
+    return rf->lower->m->set_frequency(rf->lower, llround(lower_f));
+}
+
+static int
+radio_filter_get_frequency(struct radio *r, t_frequency *fp) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    t_frequency f;
+
+    if (rf->lower->m->get_frequency(rf->lower, &f) == -1)
+	return -1;
+
+    *fp = llround(f + rf->shift);
+
+    return 0;
+}
+
+static int
+radio_filter_set_sample_rate(struct radio *r, unsigned long s) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    unsigned long rate = s * rf->decimation;
+
+    if (rf->lower->m->set_sample_rate(rf->lower, rate) == -1)
+	return -1;
+
+    fir_decimator_set_shift(rf->decimator, rf->shift / rate);
+
+    return 0;
+}
+
+static int
+radio_filter_get_sample_rate(struct radio *r, unsigned long *sp) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    unsigned long rate;
+
+    if (rf->lower->m->get_sample_rate(rf->lower, &rate) == -1)
+	return -1;
+
+    *sp = rate / rf->decimation;
+
+    return 0;
+}
+
+/*
+ * Reads until at least one output sample comes out, or the lower radio
+ * is done.  n input samples give at most ceil(n / decimation) outputs,
+ * which fit in len.
+ */
+static ssize_t
+radio_filter_read_float(struct radio *r, struct samplef *buf, size_t len) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    size_t to_read;
+    size_t nout = 0;
+
+    if (len > RADIO_FILTER_INPUT_SIZE)
+	len = RADIO_FILTER_INPUT_SIZE;
+    to_read = len * rf->decimation;
+    if (to_read > RADIO_FILTER_INPUT_SIZE)
+	to_read = RADIO_FILTER_INPUT_SIZE;
+
+    while (nout == 0) {
+	ssize_t nread = rf->lower->m->read_float(rf->lower, rf->input,
+	    to_read);
+
+	if (nread <= 0)
+	    return nread;
+
+	nout = fir_decimator_process(rf->decimator, rf->input, nread, buf);
+    }
+
+    return nout;
+}
+
+static ssize_t
+radio_filter_acquire_buffer(struct radio *r, struct radio_buffer *rb,
+								size_t len) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    ssize_t nread;
+
+    if (len > RADIO_FILTER_INPUT_SIZE / rf->decimation + 1)
+	len = RADIO_FILTER_INPUT_SIZE / rf->decimation + 1;
+
+    nread = radio_filter_read_float(r, rf->output, len);
+
+    rb->data = rf->output;
+    rb->nsamples = nread > 0? nread : 0;
+    rb->encoding = SAMPLE_ENCODING_CF32;
+
+    return nread;
+}
+
+static void
+radio_filter_release_buffer(struct radio *r, struct radio_buffer *rb) {
+    (void) r;
+
+    rb->data = NULL;
+    rb->nsamples = 0;
+}
+
+static off_t
+radio_filter_get_file_position(struct radio *r) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+
+    return rf->lower->m->get_file_position(rf->lower);
+}
+
+/*
+ * The filter starts over from there, as if preceded by silence.
+ */
+static int
+radio_filter_seek(struct radio *r, off_t sample) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+
+    if (rf->lower->m->seek(rf->lower, sample * rf->decimation) == -1)
+	return -1;
+
+    fir_decimator_reset(rf->decimator);
+
+    return 0;
+}
+
+/*
+ * In output samples, rounded up.
+ */
+static unsigned long long
+radio_filter_get_dropped_samples(struct radio *r) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    unsigned long long n = rf->lower->m->get_dropped_samples(rf->lower);
+
+    return (n + rf->decimation - 1) / rf->decimation;
+}
+
+/*
+ * Those of lower, then as long as the filter remembers them.
+ */
+static unsigned long
+radio_filter_get_settling_samples(struct radio *r) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+    unsigned long n = rf->lower->m->get_settling_samples(rf->lower);
+
+    return (n + rf->decimation - 1) / rf->decimation +
+	FIR_DECIMATOR_DEFAULT_TAPS_PER_PHASE;
+}
+
+static void
+radio_filter_close(struct radio *r) {
+    struct radio_filter *rf = (struct radio_filter *) r;
+
+    rf->lower->m->close(rf->lower);
+    fir_decimator_delete(rf->decimator);
+    memory_free(rf->input);
+    memory_free(rf->output);
+    memory_free(rf);
+}
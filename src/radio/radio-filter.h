@@ -0,0 +1,11 @@
+/*
+ * Radio seen through a frequency translating, decimating filter
+ */
+#ifndef RADIO_RADIO_FILTER_H_
+#define RADIO_RADIO_FILTER_H_
+
+#include <radio/radio.h>
+
+struct radio *radio_filter_open(struct radio *, unsigned int, double);
+
+#endif /* RADIO_RADIO_FILTER_H_ */
@@ -0,0 +1,143 @@
+#include <radio/radio-transformer.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <signal/sample.h>
+#include <signal/transformer.h>
+#include <signal/transformer-type.h>
+#include <util/memory.h>
+
+/*
+ * The encoding, and so the size of elements, is only known from a first
+ * buffer, acquired when made and passed on first.
+ */
+struct radio_transformer {
+    struct transformer_type type;
+    struct radio *radio;
+    int encoding;
+    struct radio_buffer first;
+    int has_first;			/* not passed on yet */
+    int ended;
+    off_t first_offset;			/* file position of the first sample */
+    off_t sample_offset;		/* file bytes per sample */
+};
+
+static ssize_t radio_transformer_apply(struct transformer_type *, void *,
+	size_t, const void *, size_t, void *);
+
+static ssize_t
+radio_transformer_apply(struct transformer_type *type, void *dest,
+	size_t dest_size, const void *src, size_t src_size, void *aux) {
+    struct radio_transformer *rt = aux;
+    struct radio *radio = rt->radio;
+    struct radio_buffer rb;
+    ssize_t nread;
+    size_t size;
+
+    (void) src;
+    (void) src_size;
+
+    if (rt->has_first) {
+	rb = rt->first;
+	rt->has_first = 0;
+    } else if (rt->ended)
+	return 0;
+    else {
+	nread = radio->m->acquire_buffer(radio, &rb,
+	    dest_size / type->output_elem_size);
+	if (nread <= 0)
+	    return nread;
+	if (rb.encoding != rt->encoding) {
+	    radio->m->release_buffer(radio, &rb);
+	    errno = EINVAL;
+	    return -1;
+	}
+    }
+
+    size = rb.nsamples * type->output_elem_size;
+    memcpy(dest, rb.data, size);
+    radio->m->release_buffer(radio, &rb);
+
+    return size;
+}
+
+/*
+ * The radio must already be set up; it is left open at the end.  Returns
+ * NULL if reading it fails.  A radio ending at once gives no samples, as
+ * CF32.
+ */
+struct transformer *
+radio_transformer_new(struct radio *radio) {
+    struct radio_transformer *rt = memory_alloc(sizeof *rt);
+    ssize_t nread;
+
+    rt->radio = radio;
+    rt->first_offset = radio->m->get_file_position(radio);
+    rt->sample_offset = 0;
+    rt->ended = 0;
+
+    nread = radio->m->acquire_buffer(radio, &rt->first,
+	RADIO_TRANSFORMER_CHUNK_SIZE);
+    if (nread == -1) {
+	memory_free(rt);
+	return NULL;
+    }
+    rt->has_first = nread != 0;
+    if (nread != 0) {
+	rt->encoding = rt->first.encoding;
+	rt->sample_offset = (radio->m->get_file_position(radio) -
+	    rt->first_offset) / nread;
+    } else {
+	rt->encoding = SAMPLE_ENCODING_CF32;
+	rt->ended = 1;
+    }
+
+    rt->type.name = "radio";
+    rt->type.input_elem_size = 0;
+    rt->type.output_elem_size = sample_encoding_size(rt->encoding);
+    rt->type.input_chunk_max_size = 0;
+    rt->type.output_chunk_max_size =
+	RADIO_TRANSFORMER_CHUNK_SIZE * rt->type.output_elem_size;
+    rt->type.apply = radio_transformer_apply;
+
+    return transformer_new(&rt->type, rt);
+}
+
+void
+radio_transformer_delete(struct transformer *t) {
+    struct radio_transformer *rt = transformer_get_private(t);
+
+    if (rt->has_first)
+	rt->radio->m->release_buffer(rt->radio, &rt->first);
+    transformer_delete(t);
+    memory_free(rt);
+}
+
+int
+radio_transformer_get_encoding(struct transformer *t) {
+    struct radio_transformer *rt = transformer_get_private(t);
+
+    return rt->encoding;
+}
+
+/*
+ * Where in the radio's file its first sample is, in bytes.
+ */
+off_t
+radio_transformer_get_first_offset(struct transformer *t) {
+    struct radio_transformer *rt = transformer_get_private(t);
+
+    return rt->first_offset;
+}
+
+/*
+ * How far apart in the radio's file samples are, in bytes, as of the
+ * first buffer; 0 if it has no file.
+ */
+off_t
+radio_transformer_get_sample_offset(struct transformer *t) {
+    struct radio_transformer *rt = transformer_get_private(t);
+
+    return rt->sample_offset;
+}
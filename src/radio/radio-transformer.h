@@ -0,0 +1,22 @@
+/*
+ * Source transformer passing on the samples of a radio as they come, in
+ * its native encoding
+ */
+#ifndef RADIO_RADIO_TRANSFORMER_H_
+#define RADIO_RADIO_TRANSFORMER_H_
+
+#include <sys/types.h>
+
+#include <radio/radio.h>
+
+struct transformer;
+
+#define RADIO_TRANSFORMER_CHUNK_SIZE	16384	/* in samples */
+
+struct transformer *radio_transformer_new(struct radio *);
+void radio_transformer_delete(struct transformer *);
+int radio_transformer_get_encoding(struct transformer *);
+off_t radio_transformer_get_first_offset(struct transformer *);
+off_t radio_transformer_get_sample_offset(struct transformer *);
+
+#endif /* RADIO_RADIO_TRANSFORMER_H_ */
@@ -4,13 +4,26 @@
 #include <stddef.h>
 
 #include <util/exception.h>
+#include <util/memory.h>
 
 static int radio_dummy_set_frequency(struct radio *, t_frequency);
 static int radio_dummy_get_frequency(struct radio *, t_frequency *);
 static int radio_dummy_set_sample_rate(struct radio *, unsigned long);
 static int radio_dummy_get_sample_rate(struct radio *, unsigned long *);
 static ssize_t radio_dummy_read(struct radio *, struct sample *, size_t);
+static ssize_t radio_dummy_read_float(struct radio *, struct samplef *, size_t);
+static ssize_t radio_read_from_float(struct radio *, struct sample *, size_t);
+static ssize_t radio_read_float_from_double(struct radio *, struct samplef *,
+	size_t);
+static ssize_t radio_acquire_buffer_from_read(struct radio *,
+	struct radio_buffer *, size_t);
+static void radio_release_buffer_from_read(struct radio *,
+	struct radio_buffer *);
+static void radio_dummy_release_buffer(struct radio *, struct radio_buffer *);
 static off_t radio_dummy_get_file_position(struct radio *);
+static int radio_dummy_seek(struct radio *, off_t);
+static unsigned long long radio_dummy_get_dropped_samples(struct radio *);
+static unsigned long radio_dummy_get_settling_samples(struct radio *);
 static void radio_dummy_close(struct radio *);
 
 static void radio_methods_fill_empty_slots(struct radio_methods *);
@@ -23,7 +36,7 @@ radio_init(struct radio *r, struct radio_methods *m) {
 
 static void
 radio_methods_fill_empty_slots(struct radio_methods *m) {
-    if (sizeof *m != 7 * sizeof (void *))
+    if (sizeof *m != 13 * sizeof (void *))
 	EXCEPTION_RAISE(runtime_error,
 	    "Missing slot initialisation in radio/radio.c");
 
@@ -35,10 +48,37 @@ radio_methods_fill_empty_slots(struct radio_methods *m) {
 	m->set_sample_rate = radio_dummy_set_sample_rate;
     if (m->get_sample_rate == NULL)
 	m->get_sample_rate = radio_dummy_get_sample_rate;
-    if (m->read == NULL)
+    /*
+     * A radio need only implement one of read() and read_float(), the
+     * other one is then emulated by converting.
+     */
+    if (m->read == NULL && m->read_float == NULL) {
 	m->read = radio_dummy_read;
+	m->read_float = radio_dummy_read_float;
+    } else if (m->read == NULL)
+	m->read = radio_read_from_float;
+    else if (m->read_float == NULL)
+	m->read_float = radio_read_float_from_double;
+    /*
+     * Radios without a native buffer get one made of converted samples.
+     */
+    if (m->acquire_buffer == NULL) {
+	if (m->release_buffer != NULL)
+	    EXCEPTION_RAISE(logic_error,
+		"release_buffer without acquire_buffer in radio/radio.c");
+	m->acquire_buffer = radio_acquire_buffer_from_read;
+	m->release_buffer = radio_release_buffer_from_read;
+    }
+    if (m->release_buffer == NULL)
+	m->release_buffer = radio_dummy_release_buffer;
     if (m->get_file_position == NULL)
 	m->get_file_position = radio_dummy_get_file_position;
+    if (m->seek == NULL)
+	m->seek = radio_dummy_seek;
+    if (m->get_dropped_samples == NULL)
+	m->get_dropped_samples = radio_dummy_get_dropped_samples;
+    if (m->get_settling_samples == NULL)
+	m->get_settling_samples = radio_dummy_get_settling_samples;
     if (m->close == NULL)
 	m->close = radio_dummy_close;
 }
@@ -73,6 +113,91 @@ radio_dummy_read(struct radio *r, struct sample *buf, size_t len) {
     return -1;
 }
 
+static ssize_t
+radio_dummy_read_float(struct radio *r, struct samplef *buf, size_t len) {
+    (void) r; (void) buf; (void) len;
+    return -1;
+}
+
+#define RADIO_CONVERSION_CHUNK_SIZE 4096
+
+static ssize_t
+radio_read_from_float(struct radio *r, struct sample *buf, size_t len) {
+    struct samplef tmp[RADIO_CONVERSION_CHUNK_SIZE];
+    ssize_t nread;
+    ssize_t i;
+
+    if (len > RADIO_CONVERSION_CHUNK_SIZE)
+	len = RADIO_CONVERSION_CHUNK_SIZE;
+
+    nread = r->m->read_float(r, tmp, len);
+
+    for (i = 0; i < nread; i++)
+	buf[i].v = tmp[i].v;
+
+    return nread;
+}
+
+static ssize_t
+radio_read_float_from_double(struct radio *r, struct samplef *buf,
+							size_t len) {
+    struct sample tmp[RADIO_CONVERSION_CHUNK_SIZE];
+    ssize_t nread;
+    ssize_t i;
+
+    if (len > RADIO_CONVERSION_CHUNK_SIZE)
+	len = RADIO_CONVERSION_CHUNK_SIZE;
+
+    nread = r->m->read(r, tmp, len);
+
+    for (i = 0; i < nread; i++)
+	buf[i].v = tmp[i].v;
+
+    return nread;
+}
+
+static ssize_t
+radio_acquire_buffer_from_read(struct radio *r, struct radio_buffer *rb,
+								size_t len) {
+    struct sample *buf;
+    ssize_t nread;
+
+    if (len > RADIO_CONVERSION_CHUNK_SIZE)
+	len = RADIO_CONVERSION_CHUNK_SIZE;
+
+    buf = memory_alloc(len * sizeof *buf);
+    nread = r->m->read(r, buf, len);
+    if (nread <= 0) {
+	memory_free(buf);
+	rb->data = NULL;
+	rb->nsamples = 0;
+	return nread;
+    }
+
+    rb->data = buf;
+    rb->nsamples = nread;
+    rb->encoding = SAMPLE_ENCODING_CF64;
+
+    return nread;
+}
+
+static void
+radio_release_buffer_from_read(struct radio *r, struct radio_buffer *rb) {
+    (void) r;
+
+    memory_free((void *) rb->data);
+    rb->data = NULL;
+    rb->nsamples = 0;
+}
+
+static void
+radio_dummy_release_buffer(struct radio *r, struct radio_buffer *rb) {
+    (void) r;
+
+    rb->data = NULL;
+    rb->nsamples = 0;
+}
+
 static off_t
 radio_dummy_get_file_position(struct radio *r) {
     (void) r;
@@ -80,6 +205,30 @@ radio_dummy_get_file_position(struct radio *r) {
     return 0;
 }
 
+static int
+radio_dummy_seek(struct radio *r, off_t sample) {
+    (void) r; (void) sample;
+    return -1;
+}
+
+/*
+ * Radios which don't count them don't lose samples, as far as we know.
+ */
+static unsigned long long
+radio_dummy_get_dropped_samples(struct radio *r) {
+    (void) r;
+    return 0;
+}
+
+/*
+ * Nor do they need time to settle.
+ */
+static unsigned long
+radio_dummy_get_settling_samples(struct radio *r) {
+    (void) r;
+    return 0;
+}
+
 static void
 radio_dummy_close(struct radio *r) {
     (void) r;
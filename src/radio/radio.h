@@ -14,13 +14,33 @@ struct radio {
 
 void radio_init(struct radio *, struct radio_methods *);
 
+/*
+ * Samples in the radio's native encoding, lent by acquire_buffer() until
+ * the matching release_buffer().  Like read(), acquire_buffer() returns
+ * the number of samples, 0 at end of stream or -1 on error; only buffers
+ * actually holding samples are to be released.
+ */
+struct radio_buffer {
+    const void *data;
+    size_t nsamples;
+    int encoding;			/* SAMPLE_ENCODING_* */
+};
+
 struct radio_methods {
     int (*set_frequency)(struct radio *, t_frequency);
     int (*get_frequency)(struct radio *, t_frequency *);
     int (*set_sample_rate)(struct radio *, unsigned long);
     int (*get_sample_rate)(struct radio *, unsigned long *);
     ssize_t (*read)(struct radio *, struct sample *, size_t);
-    off_t (*get_file_position)(struct radio *);
+    ssize_t (*read_float)(struct radio *, struct samplef *, size_t);
+    ssize_t (*acquire_buffer)(struct radio *, struct radio_buffer *, size_t);
+    void (*release_buffer)(struct radio *, struct radio_buffer *);
+    off_t (*get_file_position)(struct radio *);	/* in bytes */
+    int (*seek)(struct radio *, off_t);		/* to a sample index */
+    /* Lost to overruns since opening */
+    unsigned long long (*get_dropped_samples)(struct radio *);
+    /* To discard after set_frequency(), before samples are of the new one */
+    unsigned long (*get_settling_samples)(struct radio *);
     void (*close)(struct radio *);
 };
 
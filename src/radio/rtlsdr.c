@@ -1,6 +1,7 @@
 
 #include <radio/rtlsdr.h>
 
+#include <signal/sample-convert.h>
 #include <util/async-buffer.h>
 #include <util/memory.h>
 
@@ -12,16 +13,26 @@
 
 #define DEFAULT_BUFFER_SIZE (256 * 1024)
 
+/* Read right after rtlsdr_reset_buffer(), before the tuner is steady */
+#define RTLSDR_RESET_DUMP_SAMPLES 2048
+
 static int rtlsdr_radio_set_frequency(struct radio *, t_frequency);
 static int rtlsdr_radio_get_frequency(struct radio *, t_frequency *);
 static int rtlsdr_radio_set_sample_rate(struct radio *, unsigned long);
 static int rtlsdr_radio_get_sample_rate(struct radio *, unsigned long *);
 static ssize_t rtlsdr_radio_read(struct radio *, struct sample *, size_t);
+static ssize_t rtlsdr_radio_read_float(struct radio *, struct samplef *,
+	size_t);
+static ssize_t rtlsdr_radio_acquire_buffer(struct radio *,
+	struct radio_buffer *, size_t);
+static void rtlsdr_radio_release_buffer(struct radio *, struct radio_buffer *);
+static unsigned long rtlsdr_radio_get_settling_samples(struct radio *);
 static void rtlsdr_radio_close(struct radio *);
 
 struct rtlsdr_radio {
     struct radio radio;
     rtlsdr_dev_t *dev;
+    uint8_t *raw_buffer;		/* for acquire_buffer() */
 };
 
 static struct radio_methods rtlsdr_radio_methods = {
@@ -30,6 +41,10 @@ static struct radio_methods rtlsdr_radio_methods = {
     .set_sample_rate = rtlsdr_radio_set_sample_rate,
     .get_sample_rate = rtlsdr_radio_get_sample_rate,
     .read = rtlsdr_radio_read,
+    .read_float = rtlsdr_radio_read_float,
+    .acquire_buffer = rtlsdr_radio_acquire_buffer,
+    .release_buffer = rtlsdr_radio_release_buffer,
+    .get_settling_samples = rtlsdr_radio_get_settling_samples,
     .close = rtlsdr_radio_close,
 };
 
@@ -60,6 +75,8 @@ rtlsdr_radio_open(int index) {
     if (rtlsdr_reset_buffer(rs->dev) != 0)
 	fprintf(stderr, "rtlsdr_reset_buffer() failed\n");
 
+    rs->raw_buffer = NULL;
+
     radio_init(&rs->radio, &rtlsdr_radio_methods);
 
     //printf("tuner gain = %g\n", rtlsdr_get_tuner_gain(rs->dev) / 10.0);
@@ -114,26 +131,73 @@ rtlsdr_radio_get_sample_rate(struct radio *r, unsigned long *sp) {
 
 static ssize_t
 rtlsdr_radio_read(struct radio *r, struct sample *buf, size_t len) {
+    struct radio_buffer rb;
+    ssize_t nread = rtlsdr_radio_acquire_buffer(r, &rb, len);
+
+    if (nread > 0)
+	sample_convert(rb.encoding, rb.data, buf, nread);
+
+    return nread;
+}
+
+static ssize_t
+rtlsdr_radio_read_float(struct radio *r, struct samplef *buf, size_t len) {
+    struct radio_buffer rb;
+    ssize_t nread = rtlsdr_radio_acquire_buffer(r, &rb, len);
+
+    if (nread > 0)
+	sample_convert_float(rb.encoding, rb.data, buf, nread);
+
+    return nread;
+}
+
+static ssize_t
+rtlsdr_radio_acquire_buffer(struct radio *r, struct radio_buffer *rb,
+								size_t len) {
     struct rtlsdr_radio *rs = (struct rtlsdr_radio *) r;
     int nread;
-    uint8_t *byte_buf = (uint8_t *) buf;
-    int ret = rtlsdr_read_sync(rs->dev, byte_buf, len * 2, &nread);
-    int i;
 
-    if (ret != 0)
+    if (rs->raw_buffer == NULL)
+	rs->raw_buffer = memory_alloc(DEFAULT_BUFFER_SIZE);
+
+    if (len > DEFAULT_BUFFER_SIZE / 2)
+	len = DEFAULT_BUFFER_SIZE / 2;
+
+    if (rtlsdr_read_sync(rs->dev, rs->raw_buffer, len * 2, &nread) != 0)
 	return -1;
 
-    for (i = nread - 2; i >= 0; i -= 2)
-	buf[i / 2].v =
-	    (byte_buf[i] - 128.0 + I*(byte_buf[i+1] - 128.0)) / 128.0;
+    rb->data = rs->raw_buffer;
+    rb->nsamples = nread / 2;
+    rb->encoding = SAMPLE_ENCODING_UC8;
 
     return nread / 2;
 }
 
+static void
+rtlsdr_radio_release_buffer(struct radio *r, struct radio_buffer *rb) {
+    (void) r;
+
+    rb->data = NULL;
+    rb->nsamples = 0;
+}
+
+/*
+ * rtlsdr_radio_set_frequency() resets the buffer, so only the first
+ * samples after it, and a millisecond for the PLL to lock, are bad.
+ */
+static unsigned long
+rtlsdr_radio_get_settling_samples(struct radio *r) {
+    struct rtlsdr_radio *rs = (struct rtlsdr_radio *) r;
+
+    return RTLSDR_RESET_DUMP_SAMPLES + rtlsdr_get_sample_rate(rs->dev) / 1000;
+}
+
 static void
 rtlsdr_radio_close(struct radio *r) {
     struct rtlsdr_radio *rs = (struct rtlsdr_radio *) r;
 
     rtlsdr_close(rs->dev);
+    if (rs->raw_buffer != NULL)
+	memory_free(rs->raw_buffer);
     memory_free(rs);
 }
@@ -14,6 +14,7 @@ static int uhd_radio_get_frequency(struct radio *, t_frequency *);
 static int uhd_radio_set_sample_rate(struct radio *, unsigned long);
 static int uhd_radio_get_sample_rate(struct radio *, unsigned long *);
 static ssize_t uhd_radio_read(struct radio *, struct sample *, size_t);
+static unsigned long uhd_radio_get_settling_samples(struct radio *);
 static void uhd_radio_close(struct radio *);
 
 struct uhd_radio {
@@ -27,6 +28,7 @@ static struct radio_methods uhd_radio_methods = {
     .set_sample_rate = uhd_radio_set_sample_rate,
     .get_sample_rate = uhd_radio_get_sample_rate,
     .read = uhd_radio_read,
+    .get_settling_samples = uhd_radio_get_settling_samples,
     .close = uhd_radio_close,
 };
 
@@ -89,6 +91,16 @@ uhd_radio_read(struct radio *r, struct sample *buf, size_t len) {
     return uhd_wrapper_read(ur->dev, (void *) buf, len);
 }
 
+/*
+ * Streaming is stopped while tuning, so only the LO has to lock.
+ */
+static unsigned long
+uhd_radio_get_settling_samples(struct radio *r) {
+    struct uhd_radio *ur = (struct uhd_radio *) r;
+
+    return (unsigned long) uhd_wrapper_get_sample_rate(ur->dev) / 1000;
+}
+
 static void
 uhd_radio_close(struct radio *r) {
     struct uhd_radio *ur = (struct uhd_radio *) r;
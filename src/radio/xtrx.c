@@ -1,6 +1,7 @@
 
 #include <radio/xtrx.h>
 
+#include <signal/sample-convert.h>
 #include <util/async-buffer.h>
 #include <util/memory.h>
 
@@ -9,11 +10,20 @@
 #include <pthread.h>
 #include <stdio.h>
 
+/* About 200ms of sc16 at 40MS/s, for the reader's hiccups */
+#define DEFAULT_BUFFER_SIZE (32 * 1024 * 1024)
+
 static int xtrx_radio_set_frequency(struct radio *, t_frequency);
 static int xtrx_radio_get_frequency(struct radio *, t_frequency *);
 static int xtrx_radio_set_sample_rate(struct radio *, unsigned long);
 static int xtrx_radio_get_sample_rate(struct radio *, unsigned long *);
 static ssize_t xtrx_radio_read(struct radio *, struct sample *, size_t);
+static ssize_t xtrx_radio_read_float(struct radio *, struct samplef *, size_t);
+static ssize_t xtrx_radio_acquire_buffer(struct radio *, struct radio_buffer *,
+	size_t);
+static void xtrx_radio_release_buffer(struct radio *, struct radio_buffer *);
+static unsigned long long xtrx_radio_get_dropped_samples(struct radio *);
+static unsigned long xtrx_radio_get_settling_samples(struct radio *);
 static void xtrx_radio_close(struct radio *);
 
 struct xtrx_radio {
@@ -27,6 +37,8 @@ struct xtrx_radio {
     double last_set_samplerate;
     pthread_t pthread;
     struct async_buffer *buf;
+    unsigned long long device_dropped;	/* before reaching buf */
+    int16_t *raw_buffer;		/* for acquire_buffer() */
 };
 
 static struct radio_methods xtrx_radio_methods = {
@@ -35,6 +47,11 @@ static struct radio_methods xtrx_radio_methods = {
     .set_sample_rate = xtrx_radio_set_sample_rate,
     .get_sample_rate = xtrx_radio_get_sample_rate,
     .read = xtrx_radio_read,
+    .read_float = xtrx_radio_read_float,
+    .acquire_buffer = xtrx_radio_acquire_buffer,
+    .release_buffer = xtrx_radio_release_buffer,
+    .get_dropped_samples = xtrx_radio_get_dropped_samples,
+    .get_settling_samples = xtrx_radio_get_settling_samples,
     .close = xtrx_radio_close,
 };
 
@@ -80,7 +97,10 @@ xtrx_radio_open(void) {
     rs->last_set_samplerate = 0.0;
     rs->flags = 0;
 
-    rs->buf = async_buffer_new(1024 * 1024, ASYNC_BUFFER_READER_CAN_WAIT);
+    rs->device_dropped = 0;
+    rs->buf = async_buffer_new(DEFAULT_BUFFER_SIZE,
+	ASYNC_BUFFER_READER_CAN_WAIT);
+    rs->raw_buffer = NULL;
 
     radio_init(&rs->radio, &xtrx_radio_methods);
 
@@ -103,6 +123,10 @@ xtrx_radio_set_frequency(struct radio *r, t_frequency f) {
     xtrx_set_gain(rs->dev, XTRX_CH_ALL, XTRX_RX_PGA_GAIN, 0, &gain);
     xtrx_set_gain(rs->dev, XTRX_CH_ALL, XTRX_RX_TIA_GAIN, 9, &gain);
 
+    /* What was queued is from the old frequency */
+    if (rs->flags & RADIO_XTRX_FLAGS_STARTED)
+	async_buffer_empty(rs->buf);
+
     return ret == 0? 0 : -1;
 }
 
@@ -165,6 +189,9 @@ xtrx_radio_read_thread(void *r) {
 	if (ri.out_events & RCVEX_EVENT_OVERFLOW) {
 	    fprintf(stderr, "%lu %lu %lu\n", ri.out_first_sample,
 			    ri.out_overrun_at, ri.out_resumed_at);
+	    if (ri.out_resumed_at > ri.out_overrun_at)
+		__atomic_store_n(&rs->device_dropped, rs->device_dropped +
+		    (ri.out_resumed_at - ri.out_overrun_at), __ATOMIC_RELAXED);
 	}
 
 	async_buffer_write(rs->buf, tmpbuf,
@@ -174,50 +201,115 @@ xtrx_radio_read_thread(void *r) {
     return NULL;
 }
 
+static int
+xtrx_radio_start(struct xtrx_radio *rs) {
+    static struct xtrx_run_params params;
+
+    if ((rs->flags & RADIO_XTRX_FLAGS_STARTED) != 0)
+	return 0;
+
+    xtrx_run_params_init(&params);
+    params.dir = XTRX_RX;
+    params.nflags = 0;
+    params.rx.wfmt = XTRX_WF_16;
+    params.rx.hfmt = XTRX_IQ_INT16;
+    params.rx.chs = XTRX_CH_ALL;
+    params.rx.paketsize = 0;
+    params.rx.flags = XTRX_RSP_SISO_MODE;
+#if 0
+    params.rx.flags |= XTRX_RSP_SCALE;
+    params.rx.scale = 1.0;
+#endif
+
+    params.rx_stream_start = 0;
+
+    if (xtrx_run_ex(rs->dev, &params) != 0) {
+	fprintf(stderr, "can't start radio rx\n");
+	return -1;
+    }
+
+    pthread_create(&rs->pthread, NULL, xtrx_radio_read_thread, rs);
+
+    rs->flags |= RADIO_XTRX_FLAGS_STARTED;
+
+    return 0;
+}
+
 static ssize_t
 xtrx_radio_read(struct radio *r, struct sample *buf, size_t len) {
+    struct radio_buffer rb;
+    ssize_t nread = xtrx_radio_acquire_buffer(r, &rb, len);
+
+    if (nread > 0)
+	sample_convert(rb.encoding, rb.data, buf, nread);
+
+    return nread;
+}
+
+static ssize_t
+xtrx_radio_read_float(struct radio *r, struct samplef *buf, size_t len) {
+    struct radio_buffer rb;
+    ssize_t nread = xtrx_radio_acquire_buffer(r, &rb, len);
+
+    if (nread > 0)
+	sample_convert_float(rb.encoding, rb.data, buf, nread);
+
+    return nread;
+}
+
+static ssize_t
+xtrx_radio_acquire_buffer(struct radio *r, struct radio_buffer *rb,
+								size_t len) {
     struct xtrx_radio *rs = (struct xtrx_radio *) r;
-    static struct xtrx_run_params params;
-    int16_t tmpbuf[CHUNK_NSAMPLES * 2];
     ssize_t nread;
-    int i;
-
-    if (len > sizeof tmpbuf / 2)
-	len = sizeof tmpbuf / 2;
-
-    if ((rs->flags & RADIO_XTRX_FLAGS_STARTED) == 0) {
-	xtrx_run_params_init(&params);
-	params.dir = XTRX_RX;
-	params.nflags = 0;
-	params.rx.wfmt = XTRX_WF_16;
-	params.rx.hfmt = XTRX_IQ_INT16;
-	params.rx.chs = XTRX_CH_ALL;
-	params.rx.paketsize = 0;
-	params.rx.flags = XTRX_RSP_SISO_MODE;
-#if 0
-	params.rx.flags |= XTRX_RSP_SCALE;
-	params.rx.scale = 1.0;
-#endif
 
-	params.rx_stream_start = 0;
+    if (len > CHUNK_NSAMPLES)
+	len = CHUNK_NSAMPLES;
 
-	if (xtrx_run_ex(rs->dev, &params) != 0) {
-	    fprintf(stderr, "can't start radio rx\n");
-	    return -1;
-	}
+    if (rs->raw_buffer == NULL)
+	rs->raw_buffer =
+	    memory_alloc(CHUNK_NSAMPLES * 2 * sizeof rs->raw_buffer[0]);
 
-	pthread_create(&rs->pthread, NULL, xtrx_radio_read_thread, rs);
+    if (xtrx_radio_start(rs) == -1)
+	return -1;
 
-	rs->flags |= RADIO_XTRX_FLAGS_STARTED;
-    }
+    nread = async_buffer_read(rs->buf, rs->raw_buffer,
+	len * 2 * sizeof rs->raw_buffer[0]);
+    if (nread == -1)
+	return -1;
 
-    nread = async_buffer_read(rs->buf, tmpbuf, len * 2 * sizeof tmpbuf[0]);
+    rb->data = rs->raw_buffer;
+    rb->nsamples = nread / (2 * sizeof rs->raw_buffer[0]);
+    rb->encoding = SAMPLE_ENCODING_SC16;
 
-    for (i = 0; i < nread / (2 * sizeof tmpbuf[0]); i++) {
-	buf[i].v = tmpbuf[2 * i] / 32768. + tmpbuf[2 * i + 1] / 32768. * I;
-    }
+    return rb->nsamples;
+}
 
-    return nread / (2 * sizeof tmpbuf[0]);
+static void
+xtrx_radio_release_buffer(struct radio *r, struct radio_buffer *rb) {
+    (void) r;
+
+    rb->data = NULL;
+    rb->nsamples = 0;
+}
+
+static unsigned long long
+xtrx_radio_get_dropped_samples(struct radio *r) {
+    struct xtrx_radio *rs = (struct xtrx_radio *) r;
+
+    return __atomic_load_n(&rs->device_dropped, __ATOMIC_RELAXED) +
+	async_buffer_get_dropped_bytes(rs->buf) / 4;
+}
+
+/*
+ * The read thread may be holding a chunk from before the buffer was
+ * emptied, then the PLL takes about a millisecond to lock.
+ */
+static unsigned long
+xtrx_radio_get_settling_samples(struct radio *r) {
+    struct xtrx_radio *rs = (struct xtrx_radio *) r;
+
+    return CHUNK_NSAMPLES + (unsigned long) rs->last_set_samplerate / 1000;
 }
 
 static void
@@ -230,5 +322,13 @@ xtrx_radio_close(struct radio *r) {
     }
 
     xtrx_close(rs->dev);
+
+    if (async_buffer_get_overruns(rs->buf) != 0)
+	fprintf(stderr, "xtrx: %llu samples dropped in %lu overruns\n",
+	    async_buffer_get_dropped_bytes(rs->buf) / 4,
+	    async_buffer_get_overruns(rs->buf));
+
+    if (rs->raw_buffer != NULL)
+	memory_free(rs->raw_buffer);
     memory_free(rs);
 }
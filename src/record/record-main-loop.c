@@ -0,0 +1,68 @@
+#include <record/record-main-loop.h>
+
+#include <signal.h>
+#include <stdio.h>
+
+#include <radio/radio.h>
+
+/* In samples, asked of the radio at once */
+#define RECORD_READ_SIZE	(256 * 1024)
+
+static volatile sig_atomic_t record_stop;
+
+static void record_interrupt(int);
+
+static void
+record_interrupt(int sig) {
+    (void) sig;
+    record_stop = 1;
+}
+
+/*
+ * Writes the radio's samples as they come, in its own encoding, to name
+ * ("-" for stdout) until the radio ends or SIGINT or SIGTERM.  A SigMF
+ * metadata file goes alongside, with an annotation wherever the radio
+ * dropped samples.
+ */
+int
+record_main_loop(struct radio *radio, const char *name, int flags) {
+    struct record *r = record_new(radio, name, flags);
+    struct sigaction sa, old_int, old_term;
+    int status = 0;
+
+    if (r == NULL)
+	return -1;
+
+    record_stop = 0;
+    sa.sa_handler = record_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    while (!record_stop) {
+	struct radio_buffer rb;
+	ssize_t n = radio->m->acquire_buffer(radio, &rb, RECORD_READ_SIZE);
+
+	if (n <= 0) {
+	    if (n == -1 && !record_stop) {
+		fprintf(stderr, "radio read error\n");
+		status = -1;
+	    }
+	    break;
+	}
+
+	n = record_write(r, rb.data, n, rb.encoding);
+	radio->m->release_buffer(radio, &rb);
+	if (n == -1)
+	    break;
+    }
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+
+    if (record_delete(r) == -1)
+	status = -1;
+
+    return status;
+}
@@ -0,0 +1,10 @@
+#ifndef RECORD_RECORD_MAIN_LOOP_H_
+#define RECORD_RECORD_MAIN_LOOP_H_
+
+#include <record/record.h>
+
+struct radio;
+
+int record_main_loop(struct radio *, const char *, int flags);
+
+#endif /* RECORD_RECORD_MAIN_LOOP_H_ */
@@ -0,0 +1,494 @@
+#ifdef __linux__
+#define _GNU_SOURCE			/* for O_DIRECT and fallocate() */
+#endif
+
+#include <record/record.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include <radio/radio.h>
+#include <signal/iqz.h>
+#include <signal/sample.h>
+#include <signal/sigmf.h>
+#include <signal/transformer.h>
+#include <signal/transformer-type.h>
+#include <util/async-buffer.h>
+#include <util/memory.h>
+
+#ifndef O_DIRECT
+#define O_DIRECT	0
+#endif
+
+struct record_block {
+    void *alloc;
+    unsigned char *data;		/* aligned to RECORD_ALIGNMENT */
+    size_t len;
+};
+
+/*
+ * The reader fills blocks and queues them in full, the writer thread
+ * writes them out and hands them back through free.  A NULL block ends
+ * the recording.
+ */
+struct record {
+    struct radio *radio;
+    char *name;
+    int flags;
+    int encoding;			/* set before the first block */
+    size_t sample_size;
+    int fd;
+    struct iqz_writer *iqz;		/* compressing, once started */
+    int direct;				/* O_DIRECT is on */
+    int preallocate;			/* fallocate() works */
+    off_t written;
+    off_t allocated;
+    int error;				/* errno of the first failed write */
+    struct async_buffer *full;
+    struct async_buffer *free;
+    struct record_block blocks[RECORD_NBLOCKS];
+    struct record_block *block;		/* being filled */
+    pthread_t writer;
+
+    /* What the metadata and statistics say */
+    struct signal_desc *desc;
+    time_t start;
+    struct timeval t0;
+    unsigned long long dropped_base;
+    unsigned long long dropped;
+    uint64_t nsamples;
+
+    struct transformer_type type;	/* of record_transformer_new() */
+};
+
+static int record_open(struct record *, const char *);
+static void record_set_direct(struct record *, int);
+static void record_preallocate(struct record *, off_t);
+static int record_write_block(struct record *, const struct record_block *);
+static void *record_writer(void *);
+static void record_push(struct record *, struct record_block *);
+static struct record_block *record_pop_free(struct record *);
+static int record_finish(struct record *);
+static void record_write_metadata(struct radio *, const char *, int,
+	struct signal_desc *, time_t);
+static ssize_t record_apply(struct transformer_type *, void *, size_t,
+	const void *, size_t, void *);
+
+/*
+ * Bypasses the page cache where the file system allows it: at tens of
+ * MB/s, caching only evicts everything else and makes the writes bursty.
+ */
+static int
+record_open(struct record *r, const char *name) {
+    r->written = 0;
+    r->allocated = 0;
+    r->error = 0;
+    r->iqz = NULL;
+
+    if (strcmp(name, "-") == 0) {
+	if (r->flags & RECORD_COMPRESS) {
+	    fprintf(stderr, "can't compress to stdout\n");
+	    return -1;
+	}
+	r->fd = STDOUT_FILENO;
+	r->direct = 0;
+	r->preallocate = 0;
+	return 0;
+    }
+
+    /* The compressor's writes are neither aligned nor of known size */
+    r->direct = O_DIRECT != 0 && !(r->flags & RECORD_COMPRESS);
+    r->preallocate = !(r->flags & RECORD_COMPRESS);
+    r->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC |
+	(r->direct? O_DIRECT : 0), 0666);
+    if (r->fd == -1 && errno == EINVAL && r->direct) {
+	r->direct = 0;
+	r->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    if (r->fd == -1) {
+	perror(name);
+	return -1;
+    }
+
+    return 0;
+}
+
+static void
+record_set_direct(struct record *r, int direct) {
+    int flags = fcntl(r->fd, F_GETFL);
+
+    if (flags != -1)
+	(void) fcntl(r->fd, F_SETFL,
+	    direct? flags | O_DIRECT : flags & ~O_DIRECT);
+    r->direct = direct;
+}
+
+/*
+ * Keeps the file allocated beyond end, so that writes need no block
+ * allocation and the file stays contiguous.  Its size stays that of the
+ * data written, even if the recording never finishes; the blocks past
+ * it are given back by record_finish().
+ */
+static void
+record_preallocate(struct record *r, off_t end) {
+#ifdef __linux__
+    while (r->preallocate && r->allocated < end) {
+	if (fallocate(r->fd, FALLOC_FL_KEEP_SIZE, r->allocated,
+		RECORD_PREALLOCATION) == -1) {
+	    r->preallocate = 0;
+	    break;
+	}
+	r->allocated += RECORD_PREALLOCATION;
+    }
+#else
+    (void) r; (void) end;
+#endif
+}
+
+/*
+ * Only the last block may be cut short of alignment, its tail then goes
+ * through the page cache.  So does everything if the file system turns
+ * O_DIRECT down.
+ */
+static int
+record_write_block(struct record *r, const struct record_block *b) {
+    size_t done = 0;
+
+    if (r->flags & RECORD_COMPRESS) {
+	if (r->iqz == NULL) {
+	    r->iqz = iqz_writer_new(r->fd, r->encoding, 0);
+	    if (r->iqz == NULL)
+		return -1;
+	}
+	return iqz_writer_write(r->iqz, b->data, b->len);
+    }
+
+    record_preallocate(r, r->written + b->len);
+
+    while (done < b->len) {
+	size_t len = b->len - done;
+	ssize_t n;
+
+	if (r->direct && len % RECORD_ALIGNMENT != 0) {
+	    len -= len % RECORD_ALIGNMENT;
+	    if (len == 0) {
+		record_set_direct(r, 0);
+		continue;
+	    }
+	}
+
+	n = write(r->fd, b->data + done, len);
+	if (n == -1) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EINVAL && r->direct) {
+		record_set_direct(r, 0);
+		continue;
+	    }
+	    return -1;
+	}
+	done += n;
+	r->written += n;
+    }
+
+    return 0;
+}
+
+/*
+ * After a failure, blocks keep being handed back unwritten so that the
+ * reader never waits for good.
+ */
+static void *
+record_writer(void *arg) {
+    struct record *r = arg;
+
+    for (;;) {
+	struct record_block *b;
+
+	if (async_buffer_read(r->full, &b, sizeof b) == -1 || b == NULL)
+	    break;
+
+	if (__atomic_load_n(&r->error, __ATOMIC_RELAXED) == 0 &&
+		record_write_block(r, b) == -1)
+	    __atomic_store_n(&r->error, errno, __ATOMIC_RELAXED);
+
+	async_buffer_write(r->free, &b, sizeof b);
+    }
+
+    return NULL;
+}
+
+static void
+record_push(struct record *r, struct record_block *b) {
+    async_buffer_write(r->full, &b, sizeof b);
+}
+
+static struct record_block *
+record_pop_free(struct record *r) {
+    struct record_block *b;
+
+    if (async_buffer_read(r->free, &b, sizeof b) == -1)
+	return NULL;
+    b->len = 0;
+
+    return b;
+}
+
+/*
+ * Ends the writer and the file.  Returns -1 if anything was lost.
+ */
+static int
+record_finish(struct record *r) {
+    int status = 0;
+
+    record_push(r, NULL);
+    pthread_join(r->writer, NULL);
+
+    if (r->iqz != NULL) {
+	if (iqz_writer_close(r->iqz) == -1 && r->error == 0)
+	    r->error = errno;
+	r->written = lseek(r->fd, 0, SEEK_END);
+    }
+
+    if (r->error != 0) {
+	fprintf(stderr, "record: %s\n", strerror(r->error));
+	status = -1;
+    }
+
+    /* Same size, but file systems free the blocks past the end then */
+    if (r->allocated > r->written && ftruncate(r->fd, r->written) == -1)
+	perror("record: ftruncate");
+    if (r->fd != STDOUT_FILENO && close(r->fd) == -1) {
+	perror("record: close");
+	status = -1;
+    }
+
+    return status;
+}
+
+static void
+record_write_metadata(struct radio *radio, const char *name, int encoding,
+			    struct signal_desc *desc, time_t start) {
+    struct signal_capture *c = signal_desc_add_capture(desc, 0);
+    unsigned long rate;
+    t_frequency freq;
+    char datetime[32];
+    char *meta_name;
+
+    desc->encoding = encoding;
+    desc->flags |= SIGNAL_DESC_HAVE_ENCODING;
+    if (radio->m->get_sample_rate(radio, &rate) == 0) {
+	desc->sample_rate = rate;
+	desc->flags |= SIGNAL_DESC_HAVE_SAMPLE_RATE;
+    }
+    if (radio->m->get_frequency(radio, &freq) == 0) {
+	c->frequency = freq;
+	c->flags |= SIGNAL_CAPTURE_HAVE_FREQUENCY;
+    }
+    if (strftime(datetime, sizeof datetime, "%Y-%m-%dT%H:%M:%SZ",
+	    gmtime(&start)) != 0)
+	c->datetime = memory_strdup(datetime);
+
+    meta_name = sigmf_meta_name(name);
+    if (sigmf_write(meta_name, desc) == -1)
+	perror(meta_name);
+    memory_free(meta_name);
+}
+
+/*
+ * Starts recording samples of radio to name ("-" for stdout), as given
+ * to record_write().  Returns NULL if the file can't be opened.
+ */
+struct record *
+record_new(struct radio *radio, const char *name, int flags) {
+    struct record *r = memory_alloc(sizeof *r);
+    struct record_block *b;
+    unsigned int i;
+
+    r->flags = flags;
+    r->encoding = 0;
+    r->sample_size = 0;
+    if (record_open(r, name) == -1) {
+	memory_free(r);
+	return NULL;
+    }
+
+    /* One more slot each for the end of the recording */
+    r->full = async_buffer_new((RECORD_NBLOCKS + 1) * sizeof b,
+	ASYNC_BUFFER_READER_CAN_WAIT | ASYNC_BUFFER_WRITER_CAN_WAIT);
+    r->free = async_buffer_new((RECORD_NBLOCKS + 1) * sizeof b,
+	ASYNC_BUFFER_READER_CAN_WAIT | ASYNC_BUFFER_WRITER_CAN_WAIT);
+    for (i = 0; i < RECORD_NBLOCKS; i++) {
+	b = &r->blocks[i];
+	b->alloc = memory_alloc(RECORD_BLOCK_SIZE + RECORD_ALIGNMENT);
+	b->data = (unsigned char *) b->alloc + (RECORD_ALIGNMENT -
+	    (uintptr_t) b->alloc % RECORD_ALIGNMENT);
+	async_buffer_write(r->free, &b, sizeof b);
+    }
+
+    if (pthread_create(&r->writer, NULL, record_writer, r) != 0) {
+	fprintf(stderr, "record: can't create writer thread\n");
+	if (r->fd != STDOUT_FILENO)
+	    close(r->fd);
+	for (i = 0; i < RECORD_NBLOCKS; i++)
+	    memory_free(r->blocks[i].alloc);
+	async_buffer_delete(r->full);
+	async_buffer_delete(r->free);
+	memory_free(r);
+	return NULL;
+    }
+
+    r->radio = radio;
+    r->name = memory_strdup(name);
+    r->desc = signal_desc_new();
+    r->start = time(NULL);
+    gettimeofday(&r->t0, NULL);
+    r->dropped_base = radio->m->get_dropped_samples(radio);
+    r->dropped = 0;
+    r->nsamples = 0;
+    r->block = record_pop_free(r);
+
+    return r;
+}
+
+/*
+ * Queues n samples of the radio, in encoding, which must stay the same.
+ * Returns -1 once writing has failed, which record_delete() tells.
+ */
+int
+record_write(struct record *r, const void *samples, size_t n, int encoding) {
+    const unsigned char *data = samples;
+    size_t len;
+    unsigned long long d;
+
+    if (__atomic_load_n(&r->error, __ATOMIC_RELAXED) != 0)
+	return -1;
+
+    if (r->encoding == 0) {
+	r->encoding = encoding;
+	r->sample_size = sample_encoding_size(encoding);
+    }
+
+    /* Blocks are always filled up, wherever samples fall */
+    len = n * r->sample_size;
+    while (len != 0) {
+	struct record_block *b = r->block;
+	size_t chunk = RECORD_BLOCK_SIZE - b->len;
+
+	if (chunk > len)
+	    chunk = len;
+	memcpy(b->data + b->len, data, chunk);
+	b->len += chunk;
+	data += chunk;
+	len -= chunk;
+
+	if (b->len == RECORD_BLOCK_SIZE) {
+	    record_push(r, b);
+	    r->block = record_pop_free(r);
+	}
+    }
+
+    /* Lost before these samples, so ahead of the first */
+    d = r->radio->m->get_dropped_samples(r->radio) - r->dropped_base;
+    if (d != r->dropped) {
+	struct signal_annotation *a =
+	    signal_desc_add_annotation(r->desc, r->nsamples, 1, "dropped");
+	char *comment = memory_alloc(64);
+
+	snprintf(comment, 64, "%llu samples lost", d - r->dropped);
+	a->comment = comment;
+	fprintf(stderr, "record: %llu samples dropped at sample %"
+	    PRIu64 "\n", d - r->dropped, r->nsamples);
+	r->dropped = d;
+    }
+    r->nsamples += n;
+
+    return 0;
+}
+
+/*
+ * Ends the recording and writes its metadata alongside.  Returns -1 if
+ * anything was lost.
+ */
+int
+record_delete(struct record *r) {
+    struct timeval t1;
+    double elapsed;
+    int status = 0;
+    unsigned int i;
+
+    if (r->block->len != 0)
+	record_push(r, r->block);
+    if (record_finish(r) == -1)
+	status = -1;
+
+    gettimeofday(&t1, NULL);
+    elapsed = (t1.tv_sec - r->t0.tv_sec) +
+	(t1.tv_usec - r->t0.tv_usec) / 1e6;
+    fprintf(stderr, "record: %" PRIu64 " samples in %.1fs (%.1fMB/s), "
+	"%llu dropped\n", r->nsamples, elapsed, elapsed > 0?
+	r->nsamples * r->sample_size / elapsed / 1e6 : 0, r->dropped);
+    if (r->iqz != NULL && r->nsamples != 0)
+	fprintf(stderr, "record: compressed to %.1f%%\n",
+	    100.0 * r->written / (r->nsamples * r->sample_size));
+
+    if (r->iqz != NULL)
+	r->desc->flags |= SIGNAL_DESC_COMPRESSED;
+    if (strcmp(r->name, "-") != 0 && r->encoding != 0)
+	record_write_metadata(r->radio, r->name, r->encoding, r->desc,
+	    r->start);
+
+    for (i = 0; i < RECORD_NBLOCKS; i++)
+	memory_free(r->blocks[i].alloc);
+    async_buffer_delete(r->full);
+    async_buffer_delete(r->free);
+    signal_desc_delete(r->desc);
+    memory_free(r->name);
+    memory_free(r);
+
+    return status;
+}
+
+static ssize_t
+record_apply(struct transformer_type *type, void *dest, size_t dest_size,
+			    const void *src, size_t src_size, void *aux) {
+    struct record *r = aux;
+
+    (void) dest;
+    (void) dest_size;
+
+    if (record_write(r, src, src_size / type->input_elem_size,
+	    r->encoding) == -1)
+	return -1;
+
+    return 0;
+}
+
+/*
+ * Sink recording samples in encoding, as a radio transformer gives them.
+ * Dropped samples are noticed when written, up to the depth of the
+ * pipeline late.  One per recording.
+ */
+struct transformer *
+record_transformer_new(struct record *r, int encoding) {
+    r->encoding = encoding;
+    r->sample_size = sample_encoding_size(encoding);
+
+    r->type.name = "record";
+    r->type.input_elem_size = r->sample_size;
+    r->type.output_elem_size = 0;
+    r->type.input_chunk_max_size = TRANSFORMER_CHUNK_SIZE_UNLIMITED;
+    r->type.output_chunk_max_size = 0;
+    r->type.apply = record_apply;
+
+    return transformer_new(&r->type, r);
+}
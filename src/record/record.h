@@ -0,0 +1,30 @@
+/*
+ * Recording of samples as they come, in the radio's own encoding, with
+ * SigMF metadata alongside
+ */
+#ifndef RECORD_RECORD_H_
+#define RECORD_RECORD_H_
+
+#include <stddef.h>
+
+struct radio;
+struct record;
+struct transformer;
+
+/* Blocks queued between the radio and the disk, 128MB in all */
+#define RECORD_NBLOCKS		16
+#define RECORD_BLOCK_SIZE	(8 * 1024 * 1024)
+
+/* O_DIRECT transfers are multiples of this, from addresses aligned so */
+#define RECORD_ALIGNMENT	4096
+
+/* The file is grown ahead of the data by this much */
+#define RECORD_PREALLOCATION	(1024 * 1024 * 1024)
+
+struct record *record_new(struct radio *, const char *, int flags);
+#define RECORD_COMPRESS		0x01	/* as a signal/iqz.h file */
+int record_write(struct record *, const void *, size_t, int);
+int record_delete(struct record *);
+struct transformer *record_transformer_new(struct record *, int);
+
+#endif /* RECORD_RECORD_H_ */
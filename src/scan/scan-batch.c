@@ -0,0 +1,446 @@
+#include <scan/scan-batch.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include <radio/radio-file.h>
+#include <scan/scan-detector.h>
+#include <scan/scan-output.h>
+#include <util/memory.h>
+#include <util/thread-pool.h>
+
+/*
+ * Segments are read from this many frames before their start: learning
+ * over SCAN_BACKLOG_SIZE frames gets the noise level of bins out of
+ * signals there, and SCAN_DECISION_SIZE + 1 quiet frames find the bins
+ * in signals.  Those are left to the segment before, which follows its
+ * signals past its end until they are over, where the learning would
+ * have taken them for noise.
+ */
+#define SCAN_BATCH_OVERLAP	(SCAN_BACKLOG_SIZE + SCAN_DECISION_SIZE + 1)
+
+struct scan_batch_file {
+    const char *name;
+    uint64_t nsamples;
+    unsigned long rate;
+    int dated;
+    double start_time;			/* of sample 0, since the epoch */
+};
+
+struct scan_batch_hit {
+    struct scan_hit hit;
+    size_t file;
+    size_t order;			/* file, or 0 if all are dated */
+    double time;			/* since the epoch if dated */
+};
+
+struct scan_batch_detection {
+    struct scan_output_record record;
+    size_t order;
+};
+
+struct scan_batch_segment {
+    struct scan_batch *batch;
+    size_t file;
+    uint64_t start;
+    uint64_t end;			/* 0 for that of the file */
+    struct scan_batch_hit *hits;
+    size_t nhits;
+    size_t hits_size;
+    struct scan_batch_detection *detections;
+    size_t ndetections;
+    size_t detections_size;
+    int error;
+};
+
+struct scan_batch {
+    const struct scan_batch_params *params;
+    struct scan_batch_file *files;
+    size_t nfiles;
+    int dated;				/* all files are */
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    size_t ndone;
+};
+
+static int scan_batch_open_file(struct scan_batch *,
+	struct scan_batch_file *);
+static void scan_batch_add_hit(void *, const struct scan_hit *);
+static void scan_batch_add_detection(void *, const struct scan_detection *);
+static void scan_batch_task(void *);
+static int scan_batch_compare(const void *, const void *);
+static int scan_batch_detection_compare(const void *, const void *);
+static void scan_batch_print(struct scan_batch *,
+	const struct scan_batch_hit *);
+static void scan_batch_print_hits(struct scan_batch *,
+	struct scan_batch_segment *, size_t);
+static int scan_batch_write_detections(struct scan_batch *,
+	struct scan_batch_segment *, size_t, const char *const *);
+
+/*
+ * Takes what the scan needs to know of the file before it is split.
+ */
+static int
+scan_batch_open_file(struct scan_batch *b, struct scan_batch_file *f) {
+    struct radio *radio = radio_file_open(f->name, b->params->encoding);
+    const struct signal_desc *desc;
+    int status = -1;
+
+    if (radio == NULL) {
+	fprintf(stderr, "%s: can't open file\n", f->name);
+	return -1;
+    }
+    desc = radio_file_get_signal_desc(radio);
+
+    if (radio_file_get_nsamples(radio, &f->nsamples) == -1) {
+	fprintf(stderr, "%s: unknown length or encoding\n", f->name);
+	goto out;
+    }
+
+    f->rate = b->params->sample_rate;
+    if (f->rate == 0 && desc != NULL &&
+	    (desc->flags & SIGNAL_DESC_HAVE_SAMPLE_RATE))
+	f->rate = desc->sample_rate;
+    if (f->rate == 0) {
+	fprintf(stderr, "%s: unknown sample rate\n", f->name);
+	goto out;
+    }
+
+    f->dated = 0;
+    if (desc != NULL && desc->ncaptures != 0 &&
+	    signal_capture_get_time(&desc->captures[0],
+		&f->start_time) == 0) {
+	f->start_time -= (double) desc->captures[0].sample_start / f->rate;
+	f->dated = 1;
+    }
+    status = 0;
+
+out:
+    radio->m->close(radio);
+    return status;
+}
+
+static void
+scan_batch_add_hit(void *arg, const struct scan_hit *h) {
+    struct scan_batch_segment *s = arg;
+    const struct scan_batch_file *f = &s->batch->files[s->file];
+    struct scan_batch_hit *bh;
+
+    if (s->nhits == s->hits_size) {
+	s->hits_size = s->hits_size == 0? 64 : s->hits_size * 2;
+	s->hits = memory_realloc(s->hits, sizeof *s->hits * s->hits_size);
+    }
+
+    bh = &s->hits[s->nhits++];
+    bh->hit = *h;
+    bh->file = s->file;
+    bh->order = s->batch->dated? 0 : s->file;
+    bh->time = (double) h->sample / f->rate;
+    if (s->batch->dated)
+	bh->time += f->start_time;
+}
+
+static void
+scan_batch_add_detection(void *arg, const struct scan_detection *det) {
+    struct scan_batch_segment *s = arg;
+    const struct scan_batch_file *f = &s->batch->files[s->file];
+    struct scan_batch_detection *bd;
+
+    if (s->ndetections == s->detections_size) {
+	s->detections_size = s->detections_size == 0? 64 :
+	    s->detections_size * 2;
+	s->detections = memory_realloc(s->detections,
+	    sizeof *s->detections * s->detections_size);
+    }
+
+    bd = &s->detections[s->ndetections++];
+    bd->record.detection = *det;
+    bd->record.time = (double) det->start / f->rate;
+    if (s->batch->dated)
+	bd->record.time += f->start_time;
+    bd->record.duration = (double) (det->end - det->start) / f->rate;
+    bd->record.file = s->file;
+    bd->order = s->batch->dated? 0 : s->file;
+}
+
+/*
+ * The tuner frequency is that of the capture the segment starts in,
+ * unless the user gave one.
+ */
+static void
+scan_batch_task(void *arg) {
+    struct scan_batch_segment *s = arg;
+    struct scan_batch *b = s->batch;
+    const struct scan_batch_file *f = &b->files[s->file];
+    const struct signal_desc *desc;
+    const struct signal_capture *c = NULL;
+    struct scan_detector *d = NULL;
+    t_frequency tune = b->params->frequency;
+    uint64_t first = s->start, nquiet = 0;
+    struct radio *radio;
+
+    if (s->start != 0) {
+	first = s->start -
+	    SCAN_BATCH_OVERLAP * scan_params_get_frame_step(&b->params->scan);
+	nquiet = SCAN_DECISION_SIZE + 1;
+    }
+
+    radio = radio_file_open(f->name, b->params->encoding);
+    if (radio == NULL || radio->m->seek(radio, first) == -1) {
+	s->error = 1;
+	goto out;
+    }
+
+    desc = radio_file_get_signal_desc(radio);
+    if (desc != NULL)
+	c = signal_desc_capture_at(desc, s->start);
+    if (tune == 0 && c != NULL && (c->flags & SIGNAL_CAPTURE_HAVE_FREQUENCY))
+	tune = c->frequency;
+
+    d = scan_detector_new(&b->params->scan, tune, f->rate);
+    if (d == NULL)
+	s->error = 1;
+    else if (b->params->output == SCAN_OUTPUT_TEXT) {
+	if (scan_detector_run(d, radio, first, nquiet, s->end,
+		scan_batch_add_hit, NULL, s) == -1)
+	    s->error = 1;
+    } else if (scan_detector_run(d, radio, first, nquiet, s->end, NULL,
+	    scan_batch_add_detection, s) == -1)
+	s->error = 1;
+
+out:
+    if (d != NULL)
+	scan_detector_delete(d);
+    if (radio != NULL)
+	radio->m->close(radio);
+
+    pthread_mutex_lock(&b->mtx);
+    b->ndone++;
+    pthread_cond_signal(&b->cond);
+    pthread_mutex_unlock(&b->mtx);
+}
+
+/*
+ * In time, files taken in the order given unless they are all dated,
+ * then in frequency.
+ */
+static int
+scan_batch_compare(const void *p1, const void *p2) {
+    const struct scan_batch_hit *h1 = p1, *h2 = p2;
+
+    if (h1->order != h2->order)
+	return h1->order < h2->order? -1 : 1;
+    if (h1->time != h2->time)
+	return h1->time < h2->time? -1 : 1;
+    if (h1->hit.frequency != h2->hit.frequency)
+	return h1->hit.frequency < h2->hit.frequency? -1 : 1;
+    if (h1->file != h2->file)
+	return h1->file < h2->file? -1 : 1;
+
+    return 0;
+}
+
+static int
+scan_batch_detection_compare(const void *p1, const void *p2) {
+    const struct scan_batch_detection *d1 = p1, *d2 = p2;
+
+    if (d1->order != d2->order)
+	return d1->order < d2->order? -1 : 1;
+    if (d1->record.time != d2->record.time)
+	return d1->record.time < d2->record.time? -1 : 1;
+    if (d1->record.detection.low != d2->record.detection.low)
+	return d1->record.detection.low < d2->record.detection.low? -1 : 1;
+    if (d1->record.file != d2->record.file)
+	return d1->record.file < d2->record.file? -1 : 1;
+
+    return 0;
+}
+
+/*
+ * As scan_main_loop() prints them, with the time in the recording and
+ * the file name.
+ */
+static void
+scan_batch_print(struct scan_batch *b, const struct scan_batch_hit *h) {
+    char timestamp_string[100];
+    char *hfreq = frequency_human_print(h->hit.frequency);
+
+    if (b->dated) {
+	time_t timestamp = h->time;
+
+	strftime(timestamp_string, sizeof timestamp_string,
+	    "%F %T", localtime(&timestamp));
+    } else
+	snprintf(timestamp_string, sizeof timestamp_string, "%.6fs",
+	    h->time);
+
+    printf("%-9s %s %llu %4.1f %s\n", hfreq, timestamp_string,
+	(unsigned long long) h->hit.file_offset, h->hit.level_db,
+	b->files[h->file].name);
+    memory_free(hfreq);
+}
+
+/*
+ * Prints the hits of all segments in order, and frees them.
+ */
+static void
+scan_batch_print_hits(struct scan_batch *b,
+		    struct scan_batch_segment *segments, size_t nsegments) {
+    struct scan_batch_hit *hits;
+    size_t nhits = 0, i, j;
+
+    for (j = 0; j < nsegments; j++)
+	nhits += segments[j].nhits;
+
+    hits = memory_alloc(sizeof *hits * (nhits + 1));
+    nhits = 0;
+    for (j = 0; j < nsegments; j++) {
+	for (i = 0; i < segments[j].nhits; i++)
+	    hits[nhits++] = segments[j].hits[i];
+	if (segments[j].hits != NULL)
+	    memory_free(segments[j].hits);
+    }
+
+    qsort(hits, nhits, sizeof *hits, scan_batch_compare);
+    for (i = 0; i < nhits; i++)
+	scan_batch_print(b, &hits[i]);
+
+    memory_free(hits);
+}
+
+/*
+ * Writes the detections of all segments in the same order as hits, and
+ * frees them.  Returns -1 if the output failed.
+ */
+static int
+scan_batch_write_detections(struct scan_batch *b,
+		    struct scan_batch_segment *segments, size_t nsegments,
+		    const char *const *names) {
+    struct scan_batch_detection *detections;
+    struct scan_output *output;
+    size_t ndetections = 0, i, j;
+
+    for (j = 0; j < nsegments; j++)
+	ndetections += segments[j].ndetections;
+
+    detections = memory_alloc(sizeof *detections * (ndetections + 1));
+    ndetections = 0;
+    for (j = 0; j < nsegments; j++) {
+	for (i = 0; i < segments[j].ndetections; i++)
+	    detections[ndetections++] = segments[j].detections[i];
+	if (segments[j].detections != NULL)
+	    memory_free(segments[j].detections);
+    }
+
+    qsort(detections, ndetections, sizeof *detections,
+	scan_batch_detection_compare);
+    output = scan_output_new(b->params->output, stdout, names);
+    for (i = 0; i < ndetections; i++)
+	scan_output_write(output, &detections[i].record);
+
+    memory_free(detections);
+
+    return scan_output_delete(output);
+}
+
+/*
+ * Scans the nnames recordings, segments of all of them at once, and prints
+ * the hits, or writes the detections, once done.  Returns -1 if any could
+ * not be scanned.
+ */
+int
+scan_batch(const char *const *names, size_t nnames,
+				    const struct scan_batch_params *params) {
+    struct scan_batch b;
+    struct scan_batch_segment *segments;
+    struct thread_pool *pool;
+    size_t nsegments = 0, i, j;
+    uint64_t step = scan_params_get_frame_step(&params->scan);
+    uint64_t segment, start;
+    int status = 0;
+
+    b.params = params;
+    b.nfiles = nnames;
+    b.files = memory_alloc(sizeof *b.files * nnames);
+    b.dated = 1;
+    b.ndone = 0;
+
+    for (i = 0; i < nnames; i++) {
+	b.files[i].name = names[i];
+	if (scan_batch_open_file(&b, &b.files[i]) == -1) {
+	    memory_free(b.files);
+	    return -1;
+	}
+	b.dated &= b.files[i].dated;
+    }
+
+    segment = params->segment_nsamples;
+    if (segment == 0)
+	segment = SCAN_BATCH_SEGMENT;
+
+    /* In whole frames, laid as a scan from the start would */
+    segment += step - 1;
+    segment -= segment % step;
+    if (segment < SCAN_BATCH_OVERLAP * step)
+	segment = SCAN_BATCH_OVERLAP * step;
+
+    for (i = 0; i < nnames; i++)
+	nsegments += (b.files[i].nsamples + segment - 1) / segment;
+    segments = memory_alloc(sizeof *segments * (nsegments + 1));
+
+    j = 0;
+    for (i = 0; i < nnames; i++)
+	for (start = 0; start < b.files[i].nsamples; start += segment) {
+	    struct scan_batch_segment *s = &segments[j++];
+
+	    s->batch = &b;
+	    s->file = i;
+	    s->start = start;
+	    s->end = start + segment < b.files[i].nsamples?
+		start + segment : 0;
+	    s->hits = NULL;
+	    s->nhits = 0;
+	    s->hits_size = 0;
+	    s->detections = NULL;
+	    s->ndetections = 0;
+	    s->detections_size = 0;
+	    s->error = 0;
+	}
+
+    pthread_mutex_init(&b.mtx, NULL);
+    pthread_cond_init(&b.cond, NULL);
+    pool = thread_pool_new(thread_pool_default_nthreads());
+    for (j = 0; j < nsegments; j++)
+	thread_pool_submit(pool, scan_batch_task, &segments[j]);
+
+    pthread_mutex_lock(&b.mtx);
+    while (b.ndone != nsegments)
+	pthread_cond_wait(&b.cond, &b.mtx);
+    pthread_mutex_unlock(&b.mtx);
+    thread_pool_delete(pool);
+    pthread_mutex_destroy(&b.mtx);
+    pthread_cond_destroy(&b.cond);
+
+    for (j = 0; j < nsegments; j++) {
+	if (segments[j].error) {
+	    fprintf(stderr, "%s: scan failed from sample %llu\n",
+		b.files[segments[j].file].name,
+		(unsigned long long) segments[j].start);
+	    status = -1;
+	}
+    }
+
+    if (params->output == SCAN_OUTPUT_TEXT)
+	scan_batch_print_hits(&b, segments, nsegments);
+    else if (scan_batch_write_detections(&b, segments, nsegments,
+	    names) == -1)
+	status = -1;
+
+    memory_free(segments);
+    memory_free(b.files);
+
+    return status;
+}
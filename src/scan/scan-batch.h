@@ -0,0 +1,31 @@
+/*
+ * Scan of recordings split in segments, on all cores
+ */
+#ifndef SCAN_SCAN_BATCH_H_
+#define SCAN_SCAN_BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <common/frequency.h>
+#include <scan/scan-detector.h>
+
+/* Samples per segment unless given, whatever the number of cores */
+#define SCAN_BATCH_SEGMENT	(4 * 1024 * 1024)
+
+/*
+ * What is 0 is taken from each recording's metadata, or picked.
+ */
+struct scan_batch_params {
+    int encoding;
+    unsigned long sample_rate;
+    t_frequency frequency;
+    struct scan_params scan;
+    uint64_t segment_nsamples;
+    int output;				/* SCAN_OUTPUT_* */
+};
+
+int scan_batch(const char *const *, size_t,
+	const struct scan_batch_params *);
+
+#endif /* SCAN_SCAN_BATCH_H_ */
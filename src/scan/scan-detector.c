@@ -0,0 +1,767 @@
+#include <scan/scan-detector.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <radio/radio.h>
+#include <signal/transformer.h>
+#include <signal/transformer-type.h>
+#include <util/memory.h>
+#include <util/thread-pool.h>
+
+/*
+ * A bin entering or leaving a signal.  SNRs are in times the limit.
+ */
+struct scan_detector_event {
+    uint64_t frame;
+    unsigned int bin;
+    int rising;
+    double level_db;			/* rising, above noise */
+    float peak;				/* leaving, over the signal */
+    float snr_sum;			/* over its frames above noise */
+    uint32_t nabove;
+};
+
+/*
+ * Adjacent bins entering a signal in the same frame, followed until all
+ * have left it.  Frames are those of the first and last above noise.
+ */
+struct scan_detector_group {
+    uint64_t start;
+    uint64_t end;
+    unsigned int first_bin;
+    unsigned int last_bin;
+    unsigned int nopen;			/* bins still in the signal */
+    float peak;
+    double snr_sum;
+    uint64_t nabove;
+};
+
+/*
+ * Tracks its own range of bins over the segments of a batch, so that
+ * shards never share a bin and need no lock.
+ */
+struct scan_detector_shard {
+    struct scan_detector *d;
+    unsigned int first_bin;
+    unsigned int end_bin;
+    unsigned int nrows;			/* segments of the batch */
+    unsigned char *changes;		/* SCAN_DETECTOR_RISING... */
+#define SCAN_DETECTOR_RISING	0x1
+#define SCAN_DETECTOR_FALLING	0x2
+    struct scan_detector_event *events;
+    size_t nevents;
+    size_t events_size;
+};
+
+struct scan_detector {
+    t_frequency tune;
+    unsigned long rate;
+    double threshold;			/* in power */
+    unsigned int naverage;
+    unsigned long frame_step;
+    unsigned int size;
+    struct spectrum *spectrum;
+    float *frame_sum;			/* of the frame in progress */
+    unsigned int nsegments;		/* in it so far */
+    uint64_t nframes;			/* done */
+    uint64_t nquiet;
+    struct scan_detector_shard *shards;
+    unsigned int nshards;
+
+    /*
+     * Bin state, an array each so that a frame runs through them in
+     * order.  values has a row of size per frame of the backlog.
+     */
+    float *values;			/* power */
+    double *noise;			/* sum of values */
+    float *limit;			/* threshold times noise level */
+    unsigned char *inside;		/* in a signal */
+    unsigned char *nbelow;		/* frames below noise, capped */
+    float *peak;			/* of the signal, to the limit */
+    float *snr_sum;			/* over its frames above noise */
+    uint32_t *nabove;
+
+    /* Signals followed, for detections, by group index + 1 per bin */
+    unsigned int *group;
+    struct scan_detector_group *groups;
+    size_t ngroups;
+    size_t *free_groups;
+    size_t nfree_groups;
+
+    /* Of the run in progress */
+    uint64_t first;			/* sample of frame 0 */
+    off_t first_offset;			/* in the file, of sample first */
+    off_t per_sample;			/* file bytes */
+    uint64_t end_frame;			/* the first taking up no signals */
+    void (*hit)(void *, const struct scan_hit *);
+    void (*detection)(void *, const struct scan_detection *);
+    void *arg;
+};
+
+static t_frequency scan_bin_to_frequency(t_frequency, t_frequency, int,
+	int);
+static unsigned char scan_detector_compare_bins(unsigned int,
+	const float *restrict, float, const float *restrict,
+	unsigned char *restrict, unsigned char *restrict, float *restrict,
+	float *restrict, uint32_t *restrict, unsigned char *restrict);
+static unsigned char scan_detector_compare(struct scan_detector_shard *,
+	unsigned int, unsigned int, const float *);
+static void scan_detector_events(struct scan_detector_shard *,
+	unsigned int, unsigned int, uint64_t, const float *);
+static void scan_detector_frame(struct scan_detector_shard *, uint64_t,
+	const float *);
+static void scan_detector_shard_run(void *);
+static int scan_detector_event_compare(const void *, const void *);
+static void scan_detector_open(struct scan_detector *,
+	const struct scan_detector_event *);
+static void scan_detector_close(struct scan_detector *,
+	const struct scan_detector_event *);
+static void scan_detector_report(struct scan_detector *, size_t);
+static void scan_detector_rows(struct scan_detector *, unsigned int);
+static void scan_detector_finish(struct scan_detector *);
+static ssize_t scan_detector_apply(struct transformer_type *, void *,
+	size_t, const void *, size_t, void *);
+
+static struct transformer_type scan_detector_type = {
+    .name = "scan detector",
+    .input_elem_size = sizeof (struct samplef),
+    .output_elem_size = 0,
+    .input_chunk_max_size = TRANSFORMER_CHUNK_SIZE_UNLIMITED,
+    .output_chunk_max_size = 0,
+    .apply = scan_detector_apply,
+};
+
+static t_frequency
+scan_bin_to_frequency(t_frequency tune, t_frequency rate, int nbins, int bin) {
+    if (bin >= nbins / 2)
+	bin = bin - nbins;
+
+    return tune + (double) bin * rate / nbins;
+}
+
+/*
+ * Samples between the starts of two frames.
+ */
+unsigned long
+scan_params_get_frame_step(const struct scan_params *params) {
+    return (unsigned long) params->naverage *
+	(params->spectrum.size - params->spectrum.overlap);
+}
+
+/*
+ * Returns NULL if the spectrum can't be made.  Bins are split between as
+ * many shards as the spectrum has threads.
+ */
+struct scan_detector *
+scan_detector_new(const struct scan_params *params, t_frequency tune,
+							unsigned long rate) {
+    struct scan_detector *d;
+    struct thread_pool *pool;
+    size_t nvalues;
+    unsigned int i;
+
+    if (params->naverage == 0)
+	return NULL;
+
+    d = memory_alloc(sizeof *d);
+    d->tune = tune;
+    d->rate = rate;
+    d->threshold = pow(10, params->threshold_db / 10);
+    d->naverage = params->naverage;
+    d->frame_step = scan_params_get_frame_step(params);
+    d->size = params->spectrum.size;
+    d->nsegments = 0;
+    d->nframes = 0;
+    d->nquiet = 0;
+
+    d->spectrum = spectrum_new(&params->spectrum);
+    if (d->spectrum == NULL) {
+	memory_free(d);
+	return NULL;
+    }
+    d->frame_sum = memory_alloc(sizeof *d->frame_sum * d->size);
+
+    pool = spectrum_get_pool(d->spectrum);
+    d->nshards = pool != NULL? thread_pool_get_nthreads(pool) : 1;
+    if (d->nshards > d->size)
+	d->nshards = d->size;
+    d->shards = memory_alloc(sizeof *d->shards * d->nshards);
+    for (i = 0; i < d->nshards; i++) {
+	struct scan_detector_shard *sh = &d->shards[i];
+
+	sh->d = d;
+	sh->first_bin = (uint64_t) d->size * i / d->nshards;
+	sh->end_bin = (uint64_t) d->size * (i + 1) / d->nshards;
+	sh->changes = memory_alloc(sh->end_bin - sh->first_bin);
+	sh->events = NULL;
+	sh->nevents = 0;
+	sh->events_size = 0;
+    }
+
+    nvalues = (size_t) SCAN_BACKLOG_SIZE * d->size;
+    d->values = memory_alloc(sizeof *d->values * nvalues);
+    d->noise = memory_alloc(sizeof *d->noise * d->size);
+    d->limit = memory_alloc(sizeof *d->limit * d->size);
+    d->inside = memory_alloc(d->size);
+    d->nbelow = memory_alloc(d->size);
+    d->peak = memory_alloc(sizeof *d->peak * d->size);
+    d->snr_sum = memory_alloc(sizeof *d->snr_sum * d->size);
+    d->nabove = memory_alloc(sizeof *d->nabove * d->size);
+    d->group = memory_alloc(sizeof *d->group * d->size);
+    for (i = 0; i < nvalues; i++)
+	d->values[i] = 0;
+    for (i = 0; i < d->size; i++) {
+	d->noise[i] = 0;
+	d->limit[i] = 0;
+	d->peak[i] = 0;
+	d->snr_sum[i] = 0;
+	d->nabove[i] = 0;
+	d->group[i] = 0;
+    }
+    d->groups = NULL;
+    d->ngroups = 0;
+    d->free_groups = NULL;
+    d->nfree_groups = 0;
+    memset(d->inside, 0, d->size);
+    memset(d->nbelow, 0, d->size);
+
+    return d;
+}
+
+void
+scan_detector_delete(struct scan_detector *d) {
+    unsigned int i;
+
+    for (i = 0; i < d->nshards; i++) {
+	memory_free(d->shards[i].changes);
+	if (d->shards[i].events != NULL)
+	    memory_free(d->shards[i].events);
+    }
+    memory_free(d->shards);
+    spectrum_delete(d->spectrum);
+    memory_free(d->frame_sum);
+    memory_free(d->values);
+    memory_free(d->noise);
+    memory_free(d->limit);
+    memory_free(d->inside);
+    memory_free(d->nbelow);
+    memory_free(d->peak);
+    memory_free(d->snr_sum);
+    memory_free(d->nabove);
+    memory_free(d->group);
+    if (d->groups != NULL) {
+	memory_free(d->groups);
+	memory_free(d->free_groups);
+    }
+    memory_free(d);
+}
+
+/*
+ * The loop of scan_detector_compare(), over arrays declared not to
+ * overlap: free of branches and of aliasing, it can be vectorized.
+ */
+static unsigned char
+scan_detector_compare_bins(unsigned int n, const float *restrict sum,
+	float naverage, const float *restrict limit,
+	unsigned char *restrict inside, unsigned char *restrict nbelow,
+	float *restrict peak, float *restrict snr_sum,
+	uint32_t *restrict nabove, unsigned char *restrict changes) {
+    unsigned char any = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+	float level = sum[i] / naverage;
+	float snr = level / limit[i];
+	unsigned char above = level >= limit[i];
+	unsigned char below = above? 0 : nbelow[i] + 1;
+	unsigned char was_inside = inside[i];
+	unsigned char rising, falling;
+
+	if (below > SCAN_DECISION_SIZE + 1)
+	    below = SCAN_DECISION_SIZE + 1;
+	nbelow[i] = below;
+	inside[i] = above | (was_inside & (below <= SCAN_DECISION_SIZE));
+	rising = above & !was_inside;
+	falling = was_inside & !inside[i];
+
+	peak[i] = (rising | (above & (snr > peak[i])))? snr : peak[i];
+	snr_sum[i] = (rising? 0 : snr_sum[i]) + (above? snr : 0);
+	nabove[i] = nabove[i] * !rising + above;
+
+	changes[i] = rising * SCAN_DETECTOR_RISING |
+	    falling * SCAN_DETECTOR_FALLING;
+	any |= changes[i];
+    }
+
+    return any;
+}
+
+/*
+ * Compares bins from first to end to their limit, and updates
+ * whether they are in a signal, a bin leaving one after more than
+ * SCAN_DECISION_SIZE frames below noise, and the SNR of the signal.
+ * Marks those entering or leaving one in the shard's changes, and
+ * returns non-zero if there are any.
+ */
+static unsigned char
+scan_detector_compare(struct scan_detector_shard *sh, unsigned int first,
+					unsigned int end, const float *sums) {
+    struct scan_detector *d = sh->d;
+
+    return scan_detector_compare_bins(end - first, sums + first,
+	d->naverage, d->limit + first, d->inside + first, d->nbelow + first,
+	d->peak + first, d->snr_sum + first, d->nabove + first,
+	sh->changes + (first - sh->first_bin));
+}
+
+/*
+ * Records an event for each bin from first to end entering or leaving a
+ * signal, before the noise levels take in the frame.
+ */
+static void
+scan_detector_events(struct scan_detector_shard *sh, unsigned int first,
+			unsigned int end, uint64_t frame, const float *sums) {
+    struct scan_detector *d = sh->d;
+    unsigned int i;
+
+    for (i = first; i < end; i++) {
+	unsigned char change = sh->changes[i - sh->first_bin];
+	struct scan_detector_event *e;
+
+	if (change == 0)
+	    continue;
+
+	if (sh->nevents == sh->events_size) {
+	    sh->events_size = sh->events_size == 0? 64 :
+		sh->events_size * 2;
+	    sh->events = memory_realloc(sh->events,
+		sizeof *sh->events * sh->events_size);
+	}
+	e = &sh->events[sh->nevents++];
+	e->frame = frame;
+	e->bin = i;
+	e->rising = change == SCAN_DETECTOR_RISING;
+	if (e->rising) {
+	    float level = sums[i] / d->naverage;
+
+	    e->level_db =
+		10 * log10(level / (d->noise[i] / SCAN_BACKLOG_SIZE));
+	} else {
+	    e->peak = d->peak[i];
+	    e->snr_sum = d->snr_sum[i];
+	    e->nabove = d->nabove[i];
+	}
+    }
+}
+
+/*
+ * Processes the shard's bins of a frame of the given sums, the first
+ * SCAN_BACKLOG_SIZE frames only learning noise levels, and the nquiet
+ * after only tracking bins in and out of signals.  Levels above the
+ * limit are left out of the noise level, which holds while a signal
+ * lasts rather than rising to it and ending it early.  The DC bin is
+ * left out.
+ */
+static void
+scan_detector_frame(struct scan_detector_shard *sh, uint64_t frame,
+							const float *sums) {
+    struct scan_detector *d = sh->d;
+    int learning = frame < SCAN_BACKLOG_SIZE;
+    int report = frame >= SCAN_BACKLOG_SIZE + d->nquiet;
+    float *values = d->values + (size_t) (frame % SCAN_BACKLOG_SIZE) * d->size;
+    float naverage = d->naverage;
+    double threshold = d->threshold;
+    unsigned int first = sh->first_bin != 0? sh->first_bin : 1;
+    unsigned int i;
+
+    if (first >= sh->end_bin)
+	return;
+
+    if (!learning && scan_detector_compare(sh, first, sh->end_bin, sums) &&
+	    report)
+	scan_detector_events(sh, first, sh->end_bin, frame, sums);
+
+    for (i = first; i < sh->end_bin; i++) {
+	float level = sums[i] / naverage;
+
+	if (!learning && level >= d->limit[i])
+	    continue;
+	d->noise[i] = d->noise[i] + level - values[i];
+	values[i] = level;
+	d->limit[i] = threshold * (d->noise[i] / SCAN_BACKLOG_SIZE);
+    }
+}
+
+/*
+ * Adds the shard's bins of each segment of the batch to the frame in
+ * progress, processing frames as they complete.
+ */
+static void
+scan_detector_shard_run(void *arg) {
+    struct scan_detector_shard *sh = arg;
+    struct scan_detector *d = sh->d;
+    unsigned int nsegments = d->nsegments;
+    uint64_t frame = d->nframes;
+    unsigned int i, j;
+
+    for (j = 0; j < sh->nrows; j++) {
+	const float *row = spectrum_get_power(d->spectrum, j);
+
+	if (d->naverage == 1) {
+	    scan_detector_frame(sh, frame++, row);
+	    continue;
+	}
+
+	if (nsegments == 0)
+	    for (i = sh->first_bin; i < sh->end_bin; i++)
+		d->frame_sum[i] = row[i];
+	else
+	    for (i = sh->first_bin; i < sh->end_bin; i++)
+		d->frame_sum[i] += row[i];
+
+	if (++nsegments == d->naverage) {
+	    scan_detector_frame(sh, frame++, d->frame_sum);
+	    nsegments = 0;
+	}
+    }
+}
+
+static int
+scan_detector_event_compare(const void *p1, const void *p2) {
+    const struct scan_detector_event *e1 = p1, *e2 = p2;
+
+    if (e1->frame != e2->frame)
+	return e1->frame < e2->frame? -1 : 1;
+    if (e1->bin != e2->bin)
+	return e1->bin < e2->bin? -1 : 1;
+
+    return 0;
+}
+
+/*
+ * Adds a bin entering a signal to the group of the previous one, if it
+ * is its neighbour entering in the same frame, or to a new group.  Bins
+ * either side of the band's edges are no neighbours.
+ */
+static void
+scan_detector_open(struct scan_detector *d,
+				    const struct scan_detector_event *e) {
+    struct scan_detector_group *g;
+    size_t index;
+
+    if (e->bin > 1 && e->bin != d->size / 2 && d->group[e->bin - 1] != 0) {
+	g = &d->groups[d->group[e->bin - 1] - 1];
+	if (g->start == e->frame && g->last_bin == e->bin - 1) {
+	    g->last_bin = e->bin;
+	    g->nopen++;
+	    d->group[e->bin] = d->group[e->bin - 1];
+	    return;
+	}
+    }
+
+    if (d->nfree_groups != 0)
+	index = d->free_groups[--d->nfree_groups];
+    else {
+	index = d->ngroups++;
+	d->groups = memory_realloc(d->groups,
+	    sizeof *d->groups * d->ngroups);
+	d->free_groups = memory_realloc(d->free_groups,
+	    sizeof *d->free_groups * d->ngroups);
+    }
+
+    g = &d->groups[index];
+    g->start = e->frame;
+    g->end = e->frame;
+    g->first_bin = e->bin;
+    g->last_bin = e->bin;
+    g->nopen = 1;
+    g->peak = 0;
+    g->snr_sum = 0;
+    g->nabove = 0;
+    d->group[e->bin] = index + 1;
+}
+
+/*
+ * Takes in a bin leaving the signal of its group, which is reported
+ * once it was the last one.  Bins which entered before reporting began
+ * belong to none.
+ */
+static void
+scan_detector_close(struct scan_detector *d,
+				    const struct scan_detector_event *e) {
+    struct scan_detector_group *g;
+    size_t index;
+    uint64_t last;
+
+    if (d->group[e->bin] == 0)
+	return;
+    index = d->group[e->bin] - 1;
+    d->group[e->bin] = 0;
+
+    g = &d->groups[index];
+    if (e->peak > g->peak)
+	g->peak = e->peak;
+    g->snr_sum += e->snr_sum;
+    g->nabove += e->nabove;
+    last = e->frame - (SCAN_DECISION_SIZE + 1);
+    if (last > g->end)
+	g->end = last;
+
+    if (--g->nopen == 0)
+	scan_detector_report(d, index);
+}
+
+static void
+scan_detector_report(struct scan_detector *d, size_t index) {
+    const struct scan_detector_group *g = &d->groups[index];
+    struct scan_detection det;
+
+    det.start = d->first + g->start * d->frame_step;
+    det.end = d->first + (g->end + 1) * d->frame_step;
+    det.low = scan_bin_to_frequency(d->tune, d->rate, d->size,
+	g->first_bin);
+    det.high = scan_bin_to_frequency(d->tune, d->rate, d->size,
+	g->last_bin);
+    det.peak_db = 10 * log10(g->peak * d->threshold);
+    det.mean_db = 10 * log10(g->snr_sum / g->nabove * d->threshold);
+
+    /* Bins below 0Hz wrap around */
+    if (det.low < 10e9)
+	d->detection(d->arg, &det);
+
+    d->free_groups[d->nfree_groups++] = index;
+}
+
+/*
+ * Processes the nrows segments just transformed, then handles the events
+ * in frame and bin order, as a single thread would find them.
+ */
+static void
+scan_detector_rows(struct scan_detector *d, unsigned int nrows) {
+    struct scan_detector_event *events;
+    size_t nevents = 0, i, k;
+
+    if (nrows == 0)
+	return;
+
+    for (i = 0; i < d->nshards; i++) {
+	d->shards[i].nrows = nrows;
+	d->shards[i].nevents = 0;
+    }
+    if (d->nshards == 1)
+	scan_detector_shard_run(&d->shards[0]);
+    else
+	thread_pool_run(spectrum_get_pool(d->spectrum),
+	    scan_detector_shard_run, d->shards, d->nshards, sizeof *d->shards);
+
+    d->nframes += (d->nsegments + nrows) / d->naverage;
+    d->nsegments = (d->nsegments + nrows) % d->naverage;
+
+    for (i = 0; i < d->nshards; i++)
+	nevents += d->shards[i].nevents;
+    if (nevents == 0)
+	return;
+
+    events = memory_alloc(sizeof *events * nevents);
+    nevents = 0;
+    for (i = 0; i < d->nshards; i++)
+	for (k = 0; k < d->shards[i].nevents; k++)
+	    events[nevents++] = d->shards[i].events[k];
+    if (d->nshards != 1)
+	qsort(events, nevents, sizeof *events, scan_detector_event_compare);
+
+    for (i = 0; i < nevents; i++) {
+	const struct scan_detector_event *e = &events[i];
+	struct scan_hit h;
+
+	if (!e->rising) {
+	    if (d->detection != NULL)
+		scan_detector_close(d, e);
+	    continue;
+	}
+	if (e->frame >= d->end_frame)
+	    continue;
+	if (d->detection != NULL)
+	    scan_detector_open(d, e);
+	if (d->hit == NULL)
+	    continue;
+
+	h.sample = d->first + e->frame * d->frame_step;
+	h.file_offset = d->first_offset +
+	    d->per_sample * (off_t) (h.sample - d->first);
+	h.frequency = scan_bin_to_frequency(d->tune, d->rate, d->size,
+	    e->bin);
+	h.level_db = e->level_db;
+
+	/* Bins below 0Hz wrap around */
+	if (h.frequency < 10e9)
+	    d->hit(d->arg, &h);
+    }
+
+    memory_free(events);
+}
+
+/*
+ * Reports the signals still going on at the end of the run, as if they
+ * ended there.
+ */
+static void
+scan_detector_finish(struct scan_detector *d) {
+    size_t index;
+    unsigned int i;
+
+    for (index = 0; index < d->ngroups; index++) {
+	struct scan_detector_group *g = &d->groups[index];
+
+	if (g->nopen == 0)
+	    continue;
+
+	for (i = g->first_bin; i <= g->last_bin; i++) {
+	    uint64_t last;
+
+	    if (d->group[i] != index + 1)
+		continue;
+	    d->group[i] = 0;
+	    if (d->peak[i] > g->peak)
+		g->peak = d->peak[i];
+	    g->snr_sum += d->snr_sum[i];
+	    g->nabove += d->nabove[i];
+	    last = d->nframes - 1 - d->nbelow[i];
+	    if (last > g->end)
+		g->end = last;
+	}
+
+	g->nopen = 0;
+	scan_detector_report(d, index);
+    }
+}
+
+/*
+ * Starts a run fed by scan_detector_feed(), the first frame at sample,
+ * which is at first_offset in the file of the radio, and per_sample bytes
+ * from the next one.  Bins entering a signal go to hit and whole signals
+ * to detection, once over, either of which can be NULL.
+ */
+void
+scan_detector_start(struct scan_detector *d, uint64_t sample,
+	off_t first_offset, off_t per_sample,
+	void (*hit)(void *, const struct scan_hit *),
+	void (*detection)(void *, const struct scan_detection *), void *arg) {
+    d->nquiet = 0;
+    d->end_frame = UINT64_MAX;
+    d->first = sample;
+    d->first_offset = first_offset;
+    d->per_sample = per_sample;
+    d->hit = hit;
+    d->detection = detection;
+    d->arg = arg;
+}
+
+void
+scan_detector_feed(struct scan_detector *d, const struct samplef *samples,
+								size_t n) {
+    while (n != 0) {
+	size_t room;
+	struct samplef *in = spectrum_input(d->spectrum, &room);
+
+	if (room > n)
+	    room = n;
+	memcpy(in, samples, room * sizeof *in);
+	scan_detector_rows(d, spectrum_commit(d->spectrum, room));
+	samples += room;
+	n -= room;
+    }
+}
+
+/*
+ * Ends the run, signals in progress included.
+ */
+void
+scan_detector_end(struct scan_detector *d) {
+    scan_detector_rows(d, spectrum_flush(d->spectrum));
+    if (d->detection != NULL)
+	scan_detector_finish(d);
+}
+
+static ssize_t
+scan_detector_apply(struct transformer_type *type, void *dest,
+	size_t dest_size, const void *src, size_t src_size, void *aux) {
+    (void) type;
+    (void) dest;
+    (void) dest_size;
+
+    scan_detector_feed(aux, src, src_size / sizeof (struct samplef));
+
+    return 0;
+}
+
+/*
+ * Sink feeding the detector, between scan_detector_start() and
+ * scan_detector_end().
+ */
+struct transformer *
+scan_detector_transformer_new(struct scan_detector *d) {
+    return transformer_new(&scan_detector_type, d);
+}
+
+/*
+ * Reads frames from radio, the first at sample, until its end or that of
+ * the frame before end (0 for none).  Signals going on there are then
+ * followed until they are over, but none start past it.  Frames past
+ * learning are only reported on after nquiet more, which catch up with
+ * signals already going on, left to the run before.  hit and detection
+ * are as for scan_detector_start().
+ * Returns -1 if reading fails.  Samples are read ahead of the frames, so
+ * their file offsets are worked out from how far reading went.
+ */
+int
+scan_detector_run(struct scan_detector *d, struct radio *r, uint64_t sample,
+	uint64_t nquiet, uint64_t end,
+	void (*hit)(void *, const struct scan_hit *),
+	void (*detection)(void *, const struct scan_detection *), void *arg) {
+    unsigned int step = spectrum_get_step(d->spectrum);
+    uint64_t nread = 0, nwanted = 0;
+
+    scan_detector_start(d, sample, r->m->get_file_position(r), 0, hit,
+	detection, arg);
+    d->nquiet = nquiet;
+
+    /* Up to the end of the last segment of the last frame */
+    if (end != 0) {
+	uint64_t nframes = end > sample?
+	    (end - sample + d->frame_step - 1) / d->frame_step : 0;
+
+	if (nframes == 0)
+	    return 0;
+	nwanted = (nframes * d->naverage - 1) * step + d->size;
+	d->end_frame = nframes;
+    }
+
+    for (;;) {
+	size_t room;
+	struct samplef *in = spectrum_input(d->spectrum, &room);
+	ssize_t ret;
+
+	if (end != 0 && nread >= nwanted) {
+	    if (d->detection == NULL || d->nfree_groups == d->ngroups)
+		break;
+	} else if (end != 0 && room > nwanted - nread)
+	    room = nwanted - nread;
+
+	ret = r->m->read_float(r, in, room);
+	if (ret == -1)
+	    return -1;
+	if (ret == 0)
+	    break;
+	nread += ret;
+	d->per_sample = (r->m->get_file_position(r) - d->first_offset) /
+	    (off_t) nread;
+	scan_detector_rows(d, spectrum_commit(d->spectrum, ret));
+    }
+
+    scan_detector_end(d);
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Detection of signals rising above the noise level learnt in each FFT bin
+ */
+#ifndef SCAN_SCAN_DETECTOR_H_
+#define SCAN_SCAN_DETECTOR_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <common/frequency.h>
+#include <signal/spectrum.h>
+
+struct radio;
+struct scan_detector;
+struct transformer;
+
+/* Frames the noise level is averaged on, the first ones only learn it */
+#define SCAN_BACKLOG_SIZE	10
+
+/* A bin leaves a signal after this many frames below noise */
+#define SCAN_DECISION_SIZE	10
+
+/*
+ * A frame is the average of naverage segments of the spectrum.
+ */
+struct scan_params {
+    struct spectrum_params spectrum;
+    unsigned int naverage;
+    double threshold_db;
+};
+
+/*
+ * A bin rising above noise, in the frame starting at sample
+ */
+struct scan_hit {
+    uint64_t sample;
+    off_t file_offset;
+    t_frequency frequency;
+    double level_db;			/* above noise */
+};
+
+/*
+ * A signal: adjacent bins rising above noise together, from the start of
+ * their first frame above it to the end of their last.
+ */
+struct scan_detection {
+    uint64_t start;			/* samples */
+    uint64_t end;
+    t_frequency low;			/* of its lowest and highest bins */
+    t_frequency high;
+    double peak_db;			/* above noise */
+    double mean_db;			/* over its frames above noise */
+};
+
+unsigned long scan_params_get_frame_step(const struct scan_params *);
+
+struct scan_detector *scan_detector_new(const struct scan_params *,
+	t_frequency, unsigned long);
+void scan_detector_delete(struct scan_detector *);
+void scan_detector_start(struct scan_detector *, uint64_t, off_t, off_t,
+	void (*)(void *, const struct scan_hit *),
+	void (*)(void *, const struct scan_detection *), void *);
+void scan_detector_feed(struct scan_detector *, const struct samplef *,
+	size_t);
+void scan_detector_end(struct scan_detector *);
+struct transformer *scan_detector_transformer_new(struct scan_detector *);
+int scan_detector_run(struct scan_detector *, struct radio *, uint64_t,
+	uint64_t, uint64_t, void (*)(void *, const struct scan_hit *),
+	void (*)(void *, const struct scan_detection *), void *);
+
+#endif /* SCAN_SCAN_DETECTOR_H_ */
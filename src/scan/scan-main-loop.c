@@ -1,154 +1,235 @@
 #include <scan/scan-main-loop.h>
 
-#include <complex.h>
-#include <math.h>
-#include <fftw3.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/time.h>
 #include <time.h>
 
 #include <radio/radio.h>
+#include <radio/radio-transformer.h>
+#include <record/record.h>
+#include <scan/scan-detector.h>
+#include <scan/scan-output.h>
+#include <signal/channelizer.h>
+#include <signal/pipeline.h>
+#include <signal/sample-convert-transformer.h>
+#include <signal/transformer.h>
 #include <util/memory.h>
 
-#define DEFAULT_FFT_SIZE 1024
+/*
+ * A detector on the whole band, or on one of its channels, and where its
+ * detections go, their times being counted from when the scan started.
+ */
+struct scan_channel {
+    struct scan_detector *d;
+    struct transformer *select;		/* NULL on the whole band */
+    struct transformer *sink;
+    struct scan_output *output;
+    unsigned long rate;
+    double start_time;
+};
 
-#define DEFAULT_BACKLOG_SIZE 10
-#define DEFAULT_DECISION_SIZE 10	// this many "rounds" below noise
+/* Stopped by SIGINT and SIGTERM */
+static struct pipeline *scan_running;
+static volatile sig_atomic_t scan_interrupted;
 
-struct bin_info {
-    double complex values[DEFAULT_BACKLOG_SIZE];
-    double noise_level;
-    int flags;
-#define BIN_INSIDE_SIGNAL	0x1
-    long long samples_above_noise;
-    long long samples_below_noise;
-};
+static void scan_interrupt(int);
+static void scan_print_hit(void *, const struct scan_hit *);
+static void scan_write_detection(void *, const struct scan_detection *);
 
-static t_frequency
-scan_bin_to_frequency(t_frequency tune, t_frequency rate, int nbins, int bin) {
-    if (bin >= nbins / 2)
-	bin = bin - nbins;
+static void
+scan_interrupt(int sig) {
+    (void) sig;
+    scan_interrupted = 1;
+    pipeline_stop(scan_running);
+}
 
-    return tune + (double) bin * rate / nbins;
+/*
+ * Channels may print from several threads at once.
+ */
+static void
+scan_print_hit(void *arg, const struct scan_hit *h) {
+    char timestamp_string[100];
+    time_t timestamp = time(NULL);
+    struct tm tm;
+    char *hfreq = frequency_human_print(h->frequency);
+
+    (void) arg;
+    strftime(timestamp_string, sizeof timestamp_string,
+	"%F %T", localtime_r(&timestamp, &tm));
+    printf("%-9s %s %llu %4.1f\n", hfreq, timestamp_string,
+	(unsigned long long) h->file_offset, h->level_db);
+    memory_free(hfreq);
 }
 
-void
-scan_main_loop(struct radio *r, double threshold_db) {
-    fftw_plan fft_plan = NULL;
-    struct sample *in_buf = NULL;
-    double complex *out_buf = NULL;
-    struct bin_info *bins = memory_alloc(sizeof *bins * DEFAULT_FFT_SIZE);
-    double threshold = pow(10, threshold_db / 20);
+static void
+scan_write_detection(void *arg, const struct scan_detection *det) {
+    struct scan_channel *ch = arg;
+    struct scan_output_record record;
+
+    record.detection = *det;
+    record.time = ch->start_time + (double) det->start / ch->rate;
+    record.duration = (double) (det->end - det->start) / ch->rate;
+    record.file = -1;
+    scan_output_write(ch->output, &record);
+}
+
+/*
+ * Prints hits as they come in SCAN_OUTPUT_TEXT format, or else writes
+ * detections once over, until the radio ends or SIGINT or SIGTERM.
+ * Signals still going on then are written as ending there.  Samples go
+ * through a pipeline: radio, conversion, detector.  With nchannels above
+ * 1, a channelizer splits the band in between, and each channel has a
+ * detector of its own.  If record_name isn't NULL, samples are also
+ * recorded to it, as record_new() does with record_flags, straight from
+ * the radio.  Returns -1 if reading or writing fails.
+ */
+int
+scan_main_loop(struct radio *r, const struct scan_params *params,
+	int format, unsigned int nchannels, const char *record_name,
+	int record_flags) {
+    struct scan_channel *channels;
+    struct channelizer *c = NULL;
+    struct record *rec = NULL;
+    struct transformer *source, *convert, *split = NULL;
+    struct transformer *record_sink = NULL;
+    struct scan_output *output = NULL;
+    struct pipeline *p;
+    struct sigaction sa, old_int, old_term;
+    struct timeval tv;
     t_frequency tune = 0;
     unsigned long rate = 1;
-    int current_index = 0;
-    int learning = DEFAULT_BACKLOG_SIZE;
-    int i;
+    off_t first_offset, per_sample;
+    double start_time;
+    int status = -1;
+    unsigned int i;
 
     r->m->get_frequency(r, &tune);
     r->m->get_sample_rate(r, &rate);
 
-    in_buf = fftw_malloc(sizeof *in_buf * DEFAULT_FFT_SIZE);
-    if (in_buf == NULL)
-	goto err;
-    out_buf = fftw_malloc(sizeof *out_buf * DEFAULT_FFT_SIZE);
-    if (out_buf == NULL)
-	goto err;
-
-    fft_plan = fftw_plan_dft_1d(DEFAULT_FFT_SIZE,
-	(double complex *) in_buf, out_buf, FFTW_FORWARD, FFTW_ESTIMATE);
-    if (fft_plan == NULL)
-	goto err;
-
-    for (i = 0; i < DEFAULT_FFT_SIZE; i++) {
-	struct bin_info *b = bins + i;
-
-	b->noise_level = 0;
-	b->flags = 0;
-	b->samples_below_noise = 0;
-	b->samples_above_noise = 0;
-	for (size_t j = 0; j < sizeof b->values / sizeof b->values[0]; j++)
-	    b->values[j] = 0;
+    if (nchannels > 1)
+	c = channelizer_new(nchannels, CHANNELIZER_DEFAULT_TAPS_PER_CHANNEL);
+
+    channels = memory_alloc(nchannels * sizeof *channels);
+    for (i = 0; i < nchannels; i++) {
+	struct scan_channel *ch = &channels[i];
+	t_frequency channel_tune = tune;
+
+	if (c != NULL)
+	    channel_tune = tune + channelizer_channel_offset(c, i, rate);
+	ch->rate = rate / nchannels;
+	ch->d = scan_detector_new(params, channel_tune, ch->rate);
+	if (ch->d == NULL) {
+	    fprintf(stderr, "scan: can't make the FFT\n");
+	    nchannels = i;
+	    goto out_detectors;
+	}
     }
 
-    for (;;) {
-	size_t to_read = DEFAULT_FFT_SIZE;
-	off_t file_offset = r->m->get_file_position(r);
-	int next_index = (current_index + 1) % DEFAULT_BACKLOG_SIZE;
-	ssize_t ret;
-
-	while (to_read != 0) {
-	    ret = r->m->read(r,
-		(struct sample *) in_buf + DEFAULT_FFT_SIZE - to_read, to_read);
-	    if (ret == 0)
-		goto finish;
-	    if (ret == -1)
-		goto err;
-	    to_read -= ret;
-	}
+    source = radio_transformer_new(r);
+    if (source == NULL)
+	goto out_detectors;
+    convert = sample_convert_transformer_new(
+	radio_transformer_get_encoding(source));
+    transformer_connect(source, convert);
+
+    p = pipeline_new();
+    pipeline_add(p, source);
+    pipeline_add(p, convert);
+
+    if (c != NULL) {
+	split = channelizer_transformer_new(c);
+	transformer_connect(convert, split);
+	pipeline_add(p, split);
+    }
+    for (i = 0; i < nchannels; i++) {
+	struct scan_channel *ch = &channels[i];
+
+	ch->select = NULL;
+	ch->sink = scan_detector_transformer_new(ch->d);
+	if (c != NULL) {
+	    ch->select = channelizer_select_new(c, i);
+	    transformer_connect(split, ch->select);
+	    transformer_connect(ch->select, ch->sink);
+	    pipeline_add(p, ch->select);
+	} else
+	    transformer_connect(convert, ch->sink);
+	pipeline_add(p, ch->sink);
+    }
 
-	fftw_execute(fft_plan);
-
-	for (i = 0; i < DEFAULT_FFT_SIZE; i++) {
-	    struct bin_info *b = bins + i;
-	    double level = cabs(out_buf[i]);
-	    double noise_level = b->noise_level / DEFAULT_BACKLOG_SIZE;
-	    if (i == 0)
-		continue;
-
-	    if (!learning) {
-		if (level >= threshold * noise_level) {
-		    b->samples_above_noise++;
-		    b->samples_below_noise = 0;
-		} else {
-		    b->samples_above_noise = 0;
-		    b->samples_below_noise++;
-		}
-
-		if (b->samples_above_noise > 0 &&
-			!(b->flags & BIN_INSIDE_SIGNAL)) {
-		    char timestamp_string[100];
-		    time_t timestamp = time(NULL);
-		    t_frequency freq =
-			scan_bin_to_frequency(tune, rate, DEFAULT_FFT_SIZE, i);
-		    char *hfreq = frequency_human_print(freq);
-		    if (freq < 10e9) {
-			strftime(timestamp_string, sizeof timestamp_string,
-				"%F %T", localtime(&timestamp));
-			printf("%-9s %s %llu %4.1f\n", hfreq, timestamp_string,
-				(unsigned long long) file_offset,
-				20 * log10(level / noise_level));
-		    }
-		    memory_free(hfreq);
-
-		    b->flags |= BIN_INSIDE_SIGNAL;
-		} else if (b->samples_below_noise > DEFAULT_DECISION_SIZE &&
-			(b->flags & BIN_INSIDE_SIGNAL)) {
-		    b->flags &= ~BIN_INSIDE_SIGNAL;
-		    //printf("bin %d stop\n", i);
-		}
-	    }
-
-#if 0
-	    if (i == 0) {
-		printf("current level = %g, noise_level = %g\n", level, noise_level);
-	    }
-#endif
-	    b->noise_level =
-		b->noise_level + level - cabs(b->values[current_index]);
-	    b->values[current_index] = out_buf[i];
-	}
+    if (record_name != NULL) {
+	rec = record_new(r, record_name, record_flags);
+	if (rec == NULL)
+	    goto out;
+	record_sink = record_transformer_new(rec,
+	    radio_transformer_get_encoding(source));
+	transformer_connect(source, record_sink);
+	pipeline_add(p, record_sink);
+    }
 
-	current_index = next_index;
-	if (learning)
-	    learning--;
+    /* A sample of a channel stands for nchannels of the radio */
+    first_offset = radio_transformer_get_first_offset(source);
+    per_sample = radio_transformer_get_sample_offset(source) * nchannels;
+    gettimeofday(&tv, NULL);
+    start_time = tv.tv_sec + tv.tv_usec / 1e6;
+    if (format != SCAN_OUTPUT_TEXT)
+	output = scan_output_new(format, stdout, NULL);
+    for (i = 0; i < nchannels; i++) {
+	struct scan_channel *ch = &channels[i];
+
+	ch->output = output;
+	ch->start_time = start_time;
+	if (format == SCAN_OUTPUT_TEXT)
+	    scan_detector_start(ch->d, 0, first_offset, per_sample,
+		scan_print_hit, NULL, NULL);
+	else
+	    scan_detector_start(ch->d, 0, first_offset, per_sample, NULL,
+		scan_write_detection, ch);
     }
 
-finish:
-    ;
-err:
-    if (fft_plan != NULL)
-	fftw_destroy_plan(fft_plan);
-    if (out_buf != NULL)
-	fftw_free(out_buf);
-    if (in_buf != NULL)
-	fftw_free(in_buf);
+    scan_running = p;
+    scan_interrupted = 0;
+    sa.sa_handler = scan_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    /* Reads cut short by the signal are no failure */
+    status = pipeline_run(p);
+    if (scan_interrupted)
+	status = 0;
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    scan_running = NULL;
+
+    for (i = 0; i < nchannels; i++)
+	scan_detector_end(channels[i].d);
+    if (output != NULL && scan_output_delete(output) == -1)
+	status = -1;
+    if (rec != NULL && record_delete(rec) == -1)
+	status = -1;
+
+out:
+    pipeline_delete(p);
+    if (record_sink != NULL)
+	transformer_delete(record_sink);
+    for (i = 0; i < nchannels; i++) {
+	transformer_delete(channels[i].sink);
+	if (channels[i].select != NULL)
+	    transformer_delete(channels[i].select);
+    }
+    if (split != NULL)
+	transformer_delete(split);
+    sample_convert_transformer_delete(convert);
+    radio_transformer_delete(source);
+out_detectors:
+    for (i = 0; i < nchannels; i++)
+	scan_detector_delete(channels[i].d);
+    memory_free(channels);
+    if (c != NULL)
+	channelizer_delete(c);
+
+    return status;
 }
@@ -2,7 +2,9 @@
 #define SCAN_SCAN_MAIN_LOOP_H_
 
 struct radio;
+struct scan_params;
 
-void scan_main_loop(struct radio *, double /* threshold in dB */);
+int scan_main_loop(struct radio *, const struct scan_params *, int,
+	unsigned int, const char *, int);
 
 #endif /* SCAN_SCAN_MAIN_LOOP_H_ */
@@ -0,0 +1,248 @@
+#include <scan/scan-output.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include <util/async-buffer.h>
+#include <util/json.h>
+#include <util/memory.h>
+
+struct scan_output_entry {
+    int last;				/* ends the writer */
+    struct scan_output_record record;
+};
+
+/*
+ * Records are queued by the scanning threads and formatted by the writer,
+ * which flushes the stream whenever it runs out of them.  The queue has
+ * a single writer, so scanning threads take turns at it.
+ */
+struct scan_output {
+    int format;
+    FILE *out;
+    const char *const *files;
+    pthread_mutex_t mtx;
+    struct async_buffer *queue;
+    pthread_t writer;
+    int threaded;			/* or written as they come */
+};
+
+static void scan_output_put32(unsigned char *, uint32_t);
+static void scan_output_put64(unsigned char *, uint64_t);
+static void scan_output_put_float(unsigned char *, float);
+static void scan_output_put_double(unsigned char *, double);
+static void scan_output_csv_string(FILE *, const char *);
+static void scan_output_print(struct scan_output *,
+	const struct scan_output_record *);
+static void *scan_output_writer(void *);
+
+/*
+ * Returns -1 for an unknown format.
+ */
+int
+scan_output_parse(const char *name) {
+    if (strcmp(name, "text") == 0)
+	return SCAN_OUTPUT_TEXT;
+    if (strcmp(name, "csv") == 0)
+	return SCAN_OUTPUT_CSV;
+    if (strcmp(name, "json") == 0)
+	return SCAN_OUTPUT_JSON;
+    if (strcmp(name, "binary") == 0)
+	return SCAN_OUTPUT_BINARY;
+
+    return -1;
+}
+
+static void
+scan_output_put32(unsigned char *p, uint32_t x) {
+    p[0] = x;
+    p[1] = x >> 8;
+    p[2] = x >> 16;
+    p[3] = x >> 24;
+}
+
+static void
+scan_output_put64(unsigned char *p, uint64_t x) {
+    scan_output_put32(p, x);
+    scan_output_put32(p + 4, x >> 32);
+}
+
+static void
+scan_output_put_float(unsigned char *p, float x) {
+    uint32_t bits;
+
+    memcpy(&bits, &x, sizeof bits);
+    scan_output_put32(p, bits);
+}
+
+static void
+scan_output_put_double(unsigned char *p, double x) {
+    uint64_t bits;
+
+    memcpy(&bits, &x, sizeof bits);
+    scan_output_put64(p, bits);
+}
+
+/*
+ * Quoted if it has to be.
+ */
+static void
+scan_output_csv_string(FILE *out, const char *s) {
+    if (strpbrk(s, ",\"\r\n") == NULL) {
+	fputs(s, out);
+	return;
+    }
+
+    putc('"', out);
+    for (; *s != '\0'; s++) {
+	if (*s == '"')
+	    putc('"', out);
+	putc(*s, out);
+    }
+    putc('"', out);
+}
+
+static void
+scan_output_print(struct scan_output *o, const struct scan_output_record *r) {
+    const struct scan_detection *d = &r->detection;
+    const char *file = r->file >= 0? o->files[r->file] : NULL;
+    unsigned char buf[SCAN_OUTPUT_RECORD_SIZE];
+
+    switch (o->format) {
+    case SCAN_OUTPUT_CSV:
+	fprintf(o->out, "%.6f,%.6f,%llu,%llu,%llu,%llu,%.1f,%.1f,",
+	    r->time, r->duration, (unsigned long long) d->start,
+	    (unsigned long long) d->end, d->low, d->high, d->peak_db,
+	    d->mean_db);
+	if (file != NULL)
+	    scan_output_csv_string(o->out, file);
+	putc('\n', o->out);
+	break;
+    case SCAN_OUTPUT_JSON:
+	fprintf(o->out, "{\"time\": %.6f, \"duration\": %.6f, "
+	    "\"start_sample\": %llu, \"end_sample\": %llu, "
+	    "\"low_frequency\": %llu, \"high_frequency\": %llu, "
+	    "\"peak_snr\": %.1f, \"mean_snr\": %.1f",
+	    r->time, r->duration, (unsigned long long) d->start,
+	    (unsigned long long) d->end, d->low, d->high, d->peak_db,
+	    d->mean_db);
+	if (file != NULL) {
+	    fputs(", \"file\": ", o->out);
+	    json_print_string(o->out, file);
+	}
+	fputs("}\n", o->out);
+	break;
+    case SCAN_OUTPUT_BINARY:
+	scan_output_put64(buf, d->start);
+	scan_output_put64(buf + 8, d->end);
+	scan_output_put64(buf + 16, d->low);
+	scan_output_put64(buf + 24, d->high);
+	scan_output_put_double(buf + 32, r->time);
+	scan_output_put_double(buf + 40, r->duration);
+	scan_output_put_float(buf + 48, d->peak_db);
+	scan_output_put_float(buf + 52, d->mean_db);
+	scan_output_put32(buf + 56, r->file >= 0? (uint32_t) r->file :
+	    UINT32_MAX);
+	scan_output_put32(buf + 60, 0);
+	fwrite(buf, sizeof buf, 1, o->out);
+	break;
+    }
+}
+
+static void *
+scan_output_writer(void *arg) {
+    struct scan_output *o = arg;
+    struct scan_output_entry e;
+
+    for (;;) {
+	if (async_buffer_read(o->queue, &e, sizeof e) == -1 || e.last)
+	    break;
+
+	scan_output_print(o, &e.record);
+	if (async_buffer_get_fill(o->queue) == 0)
+	    fflush(o->out);
+    }
+
+    return NULL;
+}
+
+/*
+ * Records name their file by index in files, which can be NULL if none
+ * does.  CSV starts with a header line.
+ */
+struct scan_output *
+scan_output_new(int format, FILE *out, const char *const *files) {
+    struct scan_output *o = memory_alloc(sizeof *o);
+
+    o->format = format;
+    o->out = out;
+    o->files = files;
+    pthread_mutex_init(&o->mtx, NULL);
+    o->queue = async_buffer_new(
+	SCAN_OUTPUT_QUEUE_SIZE * sizeof (struct scan_output_entry),
+	ASYNC_BUFFER_READER_CAN_WAIT | ASYNC_BUFFER_WRITER_CAN_WAIT);
+
+    if (format == SCAN_OUTPUT_CSV)
+	fputs("time,duration,start_sample,end_sample,low_frequency,"
+	    "high_frequency,peak_snr,mean_snr,file\n", out);
+
+    o->threaded = pthread_create(&o->writer, NULL, scan_output_writer,
+	o) == 0;
+    if (!o->threaded)
+	fprintf(stderr, "scan: can't create writer thread\n");
+
+    return o;
+}
+
+/*
+ * Waits for room in the queue if the writer is that far behind, rather
+ * than losing detections.  Can be called from several threads.
+ */
+void
+scan_output_write(struct scan_output *o,
+				    const struct scan_output_record *r) {
+    struct scan_output_entry e;
+
+    pthread_mutex_lock(&o->mtx);
+    if (!o->threaded)
+	scan_output_print(o, r);
+    else {
+	e.last = 0;
+	e.record = *r;
+	async_buffer_write(o->queue, &e, sizeof e);
+    }
+    pthread_mutex_unlock(&o->mtx);
+}
+
+/*
+ * Writes out what is queued.  Returns -1 if the output failed.
+ */
+int
+scan_output_delete(struct scan_output *o) {
+    struct scan_output_entry e;
+    int status;
+
+    if (o->threaded) {
+	memset(&e, 0, sizeof e);
+	e.last = 1;
+	async_buffer_write(o->queue, &e, sizeof e);
+	pthread_join(o->writer, NULL);
+    }
+    async_buffer_delete(o->queue);
+    pthread_mutex_destroy(&o->mtx);
+
+    /* errno is only that of the last write, which may have gone well */
+    status = 0;
+    if (fflush(o->out) == EOF) {
+	perror("scan");
+	status = -1;
+    } else if (ferror(o->out)) {
+	fprintf(stderr, "scan: couldn't write all signals\n");
+	status = -1;
+    }
+    memory_free(o);
+
+    return status;
+}
@@ -0,0 +1,42 @@
+/*
+ * Detections written out as CSV, JSON lines or binary records by a thread
+ * of their own, so that scanning never waits for the output
+ */
+#ifndef SCAN_SCAN_OUTPUT_H_
+#define SCAN_SCAN_OUTPUT_H_
+
+#include <stdio.h>
+
+#include <scan/scan-detector.h>
+
+#define SCAN_OUTPUT_TEXT	0	/* hits, printed as they come */
+#define SCAN_OUTPUT_CSV		1
+#define SCAN_OUTPUT_JSON	2
+#define SCAN_OUTPUT_BINARY	3
+
+/*
+ * Binary records, little endian: start and end sample, low and high
+ * frequency in Hz (u64), time and duration in s (f64), peak and mean SNR
+ * in dB (f32), file index (u32, all ones for none) and 4 bytes of zeros.
+ */
+#define SCAN_OUTPUT_RECORD_SIZE	64
+
+/* Records queued for the writer at most */
+#define SCAN_OUTPUT_QUEUE_SIZE	4096
+
+struct scan_output;
+
+struct scan_output_record {
+    struct scan_detection detection;
+    double time;			/* of the start, in s */
+    double duration;			/* in s */
+    long file;				/* index in the files, -1 for none */
+};
+
+int scan_output_parse(const char *);
+struct scan_output *scan_output_new(int, FILE *, const char *const *);
+void scan_output_write(struct scan_output *,
+	const struct scan_output_record *);
+int scan_output_delete(struct scan_output *);
+
+#endif /* SCAN_SCAN_OUTPUT_H_ */
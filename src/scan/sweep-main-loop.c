@@ -0,0 +1,324 @@
+#include <scan/sweep-main-loop.h>
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <radio/radio.h>
+#include <scan/scan-detector.h>
+#include <util/memory.h>
+
+/*
+ * A bin of the stitched spectrum.  Its noise level is the mean of its
+ * last SCAN_BACKLOG_SIZE levels, those of the first sweeps, which only
+ * learn it, and since then those below the limit: a signal is never
+ * taken for noise, however long it lasts.
+ */
+struct sweep_bin {
+    float levels[SCAN_BACKLOG_SIZE];
+    unsigned long long nlevels;		/* ever put in levels */
+    float level;			/* in the current sweep */
+    float noise_level;			/* it was compared to, 0 if none */
+    int flags;
+#define SWEEP_BIN_INSIDE_SIGNAL	0x1
+    int sweeps_below_noise;
+};
+
+/*
+ * Each step is tuned so that its usable middle bins fall on the next ones
+ * of the spectrum, bin i being at low + i * bin_width.
+ */
+struct sweep {
+    struct radio *radio;
+    t_frequency low;
+    double bin_width;
+    double threshold;			/* in power */
+    size_t nbins;
+    struct sweep_bin *bins;
+    unsigned long long nsweeps;		/* complete ones */
+    struct spectrum *spectrum;
+    unsigned int size;
+    unsigned int usable;
+    unsigned int nsegments;		/* averaged at each step */
+    float *power;			/* summed over a step */
+    FILE *spectrum_out;			/* or NULL */
+};
+
+static volatile sig_atomic_t sweep_stop;
+
+static void sweep_interrupt(int);
+static void sweep_bin_update(struct sweep *, size_t, float);
+static int sweep_discard(struct radio *, unsigned long);
+static void sweep_add_rows(struct sweep *, unsigned int);
+static int sweep_step(struct sweep *, size_t);
+static int sweep_write_spectrum(struct sweep *);
+
+static void
+sweep_interrupt(int sig) {
+    (void) sig;
+    sweep_stop = 1;
+}
+
+static void
+sweep_bin_update(struct sweep *s, size_t i, float level) {
+    struct sweep_bin *b = &s->bins[i];
+    float noise_level = 0;
+    int above = 0;
+    int j;
+
+    if (s->nsweeps >= SCAN_BACKLOG_SIZE) {
+	for (j = 0; j < SCAN_BACKLOG_SIZE; j++)
+	    noise_level += b->levels[j];
+	noise_level /= SCAN_BACKLOG_SIZE;
+	above = level >= s->threshold * noise_level;
+
+	if (above) {
+	    b->sweeps_below_noise = 0;
+	    if (!(b->flags & SWEEP_BIN_INSIDE_SIGNAL)) {
+		char timestamp_string[100];
+		time_t timestamp = time(NULL);
+		t_frequency freq = s->low + llround(i * s->bin_width);
+		char *hfreq = frequency_human_print(freq);
+
+		strftime(timestamp_string, sizeof timestamp_string,
+		    "%F %T", localtime(&timestamp));
+		printf("%-9s %s %llu %4.1f\n", hfreq, timestamp_string,
+		    s->nsweeps, 10 * log10(level / noise_level));
+		memory_free(hfreq);
+
+		b->flags |= SWEEP_BIN_INSIDE_SIGNAL;
+	    }
+	} else if (++b->sweeps_below_noise > SCAN_DECISION_SIZE)
+	    b->flags &= ~SWEEP_BIN_INSIDE_SIGNAL;
+    }
+
+    if (!above)
+	b->levels[b->nlevels++ % SCAN_BACKLOG_SIZE] = level;
+    b->level = level;
+    b->noise_level = noise_level;
+}
+
+/*
+ * Drops n samples without converting them.  Returns 0 at end of stream.
+ */
+static int
+sweep_discard(struct radio *r, unsigned long n) {
+    while (n != 0) {
+	struct radio_buffer rb;
+	ssize_t nread = r->m->acquire_buffer(r, &rb, n);
+
+	if (nread <= 0)
+	    return nread;
+	r->m->release_buffer(r, &rb);
+	n -= nread;
+    }
+
+    return 1;
+}
+
+static void
+sweep_add_rows(struct sweep *s, unsigned int nrows) {
+    unsigned int i, j;
+
+    for (j = 0; j < nrows; j++) {
+	const float *row = spectrum_get_power(s->spectrum, j);
+
+	for (i = 0; i < s->size; i++)
+	    s->power[i] += row[i];
+    }
+}
+
+/*
+ * Measures the bins from first on.  Returns 0 at end of stream, -1 on
+ * error.
+ */
+static int
+sweep_step(struct sweep *s, size_t first) {
+    struct radio *r = s->radio;
+    t_frequency center =
+	s->low + llround((first + s->usable / 2) * s->bin_width);
+    size_t nwanted = (size_t) (s->nsegments - 1) *
+	spectrum_get_step(s->spectrum) + s->size;
+    float *power = s->power;
+    float dc;
+    int i, ret;
+
+    if (r->m->set_frequency(r, center) == -1) {
+	fprintf(stderr, "sweep: couldn't tune to %" PRIuFREQUENCY "Hz\n",
+	    center);
+	return -1;
+    }
+    ret = sweep_discard(r, r->m->get_settling_samples(r));
+    if (ret <= 0)
+	return ret;
+
+    for (i = 0; i < (int) s->size; i++)
+	power[i] = 0;
+
+    spectrum_reset(s->spectrum);
+    while (nwanted != 0) {
+	size_t room;
+	struct samplef *in = spectrum_input(s->spectrum, &room);
+	ssize_t nread;
+
+	if (room > nwanted)
+	    room = nwanted;
+	nread = r->m->read_float(r, in, room);
+	if (nread <= 0)
+	    return nread;
+	sweep_add_rows(s, spectrum_commit(s->spectrum, nread));
+	nwanted -= nread;
+    }
+    sweep_add_rows(s, spectrum_flush(s->spectrum));
+
+    /* The DC bin holds the LO leakage rather than the band */
+    dc = (power[1] + power[s->size - 1]) / 2;
+
+    for (i = -(int) s->usable / 2; i < (int) s->usable / 2; i++) {
+	size_t bin = first + s->usable / 2 + i;
+
+	if (bin >= s->nbins)
+	    break;
+	sweep_bin_update(s, bin,
+	    (i == 0? dc : power[(i + s->size) % s->size]) / s->nsegments);
+    }
+
+    return 1;
+}
+
+/*
+ * Writes the sweep just completed as CSV lines of its number, then the
+ * frequency in Hz, power and noise level in dB of each bin, the noise
+ * level being empty while still learnt.  Returns -1 on error.
+ */
+static int
+sweep_write_spectrum(struct sweep *s) {
+    size_t i;
+
+    for (i = 0; i < s->nbins; i++) {
+	const struct sweep_bin *b = &s->bins[i];
+
+	fprintf(s->spectrum_out, "%llu,%" PRIuFREQUENCY ",%.2f,", s->nsweeps,
+	    s->low + llround(i * s->bin_width), 10 * log10(b->level));
+	if (b->noise_level != 0)
+	    fprintf(s->spectrum_out, "%.2f", 10 * log10(b->noise_level));
+	putc('\n', s->spectrum_out);
+    }
+
+    return ferror(s->spectrum_out)? -1 : 0;
+}
+
+/*
+ * Sweeps from low to high until interrupted, printing bins rising above
+ * their noise level with the sweep they did so in.  Each complete sweep
+ * is also written to the file spectrum_name if not NULL.
+ */
+int
+sweep_main_loop(struct radio *radio, t_frequency low, t_frequency high,
+	    const struct scan_params *params, const char *spectrum_name) {
+    struct sweep s;
+    struct sigaction sa, old_int, old_term;
+    struct timeval t0, t1;
+    unsigned long rate;
+    unsigned long long nsteps_done = 0;
+    size_t nsteps, step, i;
+    double elapsed;
+    int status = 0;
+    int ret = 1;
+
+    if (radio->m->get_sample_rate(radio, &rate) == -1 || rate == 0) {
+	fprintf(stderr, "sweep: unknown sample rate\n");
+	return -1;
+    }
+    if (high <= low) {
+	fprintf(stderr, "sweep: empty frequency range\n");
+	return -1;
+    }
+
+    s.spectrum_out = NULL;
+    if (spectrum_name != NULL) {
+	s.spectrum_out = fopen(spectrum_name, "w");
+	if (s.spectrum_out == NULL) {
+	    perror(spectrum_name);
+	    return -1;
+	}
+	fputs("sweep,frequency,power_db,noise_db\n", s.spectrum_out);
+    }
+
+    s.spectrum = spectrum_new(&params->spectrum);
+    if (s.spectrum == NULL) {
+	fprintf(stderr, "sweep: can't make the FFT\n");
+	if (s.spectrum_out != NULL && s.spectrum_out != stdout)
+	    fclose(s.spectrum_out);
+	return -1;
+    }
+
+    s.radio = radio;
+    s.low = low;
+    s.size = params->spectrum.size;
+    s.usable = SWEEP_USABLE_BINS(s.size);
+    s.nsegments = params->naverage > SWEEP_MIN_SEGMENTS?
+	params->naverage : SWEEP_MIN_SEGMENTS;
+    s.bin_width = (double) rate / s.size;
+    s.threshold = pow(10, params->threshold_db / 10);
+    s.nbins = (high - low) / s.bin_width + 1;
+    s.nsweeps = 0;
+    nsteps = (s.nbins + s.usable - 1) / s.usable;
+
+    s.power = memory_alloc(sizeof *s.power * s.size);
+    s.bins = memory_alloc(sizeof *s.bins * s.nbins);
+    for (i = 0; i < s.nbins; i++) {
+	s.bins[i].flags = 0;
+	s.bins[i].sweeps_below_noise = 0;
+	s.bins[i].nlevels = 0;
+    }
+
+    sweep_stop = 0;
+    sa.sa_handler = sweep_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    gettimeofday(&t0, NULL);
+    while (!sweep_stop && ret > 0) {
+	for (step = 0; step < nsteps && !sweep_stop; step++) {
+	    ret = sweep_step(&s, step * s.usable);
+	    if (ret <= 0)
+		break;
+	    nsteps_done++;
+	}
+	if (step == nsteps) {
+	    if (s.spectrum_out != NULL && sweep_write_spectrum(&s) == -1) {
+		perror(spectrum_name);
+		ret = -1;
+	    }
+	    s.nsweeps++;
+	}
+    }
+    gettimeofday(&t1, NULL);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+
+    if (ret == -1)
+	status = -1;
+
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+    fprintf(stderr, "sweep: %llu sweeps of %zu steps in %.1fs, "
+	"%.2fms per step\n", s.nsweeps, nsteps, elapsed,
+	nsteps_done != 0? elapsed * 1000 / nsteps_done : 0);
+
+    if (s.spectrum_out != NULL && fclose(s.spectrum_out) == EOF) {
+	perror(spectrum_name);
+	status = -1;
+    }
+
+    spectrum_delete(s.spectrum);
+    memory_free(s.power);
+    memory_free(s.bins);
+
+    return status;
+}
@@ -0,0 +1,18 @@
+#ifndef SCAN_SWEEP_MAIN_LOOP_H_
+#define SCAN_SWEEP_MAIN_LOOP_H_
+
+#include <common/frequency.h>
+
+struct radio;
+struct scan_params;
+
+/* Segments averaged at each step, at least */
+#define SWEEP_MIN_SEGMENTS	4
+
+/* Out of the FFT bins, those kept at each step, away from the edges */
+#define SWEEP_USABLE_BINS(size)	((size) - (size) / 4)
+
+int sweep_main_loop(struct radio *, t_frequency, t_frequency,
+	const struct scan_params *, const char *);
+
+#endif /* SCAN_SWEEP_MAIN_LOOP_H_ */
@@ -0,0 +1,285 @@
+#include <signal/channelizer.h>
+
+#include <complex.h>
+#include <fftw3.h>
+#include <math.h>
+#include <string.h>
+
+#include <signal/fft-plan.h>
+#include <signal/transformer.h>
+#include <signal/transformer-type.h>
+#include <util/exception.h>
+#include <util/memory.h>
+
+struct channelizer_select {
+    struct channelizer *c;
+    unsigned int channel;
+};
+
+/*
+ * Channel k is y_k[m] = sum_n h[n] x[mM - n] e^(2i pi k n / M).  Writing
+ * n = tM + p, that's the inverse DFT over p of the M polyphase branches
+ * v_p[m] = sum_t h[tM + p] x[(m - t)M - p], so a frame of all channels
+ * costs one pass over the filter and one FFT of size M.
+ */
+struct channelizer {
+    unsigned int nchannels;
+    unsigned int ntaps;			/* nchannels * taps per channel */
+    float *taps;			/* prototype filter, time reversed */
+
+    float complex *history;		/* input, oldest first */
+    size_t history_size;
+    size_t history_fill;
+    size_t history_pos;			/* start of the next frame's window */
+
+    float complex *folded;
+    float complex *fft_in;
+    float complex *fft_out;
+    fftwf_plan fft_plan;
+
+    struct transformer_type type;
+    struct transformer_type select_type;
+    struct channelizer_select *selects;
+};
+
+static void channelizer_make_taps(struct channelizer *);
+static void channelizer_frame(struct channelizer *, const float complex *,
+	struct samplef *);
+static ssize_t channelizer_apply(struct transformer_type *, void *, size_t,
+	const void *, size_t, void *);
+static ssize_t channelizer_select_apply(struct transformer_type *, void *,
+	size_t, const void *, size_t, void *);
+
+/*
+ * Blackman windowed sinc cut at the edge of a channel, with unity gain at
+ * DC so that a tone at the center of a channel comes out unchanged.
+ */
+static void
+channelizer_make_taps(struct channelizer *c) {
+    unsigned int n = c->ntaps;
+    double fc = 0.5 / c->nchannels;
+    double sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+	double x = i - (n - 1) / 2.0;
+	double w = 0.42 - 0.5 * cos(2 * M_PI * i / (n - 1)) +
+	    0.08 * cos(4 * M_PI * i / (n - 1));
+	double s = x == 0? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+
+	c->taps[n - 1 - i] = s * w;
+	sum += s * w;
+    }
+
+    for (i = 0; i < n; i++)
+	c->taps[i] /= sum;
+}
+
+struct channelizer *
+channelizer_new(unsigned int nchannels, unsigned int taps_per_channel) {
+    struct channelizer *c;
+    unsigned int i;
+
+    if (nchannels < 2 || taps_per_channel == 0)
+	EXCEPTION_RAISE(logic_error, "bad channelizer geometry");
+
+    c = memory_alloc(sizeof *c);
+    c->nchannels = nchannels;
+    c->ntaps = nchannels * taps_per_channel;
+    c->taps = memory_alloc(c->ntaps * sizeof *c->taps);
+    channelizer_make_taps(c);
+
+    c->history_size = c->ntaps + nchannels * CHANNELIZER_CHUNK_FRAMES;
+    c->history = memory_alloc(c->history_size * sizeof *c->history);
+    c->folded = memory_alloc(nchannels * sizeof *c->folded);
+
+    c->fft_in = fftwf_malloc(nchannels * sizeof *c->fft_in);
+    c->fft_out = fftwf_malloc(nchannels * sizeof *c->fft_out);
+    if (c->fft_in == NULL || c->fft_out == NULL)
+	EXCEPTION_RAISE(runtime_error, "can't allocate FFT buffers");
+    c->fft_plan = fft_plan_getf(nchannels, FFTW_BACKWARD, c->fft_in,
+	c->fft_out);
+    if (c->fft_plan == NULL)
+	EXCEPTION_RAISE(runtime_error, "can't plan channelizer FFT");
+
+    channelizer_reset(c);
+
+    c->type.name = "channelizer";
+    c->type.input_elem_size = sizeof (struct samplef);
+    c->type.output_elem_size = nchannels * sizeof (struct samplef);
+    c->type.input_chunk_max_size = (size_t) CHANNELIZER_CHUNK_FRAMES *
+	nchannels * sizeof (struct samplef);
+    c->type.output_chunk_max_size = c->type.input_chunk_max_size;
+    c->type.apply = channelizer_apply;
+
+    c->select_type.name = "channel select";
+    c->select_type.input_elem_size = c->type.output_elem_size;
+    c->select_type.output_elem_size = sizeof (struct samplef);
+    c->select_type.input_chunk_max_size = c->type.output_chunk_max_size;
+    c->select_type.output_chunk_max_size =
+	CHANNELIZER_CHUNK_FRAMES * sizeof (struct samplef);
+    c->select_type.apply = channelizer_select_apply;
+
+    c->selects = memory_alloc(nchannels * sizeof *c->selects);
+    for (i = 0; i < nchannels; i++) {
+	c->selects[i].c = c;
+	c->selects[i].channel = i;
+    }
+
+    return c;
+}
+
+/*
+ * Transformers made from it must be gone already.
+ */
+void
+channelizer_delete(struct channelizer *c) {
+    fftwf_free(c->fft_in);
+    fftwf_free(c->fft_out);
+    memory_free(c->folded);
+    memory_free(c->history);
+    memory_free(c->taps);
+    memory_free(c->selects);
+    memory_free(c);
+}
+
+unsigned int
+channelizer_get_nchannels(struct channelizer *c) {
+    return c->nchannels;
+}
+
+/*
+ * Forget past input, as if preceded by zeros.
+ */
+void
+channelizer_reset(struct channelizer *c) {
+    memset(c->history, 0, (c->ntaps - 1) * sizeof *c->history);
+    c->history_fill = c->ntaps - 1;
+    c->history_pos = 0;
+}
+
+double
+channelizer_channel_offset(struct channelizer *c, unsigned int channel,
+								double rate) {
+    int k = channel;
+
+    if (channel > (c->nchannels - 1) / 2)
+	k -= c->nchannels;
+
+    return k * rate / c->nchannels;
+}
+
+/*
+ * window holds the ntaps last input samples, oldest first.
+ */
+static void
+channelizer_frame(struct channelizer *c, const float complex *window,
+						    struct samplef *out) {
+    unsigned int m = c->nchannels;
+    unsigned int t, q;
+
+    for (q = 0; q < m; q++)
+	c->folded[q] = 0;
+
+    /* Sample q of each row of the window belongs to branch M - 1 - q */
+    for (t = 0; t < c->ntaps; t += m) {
+	const float *h = c->taps + t;
+	const float complex *x = window + t;
+
+	for (q = 0; q < m; q++)
+	    c->folded[q] += h[q] * x[q];
+    }
+
+    for (q = 0; q < m; q++)
+	c->fft_in[m - 1 - q] = c->folded[q];
+
+    fftwf_execute_dft(c->fft_plan, c->fft_in, c->fft_out);
+    memcpy(out, c->fft_out, m * sizeof *out);
+}
+
+/*
+ * Consumes all n input samples and writes one frame of M samples, one per
+ * channel, for every M of them.  Returns the number of frames, at most
+ * ceil(n / M).
+ */
+size_t
+channelizer_process(struct channelizer *c, const struct samplef *in,
+					size_t n, struct samplef *out) {
+    unsigned int m = c->nchannels;
+    size_t nframes = 0;
+
+    while (n != 0) {
+	size_t room = c->history_size - c->history_fill;
+
+	if (room > n)
+	    room = n;
+	memcpy(c->history + c->history_fill, in, room * sizeof *in);
+	c->history_fill += room;
+	in += room;
+	n -= room;
+
+	/* The window of a frame ends on every Mth input sample */
+	while (c->history_pos + c->ntaps <= c->history_fill) {
+	    channelizer_frame(c, c->history + c->history_pos, out);
+	    out += m;
+	    nframes++;
+	    c->history_pos += m;
+	}
+
+	memmove(c->history, c->history + c->history_pos,
+	    (c->history_fill - c->history_pos) * sizeof *c->history);
+	c->history_fill -= c->history_pos;
+	c->history_pos = 0;
+    }
+
+    return nframes;
+}
+
+static ssize_t
+channelizer_apply(struct transformer_type *type, void *dest,
+	size_t dest_size, const void *src, size_t src_size, void *aux) {
+    struct channelizer *c = aux;
+    size_t n = src_size / sizeof (struct samplef);
+
+    /* Any n consecutive samples hold at most ceil(n / M) frame ends */
+    if ((n + c->nchannels - 1) / c->nchannels * type->output_elem_size >
+								dest_size)
+	return -1;
+
+    return channelizer_process(c, src, n, dest) * type->output_elem_size;
+}
+
+static ssize_t
+channelizer_select_apply(struct transformer_type *type, void *dest,
+	size_t dest_size, const void *src, size_t src_size, void *aux) {
+    struct channelizer_select *s = aux;
+    const struct samplef *frames = src;
+    struct samplef *out = dest;
+    size_t nframes = src_size / type->input_elem_size;
+    size_t i;
+
+    if (nframes * sizeof *out > dest_size)
+	return -1;
+
+    for (i = 0; i < nframes; i++)
+	out[i] = frames[i * s->c->nchannels + s->channel];
+
+    return nframes * sizeof *out;
+}
+
+/*
+ * Connect the output to channelizer_select_new() transformers, or to
+ * anything taking whole frames.
+ */
+struct transformer *
+channelizer_transformer_new(struct channelizer *c) {
+    return transformer_new(&c->type, c);
+}
+
+struct transformer *
+channelizer_select_new(struct channelizer *c, unsigned int channel) {
+    if (channel >= c->nchannels)
+	EXCEPTION_RAISE(logic_error, "no such channel");
+
+    return transformer_new(&c->select_type, &c->selects[channel]);
+}
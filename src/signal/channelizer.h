@@ -0,0 +1,40 @@
+/*
+ * Polyphase filter bank splitting a complex stream into M channels, each
+ * decimated by M
+ */
+#ifndef SIGNAL_CHANNELIZER_H_
+#define SIGNAL_CHANNELIZER_H_
+
+#include <stddef.h>
+
+#include <signal/sample.h>
+
+struct channelizer;
+struct transformer;
+
+#define CHANNELIZER_DEFAULT_TAPS_PER_CHANNEL	16
+
+/* Frames per chunk for the transformers */
+#define CHANNELIZER_CHUNK_FRAMES		256
+
+struct channelizer *channelizer_new(unsigned int, unsigned int);
+void channelizer_delete(struct channelizer *);
+unsigned int channelizer_get_nchannels(struct channelizer *);
+size_t channelizer_process(struct channelizer *, const struct samplef *,
+	size_t, struct samplef *);
+void channelizer_reset(struct channelizer *);
+
+/*
+ * Channel k is centered on k * rate / M, or (k - M) * rate / M past
+ * (M - 1) / 2, like the bins of an FFT.
+ */
+double channelizer_channel_offset(struct channelizer *, unsigned int, double);
+
+/* Frames of M samples, one per channel */
+struct transformer *channelizer_transformer_new(struct channelizer *);
+
+/* Samples of one channel, out of the frames */
+struct transformer *channelizer_select_new(struct channelizer *,
+	unsigned int);
+
+#endif /* SIGNAL_CHANNELIZER_H_ */
@@ -0,0 +1,269 @@
+#include <signal/fft-plan.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include <util/memory.h>
+
+#define FFT_PLAN_SINGLE		0
+#define FFT_PLAN_DOUBLE		1
+
+struct fft_plan_entry {
+    int size;
+    int precision;
+    int sign;
+    int in_alignment;
+    int out_alignment;
+    void *plan;
+};
+
+static const char *fft_plan_wisdom_names[] = {
+    [FFT_PLAN_SINGLE] = "fftwf-wisdom",
+    [FFT_PLAN_DOUBLE] = "fftw-wisdom",
+};
+
+static const unsigned int fft_plan_flags[] = {
+    [FFT_PLAN_ESTIMATE] = FFTW_ESTIMATE,
+    [FFT_PLAN_MEASURE] = FFTW_MEASURE,
+    [FFT_PLAN_PATIENT] = FFTW_PATIENT,
+};
+
+/* FFTW's planner and wisdom aren't thread safe, running plans is */
+static pthread_mutex_t fft_plan_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int fft_plan_effort = FFT_PLAN_ESTIMATE;
+static struct fft_plan_entry *fft_plans;
+static size_t fft_nplans;
+
+static char *fft_plan_wisdom_path(int, int);
+static void fft_plan_save_wisdom(int);
+static void *fft_plan_make(int, int, int, int, int);
+static void *fft_plan_get_any(int, int, int, void *, void *);
+
+/*
+ * Returns the path of the wisdom file in the user's cache directory,
+ * creating the directory if create, or NULL without a home.
+ */
+static char *
+fft_plan_wisdom_path(int precision, int create) {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    const char *name = fft_plan_wisdom_names[precision];
+    char *dir, *path;
+    size_t len;
+
+    if (cache != NULL && cache[0] != '\0') {
+	dir = memory_strdup(cache);
+    } else if (home != NULL && home[0] != '\0') {
+	dir = memory_alloc(strlen(home) + sizeof "/.cache");
+	sprintf(dir, "%s/.cache", home);
+    } else
+	return NULL;
+
+    if (create)
+	mkdir(dir, 0700);
+
+    len = strlen(dir) + sizeof "/sora/" + strlen(name);
+    path = memory_alloc(len);
+    sprintf(path, "%s/sora", dir);
+    if (create)
+	mkdir(path, 0700);
+    sprintf(path, "%s/sora/%s", dir, name);
+    memory_free(dir);
+
+    return path;
+}
+
+/*
+ * Sets how hard plans are searched for, and imports the wisdom of past
+ * runs.
+ */
+void
+fft_plan_init(int effort) {
+    int precision;
+
+    fft_plan_effort = effort;
+
+    pthread_mutex_lock(&fft_plan_mtx);
+    for (precision = FFT_PLAN_SINGLE; precision <= FFT_PLAN_DOUBLE;
+							    precision++) {
+	char *path = fft_plan_wisdom_path(precision, 0);
+
+	if (path == NULL)
+	    continue;
+	if (precision == FFT_PLAN_SINGLE)
+	    fftwf_import_wisdom_from_filename(path);
+	else
+	    fftw_import_wisdom_from_filename(path);
+	memory_free(path);
+    }
+    pthread_mutex_unlock(&fft_plan_mtx);
+}
+
+/*
+ * Saves the wisdom of precision for the next runs, the file being replaced
+ * whole.  Called with fft_plan_mtx held.
+ */
+static void
+fft_plan_save_wisdom(int precision) {
+    char *path = fft_plan_wisdom_path(precision, 1);
+    char *tmp;
+    int ret;
+
+    if (path == NULL)
+	return;
+
+    tmp = memory_alloc(strlen(path) + 32);
+    sprintf(tmp, "%s.%ld", path, (long) getpid());
+    if (precision == FFT_PLAN_SINGLE)
+	ret = fftwf_export_wisdom_to_filename(tmp);
+    else
+	ret = fftw_export_wisdom_to_filename(tmp);
+    if (!ret || rename(tmp, path) == -1) {
+	fprintf(stderr, "%s: can't save FFTW wisdom: %s\n", path,
+	    strerror(errno));
+	unlink(tmp);
+    }
+    memory_free(tmp);
+    memory_free(path);
+}
+
+/*
+ * Destroys the plans.  Wisdom is already saved, as soon as learnt.
+ */
+void
+fft_plan_exit(void) {
+    size_t i;
+
+    pthread_mutex_lock(&fft_plan_mtx);
+    for (i = 0; i < fft_nplans; i++)
+	if (fft_plans[i].precision == FFT_PLAN_SINGLE)
+	    fftwf_destroy_plan(fft_plans[i].plan);
+	else
+	    fftw_destroy_plan(fft_plans[i].plan);
+    if (fft_plans != NULL)
+	memory_free(fft_plans);
+    fft_plans = NULL;
+    fft_nplans = 0;
+    pthread_mutex_unlock(&fft_plan_mtx);
+}
+
+/*
+ * Returns -1 for an unknown effort.
+ */
+int
+fft_plan_effort_parse(const char *name) {
+    if (strcmp(name, "estimate") == 0)
+	return FFT_PLAN_ESTIMATE;
+    if (strcmp(name, "measure") == 0)
+	return FFT_PLAN_MEASURE;
+    if (strcmp(name, "patient") == 0)
+	return FFT_PLAN_PATIENT;
+
+    return -1;
+}
+
+/*
+ * Plans on arrays of its own, aligned as asked, so that measuring doesn't
+ * overwrite the caller's.  What measuring learnt is saved right away, so
+ * that it survives runs ended by a signal.
+ */
+static void *
+fft_plan_make(int precision, int size, int sign, int in_alignment,
+							int out_alignment) {
+    size_t elt_size = precision == FFT_PLAN_SINGLE?
+	sizeof (fftwf_complex) : sizeof (fftw_complex);
+    size_t buf_size = elt_size * size + 64;
+    unsigned int flags = fft_plan_flags[fft_plan_effort];
+    char *in_buf, *out_buf;
+    void *plan = NULL;
+
+    if (precision == FFT_PLAN_SINGLE) {
+	in_buf = fftwf_malloc(buf_size);
+	out_buf = fftwf_malloc(buf_size);
+    } else {
+	in_buf = fftw_malloc(buf_size);
+	out_buf = fftw_malloc(buf_size);
+    }
+    if (in_buf == NULL || out_buf == NULL)
+	goto out;
+
+    if (precision == FFT_PLAN_SINGLE)
+	plan = fftwf_plan_dft_1d(size,
+	    (fftwf_complex *) (in_buf + in_alignment),
+	    (fftwf_complex *) (out_buf + out_alignment), sign, flags);
+    else
+	plan = fftw_plan_dft_1d(size,
+	    (fftw_complex *) (in_buf + in_alignment),
+	    (fftw_complex *) (out_buf + out_alignment), sign, flags);
+    if (plan != NULL && fft_plan_effort != FFT_PLAN_ESTIMATE)
+	fft_plan_save_wisdom(precision);
+
+out:
+    if (precision == FFT_PLAN_SINGLE) {
+	fftwf_free(in_buf);
+	fftwf_free(out_buf);
+    } else {
+	fftw_free(in_buf);
+	fftw_free(out_buf);
+    }
+    return plan;
+}
+
+/*
+ * Returns the plan made for arrays like in and out, making it first if
+ * needed, or NULL if FFTW fails.
+ */
+static void *
+fft_plan_get_any(int precision, int size, int sign, void *in, void *out) {
+    struct fft_plan_entry key, *e;
+    size_t i;
+
+    key.size = size;
+    key.precision = precision;
+    key.sign = sign;
+    if (precision == FFT_PLAN_SINGLE) {
+	key.in_alignment = fftwf_alignment_of((float *) in);
+	key.out_alignment = fftwf_alignment_of((float *) out);
+    } else {
+	key.in_alignment = fftw_alignment_of((double *) in);
+	key.out_alignment = fftw_alignment_of((double *) out);
+    }
+
+    pthread_mutex_lock(&fft_plan_mtx);
+    for (i = 0; i < fft_nplans; i++) {
+	e = &fft_plans[i];
+	if (e->size == key.size && e->precision == key.precision &&
+		e->sign == key.sign && e->in_alignment == key.in_alignment &&
+		e->out_alignment == key.out_alignment) {
+	    pthread_mutex_unlock(&fft_plan_mtx);
+	    return e->plan;
+	}
+    }
+
+    key.plan = fft_plan_make(precision, size, sign, key.in_alignment,
+	key.out_alignment);
+    if (key.plan != NULL) {
+	fft_plans = memory_realloc(fft_plans,
+	    sizeof *fft_plans * (fft_nplans + 1));
+	fft_plans[fft_nplans++] = key;
+    }
+    pthread_mutex_unlock(&fft_plan_mtx);
+
+    return key.plan;
+}
+
+fftwf_plan
+fft_plan_getf(int size, int sign, fftwf_complex *in, fftwf_complex *out) {
+    return fft_plan_get_any(FFT_PLAN_SINGLE, size, sign, in, out);
+}
+
+fftw_plan
+fft_plan_get(int size, int sign, fftw_complex *in, fftw_complex *out) {
+    return fft_plan_get_any(FFT_PLAN_DOUBLE, size, sign, in, out);
+}
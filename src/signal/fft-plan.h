@@ -0,0 +1,26 @@
+/*
+ * FFTW plans shared by all the FFTs of a size, and wisdom kept from run
+ * to run
+ */
+#ifndef SIGNAL_FFT_PLAN_H_
+#define SIGNAL_FFT_PLAN_H_
+
+#include <complex.h>
+#include <fftw3.h>
+
+#define FFT_PLAN_ESTIMATE	0
+#define FFT_PLAN_MEASURE	1
+#define FFT_PLAN_PATIENT	2
+
+void fft_plan_init(int);
+void fft_plan_exit(void);
+int fft_plan_effort_parse(const char *);
+
+/*
+ * Out of place plans, to be run with fftw(f)_execute_dft() on arrays
+ * aligned as those given, and never destroyed.
+ */
+fftwf_plan fft_plan_getf(int, int, fftwf_complex *, fftwf_complex *);
+fftw_plan fft_plan_get(int, int, fftw_complex *, fftw_complex *);
+
+#endif /* SIGNAL_FFT_PLAN_H_ */
@@ -0,0 +1,405 @@
+#include <signal/fir-decimator.h>
+
+#include <complex.h>
+#include <math.h>
+#include <string.h>
+
+#include <signal/transformer.h>
+#include <signal/transformer-type.h>
+#include <util/exception.h>
+#include <util/memory.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FIR_DECIMATOR_HAVE_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Dot product of ntaps complex samples with ntaps complex taps, given as
+ * their real and imaginary parts each repeated twice so that they line up
+ * with interleaved I/Q.  ntaps is a multiple of FIR_DECIMATOR_TAP_ALIGN.
+ */
+typedef float complex (*t_fir_decimator_kernel)(const float *, const float *,
+	const float *, size_t);
+
+struct fir_decimator_impl {
+    const char *name;
+    t_fir_decimator_kernel kernel;
+};
+
+#define FIR_DECIMATOR_TAP_ALIGN	4
+
+/*
+ * Shifting by f then filtering with h and keeping every Dth output is
+ *   y[m] = sum_n h[n] x[mD - n] e^(-2i pi f (mD - n))
+ *        = e^(-2i pi f mD) sum_n h[n] e^(2i pi f n) x[mD - n]
+ * so the shift goes into the taps, plus one rotation per output, and
+ * only the outputs which are kept get computed: that's the polyphase
+ * decimator, without the bookkeeping of explicit branches.
+ */
+struct fir_decimator {
+    unsigned int decimation;
+    unsigned int ntaps;			/* padded to FIR_DECIMATOR_TAP_ALIGN */
+    float *prototype;			/* time reversed, real */
+    float *taps_re;			/* shifted, each value twice */
+    float *taps_im;
+    double shift;			/* in cycles per input sample */
+    double phase;			/* of the next output, in cycles */
+
+    float complex *history;		/* input, oldest first */
+    size_t history_size;
+    size_t history_fill;
+    size_t history_pos;			/* start of the next output's window */
+
+    struct transformer_type type;
+};
+
+static float complex fir_decimator_kernel_scalar(const float *,
+	const float *, const float *, size_t);
+#ifdef FIR_DECIMATOR_HAVE_X86
+static float complex fir_decimator_kernel_sse2(const float *, const float *,
+	const float *, size_t);
+static float complex fir_decimator_kernel_avx2(const float *, const float *,
+	const float *, size_t);
+#endif
+static void fir_decimator_make_taps(struct fir_decimator *, unsigned int);
+static ssize_t fir_decimator_apply(struct transformer_type *, void *, size_t,
+	const void *, size_t, void *);
+
+static const struct fir_decimator_impl fir_decimator_scalar = {
+    "scalar", fir_decimator_kernel_scalar
+};
+#ifdef FIR_DECIMATOR_HAVE_X86
+static const struct fir_decimator_impl fir_decimator_sse2 = {
+    "sse2", fir_decimator_kernel_sse2
+};
+static const struct fir_decimator_impl fir_decimator_avx2 = {
+    "avx2", fir_decimator_kernel_avx2
+};
+#endif
+
+static const struct fir_decimator_impl *fir_decimator_impl;
+
+static float complex
+fir_decimator_kernel_scalar(const float *x, const float *hr, const float *hi,
+							    size_t ntaps) {
+    float re = 0, im = 0;
+    size_t i;
+
+    for (i = 0; i < 2 * ntaps; i += 2) {
+	re += x[i] * hr[i] - x[i + 1] * hi[i];
+	im += x[i] * hi[i] + x[i + 1] * hr[i];
+    }
+
+    return re + I * im;
+}
+
+#ifdef FIR_DECIMATOR_HAVE_X86
+/*
+ * Accumulates (xr hr, xi hr) and (xr hi, xi hi) lane by lane, and only
+ * combines them into a complex number at the end.
+ */
+__attribute__((target("sse2")))
+static float complex
+fir_decimator_kernel_sse2(const float *x, const float *hr, const float *hi,
+							    size_t ntaps) {
+    __m128 acc_r0 = _mm_setzero_ps(), acc_i0 = _mm_setzero_ps();
+    __m128 acc_r1 = _mm_setzero_ps(), acc_i1 = _mm_setzero_ps();
+    float r[4], i[4];
+    size_t k;
+
+    for (k = 0; k < 2 * ntaps; k += 8) {
+	__m128 x0 = _mm_loadu_ps(x + k);
+	__m128 x1 = _mm_loadu_ps(x + k + 4);
+
+	acc_r0 = _mm_add_ps(acc_r0, _mm_mul_ps(x0, _mm_loadu_ps(hr + k)));
+	acc_i0 = _mm_add_ps(acc_i0, _mm_mul_ps(x0, _mm_loadu_ps(hi + k)));
+	acc_r1 = _mm_add_ps(acc_r1,
+	    _mm_mul_ps(x1, _mm_loadu_ps(hr + k + 4)));
+	acc_i1 = _mm_add_ps(acc_i1,
+	    _mm_mul_ps(x1, _mm_loadu_ps(hi + k + 4)));
+    }
+
+    _mm_storeu_ps(r, _mm_add_ps(acc_r0, acc_r1));
+    _mm_storeu_ps(i, _mm_add_ps(acc_i0, acc_i1));
+
+    return (r[0] + r[2] - i[1] - i[3]) + I * (r[1] + r[3] + i[0] + i[2]);
+}
+
+/*
+ * Two pairs of accumulators, as the latency of an addition is longer than
+ * the time it takes to issue the next one.
+ */
+__attribute__((target("avx2")))
+static float complex
+fir_decimator_kernel_avx2(const float *x, const float *hr, const float *hi,
+							    size_t ntaps) {
+    __m256 acc_r0 = _mm256_setzero_ps(), acc_i0 = _mm256_setzero_ps();
+    __m256 acc_r1 = _mm256_setzero_ps(), acc_i1 = _mm256_setzero_ps();
+    __m128 sum_r, sum_i;
+    float r[4], i[4];
+    size_t k;
+
+    for (k = 0; k + 16 <= 2 * ntaps; k += 16) {
+	__m256 x0 = _mm256_loadu_ps(x + k);
+	__m256 x1 = _mm256_loadu_ps(x + k + 8);
+
+	acc_r0 = _mm256_add_ps(acc_r0,
+	    _mm256_mul_ps(x0, _mm256_loadu_ps(hr + k)));
+	acc_i0 = _mm256_add_ps(acc_i0,
+	    _mm256_mul_ps(x0, _mm256_loadu_ps(hi + k)));
+	acc_r1 = _mm256_add_ps(acc_r1,
+	    _mm256_mul_ps(x1, _mm256_loadu_ps(hr + k + 8)));
+	acc_i1 = _mm256_add_ps(acc_i1,
+	    _mm256_mul_ps(x1, _mm256_loadu_ps(hi + k + 8)));
+    }
+
+    if (k < 2 * ntaps) {
+	__m256 x0 = _mm256_loadu_ps(x + k);
+
+	acc_r0 = _mm256_add_ps(acc_r0,
+	    _mm256_mul_ps(x0, _mm256_loadu_ps(hr + k)));
+	acc_i0 = _mm256_add_ps(acc_i0,
+	    _mm256_mul_ps(x0, _mm256_loadu_ps(hi + k)));
+    }
+
+    acc_r0 = _mm256_add_ps(acc_r0, acc_r1);
+    acc_i0 = _mm256_add_ps(acc_i0, acc_i1);
+    sum_r = _mm_add_ps(_mm256_castps256_ps128(acc_r0),
+	_mm256_extractf128_ps(acc_r0, 1));
+    sum_i = _mm_add_ps(_mm256_castps256_ps128(acc_i0),
+	_mm256_extractf128_ps(acc_i0, 1));
+    _mm_storeu_ps(r, sum_r);
+    _mm_storeu_ps(i, sum_i);
+
+    return (r[0] + r[2] - i[1] - i[3]) + I * (r[1] + r[3] + i[0] + i[2]);
+}
+#endif /* FIR_DECIMATOR_HAVE_X86 */
+
+/*
+ * Select the implementation to use, FIR_DECIMATOR_BEST picking the
+ * fastest one the CPU supports.  Returns -1 if the CPU doesn't support
+ * the requested one.
+ */
+int
+fir_decimator_use(int which) {
+    const struct fir_decimator_impl *impl = &fir_decimator_scalar;
+
+#ifdef FIR_DECIMATOR_HAVE_X86
+    __builtin_cpu_init();
+
+    switch (which) {
+    case FIR_DECIMATOR_BEST:
+	if (__builtin_cpu_supports("avx2"))
+	    impl = &fir_decimator_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+	    impl = &fir_decimator_sse2;
+	break;
+    case FIR_DECIMATOR_SSE2:
+	if (!__builtin_cpu_supports("sse2"))
+	    return -1;
+	impl = &fir_decimator_sse2;
+	break;
+    case FIR_DECIMATOR_AVX2:
+	if (!__builtin_cpu_supports("avx2"))
+	    return -1;
+	impl = &fir_decimator_avx2;
+	break;
+    }
+#else
+    if (which != FIR_DECIMATOR_BEST && which != FIR_DECIMATOR_SCALAR)
+	return -1;
+#endif
+
+    fir_decimator_impl = impl;
+
+    return 0;
+}
+
+const char *
+fir_decimator_get_implementation_name(void) {
+    if (fir_decimator_impl == NULL)
+	fir_decimator_use(FIR_DECIMATOR_BEST);
+
+    return fir_decimator_impl->name;
+}
+
+/*
+ * Blackman windowed sinc cut at the output Nyquist frequency, with unity
+ * gain at DC.  The padding taps, at the old end, stay zero.
+ */
+static void
+fir_decimator_make_taps(struct fir_decimator *d, unsigned int n) {
+    double fc = 0.5 / d->decimation;
+    double sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+	double x = i - (n - 1) / 2.0;
+	double w = n == 1? 1 : 0.42 - 0.5 * cos(2 * M_PI * i / (n - 1)) +
+	    0.08 * cos(4 * M_PI * i / (n - 1));
+	double s = x == 0? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+
+	d->prototype[d->ntaps - 1 - i] = s * w;
+	sum += s * w;
+    }
+
+    for (i = 0; i < n; i++)
+	d->prototype[d->ntaps - 1 - i] /= sum;
+}
+
+struct fir_decimator *
+fir_decimator_new(unsigned int decimation, unsigned int taps_per_phase) {
+    struct fir_decimator *d;
+    unsigned int n = decimation * taps_per_phase;
+    unsigned int i;
+
+    if (decimation == 0 || taps_per_phase == 0)
+	EXCEPTION_RAISE(logic_error, "bad decimator geometry");
+
+    if (fir_decimator_impl == NULL)
+	fir_decimator_use(FIR_DECIMATOR_BEST);
+
+    d = memory_alloc(sizeof *d);
+    d->decimation = decimation;
+    d->ntaps = (n + FIR_DECIMATOR_TAP_ALIGN - 1) / FIR_DECIMATOR_TAP_ALIGN *
+	FIR_DECIMATOR_TAP_ALIGN;
+    d->prototype = memory_alloc(d->ntaps * sizeof *d->prototype);
+    for (i = 0; i < d->ntaps; i++)
+	d->prototype[i] = 0;
+    fir_decimator_make_taps(d, n);
+
+    d->taps_re = memory_alloc(2 * d->ntaps * sizeof *d->taps_re);
+    d->taps_im = memory_alloc(2 * d->ntaps * sizeof *d->taps_im);
+    fir_decimator_set_shift(d, 0);
+
+    d->history_size = d->ntaps + (size_t) decimation * FIR_DECIMATOR_CHUNK_SIZE;
+    d->history = memory_alloc(d->history_size * sizeof *d->history);
+    fir_decimator_reset(d);
+
+    d->type.name = "fir decimator";
+    d->type.input_elem_size = sizeof (struct samplef);
+    d->type.output_elem_size = sizeof (struct samplef);
+    d->type.input_chunk_max_size = (size_t) decimation *
+	FIR_DECIMATOR_CHUNK_SIZE * sizeof (struct samplef);
+    d->type.output_chunk_max_size =
+	FIR_DECIMATOR_CHUNK_SIZE * sizeof (struct samplef);
+    d->type.apply = fir_decimator_apply;
+
+    return d;
+}
+
+/*
+ * Transformers made from it must be gone already.
+ */
+void
+fir_decimator_delete(struct fir_decimator *d) {
+    memory_free(d->taps_re);
+    memory_free(d->taps_im);
+    memory_free(d->prototype);
+    memory_free(d->history);
+    memory_free(d);
+}
+
+/*
+ * Bring what's at shift cycles per input sample (e.g. -0.1 for 100kHz
+ * below the center of a 1MS/s input) to DC.
+ */
+void
+fir_decimator_set_shift(struct fir_decimator *d, double shift) {
+    unsigned int i;
+
+    d->shift = shift;
+    d->phase = 0;
+
+    /* Tap i of the reversed prototype applies to x[mD - (ntaps - 1 - i)] */
+    for (i = 0; i < d->ntaps; i++) {
+	double complex h = d->prototype[i] *
+	    cexp(2 * M_PI * I * shift * (d->ntaps - 1 - i));
+
+	d->taps_re[2 * i] = d->taps_re[2 * i + 1] = creal(h);
+	d->taps_im[2 * i] = d->taps_im[2 * i + 1] = cimag(h);
+    }
+}
+
+unsigned int
+fir_decimator_get_decimation(struct fir_decimator *d) {
+    return d->decimation;
+}
+
+/*
+ * Forget past input, as if preceded by zeros.
+ */
+void
+fir_decimator_reset(struct fir_decimator *d) {
+    memset(d->history, 0, (d->ntaps - 1) * sizeof *d->history);
+    d->history_fill = d->ntaps - 1;
+    d->history_pos = 0;
+    d->phase = 0;
+}
+
+/*
+ * Consumes all n input samples and writes one output for every D of them.
+ * Returns the number of outputs, at most ceil(n / D).
+ */
+size_t
+fir_decimator_process(struct fir_decimator *d, const struct samplef *in,
+					size_t n, struct samplef *out) {
+    t_fir_decimator_kernel kernel = fir_decimator_impl->kernel;
+    double step = d->shift * d->decimation;
+    size_t nout = 0;
+
+    step -= floor(step);
+
+    while (n != 0) {
+	size_t room = d->history_size - d->history_fill;
+
+	if (room > n)
+	    room = n;
+	memcpy(d->history + d->history_fill, in, room * sizeof *in);
+	d->history_fill += room;
+	in += room;
+	n -= room;
+
+	while (d->history_pos + d->ntaps <= d->history_fill) {
+	    float complex y = kernel(
+		(const float *) (d->history + d->history_pos),
+		d->taps_re, d->taps_im, d->ntaps);
+
+	    if (d->shift != 0) {
+		y *= cexpf(-2 * M_PI * I * d->phase);
+		d->phase += step;
+		if (d->phase >= 1)
+		    d->phase -= 1;
+	    }
+
+	    out[nout++].v = y;
+	    d->history_pos += d->decimation;
+	}
+
+	memmove(d->history, d->history + d->history_pos,
+	    (d->history_fill - d->history_pos) * sizeof *d->history);
+	d->history_fill -= d->history_pos;
+	d->history_pos = 0;
+    }
+
+    return nout;
+}
+
+static ssize_t
+fir_decimator_apply(struct transformer_type *type, void *dest,
+	size_t dest_size, const void *src, size_t src_size, void *aux) {
+    struct fir_decimator *d = aux;
+    size_t n = src_size / sizeof (struct samplef);
+
+    if ((n + d->decimation - 1) / d->decimation * type->output_elem_size >
+								dest_size)
+	return -1;
+
+    return fir_decimator_process(d, src, n, dest) * type->output_elem_size;
+}
+
+struct transformer *
+fir_decimator_transformer_new(struct fir_decimator *d) {
+    return transformer_new(&d->type, d);
+}
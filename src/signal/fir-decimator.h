@@ -0,0 +1,37 @@
+/*
+ * Frequency translating FIR filter, decimating by any integer
+ */
+#ifndef SIGNAL_FIR_DECIMATOR_H_
+#define SIGNAL_FIR_DECIMATOR_H_
+
+#include <stddef.h>
+
+#include <signal/sample.h>
+
+struct fir_decimator;
+struct transformer;
+
+#define FIR_DECIMATOR_DEFAULT_TAPS_PER_PHASE	16
+
+/* Output samples per chunk for the transformer */
+#define FIR_DECIMATOR_CHUNK_SIZE		4096
+
+#define FIR_DECIMATOR_SCALAR		0
+#define FIR_DECIMATOR_SSE2		1
+#define FIR_DECIMATOR_AVX2		2
+#define FIR_DECIMATOR_BEST		-1
+
+struct fir_decimator *fir_decimator_new(unsigned int, unsigned int);
+void fir_decimator_delete(struct fir_decimator *);
+void fir_decimator_set_shift(struct fir_decimator *, double);
+unsigned int fir_decimator_get_decimation(struct fir_decimator *);
+void fir_decimator_reset(struct fir_decimator *);
+size_t fir_decimator_process(struct fir_decimator *, const struct samplef *,
+	size_t, struct samplef *);
+
+struct transformer *fir_decimator_transformer_new(struct fir_decimator *);
+
+int fir_decimator_use(int);
+const char *fir_decimator_get_implementation_name(void);
+
+#endif /* SIGNAL_FIR_DECIMATOR_H_ */
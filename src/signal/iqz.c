@@ -0,0 +1,989 @@
+#include <signal/iqz.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include <signal/sample.h>
+#include <util/memory.h>
+#include <util/thread-pool.h>
+
+/*
+ * File layout, all integers little endian:
+ *
+ *   header	magic[8], version, encoding, block_nsamples, flags (u32),
+ *		nsamples, index_offset (u64)
+ *   blocks	csize, nsamples (u32), then csize bytes
+ *   index	nblocks (u64), then per block: offset of its header (u64),
+ *		csize, nsamples (u32)
+ *
+ * index_offset is 0 until the writer is done; the index of an unfinished
+ * file is rebuilt by walking the blocks.
+ */
+#define IQZ_VERSION		1
+#define IQZ_HEADER_SIZE		40
+#define IQZ_BLOCK_HEADER_SIZE	8
+#define IQZ_INDEX_ENTRY_SIZE	16
+
+/*
+ * A block is a sequence of frames of IQZ_FRAME_NVALUES values, made
+ * unsigned by flipping the sign bit.  A frame starts with a byte holding
+ * its mode (bit 7) and bit width (bits 0 to 4):
+ *
+ *   reference	the minimum (1 or 2 bytes), then each value minus it
+ *   delta	each value minus the previous one of the same component,
+ *		zigzag coded
+ *
+ * then the values packed LSB first.  A block which would not get smaller
+ * is stored as is: csize is then that of the raw samples.
+ */
+#define IQZ_FRAME_DELTA		0x80
+#define IQZ_FRAME_BITS_MASK	0x1f
+
+/* Blocks decoded or encoded ahead, per thread */
+#define IQZ_SLOTS_PER_THREAD	2
+
+struct iqz_index_entry {
+    uint64_t offset;
+    uint64_t sample_start;
+    uint32_t csize;
+    uint32_t nsamples;
+};
+
+struct iqz_slot {
+    void *owner;			/* writer or reader */
+    unsigned char *raw;
+    unsigned char *packed;
+    size_t nsamples;
+    size_t csize;
+    size_t block;			/* reader only */
+    int busy;				/* handed to the pool */
+    int error;
+};
+
+struct iqz_writer {
+    int fd;
+    int encoding;
+    size_t sample_size;
+    struct thread_pool *pool;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    unsigned int nslots;
+    struct iqz_slot *slots;
+    unsigned int fill;			/* slot being filled */
+    unsigned int oldest;		/* first one not written out */
+    unsigned int nqueued;		/* submitted and not written out */
+    uint64_t nsamples;
+    uint64_t offset;
+    size_t nblocks;
+    struct iqz_index_entry *index;
+    int error;				/* errno */
+};
+
+struct iqz_reader {
+    int fd;
+    int encoding;
+    size_t sample_size;
+    uint32_t block_nsamples;
+    uint64_t nsamples;
+    size_t nblocks;
+    struct iqz_index_entry *index;
+    struct thread_pool *pool;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    unsigned int nslots;
+    struct iqz_slot *slots;
+    unsigned int nbusy;
+    size_t next_block;			/* returned by the next call */
+    size_t next_submit;			/* blocks before it are in slots */
+    size_t skip;			/* samples, in next_block */
+};
+
+static unsigned int iqz_value_width(int);
+static unsigned int iqz_bit_length(unsigned int);
+static unsigned char *iqz_pack(unsigned char *, const uint16_t *, size_t,
+	unsigned int);
+static const unsigned char *iqz_unpack(const unsigned char *,
+	const unsigned char *, uint16_t *, size_t, unsigned int);
+static void iqz_put32(unsigned char *, uint32_t);
+static void iqz_put64(unsigned char *, uint64_t);
+static uint32_t iqz_get32(const unsigned char *);
+static uint64_t iqz_get64(const unsigned char *);
+static int iqz_write_all(int, const void *, size_t);
+static int iqz_read_all(int, void *, size_t, off_t);
+static void iqz_slots_new(struct iqz_slot **, unsigned int, void *, size_t,
+	size_t);
+static void iqz_slots_delete(struct iqz_slot *, unsigned int);
+static void iqz_compress_task(void *);
+static void iqz_writer_submit(struct iqz_writer *);
+static void iqz_writer_flush_oldest(struct iqz_writer *);
+static int iqz_reader_load_index(struct iqz_reader *, uint64_t);
+static int iqz_reader_walk_blocks(struct iqz_reader *);
+static void iqz_decompress_task(void *);
+static void iqz_reader_wait_idle(struct iqz_reader *);
+
+/*
+ * Bytes per packable value, 0 for encodings stored as they are.
+ */
+static unsigned int
+iqz_value_width(int encoding) {
+    switch (encoding) {
+    case SAMPLE_ENCODING_UC8:
+    case SAMPLE_ENCODING_SC8:
+    case SAMPLE_ENCODING_U8:
+	return 1;
+    case SAMPLE_ENCODING_SC16:
+    case SAMPLE_ENCODING_S16:
+	return 2;
+    default:
+	return 0;
+    }
+}
+
+static unsigned int
+iqz_bit_length(unsigned int x) {
+    return x == 0? 0 : 32 - __builtin_clz(x);
+}
+
+static unsigned char *
+iqz_pack(unsigned char *out, const uint16_t *v, size_t n, unsigned int bits) {
+    uint64_t acc = 0;
+    unsigned int nacc = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	acc |= (uint64_t) v[i] << nacc;
+	nacc += bits;
+	if (nacc >= 32) {
+	    iqz_put32(out, acc);
+	    out += 4;
+	    acc >>= 32;
+	    nacc -= 32;
+	}
+    }
+    for (; nacc > 0; nacc = nacc > 8? nacc - 8 : 0) {
+	*out++ = acc;
+	acc >>= 8;
+    }
+
+    return out;
+}
+
+/*
+ * The caller checked that the packed values are all before end.
+ */
+static const unsigned char *
+iqz_unpack(const unsigned char *in, const unsigned char *end, uint16_t *v,
+						size_t n, unsigned int bits) {
+    size_t len = (n * bits + 7) / 8;
+    uint32_t mask = (1u << bits) - 1;
+    size_t i, pos;
+
+    /* A value is within the 4 bytes from its first one */
+    if ((size_t) (end - in) >= len + 4) {
+	for (i = 0, pos = 0; i < n; i++, pos += bits)
+	    v[i] = iqz_get32(in + (pos >> 3)) >> (pos & 7) & mask;
+    } else {
+	const unsigned char *p = in;
+	uint64_t acc = 0;
+	unsigned int nacc = 0;
+
+	for (i = 0; i < n; i++) {
+	    while (nacc < bits) {
+		acc |= (uint64_t) *p++ << nacc;
+		nacc += 8;
+	    }
+	    v[i] = acc & mask;
+	    acc >>= bits;
+	    nacc -= bits;
+	}
+    }
+
+    return in + len;
+}
+
+static void
+iqz_put32(unsigned char *p, uint32_t x) {
+    p[0] = x;
+    p[1] = x >> 8;
+    p[2] = x >> 16;
+    p[3] = x >> 24;
+}
+
+static void
+iqz_put64(unsigned char *p, uint64_t x) {
+    iqz_put32(p, x);
+    iqz_put32(p + 4, x >> 32);
+}
+
+static uint32_t
+iqz_get32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t
+iqz_get64(const unsigned char *p) {
+    return iqz_get32(p) | (uint64_t) iqz_get32(p + 4) << 32;
+}
+
+size_t
+iqz_block_bound(int encoding, size_t nsamples) {
+    size_t nvalues = nsamples * 2;
+
+    return nsamples * sample_encoding_size(encoding) +
+	(nvalues / IQZ_FRAME_NVALUES + 1) * 3;
+}
+
+/*
+ * dest must hold iqz_block_bound() bytes.  Returns the compressed size.
+ */
+size_t
+iqz_block_compress(int encoding, const void *src, size_t nsamples,
+							unsigned char *dest) {
+    unsigned int width = iqz_value_width(encoding);
+    size_t raw_size = nsamples * sample_encoding_size(encoding);
+    const unsigned char *in = src;
+    unsigned char *out = dest;
+    unsigned int bits = width * 8;
+    unsigned int stride = encoding < SAMPLE_ENCODING_U8? 2 : 1;
+    uint32_t mask, flip;
+    uint16_t prev[2];
+    size_t nvalues, i;
+
+    if (width == 0)
+	goto raw;
+
+    mask = (1u << bits) - 1;
+    flip = encoding == SAMPLE_ENCODING_UC8 ||
+	encoding == SAMPLE_ENCODING_U8? 0 : 1u << (bits - 1);
+    nvalues = raw_size / width;
+    prev[0] = prev[1] = 1u << (bits - 1);
+
+    for (i = 0; i < nvalues; i += IQZ_FRAME_NVALUES) {
+	uint16_t v[IQZ_FRAME_NVALUES], z[IQZ_FRAME_NVALUES];
+	size_t n = nvalues - i;
+	uint32_t lo = mask, hi = 0, zor = 0;
+	unsigned int for_bits, delta_bits;
+	size_t j;
+
+	if (n > IQZ_FRAME_NVALUES)
+	    n = IQZ_FRAME_NVALUES;
+
+	if (width == 1)
+	    for (j = 0; j < n; j++)
+		v[j] = in[i + j] ^ flip;
+	else
+	    for (j = 0; j < n; j++)
+		v[j] = (in[2 * (i + j)] | in[2 * (i + j) + 1] << 8) ^ flip;
+
+	/* Frames hold whole samples, so value j is of component j % stride */
+	for (j = 0; j < stride; j++)
+	    z[j] = v[j] - prev[j];
+	for (j = stride; j < n; j++)
+	    z[j] = v[j] - v[j - stride];
+	for (j = 0; j < n; j++) {
+	    /* Zigzag of the difference seen as a signed bits wide value */
+	    int32_t d = (int32_t) ((uint32_t) z[j] << (32 - bits)) >>
+		(32 - bits);
+
+	    z[j] = ((uint32_t) d << 1 ^ (uint32_t) (d >> 31)) & mask;
+	    zor |= z[j];
+	    lo = v[j] < lo? v[j] : lo;
+	    hi = v[j] > hi? v[j] : hi;
+	}
+	for (j = 0; j < stride; j++)
+	    prev[j] = v[n - stride + j];
+
+	for_bits = iqz_bit_length(hi - lo);
+	delta_bits = iqz_bit_length(zor);
+
+	if (1 + (n * delta_bits + 7) / 8 < width + 1 + (n * for_bits + 7) / 8) {
+	    *out++ = IQZ_FRAME_DELTA | delta_bits;
+	    out = iqz_pack(out, z, n, delta_bits);
+	} else {
+	    *out++ = for_bits;
+	    *out++ = lo;
+	    if (width == 2)
+		*out++ = lo >> 8;
+	    for (j = 0; j < n; j++)
+		v[j] -= lo;
+	    out = iqz_pack(out, v, n, for_bits);
+	}
+
+	if ((size_t) (out - dest) >= raw_size)
+	    goto raw;
+    }
+
+    return out - dest;
+
+raw:
+    memcpy(dest, src, raw_size);
+    return raw_size;
+}
+
+/*
+ * Returns -1 if src is not a valid block of nsamples samples.
+ */
+int
+iqz_block_decompress(int encoding, const unsigned char *src, size_t csize,
+					    void *dest, size_t nsamples) {
+    unsigned int width = iqz_value_width(encoding);
+    size_t raw_size = nsamples * sample_encoding_size(encoding);
+    const unsigned char *end = src + csize;
+    unsigned char *out = dest;
+    unsigned int bits = width * 8;
+    unsigned int stride = encoding < SAMPLE_ENCODING_U8? 2 : 1;
+    uint32_t mask, flip;
+    uint32_t prev[2];
+    size_t nvalues, i;
+
+    if (csize == raw_size) {
+	memcpy(dest, src, raw_size);
+	return 0;
+    }
+    if (width == 0)
+	return -1;
+
+    mask = (1u << bits) - 1;
+    flip = encoding == SAMPLE_ENCODING_UC8 ||
+	encoding == SAMPLE_ENCODING_U8? 0 : 1u << (bits - 1);
+    nvalues = raw_size / width;
+    prev[0] = prev[1] = 1u << (bits - 1);
+
+    for (i = 0; i < nvalues; i += IQZ_FRAME_NVALUES) {
+	uint16_t v[IQZ_FRAME_NVALUES];
+	size_t n = nvalues - i;
+	unsigned int mode, fbits;
+	uint32_t lo = 0;
+	size_t j;
+
+	if (n > IQZ_FRAME_NVALUES)
+	    n = IQZ_FRAME_NVALUES;
+
+	if (src == end)
+	    return -1;
+	mode = *src & IQZ_FRAME_DELTA;
+	fbits = *src++ & IQZ_FRAME_BITS_MASK;
+	if (fbits > bits)
+	    return -1;
+	if (!mode) {
+	    if ((size_t) (end - src) < width)
+		return -1;
+	    lo = width == 1? src[0] : src[0] | src[1] << 8;
+	    src += width;
+	}
+	if ((size_t) (end - src) < (n * fbits + 7) / 8)
+	    return -1;
+	src = iqz_unpack(src, end, v, n, fbits);
+
+	if (mode)
+	    for (j = 0; j < n; j++) {
+		uint32_t *p = &prev[j % stride];
+
+		/* Undo the zigzag, modulo 2^bits */
+		*p = (*p + (v[j] & 1? ~(uint32_t) (v[j] >> 1) :
+		    (uint32_t) (v[j] >> 1))) & mask;
+		v[j] = *p;
+	    }
+	else {
+	    for (j = 0; j < n; j++)
+		v[j] += lo;
+	    for (j = 0; j < stride; j++)
+		prev[j] = v[n - stride + j];
+	}
+
+	if (width == 1)
+	    for (j = 0; j < n; j++)
+		*out++ = v[j] ^ flip;
+	else
+	    for (j = 0; j < n; j++) {
+		uint32_t x = v[j] ^ flip;
+
+		*out++ = x;
+		*out++ = x >> 8;
+	    }
+    }
+
+    return src == end? 0 : -1;
+}
+
+static int
+iqz_write_all(int fd, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+
+    while (len != 0) {
+	ssize_t n = write(fd, p, len);
+
+	if (n == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * pread() is safe from several threads at once.  A short file is EINVAL.
+ */
+static int
+iqz_read_all(int fd, void *buf, size_t len, off_t offset) {
+    unsigned char *p = buf;
+
+    while (len != 0) {
+	ssize_t n = pread(fd, p, len, offset);
+
+	if (n == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (n == 0) {
+	    errno = EINVAL;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+	offset += n;
+    }
+
+    return 0;
+}
+
+int
+iqz_fd_is_iqz(int fd) {
+    unsigned char magic[IQZ_MAGIC_SIZE];
+
+    return iqz_read_all(fd, magic, sizeof magic, 0) == 0 &&
+	memcmp(magic, IQZ_MAGIC, IQZ_MAGIC_SIZE) == 0;
+}
+
+static void
+iqz_slots_new(struct iqz_slot **slotsp, unsigned int nslots, void *owner,
+					size_t raw_size, size_t packed_size) {
+    struct iqz_slot *slots = memory_alloc(nslots * sizeof *slots);
+    unsigned int i;
+
+    for (i = 0; i < nslots; i++) {
+	slots[i].owner = owner;
+	slots[i].raw = memory_alloc(raw_size);
+	slots[i].packed = memory_alloc(packed_size);
+	slots[i].nsamples = 0;
+	slots[i].csize = 0;
+	slots[i].block = 0;
+	slots[i].busy = 0;
+	slots[i].error = 0;
+    }
+
+    *slotsp = slots;
+}
+
+static void
+iqz_slots_delete(struct iqz_slot *slots, unsigned int nslots) {
+    unsigned int i;
+
+    for (i = 0; i < nslots; i++) {
+	memory_free(slots[i].raw);
+	memory_free(slots[i].packed);
+    }
+    memory_free(slots);
+}
+
+/*
+ * Blocks are compressed by the pool in any order and written out in
+ * order by the caller's thread, nthreads at a time (0 for one per CPU).
+ * fd must be a new, seekable file, as the header is written at its start
+ * and completed there on close.
+ */
+struct iqz_writer *
+iqz_writer_new(int fd, int encoding, unsigned int nthreads) {
+    struct iqz_writer *w;
+    unsigned char header[IQZ_HEADER_SIZE];
+
+    if (sample_encoding_size(encoding) == 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    memset(header, 0, sizeof header);
+    memcpy(header, IQZ_MAGIC, IQZ_MAGIC_SIZE);
+    iqz_put32(header + 8, IQZ_VERSION);
+    iqz_put32(header + 12, encoding);
+    iqz_put32(header + 16, IQZ_BLOCK_NSAMPLES);
+    if (iqz_write_all(fd, header, sizeof header) == -1)
+	return NULL;
+
+    if (nthreads == 0)
+	nthreads = thread_pool_default_nthreads();
+
+    w = memory_alloc(sizeof *w);
+    w->fd = fd;
+    w->encoding = encoding;
+    w->sample_size = sample_encoding_size(encoding);
+    w->pool = thread_pool_new(nthreads);
+    pthread_mutex_init(&w->mtx, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->nslots = nthreads * IQZ_SLOTS_PER_THREAD;
+    iqz_slots_new(&w->slots, w->nslots, w,
+	IQZ_BLOCK_NSAMPLES * w->sample_size,
+	IQZ_BLOCK_HEADER_SIZE + iqz_block_bound(encoding, IQZ_BLOCK_NSAMPLES));
+    w->fill = 0;
+    w->oldest = 0;
+    w->nqueued = 0;
+    w->nsamples = 0;
+    w->offset = IQZ_HEADER_SIZE;
+    w->nblocks = 0;
+    w->index = NULL;
+    w->error = 0;
+
+    return w;
+}
+
+static void
+iqz_compress_task(void *arg) {
+    struct iqz_slot *s = arg;
+    struct iqz_writer *w = s->owner;
+
+    s->csize = iqz_block_compress(w->encoding, s->raw, s->nsamples,
+	s->packed + IQZ_BLOCK_HEADER_SIZE);
+    iqz_put32(s->packed, s->csize);
+    iqz_put32(s->packed + 4, s->nsamples);
+
+    pthread_mutex_lock(&w->mtx);
+    s->busy = 0;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->mtx);
+}
+
+static void
+iqz_writer_submit(struct iqz_writer *w) {
+    struct iqz_slot *s = &w->slots[w->fill];
+
+    s->busy = 1;
+    thread_pool_submit(w->pool, iqz_compress_task, s);
+    w->nqueued++;
+    w->fill = (w->fill + 1) % w->nslots;
+}
+
+/*
+ * After an error, blocks are still waited for but no longer written.
+ */
+static void
+iqz_writer_flush_oldest(struct iqz_writer *w) {
+    struct iqz_slot *s = &w->slots[w->oldest];
+    struct iqz_index_entry *e;
+    size_t len;
+
+    pthread_mutex_lock(&w->mtx);
+    while (s->busy)
+	pthread_cond_wait(&w->cond, &w->mtx);
+    pthread_mutex_unlock(&w->mtx);
+
+    w->oldest = (w->oldest + 1) % w->nslots;
+    w->nqueued--;
+
+    if (w->error != 0)
+	goto out;
+
+    len = IQZ_BLOCK_HEADER_SIZE + s->csize;
+    if (iqz_write_all(w->fd, s->packed, len) == -1) {
+	w->error = errno;
+	goto out;
+    }
+
+    /* Grow by powers of two */
+    if ((w->nblocks & (w->nblocks - 1)) == 0)
+	w->index = memory_realloc(w->index,
+	    (w->nblocks == 0? 1 : 2 * w->nblocks) * sizeof *w->index);
+    e = &w->index[w->nblocks++];
+    e->offset = w->offset;
+    e->sample_start = w->nsamples;
+    e->csize = s->csize;
+    e->nsamples = s->nsamples;
+
+    w->offset += len;
+    w->nsamples += s->nsamples;
+
+out:
+    /* Ready to be filled again */
+    s->nsamples = 0;
+    s->csize = 0;
+}
+
+/*
+ * len is in bytes and need not be a whole number of samples.
+ */
+int
+iqz_writer_write(struct iqz_writer *w, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    size_t block_size = IQZ_BLOCK_NSAMPLES * w->sample_size;
+
+    while (len != 0 && w->error == 0) {
+	struct iqz_slot *s = &w->slots[w->fill];
+	size_t filled, chunk;
+
+	/* The slot to fill is the oldest one when all are queued */
+	if (w->nqueued == w->nslots)
+	    iqz_writer_flush_oldest(w);
+
+	/* Bytes of a partial sample are counted in csize until complete */
+	filled = s->nsamples * w->sample_size + s->csize;
+	chunk = block_size - filled;
+	if (chunk > len)
+	    chunk = len;
+	memcpy(s->raw + filled, p, chunk);
+	filled += chunk;
+	p += chunk;
+	len -= chunk;
+	s->nsamples = filled / w->sample_size;
+	s->csize = filled % w->sample_size;
+
+	if (s->nsamples == IQZ_BLOCK_NSAMPLES)
+	    iqz_writer_submit(w);
+    }
+
+    if (w->error != 0) {
+	errno = w->error;
+	return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Writes what is left, the index and the final header.  fd is left
+ * open.  Returns -1 with errno set if anything could not be written.
+ */
+int
+iqz_writer_close(struct iqz_writer *w) {
+    struct iqz_slot *s = &w->slots[w->fill];
+    unsigned char buf[IQZ_INDEX_ENTRY_SIZE];
+    int error;
+    size_t i;
+
+    if (w->nqueued == w->nslots)
+	iqz_writer_flush_oldest(w);
+    /* A trailing partial sample is dropped */
+    s->csize = 0;
+    if (s->nsamples != 0)
+	iqz_writer_submit(w);
+    while (w->nqueued != 0)
+	iqz_writer_flush_oldest(w);
+
+    if (w->error == 0) {
+	iqz_put64(buf, w->nblocks);
+	if (iqz_write_all(w->fd, buf, 8) == -1)
+	    w->error = errno;
+    }
+    for (i = 0; i < w->nblocks && w->error == 0; i++) {
+	iqz_put64(buf, w->index[i].offset);
+	iqz_put32(buf + 8, w->index[i].csize);
+	iqz_put32(buf + 12, w->index[i].nsamples);
+	if (iqz_write_all(w->fd, buf, IQZ_INDEX_ENTRY_SIZE) == -1)
+	    w->error = errno;
+    }
+
+    if (w->error == 0) {
+	iqz_put64(buf, w->nsamples);
+	iqz_put64(buf + 8, w->offset);
+	if (pwrite(w->fd, buf, 16, 24) != 16)
+	    w->error = errno != 0? errno : EIO;
+    }
+
+    error = w->error;
+    thread_pool_delete(w->pool);
+    iqz_slots_delete(w->slots, w->nslots);
+    pthread_mutex_destroy(&w->mtx);
+    pthread_cond_destroy(&w->cond);
+    if (w->index != NULL)
+	memory_free(w->index);
+    memory_free(w);
+
+    if (error != 0) {
+	errno = error;
+	return -1;
+    }
+
+    return 0;
+}
+
+static int
+iqz_reader_load_index(struct iqz_reader *r, uint64_t index_offset) {
+    unsigned char buf[IQZ_INDEX_ENTRY_SIZE];
+    uint64_t nblocks, start = 0;
+    size_t i;
+
+    if (index_offset < IQZ_HEADER_SIZE) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (iqz_read_all(r->fd, buf, 8, index_offset) == -1)
+	return -1;
+    nblocks = iqz_get64(buf);
+    if (nblocks > (index_offset - IQZ_HEADER_SIZE) / IQZ_BLOCK_HEADER_SIZE) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    r->nblocks = nblocks;
+    r->index = memory_alloc((nblocks + 1) * sizeof *r->index);
+    for (i = 0; i < nblocks; i++) {
+	struct iqz_index_entry *e = &r->index[i];
+
+	if (iqz_read_all(r->fd, buf, IQZ_INDEX_ENTRY_SIZE,
+		index_offset + 8 + i * IQZ_INDEX_ENTRY_SIZE) == -1)
+	    return -1;
+	e->offset = iqz_get64(buf) + IQZ_BLOCK_HEADER_SIZE;
+	e->csize = iqz_get32(buf + 8);
+	e->nsamples = iqz_get32(buf + 12);
+	e->sample_start = start;
+	if (e->nsamples == 0 || e->nsamples > r->block_nsamples ||
+		e->csize > iqz_block_bound(r->encoding, e->nsamples)) {
+	    errno = EINVAL;
+	    return -1;
+	}
+	start += e->nsamples;
+    }
+    r->nsamples = start;
+
+    return 0;
+}
+
+/*
+ * For files whose writer never finished: whatever complete blocks are
+ * there can be read.
+ */
+static int
+iqz_reader_walk_blocks(struct iqz_reader *r) {
+    struct stat st;
+    uint64_t offset = IQZ_HEADER_SIZE, start = 0;
+    size_t size = 0;
+
+    if (fstat(r->fd, &st) == -1)
+	return -1;
+
+    r->index = NULL;
+    r->nblocks = 0;
+    while (offset + IQZ_BLOCK_HEADER_SIZE <= (uint64_t) st.st_size) {
+	unsigned char buf[IQZ_BLOCK_HEADER_SIZE];
+	struct iqz_index_entry *e;
+	uint32_t csize, nsamples;
+
+	if (iqz_read_all(r->fd, buf, sizeof buf, offset) == -1)
+	    return -1;
+	csize = iqz_get32(buf);
+	nsamples = iqz_get32(buf + 4);
+	if (nsamples == 0 || nsamples > r->block_nsamples ||
+		csize > iqz_block_bound(r->encoding, nsamples) ||
+		offset + sizeof buf + csize > (uint64_t) st.st_size)
+	    break;
+
+	if (r->nblocks == size) {
+	    size = size == 0? 64 : 2 * size;
+	    r->index = memory_realloc(r->index, size * sizeof *r->index);
+	}
+	e = &r->index[r->nblocks++];
+	e->offset = offset + sizeof buf;
+	e->csize = csize;
+	e->nsamples = nsamples;
+	e->sample_start = start;
+	start += nsamples;
+	offset += sizeof buf + csize;
+    }
+    r->nsamples = start;
+
+    return 0;
+}
+
+/*
+ * Returns NULL with errno set, to EINVAL if fd is not a valid file.
+ * Blocks are read and decompressed ahead by nthreads threads (0 for one
+ * per CPU).
+ */
+struct iqz_reader *
+iqz_reader_open(int fd, unsigned int nthreads) {
+    unsigned char header[IQZ_HEADER_SIZE];
+    struct iqz_reader *r;
+    uint64_t index_offset;
+    int ret;
+
+    if (iqz_read_all(fd, header, sizeof header, 0) == -1)
+	return NULL;
+    if (memcmp(header, IQZ_MAGIC, IQZ_MAGIC_SIZE) != 0 ||
+	    iqz_get32(header + 8) != IQZ_VERSION ||
+	    sample_encoding_size(iqz_get32(header + 12)) == 0 ||
+	    iqz_get32(header + 16) == 0 ||
+	    iqz_get32(header + 16) > 16 * IQZ_BLOCK_NSAMPLES) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    r = memory_alloc(sizeof *r);
+    r->fd = fd;
+    r->encoding = iqz_get32(header + 12);
+    r->sample_size = sample_encoding_size(r->encoding);
+    r->block_nsamples = iqz_get32(header + 16);
+    r->index = NULL;
+
+    index_offset = iqz_get64(header + 32);
+    if (index_offset != 0)
+	ret = iqz_reader_load_index(r, index_offset);
+    else
+	ret = iqz_reader_walk_blocks(r);
+    if (ret == -1) {
+	int saved_errno = errno;
+
+	if (r->index != NULL)
+	    memory_free(r->index);
+	memory_free(r);
+	errno = saved_errno;
+	return NULL;
+    }
+
+    if (nthreads == 0)
+	nthreads = thread_pool_default_nthreads();
+
+    r->pool = thread_pool_new(nthreads);
+    pthread_mutex_init(&r->mtx, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    r->nslots = nthreads * IQZ_SLOTS_PER_THREAD;
+    iqz_slots_new(&r->slots, r->nslots, r, r->block_nsamples * r->sample_size,
+	iqz_block_bound(r->encoding, r->block_nsamples));
+    r->nbusy = 0;
+    r->next_block = 0;
+    r->next_submit = 0;
+    r->skip = 0;
+
+    return r;
+}
+
+int
+iqz_reader_get_encoding(struct iqz_reader *r) {
+    return r->encoding;
+}
+
+uint64_t
+iqz_reader_get_nsamples(struct iqz_reader *r) {
+    return r->nsamples;
+}
+
+static void
+iqz_decompress_task(void *arg) {
+    struct iqz_slot *s = arg;
+    struct iqz_reader *r = s->owner;
+    const struct iqz_index_entry *e = &r->index[s->block];
+
+    s->nsamples = e->nsamples;
+    s->error = iqz_read_all(r->fd, s->packed, e->csize, e->offset) == -1 ||
+	iqz_block_decompress(r->encoding, s->packed, e->csize, s->raw,
+	    e->nsamples) == -1;
+
+    pthread_mutex_lock(&r->mtx);
+    s->busy = 0;
+    r->nbusy--;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->mtx);
+}
+
+/*
+ * Points *datap to the next samples, valid until the next call.  Returns
+ * their number, 0 at the end or -1 on error.
+ */
+ssize_t
+iqz_reader_next(struct iqz_reader *r, const void **datap) {
+    struct iqz_slot *s;
+    size_t skip;
+
+    /* The slot of the block returned last is free again */
+    while (r->next_submit < r->nblocks &&
+	    r->next_submit < r->next_block + r->nslots) {
+	s = &r->slots[r->next_submit % r->nslots];
+	s->block = r->next_submit++;
+	s->busy = 1;
+	pthread_mutex_lock(&r->mtx);
+	r->nbusy++;
+	pthread_mutex_unlock(&r->mtx);
+	thread_pool_submit(r->pool, iqz_decompress_task, s);
+    }
+
+    if (r->next_block == r->nblocks)
+	return 0;
+
+    s = &r->slots[r->next_block % r->nslots];
+    pthread_mutex_lock(&r->mtx);
+    while (s->busy)
+	pthread_cond_wait(&r->cond, &r->mtx);
+    pthread_mutex_unlock(&r->mtx);
+
+    if (s->error)
+	return -1;
+
+    skip = r->skip;
+    r->skip = 0;
+    r->next_block++;
+    *datap = s->raw + skip * r->sample_size;
+
+    return s->nsamples - skip;
+}
+
+static void
+iqz_reader_wait_idle(struct iqz_reader *r) {
+    pthread_mutex_lock(&r->mtx);
+    while (r->nbusy != 0)
+	pthread_cond_wait(&r->cond, &r->mtx);
+    pthread_mutex_unlock(&r->mtx);
+}
+
+/*
+ * Blocks already read ahead are thrown away, even those still wanted.
+ */
+int
+iqz_reader_seek(struct iqz_reader *r, uint64_t sample) {
+    size_t lo = 0, hi = r->nblocks;
+
+    if (sample > r->nsamples)
+	return -1;
+
+    iqz_reader_wait_idle(r);
+
+    /* The last block starting at or before sample */
+    while (hi - lo > 1) {
+	size_t mid = lo + (hi - lo) / 2;
+
+	if (r->index[mid].sample_start <= sample)
+	    lo = mid;
+	else
+	    hi = mid;
+    }
+
+    if (sample == r->nsamples) {
+	r->next_block = r->nblocks;
+	r->skip = 0;
+    } else {
+	r->next_block = lo;
+	r->skip = sample - r->index[lo].sample_start;
+    }
+    r->next_submit = r->next_block;
+
+    return 0;
+}
+
+/*
+ * fd is left open.
+ */
+void
+iqz_reader_close(struct iqz_reader *r) {
+    iqz_reader_wait_idle(r);
+    thread_pool_delete(r->pool);
+    iqz_slots_delete(r->slots, r->nslots);
+    pthread_mutex_destroy(&r->mtx);
+    pthread_cond_destroy(&r->cond);
+    memory_free(r->index);
+    memory_free(r);
+}
@@ -0,0 +1,41 @@
+/*
+ * Compressed recordings of integer samples, made of independent blocks
+ * with an index for seeking
+ */
+#ifndef SIGNAL_IQZ_H_
+#define SIGNAL_IQZ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct iqz_writer;
+struct iqz_reader;
+
+#define IQZ_MAGIC		"SORAIQZ1"
+#define IQZ_MAGIC_SIZE		8
+
+/* Samples per block, the unit of compression, threading and seeking */
+#define IQZ_BLOCK_NSAMPLES	(64 * 1024)
+
+/* Values (I and Q counting as two) sharing a bit width within a block */
+#define IQZ_FRAME_NVALUES	128
+
+size_t iqz_block_bound(int, size_t);
+size_t iqz_block_compress(int, const void *, size_t, unsigned char *);
+int iqz_block_decompress(int, const unsigned char *, size_t, void *, size_t);
+
+int iqz_fd_is_iqz(int);
+
+struct iqz_writer *iqz_writer_new(int, int, unsigned int);
+int iqz_writer_write(struct iqz_writer *, const void *, size_t);
+int iqz_writer_close(struct iqz_writer *);
+
+struct iqz_reader *iqz_reader_open(int, unsigned int);
+int iqz_reader_get_encoding(struct iqz_reader *);
+uint64_t iqz_reader_get_nsamples(struct iqz_reader *);
+ssize_t iqz_reader_next(struct iqz_reader *, const void **);
+int iqz_reader_seek(struct iqz_reader *, uint64_t);
+void iqz_reader_close(struct iqz_reader *);
+
+#endif /* SIGNAL_IQZ_H_ */
@@ -0,0 +1,456 @@
+#include <signal/pipeline.h>
+
+#include <pthread.h>
+
+#include <signal/transformer.h>
+#include <signal/transformer-type.h>
+#include <util/async-buffer.h>
+#include <util/exception.h>
+#include <util/list.h>
+#include <util/memory.h>
+#include <util/thread-pool.h>
+
+/*
+ * Output of a stage, shared read-only by all its consumers.  It goes back
+ * to the producer's pool when the last of them is done with it.
+ */
+struct pipeline_chunk {
+    struct pipeline_stage *owner;
+    void *data;
+    size_t size;
+    int refcount;
+    struct pipeline_chunk *next;	/* in the owner's free list */
+};
+
+/*
+ * A stage is never run by two workers at once: whoever wakes an idle stage
+ * submits it, and waking a running stage makes it look for work again
+ * before going idle.
+ * Chunks come in through "input", a single producer, single consumer queue
+ * of chunk pointers where NULL marks the end of the stream.
+ */
+struct pipeline_stage {
+    struct pipeline *pipeline;
+    struct transformer *trans;
+    struct async_buffer *input;		/* NULL for a source */
+    struct pipeline_stage **consumers;
+    unsigned int nconsumers;
+    struct pipeline_chunk *chunks;	/* pool of the stage's output */
+    unsigned int nchunks;
+    struct pipeline_chunk *free_chunks;
+    pthread_mutex_t free_mtx;
+    struct pipeline_chunk *current;	/* input chunk being consumed */
+    size_t current_offset;
+    size_t input_max_size;
+    void *scratch;			/* output buffer if no consumer */
+    int scheduled;			/* PIPELINE_STAGE_* */
+    int done;
+    int failed;
+};
+
+#define PIPELINE_STAGE_IDLE	0
+#define PIPELINE_STAGE_RUNNING	1
+#define PIPELINE_STAGE_WOKEN	2
+
+struct pipeline {
+    t_list transformers;
+    unsigned int depth;
+    unsigned int nthreads;
+    struct thread_pool *pool;
+    unsigned int nstages_left;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    int stop;
+    int failed;
+};
+
+static struct pipeline_chunk *pipeline_stage_get_chunk(
+	struct pipeline_stage *);
+static void pipeline_chunk_release(struct pipeline_chunk *);
+static void pipeline_stage_wake(struct pipeline_stage *);
+static void pipeline_stage_send(struct pipeline_stage *,
+	struct pipeline_chunk *);
+static void pipeline_stage_finish(struct pipeline_stage *);
+static int pipeline_stage_step(struct pipeline_stage *);
+static void pipeline_stage_task(void *);
+static struct pipeline_stage *pipeline_find_stage(struct pipeline_stage *,
+	unsigned int, struct transformer *);
+
+static struct pipeline_chunk *
+pipeline_stage_get_chunk(struct pipeline_stage *stage) {
+    struct pipeline_chunk *chunk;
+
+    pthread_mutex_lock(&stage->free_mtx);
+    chunk = stage->free_chunks;
+    if (chunk != NULL)
+	stage->free_chunks = chunk->next;
+    pthread_mutex_unlock(&stage->free_mtx);
+
+    return chunk;
+}
+
+/*
+ * Called by each consumer once done with the chunk.  The last one gives it
+ * back to its producer, which may have been waiting for it.
+ */
+static void
+pipeline_chunk_release(struct pipeline_chunk *chunk) {
+    struct pipeline_stage *owner = chunk->owner;
+
+    if (__atomic_sub_fetch(&chunk->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+	return;
+
+    pthread_mutex_lock(&owner->free_mtx);
+    chunk->next = owner->free_chunks;
+    owner->free_chunks = chunk;
+    pthread_mutex_unlock(&owner->free_mtx);
+
+    pipeline_stage_wake(owner);
+}
+
+static void
+pipeline_stage_wake(struct pipeline_stage *stage) {
+    if (__atomic_exchange_n(&stage->scheduled, PIPELINE_STAGE_WOKEN,
+					__ATOMIC_SEQ_CST) == PIPELINE_STAGE_IDLE)
+	thread_pool_submit(stage->pipeline->pool, pipeline_stage_task, stage);
+}
+
+/*
+ * chunk is NULL at the end of the stream.  There is always room in the
+ * queues: they can hold every chunk of the producer plus the end.
+ */
+static void
+pipeline_stage_send(struct pipeline_stage *stage,
+					struct pipeline_chunk *chunk) {
+    unsigned int i;
+
+    if (chunk != NULL)
+	chunk->refcount = stage->nconsumers;
+
+    for (i = 0; i < stage->nconsumers; i++) {
+	async_buffer_write(stage->consumers[i]->input, &chunk, sizeof chunk);
+	pipeline_stage_wake(stage->consumers[i]);
+    }
+}
+
+static void
+pipeline_stage_finish(struct pipeline_stage *stage) {
+    struct pipeline *p = stage->pipeline;
+
+    stage->done = 1;
+    pipeline_stage_send(stage, NULL);
+
+    pthread_mutex_lock(&p->mtx);
+    if (--p->nstages_left == 0)
+	pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->mtx);
+}
+
+/*
+ * Runs apply() once if there is input and somewhere to put the output.
+ * Returns 0 if it couldn't.
+ */
+static int
+pipeline_stage_step(struct pipeline_stage *stage) {
+    struct pipeline *p = stage->pipeline;
+    struct transformer_type *type = transformer_get_type(stage->trans);
+    struct pipeline_chunk *out = NULL;
+    const void *src = NULL;
+    void *dest = stage->scratch;
+    size_t size = 0;
+    ssize_t n;
+
+    if (stage->done)
+	return 0;
+
+    if (stage->input != NULL && stage->current == NULL) {
+	if (async_buffer_read(stage->input, &stage->current,
+					sizeof stage->current) == -1)
+	    return 0;
+	stage->current_offset = 0;
+	if (stage->current == NULL) {
+	    pipeline_stage_finish(stage);
+	    return 1;
+	}
+    }
+
+    if (stage->input == NULL && __atomic_load_n(&p->stop, __ATOMIC_RELAXED)) {
+	pipeline_stage_finish(stage);
+	return 1;
+    }
+
+    /* After a failure, keep draining so that producers don't block */
+    if (stage->failed) {
+	pipeline_chunk_release(stage->current);
+	stage->current = NULL;
+	return 1;
+    }
+
+    if (stage->nconsumers != 0) {
+	out = pipeline_stage_get_chunk(stage);
+	if (out == NULL)
+	    return 0;
+	dest = out->data;
+    }
+
+    if (stage->current != NULL) {
+	src = (const char *) stage->current->data + stage->current_offset;
+	size = stage->current->size - stage->current_offset;
+	if (size > stage->input_max_size)
+	    size = stage->input_max_size;
+    }
+
+    n = type->apply(type, dest,
+	transformer_get_output_chunk_max_size(stage->trans), src, size,
+	transformer_get_private(stage->trans));
+
+    if (n == -1) {
+	stage->failed = 1;
+	__atomic_store_n(&p->failed, 1, __ATOMIC_RELAXED);
+	pipeline_stop(p);
+    }
+
+    if (out != NULL) {
+	if (n > 0) {
+	    out->size = n;
+	    pipeline_stage_send(stage, out);
+	} else {
+	    pthread_mutex_lock(&stage->free_mtx);
+	    out->next = stage->free_chunks;
+	    stage->free_chunks = out;
+	    pthread_mutex_unlock(&stage->free_mtx);
+	}
+    }
+
+    if (stage->current == NULL) {
+	if (n <= 0)
+	    pipeline_stage_finish(stage);
+    } else {
+	stage->current_offset += size;
+	if (stage->current_offset == stage->current->size) {
+	    pipeline_chunk_release(stage->current);
+	    stage->current = NULL;
+	}
+    }
+
+    return 1;
+}
+
+static void
+pipeline_stage_task(void *arg) {
+    struct pipeline_stage *stage = arg;
+    int running = PIPELINE_STAGE_RUNNING;
+
+    __atomic_store_n(&stage->scheduled, PIPELINE_STAGE_RUNNING,
+	__ATOMIC_SEQ_CST);
+
+    for (;;) {
+	while (pipeline_stage_step(stage))
+	    ;
+
+	/* Unless woken up meanwhile, as there may be new work then */
+	if (__atomic_compare_exchange_n(&stage->scheduled, &running,
+		PIPELINE_STAGE_IDLE, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+	    break;
+	running = PIPELINE_STAGE_RUNNING;
+	__atomic_store_n(&stage->scheduled, PIPELINE_STAGE_RUNNING,
+	    __ATOMIC_SEQ_CST);
+    }
+}
+
+struct pipeline *
+pipeline_new(void) {
+    struct pipeline *p = memory_alloc(sizeof *p);
+
+    p->transformers = NULL;
+    p->depth = PIPELINE_DEFAULT_DEPTH;
+    p->nthreads = 0;
+    p->pool = NULL;
+    p->stop = 0;
+    p->failed = 0;
+    pthread_mutex_init(&p->mtx, NULL);
+    pthread_cond_init(&p->cond, NULL);
+
+    return p;
+}
+
+/*
+ * The transformers themselves are left alone.
+ */
+void
+pipeline_delete(struct pipeline *p) {
+    while (p->transformers != NULL)
+	p->transformers =
+	    list_delete_elt(p->transformers, list_car(p->transformers));
+    pthread_mutex_destroy(&p->mtx);
+    pthread_cond_destroy(&p->cond);
+    memory_free(p);
+}
+
+void
+pipeline_add(struct pipeline *p, struct transformer *trans) {
+    p->transformers = list_cons(trans, p->transformers);
+}
+
+void
+pipeline_set_depth(struct pipeline *p, unsigned int depth) {
+    if (depth == 0)
+	EXCEPTION_RAISE(logic_error, "pipeline depth must be positive");
+    p->depth = depth;
+}
+
+/*
+ * 0 means one per online processor.
+ */
+void
+pipeline_set_threads(struct pipeline *p, unsigned int nthreads) {
+    p->nthreads = nthreads;
+}
+
+/*
+ * Make sources stop at their next chunk, which ends the whole pipeline.
+ * Can be called from any thread.
+ */
+void
+pipeline_stop(struct pipeline *p) {
+    __atomic_store_n(&p->stop, 1, __ATOMIC_RELAXED);
+}
+
+static struct pipeline_stage *
+pipeline_find_stage(struct pipeline_stage *stages, unsigned int nstages,
+						struct transformer *trans) {
+    unsigned int i;
+
+    for (i = 0; i < nstages; i++)
+	if (stages[i].trans == trans)
+	    return &stages[i];
+
+    EXCEPTION_RAISE(logic_error, "transformer connected outside of pipeline");
+}
+
+/*
+ * Runs the transformers on a pool of worker threads until all sources are
+ * done and everything they produced has been consumed.  Returns -1 if any
+ * transformer failed.
+ */
+int
+pipeline_run(struct pipeline *p) {
+    unsigned int nstages = list_length(p->transformers);
+    struct pipeline_stage *stages = memory_alloc(nstages * sizeof *stages);
+    unsigned int i, j;
+    t_list l;
+
+    for (i = 0, l = p->transformers; l != NULL; i++, l = list_cdr(l)) {
+	struct transformer *trans = list_car(l);
+	struct transformer_type *type = transformer_get_type(trans);
+	struct pipeline_stage *stage = &stages[i];
+	size_t max_size = transformer_get_input_chunk_max_size(trans);
+
+	if (list_length(transformer_get_producers(trans)) > 1)
+	    EXCEPTION_RAISE(logic_error,
+		"pipeline stages have at most one producer");
+	if (max_size < (size_t) type->input_elem_size)
+	    EXCEPTION_RAISE(logic_error,
+		"input chunks can't hold a single element");
+
+	if (type->input_elem_size > 0)
+	    max_size -= max_size % type->input_elem_size;
+
+	stage->pipeline = p;
+	stage->trans = trans;
+	stage->input = NULL;
+	stage->consumers = NULL;
+	stage->nconsumers = list_length(transformer_get_consumers(trans));
+	stage->chunks = NULL;
+	stage->nchunks = 0;
+	stage->free_chunks = NULL;
+	pthread_mutex_init(&stage->free_mtx, NULL);
+	stage->current = NULL;
+	stage->current_offset = 0;
+	stage->input_max_size = max_size;
+	stage->scratch = NULL;
+	stage->scheduled = PIPELINE_STAGE_IDLE;
+	stage->done = 0;
+	stage->failed = 0;
+    }
+
+    for (i = 0; i < nstages; i++) {
+	struct pipeline_stage *stage = &stages[i];
+	t_list producers = transformer_get_producers(stage->trans);
+	size_t size = transformer_get_output_chunk_max_size(stage->trans);
+
+	if (producers != NULL) {
+	    (void) pipeline_find_stage(stages, nstages, list_car(producers));
+	    /* One more slot for the end of stream */
+	    stage->input = async_buffer_new((p->depth + 1) *
+		sizeof (struct pipeline_chunk *), 0);
+	}
+
+	if (transformer_get_type(stage->trans)->output_elem_size == 0)
+	    continue;
+
+	if (size == TRANSFORMER_CHUNK_SIZE_UNLIMITED)
+	    EXCEPTION_RAISE(logic_error,
+		"pipeline stages need a bounded output chunk size");
+
+	if (stage->nconsumers == 0) {
+	    stage->scratch = memory_alloc(size);
+	    continue;
+	}
+
+	stage->consumers =
+	    memory_alloc(stage->nconsumers * sizeof *stage->consumers);
+	for (j = 0, l = transformer_get_consumers(stage->trans); l != NULL;
+						j++, l = list_cdr(l))
+	    stage->consumers[j] = pipeline_find_stage(stages, nstages,
+		list_car(l));
+
+	stage->chunks = memory_alloc(p->depth * sizeof *stage->chunks);
+	stage->nchunks = p->depth;
+	for (j = 0; j < p->depth; j++) {
+	    stage->chunks[j].owner = stage;
+	    stage->chunks[j].data = memory_alloc(size);
+	    stage->chunks[j].size = 0;
+	    stage->chunks[j].refcount = 0;
+	    stage->chunks[j].next = stage->free_chunks;
+	    stage->free_chunks = &stage->chunks[j];
+	}
+    }
+
+    p->stop = 0;
+    p->failed = 0;
+    p->nstages_left = nstages;
+    p->pool = thread_pool_new(p->nthreads != 0? p->nthreads :
+	thread_pool_default_nthreads());
+
+    /* Everything else gets scheduled as data flows from the sources */
+    for (i = 0; i < nstages; i++)
+	if (stages[i].input == NULL)
+	    pipeline_stage_wake(&stages[i]);
+
+    pthread_mutex_lock(&p->mtx);
+    while (p->nstages_left != 0)
+	pthread_cond_wait(&p->cond, &p->mtx);
+    pthread_mutex_unlock(&p->mtx);
+
+    /* Waits for the stragglers, like the wakeups of finished producers */
+    thread_pool_delete(p->pool);
+    p->pool = NULL;
+
+    for (i = 0; i < nstages; i++) {
+	if (stages[i].input != NULL)
+	    async_buffer_delete(stages[i].input);
+	for (j = 0; j < stages[i].nchunks; j++)
+	    memory_free(stages[i].chunks[j].data);
+	if (stages[i].chunks != NULL)
+	    memory_free(stages[i].chunks);
+	if (stages[i].consumers != NULL)
+	    memory_free(stages[i].consumers);
+	if (stages[i].scratch != NULL)
+	    memory_free(stages[i].scratch);
+	pthread_mutex_destroy(&stages[i].free_mtx);
+    }
+    memory_free(stages);
+
+    return p->failed? -1 : 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * Runs a graph of connected transformers on a pool of threads.  A producer
+ * may have several consumers, which all read the same chunks.
+ */
+#ifndef SIGNAL_PIPELINE_H_
+#define SIGNAL_PIPELINE_H_
+
+struct pipeline;
+struct transformer;
+
+/* Chunks in flight from a producer to its consumers */
+#define PIPELINE_DEFAULT_DEPTH	4
+
+struct pipeline *pipeline_new(void);
+void pipeline_delete(struct pipeline *);
+void pipeline_add(struct pipeline *, struct transformer *);
+void pipeline_set_depth(struct pipeline *, unsigned int);
+void pipeline_set_threads(struct pipeline *, unsigned int);
+int pipeline_run(struct pipeline *);
+void pipeline_stop(struct pipeline *);
+
+#endif /* SIGNAL_PIPELINE_H_ */
@@ -0,0 +1,59 @@
+#include <signal/sample-convert-transformer.h>
+
+#include <signal/sample-convert.h>
+#include <signal/transformer.h>
+#include <signal/transformer-type.h>
+#include <util/exception.h>
+#include <util/memory.h>
+
+struct sample_convert_transformer {
+    struct transformer_type type;
+    int encoding;
+};
+
+static ssize_t sample_convert_transformer_apply(struct transformer_type *,
+	void *, size_t, const void *, size_t, void *);
+
+static ssize_t
+sample_convert_transformer_apply(struct transformer_type *type, void *dest,
+	size_t dest_size, const void *src, size_t src_size, void *aux) {
+    struct sample_convert_transformer *ct = aux;
+    size_t n = src_size / type->input_elem_size;
+
+    (void) dest_size;
+
+    if (sample_convert_float(ct->encoding, src, dest, n) == -1)
+	return -1;
+
+    return n * sizeof (struct samplef);
+}
+
+struct transformer *
+sample_convert_transformer_new(int encoding) {
+    struct sample_convert_transformer *ct;
+    size_t size = sample_encoding_size(encoding);
+
+    if (size == 0)
+	EXCEPTION_RAISE(logic_error, "unknown sample encoding");
+
+    ct = memory_alloc(sizeof *ct);
+    ct->encoding = encoding;
+    ct->type.name = "sample convert";
+    ct->type.input_elem_size = size;
+    ct->type.output_elem_size = sizeof (struct samplef);
+    ct->type.input_chunk_max_size =
+	SAMPLE_CONVERT_TRANSFORMER_CHUNK_SIZE * size;
+    ct->type.output_chunk_max_size =
+	SAMPLE_CONVERT_TRANSFORMER_CHUNK_SIZE * sizeof (struct samplef);
+    ct->type.apply = sample_convert_transformer_apply;
+
+    return transformer_new(&ct->type, ct);
+}
+
+void
+sample_convert_transformer_delete(struct transformer *t) {
+    struct sample_convert_transformer *ct = transformer_get_private(t);
+
+    transformer_delete(t);
+    memory_free(ct);
+}
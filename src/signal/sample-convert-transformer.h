@@ -0,0 +1,14 @@
+/*
+ * Transformer converting raw samples of an encoding to struct samplef
+ */
+#ifndef SIGNAL_SAMPLE_CONVERT_TRANSFORMER_H_
+#define SIGNAL_SAMPLE_CONVERT_TRANSFORMER_H_
+
+struct transformer;
+
+#define SAMPLE_CONVERT_TRANSFORMER_CHUNK_SIZE	16384	/* in samples */
+
+struct transformer *sample_convert_transformer_new(int);
+void sample_convert_transformer_delete(struct transformer *);
+
+#endif /* SIGNAL_SAMPLE_CONVERT_TRANSFORMER_H_ */
@@ -0,0 +1,455 @@
+
+#include <signal/sample-convert.h>
+
+#include <inttypes.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SAMPLE_CONVERT_HAVE_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Every encoding boils down to a stream of 8 or 16 bit integer components,
+ * each one becoming a float or double once scaled to [-1, 1).  Unsigned
+ * components are biased by 128.  Real encodings get a null imaginary part,
+ * so their output has twice as many components as their input.
+ *
+ * Kernels take the number of input components, not of samples.
+ */
+typedef void (*t_sample_convert_kernel)(const void *, void *, size_t,
+	int /* is_unsigned */, int /* is_real */);
+
+struct sample_convert_impl {
+    const char *name;
+    t_sample_convert_kernel convert_8_to_float;
+    t_sample_convert_kernel convert_8_to_double;
+    t_sample_convert_kernel convert_16_to_float;
+    t_sample_convert_kernel convert_16_to_double;
+};
+
+/*
+ * Scalar reference implementation, also used for the tails of vectors.
+ */
+#define SAMPLE_CONVERT_SCALAR_KERNEL(name, in_type, out_type, bias, scale) \
+static void								\
+name(const void *src, void *dst, size_t n, int is_unsigned, int is_real) { \
+    const in_type *in = src;						\
+    out_type *out = dst;						\
+    size_t i;								\
+									\
+    for (i = 0; i < n; i++) {						\
+	out_type v = ((in_type) in[i] ^ (is_unsigned? (bias) : 0)) *	\
+			(out_type) (scale);				\
+	if (is_real) {							\
+	    out[2 * i] = v;						\
+	    out[2 * i + 1] = 0;						\
+	} else								\
+	    out[i] = v;							\
+    }									\
+}
+
+/*
+ * Flipping the top bit of an unsigned byte and reading it as signed is
+ * the same as subtracting 128.
+ */
+SAMPLE_CONVERT_SCALAR_KERNEL(sample_convert_scalar_8_to_float,
+	int8_t, float, -128, 1 / 128.)
+SAMPLE_CONVERT_SCALAR_KERNEL(sample_convert_scalar_8_to_double,
+	int8_t, double, -128, 1 / 128.)
+SAMPLE_CONVERT_SCALAR_KERNEL(sample_convert_scalar_16_to_float,
+	int16_t, float, 0, 1 / 32768.)
+SAMPLE_CONVERT_SCALAR_KERNEL(sample_convert_scalar_16_to_double,
+	int16_t, double, 0, 1 / 32768.)
+
+static const struct sample_convert_impl sample_convert_scalar = {
+    "scalar",
+    sample_convert_scalar_8_to_float,
+    sample_convert_scalar_8_to_double,
+    sample_convert_scalar_16_to_float,
+    sample_convert_scalar_16_to_double,
+};
+
+#ifdef SAMPLE_CONVERT_HAVE_X86
+
+/*
+ * SSE2: integers are sign-extended to 32 bits by unpacking them with
+ * themselves and shifting arithmetically, then converted and scaled.
+ */
+__attribute__((target("sse2")))
+static inline float *
+sample_convert_sse2_store_float(float *out, __m128i v, __m128 scale,
+							int is_real) {
+    __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(v), scale);
+
+    if (!is_real) {
+	_mm_storeu_ps(out, f);
+	return out + 4;
+    }
+
+    _mm_storeu_ps(out, _mm_unpacklo_ps(f, _mm_setzero_ps()));
+    _mm_storeu_ps(out + 4, _mm_unpackhi_ps(f, _mm_setzero_ps()));
+    return out + 8;
+}
+
+__attribute__((target("sse2")))
+static inline double *
+sample_convert_sse2_store_double(double *out, __m128i v, __m128d scale,
+							int is_real) {
+    __m128d d0 = _mm_mul_pd(_mm_cvtepi32_pd(v), scale);
+    __m128d d1 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xee)),
+	scale);
+
+    if (!is_real) {
+	_mm_storeu_pd(out, d0);
+	_mm_storeu_pd(out + 2, d1);
+	return out + 4;
+    }
+
+    _mm_storeu_pd(out, _mm_unpacklo_pd(d0, _mm_setzero_pd()));
+    _mm_storeu_pd(out + 2, _mm_unpackhi_pd(d0, _mm_setzero_pd()));
+    _mm_storeu_pd(out + 4, _mm_unpacklo_pd(d1, _mm_setzero_pd()));
+    _mm_storeu_pd(out + 6, _mm_unpackhi_pd(d1, _mm_setzero_pd()));
+    return out + 8;
+}
+
+#define SAMPLE_CONVERT_SSE2_KERNEL_8(name, out_type, scale_type, scale, \
+								store)	\
+__attribute__((target("sse2")))						\
+static void								\
+name(const void *src, void *dst, size_t n, int is_unsigned, int is_real) { \
+    const uint8_t *in = src;						\
+    out_type *out = dst;						\
+    const __m128i flip = _mm_set1_epi8(is_unsigned? (char) 0x80 : 0);	\
+    const scale_type sc = scale;					\
+    size_t i;								\
+									\
+    for (i = 0; i + 16 <= n; i += 16) {					\
+	__m128i b = _mm_xor_si128(					\
+	    _mm_loadu_si128((const __m128i *) (in + i)), flip);		\
+	__m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8);	\
+	__m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(b, b), 8);	\
+									\
+	out = store(out, _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16), \
+	    sc, is_real);						\
+	out = store(out, _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16), \
+	    sc, is_real);						\
+	out = store(out, _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16), \
+	    sc, is_real);						\
+	out = store(out, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16), \
+	    sc, is_real);						\
+    }									\
+									\
+    sample_convert_scalar_8_to_ ## out_type(in + i, out, n - i,	\
+	is_unsigned, is_real);						\
+}
+
+#define SAMPLE_CONVERT_SSE2_KERNEL_16(name, out_type, scale_type, scale, \
+								store)	\
+__attribute__((target("sse2")))						\
+static void								\
+name(const void *src, void *dst, size_t n, int is_unsigned, int is_real) { \
+    const int16_t *in = src;						\
+    out_type *out = dst;						\
+    const scale_type sc = scale;					\
+    size_t i;								\
+									\
+    for (i = 0; i + 8 <= n; i += 8) {					\
+	__m128i w = _mm_loadu_si128((const __m128i *) (in + i));	\
+									\
+	out = store(out, _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16),	\
+	    sc, is_real);						\
+	out = store(out, _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16),	\
+	    sc, is_real);						\
+    }									\
+									\
+    sample_convert_scalar_16_to_ ## out_type(in + i, out, n - i,	\
+	is_unsigned, is_real);						\
+}
+
+SAMPLE_CONVERT_SSE2_KERNEL_8(sample_convert_sse2_8_to_float,
+	float, __m128, _mm_set1_ps(1 / 128.f),
+	sample_convert_sse2_store_float)
+SAMPLE_CONVERT_SSE2_KERNEL_8(sample_convert_sse2_8_to_double,
+	double, __m128d, _mm_set1_pd(1 / 128.),
+	sample_convert_sse2_store_double)
+SAMPLE_CONVERT_SSE2_KERNEL_16(sample_convert_sse2_16_to_float,
+	float, __m128, _mm_set1_ps(1 / 32768.f),
+	sample_convert_sse2_store_float)
+SAMPLE_CONVERT_SSE2_KERNEL_16(sample_convert_sse2_16_to_double,
+	double, __m128d, _mm_set1_pd(1 / 32768.),
+	sample_convert_sse2_store_double)
+
+static const struct sample_convert_impl sample_convert_sse2 = {
+    "sse2",
+    sample_convert_sse2_8_to_float,
+    sample_convert_sse2_8_to_double,
+    sample_convert_sse2_16_to_float,
+    sample_convert_sse2_16_to_double,
+};
+
+/*
+ * AVX2: vpmovsx sign-extends eight integers to 32 bits at once.  Unpacking
+ * works within 128 bit lanes, hence the permutations to interleave real
+ * values with zeroes.
+ */
+__attribute__((target("avx2")))
+static inline float *
+sample_convert_avx2_store_float(float *out, __m256i v, __m256 scale,
+							int is_real) {
+    __m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale);
+    __m256 lo, hi;
+
+    if (!is_real) {
+	_mm256_storeu_ps(out, f);
+	return out + 8;
+    }
+
+    lo = _mm256_unpacklo_ps(f, _mm256_setzero_ps());
+    hi = _mm256_unpackhi_ps(f, _mm256_setzero_ps());
+    _mm256_storeu_ps(out, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    return out + 16;
+}
+
+__attribute__((target("avx2")))
+static inline double *
+sample_convert_avx2_store_double_4(double *out, __m128i v, __m256d scale,
+							int is_real) {
+    __m256d d = _mm256_mul_pd(_mm256_cvtepi32_pd(v), scale);
+    __m256d lo, hi;
+
+    if (!is_real) {
+	_mm256_storeu_pd(out, d);
+	return out + 4;
+    }
+
+    lo = _mm256_unpacklo_pd(d, _mm256_setzero_pd());
+    hi = _mm256_unpackhi_pd(d, _mm256_setzero_pd());
+    _mm256_storeu_pd(out, _mm256_permute2f128_pd(lo, hi, 0x20));
+    _mm256_storeu_pd(out + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+    return out + 8;
+}
+
+__attribute__((target("avx2")))
+static inline double *
+sample_convert_avx2_store_double(double *out, __m256i v, __m256d scale,
+							int is_real) {
+    out = sample_convert_avx2_store_double_4(out,
+	_mm256_castsi256_si128(v), scale, is_real);
+    return sample_convert_avx2_store_double_4(out,
+	_mm256_extracti128_si256(v, 1), scale, is_real);
+}
+
+#define SAMPLE_CONVERT_AVX2_KERNEL_8(name, out_type, scale_type, scale, \
+								store)	\
+__attribute__((target("avx2")))						\
+static void								\
+name(const void *src, void *dst, size_t n, int is_unsigned, int is_real) { \
+    const uint8_t *in = src;						\
+    out_type *out = dst;						\
+    const __m128i flip = _mm_set1_epi8(is_unsigned? (char) 0x80 : 0);	\
+    const scale_type sc = scale;					\
+    size_t i;								\
+									\
+    for (i = 0; i + 16 <= n; i += 16) {					\
+	__m128i b = _mm_xor_si128(					\
+	    _mm_loadu_si128((const __m128i *) (in + i)), flip);		\
+									\
+	out = store(out, _mm256_cvtepi8_epi32(b), sc, is_real);		\
+	out = store(out, _mm256_cvtepi8_epi32(_mm_srli_si128(b, 8)),	\
+	    sc, is_real);						\
+    }									\
+									\
+    sample_convert_scalar_8_to_ ## out_type(in + i, out, n - i,	\
+	is_unsigned, is_real);						\
+}
+
+#define SAMPLE_CONVERT_AVX2_KERNEL_16(name, out_type, scale_type, scale, \
+								store)	\
+__attribute__((target("avx2")))						\
+static void								\
+name(const void *src, void *dst, size_t n, int is_unsigned, int is_real) { \
+    const int16_t *in = src;						\
+    out_type *out = dst;						\
+    const scale_type sc = scale;					\
+    size_t i;								\
+									\
+    for (i = 0; i + 16 <= n; i += 16) {					\
+	__m128i w0 = _mm_loadu_si128((const __m128i *) (in + i));	\
+	__m128i w1 = _mm_loadu_si128((const __m128i *) (in + i + 8));	\
+									\
+	out = store(out, _mm256_cvtepi16_epi32(w0), sc, is_real);	\
+	out = store(out, _mm256_cvtepi16_epi32(w1), sc, is_real);	\
+    }									\
+									\
+    sample_convert_scalar_16_to_ ## out_type(in + i, out, n - i,	\
+	is_unsigned, is_real);						\
+}
+
+SAMPLE_CONVERT_AVX2_KERNEL_8(sample_convert_avx2_8_to_float,
+	float, __m256, _mm256_set1_ps(1 / 128.f),
+	sample_convert_avx2_store_float)
+SAMPLE_CONVERT_AVX2_KERNEL_8(sample_convert_avx2_8_to_double,
+	double, __m256d, _mm256_set1_pd(1 / 128.),
+	sample_convert_avx2_store_double)
+SAMPLE_CONVERT_AVX2_KERNEL_16(sample_convert_avx2_16_to_float,
+	float, __m256, _mm256_set1_ps(1 / 32768.f),
+	sample_convert_avx2_store_float)
+SAMPLE_CONVERT_AVX2_KERNEL_16(sample_convert_avx2_16_to_double,
+	double, __m256d, _mm256_set1_pd(1 / 32768.),
+	sample_convert_avx2_store_double)
+
+static const struct sample_convert_impl sample_convert_avx2 = {
+    "avx2",
+    sample_convert_avx2_8_to_float,
+    sample_convert_avx2_8_to_double,
+    sample_convert_avx2_16_to_float,
+    sample_convert_avx2_16_to_double,
+};
+
+#endif /* SAMPLE_CONVERT_HAVE_X86 */
+
+static const struct sample_convert_impl *sample_convert_impl;
+
+/*
+ * Select the implementation to use, SAMPLE_CONVERT_BEST picking the
+ * fastest one the CPU supports.  Returns -1 if the CPU doesn't support
+ * the requested one.
+ */
+int
+sample_convert_use(int which) {
+    const struct sample_convert_impl *impl = &sample_convert_scalar;
+
+#ifdef SAMPLE_CONVERT_HAVE_X86
+    __builtin_cpu_init();
+
+    switch (which) {
+    case SAMPLE_CONVERT_BEST:
+	if (__builtin_cpu_supports("avx2"))
+	    impl = &sample_convert_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+	    impl = &sample_convert_sse2;
+	break;
+    case SAMPLE_CONVERT_SSE2:
+	if (!__builtin_cpu_supports("sse2"))
+	    return -1;
+	impl = &sample_convert_sse2;
+	break;
+    case SAMPLE_CONVERT_AVX2:
+	if (!__builtin_cpu_supports("avx2"))
+	    return -1;
+	impl = &sample_convert_avx2;
+	break;
+    }
+#else
+    if (which != SAMPLE_CONVERT_BEST && which != SAMPLE_CONVERT_SCALAR)
+	return -1;
+#endif
+
+    sample_convert_impl = impl;
+
+    return 0;
+}
+
+const char *
+sample_convert_get_implementation_name(void) {
+    if (sample_convert_impl == NULL)
+	sample_convert_use(SAMPLE_CONVERT_BEST);
+
+    return sample_convert_impl->name;
+}
+
+/*
+ * Pick the kernel for the given encoding and output precision, and the
+ * number of components making n samples.
+ */
+static t_sample_convert_kernel
+sample_convert_get_kernel(int encoding, int to_double, size_t *ncomponents,
+					int *is_unsigned, int *is_real) {
+    const struct sample_convert_impl *impl;
+
+    if (sample_convert_impl == NULL)
+	sample_convert_use(SAMPLE_CONVERT_BEST);
+    impl = sample_convert_impl;
+
+    *is_unsigned = 0;
+    *is_real = 0;
+
+    switch (encoding) {
+    case SAMPLE_ENCODING_UC8:
+	*is_unsigned = 1;
+	/* FALLTHROUGH */
+    case SAMPLE_ENCODING_SC8:
+	*ncomponents *= 2;
+	return to_double? impl->convert_8_to_double : impl->convert_8_to_float;
+    case SAMPLE_ENCODING_SC16:
+	*ncomponents *= 2;
+	return to_double? impl->convert_16_to_double :
+	    impl->convert_16_to_float;
+    case SAMPLE_ENCODING_U8:
+	*is_unsigned = 1;
+	*is_real = 1;
+	return to_double? impl->convert_8_to_double : impl->convert_8_to_float;
+    case SAMPLE_ENCODING_S16:
+	*is_real = 1;
+	return to_double? impl->convert_16_to_double :
+	    impl->convert_16_to_float;
+    }
+
+    return NULL;
+}
+
+int
+sample_convert(int encoding, const void *src, struct sample *dst, size_t n) {
+    int is_unsigned, is_real;
+    t_sample_convert_kernel kernel;
+    size_t i;
+
+    switch (encoding) {
+    case SAMPLE_ENCODING_CF32:
+	for (i = 0; i < n; i++)
+	    dst[i].v = ((const struct samplef *) src)[i].v;
+	return 0;
+    case SAMPLE_ENCODING_CF64:
+	for (i = 0; i < n; i++)
+	    dst[i] = ((const struct sample *) src)[i];
+	return 0;
+    }
+
+    kernel = sample_convert_get_kernel(encoding, 1, &n, &is_unsigned,
+	&is_real);
+    if (kernel == NULL)
+	return -1;
+
+    kernel(src, dst, n, is_unsigned, is_real);
+
+    return 0;
+}
+
+int
+sample_convert_float(int encoding, const void *src, struct samplef *dst,
+								size_t n) {
+    int is_unsigned, is_real;
+    t_sample_convert_kernel kernel;
+    size_t i;
+
+    switch (encoding) {
+    case SAMPLE_ENCODING_CF32:
+	for (i = 0; i < n; i++)
+	    dst[i] = ((const struct samplef *) src)[i];
+	return 0;
+    case SAMPLE_ENCODING_CF64:
+	for (i = 0; i < n; i++)
+	    dst[i].v = ((const struct sample *) src)[i].v;
+	return 0;
+    }
+
+    kernel = sample_convert_get_kernel(encoding, 0, &n, &is_unsigned,
+	&is_real);
+    if (kernel == NULL)
+	return -1;
+
+    kernel(src, dst, n, is_unsigned, is_real);
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * Conversion of raw samples (SAMPLE_ENCODING_*) to complex samples
+ */
+#ifndef SIGNAL_SAMPLE_CONVERT_H_
+#define SIGNAL_SAMPLE_CONVERT_H_
+
+#include <stddef.h>
+
+#include <signal/sample.h>
+
+#define SAMPLE_CONVERT_SCALAR		0
+#define SAMPLE_CONVERT_SSE2		1
+#define SAMPLE_CONVERT_AVX2		2
+#define SAMPLE_CONVERT_BEST		-1
+
+/* Source and destination must not overlap.  Returns -1 on bad encoding. */
+int sample_convert(int, const void *, struct sample *, size_t);
+int sample_convert_float(int, const void *, struct samplef *, size_t);
+
+int sample_convert_use(int);
+const char *sample_convert_get_implementation_name(void);
+
+#endif /* SIGNAL_SAMPLE_CONVERT_H_ */
@@ -0,0 +1,60 @@
+
+#include <signal/sample.h>
+
+#include <string.h>
+
+static const struct {
+    const char *name;
+    int encoding;
+    size_t size;
+} sample_encodings[] = {
+    { "uc8", SAMPLE_ENCODING_UC8, 2 },
+    { "sc8", SAMPLE_ENCODING_SC8, 2 },
+    { "sc16", SAMPLE_ENCODING_SC16, 4 },
+    { "cf32", SAMPLE_ENCODING_CF32, sizeof (struct samplef) },
+    { "cf64", SAMPLE_ENCODING_CF64, sizeof (struct sample) },
+    { "u8", SAMPLE_ENCODING_U8, 1 },
+    { "s16", SAMPLE_ENCODING_S16, 2 },
+};
+
+#define NB_SAMPLE_ENCODINGS \
+	(sizeof sample_encodings / sizeof sample_encodings[0])
+
+/*
+ * Size in bytes of one sample in the given encoding, 0 if unknown.
+ */
+size_t
+sample_encoding_size(int encoding) {
+    size_t i;
+
+    for (i = 0; i < NB_SAMPLE_ENCODINGS; i++)
+	if (sample_encodings[i].encoding == encoding)
+	    return sample_encodings[i].size;
+
+    return 0;
+}
+
+/*
+ * Returns the encoding named s, or 0 if there is no such encoding.
+ */
+int
+sample_encoding_parse(const char *s) {
+    size_t i;
+
+    for (i = 0; i < NB_SAMPLE_ENCODINGS; i++)
+	if (strcmp(sample_encodings[i].name, s) == 0)
+	    return sample_encodings[i].encoding;
+
+    return 0;
+}
+
+const char *
+sample_encoding_name(int encoding) {
+    size_t i;
+
+    for (i = 0; i < NB_SAMPLE_ENCODINGS; i++)
+	if (sample_encodings[i].encoding == encoding)
+	    return sample_encodings[i].name;
+
+    return NULL;
+}
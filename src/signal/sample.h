@@ -2,9 +2,36 @@
 #define SIGNAL_SAMPLE_H_
 
 #include <complex.h>
+#include <stddef.h>
 
 struct sample {
     double complex v;
 };
 
+/*
+ * Single precision sample, 8 bytes instead of 16.  No radio we support
+ * delivers more than 16 bits per component, so this loses nothing but
+ * halves the memory traffic of every buffer and FFT it goes through.
+ */
+struct samplef {
+    float complex v;
+};
+
+/*
+ * Encodings of raw samples, as delivered by radios or stored in files.
+ * Values below 32 are complex (I/Q interleaved), the others are real.
+ */
+#define SAMPLE_ENCODING_UC8		1
+#define SAMPLE_ENCODING_SC16		2
+#define SAMPLE_ENCODING_SC8		3
+#define SAMPLE_ENCODING_CF32		4	/* struct samplef */
+#define SAMPLE_ENCODING_CF64		5	/* struct sample */
+
+#define SAMPLE_ENCODING_U8		32
+#define SAMPLE_ENCODING_S16		33
+
+size_t sample_encoding_size(int);
+int sample_encoding_parse(const char *);
+const char *sample_encoding_name(int);
+
 #endif /* SIGNAL_SAMPLE_H_ */
@@ -0,0 +1,338 @@
+#include <signal/sigmf.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <signal/sample.h>
+#include <util/json.h>
+#include <util/memory.h>
+
+#define SIGMF_VERSION	"1.0.0"
+
+/*
+ * The sora extension only says how the data file is stored: its
+ * datatype is that of the samples once decompressed.
+ */
+#define SIGMF_SORA_VERSION	"1.0.0"
+#define SIGMF_SORA_IQZ		"iqz"
+
+/* Raw files are read in host order, which is little endian in practice */
+static const struct {
+    const char *datatype;
+    int encoding;
+} sigmf_datatypes[] = {
+    { "cu8", SAMPLE_ENCODING_UC8 },
+    { "ci8", SAMPLE_ENCODING_SC8 },
+    { "ci16_le", SAMPLE_ENCODING_SC16 },
+    { "cf32_le", SAMPLE_ENCODING_CF32 },
+    { "cf64_le", SAMPLE_ENCODING_CF64 },
+    { "ru8", SAMPLE_ENCODING_U8 },
+    { "ri16_le", SAMPLE_ENCODING_S16 },
+};
+
+#define NB_SIGMF_DATATYPES \
+	(sizeof sigmf_datatypes / sizeof sigmf_datatypes[0])
+
+static int sigmf_get_count(const struct json_value *, const char *,
+	uint64_t *);
+static int sigmf_read_global(struct signal_desc *,
+	const struct json_value *);
+static int sigmf_read_captures(struct signal_desc *,
+	const struct json_value *);
+static int sigmf_read_annotations(struct signal_desc *,
+	const struct json_value *);
+
+/*
+ * The metadata of data file name: base.sigmf-data goes with
+ * base.sigmf-meta, anything else gets the suffix appended.
+ */
+char *
+sigmf_meta_name(const char *name) {
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(SIGMF_DATA_SUFFIX);
+    char *meta;
+
+    if (len >= suffix_len &&
+	    strcmp(name + len - suffix_len, SIGMF_DATA_SUFFIX) == 0)
+	len -= suffix_len;
+
+    meta = memory_alloc(len + strlen(SIGMF_META_SUFFIX) + 1);
+    memcpy(meta, name, len);
+    strcpy(meta + len, SIGMF_META_SUFFIX);
+
+    return meta;
+}
+
+/*
+ * Sample indices and counts must be non-negative integers.  Returns 0 if
+ * absent, -1 if invalid.
+ */
+static int
+sigmf_get_count(const struct json_value *v, const char *key, uint64_t *np) {
+    double n;
+
+    if (!json_object_get_number(v, key, &n))
+	return 0;
+    if (n < 0 || n != floor(n) || n >= 18446744073709551616.0)
+	return -1;
+    *np = n;
+
+    return 1;
+}
+
+static int
+sigmf_read_global(struct signal_desc *desc, const struct json_value *global) {
+    const char *datatype = json_object_get_string(global, "core:datatype");
+    const char *description, *compression;
+    double rate;
+    size_t i;
+
+    if (global == NULL || global->type != JSON_OBJECT || datatype == NULL)
+	return -1;
+
+    /* Unknown datatypes are left for the user to override */
+    for (i = 0; i < NB_SIGMF_DATATYPES; i++)
+	if (strcmp(sigmf_datatypes[i].datatype, datatype) == 0) {
+	    desc->encoding = sigmf_datatypes[i].encoding;
+	    desc->flags |= SIGNAL_DESC_HAVE_ENCODING;
+	}
+
+    if (json_object_get_number(global, "core:sample_rate", &rate)) {
+	if (rate < 1 || rate > 4294967295.0)
+	    return -1;
+	desc->sample_rate = lround(rate);
+	desc->flags |= SIGNAL_DESC_HAVE_SAMPLE_RATE;
+    }
+
+    /* Data in an unknown container can't be read at all */
+    compression = json_object_get_string(global, "sora:compression");
+    if (compression != NULL) {
+	if (strcmp(compression, SIGMF_SORA_IQZ) != 0)
+	    return -1;
+	desc->flags |= SIGNAL_DESC_COMPRESSED;
+    }
+
+    description = json_object_get_string(global, "core:description");
+    if (description != NULL)
+	desc->description = memory_strdup(description);
+
+    return 0;
+}
+
+static int
+sigmf_read_captures(struct signal_desc *desc,
+				    const struct json_value *captures) {
+    size_t i;
+
+    if (captures == NULL)
+	return 0;
+    if (captures->type != JSON_ARRAY)
+	return -1;
+
+    for (i = 0; i < captures->nelems; i++) {
+	const struct json_value *v = captures->elems[i];
+	struct signal_capture *c;
+	uint64_t start;
+	const char *datetime;
+	double freq;
+
+	if (sigmf_get_count(v, "core:sample_start", &start) != 1)
+	    return -1;
+
+	c = signal_desc_add_capture(desc, start);
+	if (json_object_get_number(v, "core:frequency", &freq)) {
+	    if (freq < 0)
+		return -1;
+	    c->frequency = llround(freq);
+	    c->flags |= SIGNAL_CAPTURE_HAVE_FREQUENCY;
+	}
+	datetime = json_object_get_string(v, "core:datetime");
+	if (datetime != NULL)
+	    c->datetime = memory_strdup(datetime);
+    }
+
+    if (desc->ncaptures != 0 &&
+	    (desc->captures[0].flags & SIGNAL_CAPTURE_HAVE_FREQUENCY)) {
+	desc->tuner_frequency = desc->captures[0].frequency;
+	desc->flags |= SIGNAL_DESC_HAVE_TUNER_FREQUENCY;
+    }
+
+    return 0;
+}
+
+static int
+sigmf_read_annotations(struct signal_desc *desc,
+				    const struct json_value *annotations) {
+    size_t i;
+
+    if (annotations == NULL)
+	return 0;
+    if (annotations->type != JSON_ARRAY)
+	return -1;
+
+    for (i = 0; i < annotations->nelems; i++) {
+	const struct json_value *v = annotations->elems[i];
+	struct signal_annotation *a;
+	uint64_t start, count = 0;
+	const char *comment;
+	double lower, upper;
+
+	if (sigmf_get_count(v, "core:sample_start", &start) != 1 ||
+		sigmf_get_count(v, "core:sample_count", &count) == -1)
+	    return -1;
+
+	a = signal_desc_add_annotation(desc, start, count,
+	    json_object_get_string(v, "core:label"));
+	if (json_object_get_number(v, "core:freq_lower_edge", &lower) &&
+		json_object_get_number(v, "core:freq_upper_edge", &upper)) {
+	    a->freq_lower_edge = lower;
+	    a->freq_upper_edge = upper;
+	    a->flags |= SIGNAL_ANNOTATION_HAVE_EDGES;
+	}
+	comment = json_object_get_string(v, "core:comment");
+	if (comment != NULL)
+	    a->comment = memory_strdup(comment);
+    }
+
+    return 0;
+}
+
+/*
+ * Returns NULL with errno set, to EINVAL if the file is not valid SigMF.
+ * Fields sora has no use for are ignored.
+ */
+struct signal_desc *
+sigmf_read(const char *meta_name) {
+    struct json_value *root = json_parse_file(meta_name);
+    struct signal_desc *desc;
+    size_t len = strlen(meta_name);
+    size_t suffix_len = strlen(SIGMF_META_SUFFIX);
+
+    if (root == NULL)
+	return NULL;
+
+    desc = signal_desc_new();
+    if (root->type != JSON_OBJECT ||
+	    sigmf_read_global(desc, json_object_get(root, "global")) == -1 ||
+	    sigmf_read_captures(desc,
+		json_object_get(root, "captures")) == -1 ||
+	    sigmf_read_annotations(desc,
+		json_object_get(root, "annotations")) == -1) {
+	signal_desc_delete(desc);
+	json_delete(root);
+	errno = EINVAL;
+	return NULL;
+    }
+    json_delete(root);
+
+    if (len >= suffix_len &&
+	    strcmp(meta_name + len - suffix_len, SIGMF_META_SUFFIX) == 0)
+	len -= suffix_len;
+    desc->file_basename = memory_alloc(len + 1);
+    memcpy(desc->file_basename, meta_name, len);
+    desc->file_basename[len] = '\0';
+
+    return desc;
+}
+
+/*
+ * Without captures, a single one at the tuner frequency is written if
+ * there is one.  Returns -1 with errno set on failure.
+ */
+int
+sigmf_write(const char *meta_name, const struct signal_desc *desc) {
+    FILE *out = fopen(meta_name, "w");
+    const char *datatype = NULL;
+    size_t i;
+
+    if (out == NULL)
+	return -1;
+
+    if (desc->flags & SIGNAL_DESC_HAVE_ENCODING)
+	for (i = 0; i < NB_SIGMF_DATATYPES; i++)
+	    if (sigmf_datatypes[i].encoding == desc->encoding)
+		datatype = sigmf_datatypes[i].datatype;
+    if (datatype == NULL) {
+	fclose(out);
+	errno = EINVAL;
+	return -1;
+    }
+
+    fprintf(out, "{\n  \"global\": {\n"
+	"    \"core:datatype\": \"%s\",\n", datatype);
+    if (desc->flags & SIGNAL_DESC_COMPRESSED)
+	fputs("    \"core:extensions\": [\n"
+	    "      { \"name\": \"sora\", \"version\": \"" SIGMF_SORA_VERSION
+	    "\", \"optional\": false }\n    ],\n"
+	    "    \"sora:compression\": \"" SIGMF_SORA_IQZ "\",\n", out);
+    if (desc->flags & SIGNAL_DESC_HAVE_SAMPLE_RATE)
+	fprintf(out, "    \"core:sample_rate\": %u,\n", desc->sample_rate);
+    if (desc->description != NULL) {
+	fputs("    \"core:description\": ", out);
+	json_print_string(out, desc->description);
+	fputs(",\n", out);
+    }
+    fputs("    \"core:recorder\": \"sora\",\n"
+	"    \"core:version\": \"" SIGMF_VERSION "\"\n  },\n"
+	"  \"captures\": [", out);
+
+    if (desc->ncaptures == 0 &&
+	    (desc->flags & SIGNAL_DESC_HAVE_TUNER_FREQUENCY))
+	fprintf(out, "\n    { \"core:sample_start\": 0, "
+	    "\"core:frequency\": %lu }\n  ", desc->tuner_frequency);
+    for (i = 0; i < desc->ncaptures; i++) {
+	const struct signal_capture *c = &desc->captures[i];
+
+	fprintf(out, "%s\n    { \"core:sample_start\": %" PRIu64,
+	    i == 0? "" : ",", c->sample_start);
+	if (c->flags & SIGNAL_CAPTURE_HAVE_FREQUENCY)
+	    fprintf(out, ", \"core:frequency\": %lu", c->frequency);
+	if (c->datetime != NULL) {
+	    fputs(", \"core:datetime\": ", out);
+	    json_print_string(out, c->datetime);
+	}
+	fputs(" }", out);
+	if (i == desc->ncaptures - 1)
+	    fputs("\n  ", out);
+    }
+
+    fputs("],\n  \"annotations\": [", out);
+    for (i = 0; i < desc->nannotations; i++) {
+	const struct signal_annotation *a = &desc->annotations[i];
+
+	fprintf(out, "%s\n    { \"core:sample_start\": %" PRIu64,
+	    i == 0? "" : ",", a->sample_start);
+	if (a->sample_count != 0)
+	    fprintf(out, ", \"core:sample_count\": %" PRIu64,
+		a->sample_count);
+	if (a->flags & SIGNAL_ANNOTATION_HAVE_EDGES)
+	    fprintf(out, ", \"core:freq_lower_edge\": %.17g, "
+		"\"core:freq_upper_edge\": %.17g",
+		a->freq_lower_edge, a->freq_upper_edge);
+	if (a->label != NULL) {
+	    fputs(", \"core:label\": ", out);
+	    json_print_string(out, a->label);
+	}
+	if (a->comment != NULL) {
+	    fputs(", \"core:comment\": ", out);
+	    json_print_string(out, a->comment);
+	}
+	fputs(" }", out);
+	if (i == desc->nannotations - 1)
+	    fputs("\n  ", out);
+    }
+    fputs("]\n}\n", out);
+
+    if (ferror(out)) {
+	int saved_errno = errno;
+
+	fclose(out);
+	errno = saved_errno;
+	return -1;
+    }
+
+    return fclose(out) == EOF? -1 : 0;
+}
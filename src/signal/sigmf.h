@@ -0,0 +1,16 @@
+/*
+ * SigMF metadata files, which describe a recording kept alongside
+ */
+#ifndef SIGNAL_SIGMF_H_
+#define SIGNAL_SIGMF_H_
+
+#include <signal/signal-desc.h>
+
+#define SIGMF_DATA_SUFFIX	".sigmf-data"
+#define SIGMF_META_SUFFIX	".sigmf-meta"
+
+char *sigmf_meta_name(const char *);
+struct signal_desc *sigmf_read(const char *);
+int sigmf_write(const char *, const struct signal_desc *);
+
+#endif /* SIGNAL_SIGMF_H_ */
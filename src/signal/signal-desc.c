@@ -0,0 +1,176 @@
+#include <signal/signal-desc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/memory.h>
+
+struct signal_desc *
+signal_desc_new(void) {
+    struct signal_desc *desc = memory_alloc(sizeof *desc);
+
+    desc->flags = 0;
+    desc->sample_rate = 0;
+    desc->tuner_frequency = 0;
+    desc->encoding = 0;
+    desc->file_basename = NULL;
+    desc->description = NULL;
+    desc->ncaptures = 0;
+    desc->captures = NULL;
+    desc->nannotations = 0;
+    desc->annotations = NULL;
+
+    return desc;
+}
+
+void
+signal_desc_delete(struct signal_desc *desc) {
+    size_t i;
+
+    for (i = 0; i < desc->ncaptures; i++)
+	if (desc->captures[i].datetime != NULL)
+	    memory_free(desc->captures[i].datetime);
+    for (i = 0; i < desc->nannotations; i++) {
+	if (desc->annotations[i].label != NULL)
+	    memory_free(desc->annotations[i].label);
+	if (desc->annotations[i].comment != NULL)
+	    memory_free(desc->annotations[i].comment);
+    }
+    if (desc->captures != NULL)
+	memory_free(desc->captures);
+    if (desc->annotations != NULL)
+	memory_free(desc->annotations);
+    if (desc->file_basename != NULL)
+	memory_free(desc->file_basename);
+    if (desc->description != NULL)
+	memory_free(desc->description);
+    memory_free(desc);
+}
+
+/*
+ * The returned capture, to be filled by the caller, is only valid until
+ * the next one is added.
+ */
+struct signal_capture *
+signal_desc_add_capture(struct signal_desc *desc, uint64_t sample_start) {
+    struct signal_capture *c;
+    size_t i = desc->ncaptures;
+
+    desc->captures = memory_realloc(desc->captures,
+	(desc->ncaptures + 1) * sizeof *desc->captures);
+
+    /* Usually appended, so insert from the end */
+    while (i > 0 && desc->captures[i - 1].sample_start > sample_start) {
+	desc->captures[i] = desc->captures[i - 1];
+	i--;
+    }
+    desc->ncaptures++;
+
+    c = &desc->captures[i];
+    c->sample_start = sample_start;
+    c->flags = 0;
+    c->frequency = 0;
+    c->datetime = NULL;
+
+    return c;
+}
+
+/*
+ * Same as above.  label is copied.
+ */
+struct signal_annotation *
+signal_desc_add_annotation(struct signal_desc *desc, uint64_t sample_start,
+			    uint64_t sample_count, const char *label) {
+    struct signal_annotation *a;
+    size_t i = desc->nannotations;
+
+    desc->annotations = memory_realloc(desc->annotations,
+	(desc->nannotations + 1) * sizeof *desc->annotations);
+
+    while (i > 0 && desc->annotations[i - 1].sample_start > sample_start) {
+	desc->annotations[i] = desc->annotations[i - 1];
+	i--;
+    }
+    desc->nannotations++;
+
+    a = &desc->annotations[i];
+    a->sample_start = sample_start;
+    a->sample_count = sample_count;
+    a->flags = 0;
+    a->freq_lower_edge = 0;
+    a->freq_upper_edge = 0;
+    a->label = label != NULL? memory_strdup(label) : NULL;
+    a->comment = NULL;
+
+    return a;
+}
+
+/*
+ * The capture sample belongs to, NULL if it comes before the first one.
+ */
+const struct signal_capture *
+signal_desc_capture_at(const struct signal_desc *desc, uint64_t sample) {
+    size_t lo = 0, hi = desc->ncaptures;
+
+    /* Find the first capture starting after sample */
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+
+	if (desc->captures[mid].sample_start <= sample)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    return lo == 0? NULL : &desc->captures[lo - 1];
+}
+
+/*
+ * The first annotation labelled label, or NULL.
+ */
+const struct signal_annotation *
+signal_desc_find_annotation(const struct signal_desc *desc,
+							const char *label) {
+    size_t i;
+
+    for (i = 0; i < desc->nannotations; i++)
+	if (desc->annotations[i].label != NULL &&
+		strcmp(desc->annotations[i].label, label) == 0)
+	    return &desc->annotations[i];
+
+    return NULL;
+}
+
+/*
+ * Seconds since the epoch of the capture's first sample, from a UTC
+ * datetime as SigMF has them: YYYY-MM-DDTHH:MM:SS[.fraction]Z.  Returns -1
+ * if there is none.
+ */
+int
+signal_capture_get_time(const struct signal_capture *c, double *tp) {
+    int year, month, day, hour, min, n = 0;
+    long days;
+    double sec;
+    char *end;
+
+    if (c->datetime == NULL ||
+	    sscanf(c->datetime, "%4d-%2d-%2dT%2d:%2d:%n", &year, &month, &day,
+		&hour, &min, &n) != 5 || n == 0)
+	return -1;
+    sec = strtod(c->datetime + n, &end);
+    if (end == c->datetime + n || strcmp(end, "Z") != 0 ||
+	    month < 1 || month > 12 || day < 1 || day > 31 ||
+	    hour > 23 || min > 59 || sec < 0 || sec >= 61)
+	return -1;
+
+    /* Days from the civil calendar, with years starting in March */
+    if (month <= 2)
+	year--;
+    days = 365L * year + year / 4 - year / 100 + year / 400 +
+	(153 * (month + (month > 2? -3 : 9)) + 2) / 5 + day - 1 - 719468;
+
+    *tp = days * 86400.0 + hour * 3600 + min * 60 + sec;
+
+    return 0;
+}
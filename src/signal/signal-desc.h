@@ -1,12 +1,65 @@
 #ifndef SIGNAL_DESC_H_
 #define SIGNAL_DESC_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Where the tuner was from sample_start on, until the next capture.
+ */
+struct signal_capture {
+    uint64_t sample_start;
+    int flags;
+#define SIGNAL_CAPTURE_HAVE_FREQUENCY		0x0001
+    unsigned long frequency;
+    char *datetime;			/* ISO 8601, or NULL */
+};
+
+/*
+ * Something of interest in the recording.  sample_count is 0 if it lasts
+ * until the end.
+ */
+struct signal_annotation {
+    uint64_t sample_start;
+    uint64_t sample_count;
+    int flags;
+#define SIGNAL_ANNOTATION_HAVE_EDGES		0x0001
+    double freq_lower_edge;		/* in Hz */
+    double freq_upper_edge;
+    char *label;			/* or NULL */
+    char *comment;			/* or NULL */
+};
+
+/*
+ * Captures and annotations are sorted by sample_start.
+ */
 struct signal_desc {
     int flags;
 #define SIGNAL_DESC_HAVE_SAMPLE_RATE		0x0001
 #define SIGNAL_DESC_HAVE_TUNER_FREQUENCY	0x0002
+#define SIGNAL_DESC_HAVE_ENCODING		0x0004
+#define SIGNAL_DESC_COMPRESSED			0x0008	/* signal/iqz.h */
     unsigned int sample_rate;
-    unsigned long tuner_frequency;
+    unsigned long tuner_frequency;	/* that of the first capture */
+    int encoding;			/* SAMPLE_ENCODING_* */
     char *file_basename;
+    char *description;			/* or NULL */
+    size_t ncaptures;
+    struct signal_capture *captures;
+    size_t nannotations;
+    struct signal_annotation *annotations;
 };
+
+struct signal_desc *signal_desc_new(void);
+void signal_desc_delete(struct signal_desc *);
+struct signal_capture *signal_desc_add_capture(struct signal_desc *,
+	uint64_t);
+struct signal_annotation *signal_desc_add_annotation(struct signal_desc *,
+	uint64_t, uint64_t, const char *);
+const struct signal_capture *signal_desc_capture_at(
+	const struct signal_desc *, uint64_t);
+const struct signal_annotation *signal_desc_find_annotation(
+	const struct signal_desc *, const char *);
+int signal_capture_get_time(const struct signal_capture *, double *);
+
 #endif /* SIGNAL_DESC_H_ */
@@ -0,0 +1,293 @@
+#include <signal/spectrum.h>
+
+#include <complex.h>
+#include <math.h>
+#include <string.h>
+
+#include <signal/fft-plan.h>
+#include <util/memory.h>
+#include <util/thread-pool.h>
+
+/*
+ * Transforms a run of the segments of a batch, into their rows.
+ */
+struct spectrum_shard {
+    struct spectrum *s;
+    unsigned int first;
+    unsigned int nsegments;
+    float complex *in_buf;
+    float complex *out_buf;
+};
+
+struct spectrum {
+    unsigned int size;
+    unsigned int overlap;
+    float *window;
+    double power_scale;
+    unsigned int nbatch;		/* segments per batch */
+    struct samplef *samples;		/* of the batch being filled */
+    size_t samples_size;
+    size_t fill;
+    fftwf_plan fft_plan;
+    struct spectrum_shard *shards;
+    unsigned int nshards;
+    struct thread_pool *pool;
+    float *power;			/* nbatch rows of size bins */
+};
+
+static const char *spectrum_window_names[] = {
+    [SPECTRUM_WINDOW_RECTANGULAR] = "rectangular",
+    [SPECTRUM_WINDOW_HANN] = "hann",
+    [SPECTRUM_WINDOW_HAMMING] = "hamming",
+    [SPECTRUM_WINDOW_BLACKMAN_HARRIS] = "blackman-harris",
+};
+
+#define SPECTRUM_NWINDOWS \
+    (sizeof spectrum_window_names / sizeof spectrum_window_names[0])
+
+static double spectrum_window_value(int, unsigned int, unsigned int);
+static void spectrum_shard_run(void *);
+static unsigned int spectrum_transform(struct spectrum *, unsigned int);
+
+/*
+ * Periodic windows, as suit spectra rather than filters.
+ */
+static double
+spectrum_window_value(int window, unsigned int i, unsigned int n) {
+    double x = 2 * M_PI * i / n;
+
+    switch (window) {
+    case SPECTRUM_WINDOW_HANN:
+	return 0.5 - 0.5 * cos(x);
+    case SPECTRUM_WINDOW_HAMMING:
+	return 0.54 - 0.46 * cos(x);
+    case SPECTRUM_WINDOW_BLACKMAN_HARRIS:
+	return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) -
+	    0.01168 * cos(3 * x);
+    default:
+	return 1;
+    }
+}
+
+/*
+ * Returns NULL if the parameters don't make sense or FFTW fails.  With
+ * threads, batches span enough segments for each to get a fair share.
+ */
+struct spectrum *
+spectrum_new(const struct spectrum_params *params) {
+    struct spectrum *s;
+    unsigned int nthreads = params->nthreads != 0? params->nthreads : 1;
+    double energy = 0;
+    unsigned int i;
+
+    if (params->size == 0 || params->size > SPECTRUM_MAX_SIZE ||
+	    params->overlap >= params->size || params->window < 0 ||
+	    (size_t) params->window >= SPECTRUM_NWINDOWS)
+	return NULL;
+
+    s = memory_alloc(sizeof *s);
+    s->size = params->size;
+    s->overlap = params->overlap;
+    s->window = memory_alloc(sizeof *s->window * s->size);
+    for (i = 0; i < s->size; i++) {
+	s->window[i] = spectrum_window_value(params->window, i, s->size);
+	energy += (double) s->window[i] * s->window[i];
+    }
+    s->power_scale = s->size / energy;
+
+    s->nbatch = 1;
+    if (nthreads > 1) {
+	s->nbatch = SPECTRUM_BATCH_SAMPLES / s->size;
+	if (s->nbatch < nthreads)
+	    s->nbatch = nthreads;
+    }
+    s->samples_size = s->overlap + (size_t) s->nbatch * (s->size - s->overlap);
+    s->samples = memory_alloc(sizeof *s->samples * s->samples_size);
+    s->fill = 0;
+    s->power = memory_alloc(sizeof *s->power * s->nbatch * s->size);
+    s->pool = nthreads > 1? thread_pool_new(nthreads) : NULL;
+
+    s->nshards = nthreads < s->nbatch? nthreads : s->nbatch;
+    s->shards = memory_alloc(sizeof *s->shards * s->nshards);
+    for (i = 0; i < s->nshards; i++) {
+	s->shards[i].s = s;
+	s->shards[i].in_buf = fftwf_malloc(sizeof (float complex) * s->size);
+	s->shards[i].out_buf = fftwf_malloc(sizeof (float complex) * s->size);
+    }
+    for (i = 0; i < s->nshards; i++)
+	if (s->shards[i].in_buf == NULL || s->shards[i].out_buf == NULL)
+	    goto err;
+
+    s->fft_plan = fft_plan_getf(s->size, FFTW_FORWARD, s->shards[0].in_buf,
+	s->shards[0].out_buf);
+    if (s->fft_plan == NULL)
+	goto err;
+
+    return s;
+
+err:
+    spectrum_delete(s);
+    return NULL;
+}
+
+void
+spectrum_delete(struct spectrum *s) {
+    unsigned int i;
+
+    if (s->pool != NULL)
+	thread_pool_delete(s->pool);
+    for (i = 0; i < s->nshards; i++) {
+	if (s->shards[i].in_buf != NULL)
+	    fftwf_free(s->shards[i].in_buf);
+	if (s->shards[i].out_buf != NULL)
+	    fftwf_free(s->shards[i].out_buf);
+    }
+    memory_free(s->shards);
+    memory_free(s->power);
+    memory_free(s->samples);
+    memory_free(s->window);
+    memory_free(s);
+}
+
+unsigned int
+spectrum_get_size(struct spectrum *s) {
+    return s->size;
+}
+
+/*
+ * Samples between the starts of two segments.
+ */
+unsigned int
+spectrum_get_step(struct spectrum *s) {
+    return s->size - s->overlap;
+}
+
+/*
+ * The threads batches are shared with, for users to share theirs, or
+ * NULL if there are none.
+ */
+struct thread_pool *
+spectrum_get_pool(struct spectrum *s) {
+    return s->pool;
+}
+
+static void
+spectrum_shard_run(void *arg) {
+    struct spectrum_shard *sh = arg;
+    struct spectrum *s = sh->s;
+    unsigned int step = s->size - s->overlap;
+    unsigned int i, j;
+
+    for (j = sh->first; j < sh->first + sh->nsegments; j++) {
+	const struct samplef *segment = s->samples + (size_t) j * step;
+	float *row = s->power + (size_t) j * s->size;
+
+	for (i = 0; i < s->size; i++)
+	    sh->in_buf[i] = segment[i].v * s->window[i];
+
+	fftwf_execute_dft(s->fft_plan, sh->in_buf, sh->out_buf);
+
+	for (i = 0; i < s->size; i++) {
+	    float re = crealf(sh->out_buf[i]);
+	    float im = cimagf(sh->out_buf[i]);
+
+	    row[i] = re * re + im * im;
+	}
+    }
+}
+
+/*
+ * Transforms the first nsegments segments, split in runs between the
+ * shards, and keeps the samples after for the next ones.
+ */
+static unsigned int
+spectrum_transform(struct spectrum *s, unsigned int nsegments) {
+    unsigned int nshards = s->nshards < nsegments? s->nshards : nsegments;
+    size_t consumed = (size_t) nsegments * (s->size - s->overlap);
+    unsigned int i, first = 0;
+
+    if (nsegments == 0)
+	return 0;
+
+    for (i = 0; i < nshards; i++) {
+	s->shards[i].first = first;
+	s->shards[i].nsegments =
+	    nsegments / nshards + (i < nsegments % nshards);
+	first += s->shards[i].nsegments;
+    }
+
+    if (nshards == 1)
+	spectrum_shard_run(&s->shards[0]);
+    else
+	thread_pool_run(s->pool, spectrum_shard_run, s->shards, nshards,
+	    sizeof *s->shards);
+
+    memmove(s->samples, s->samples + consumed,
+	sizeof *s->samples * (s->fill - consumed));
+    s->fill -= consumed;
+
+    return nsegments;
+}
+
+/*
+ * Never fewer than one sample fit, and no more than the batch lacks.
+ */
+struct samplef *
+spectrum_input(struct spectrum *s, size_t *n) {
+    *n = s->samples_size - s->fill;
+    return s->samples + s->fill;
+}
+
+unsigned int
+spectrum_commit(struct spectrum *s, size_t n) {
+    s->fill += n;
+    if (s->fill != s->samples_size)
+	return 0;
+
+    return spectrum_transform(s, s->nbatch);
+}
+
+unsigned int
+spectrum_flush(struct spectrum *s) {
+    if (s->fill < s->size)
+	return 0;
+
+    return spectrum_transform(s,
+	(s->fill - s->size) / (s->size - s->overlap) + 1);
+}
+
+const float *
+spectrum_get_power(struct spectrum *s, unsigned int segment) {
+    return s->power + (size_t) segment * s->size;
+}
+
+void
+spectrum_reset(struct spectrum *s) {
+    s->fill = 0;
+}
+
+double
+spectrum_get_power_scale(struct spectrum *s) {
+    return s->power_scale;
+}
+
+/*
+ * Returns -1 for an unknown window.
+ */
+int
+spectrum_window_parse(const char *name) {
+    size_t i;
+
+    for (i = 0; i < SPECTRUM_NWINDOWS; i++)
+	if (strcmp(name, spectrum_window_names[i]) == 0)
+	    return i;
+
+    return -1;
+}
+
+const char *
+spectrum_window_name(int window) {
+    if (window < 0 || (size_t) window >= SPECTRUM_NWINDOWS)
+	return "unknown";
+    return spectrum_window_names[window];
+}
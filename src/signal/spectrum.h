@@ -0,0 +1,63 @@
+/*
+ * Welch power spectrum estimate: the |X|^2 of windowed, overlapping
+ * segments, transformed in batches shared between threads
+ */
+#ifndef SIGNAL_SPECTRUM_H_
+#define SIGNAL_SPECTRUM_H_
+
+#include <stddef.h>
+
+#include <signal/sample.h>
+
+struct spectrum;
+struct thread_pool;
+
+#define SPECTRUM_DEFAULT_SIZE		1024
+#define SPECTRUM_MAX_SIZE		(1024 * 1024)
+
+/* Sizes from which all cores are worth using */
+#define SPECTRUM_PARALLEL_SIZE		(64 * 1024)
+
+/* Samples a batch spans at least, with more than one thread */
+#define SPECTRUM_BATCH_SAMPLES		(1024 * 1024)
+
+#define SPECTRUM_WINDOW_RECTANGULAR	0
+#define SPECTRUM_WINDOW_HANN		1
+#define SPECTRUM_WINDOW_HAMMING		2
+#define SPECTRUM_WINDOW_BLACKMAN_HARRIS	3
+
+struct spectrum_params {
+    unsigned int size;			/* of the FFT */
+    int window;				/* SPECTRUM_WINDOW_* */
+    unsigned int overlap;		/* samples, less than size */
+    unsigned int nthreads;		/* 0 or 1 for the caller's only */
+};
+
+struct spectrum *spectrum_new(const struct spectrum_params *);
+void spectrum_delete(struct spectrum *);
+unsigned int spectrum_get_size(struct spectrum *);
+unsigned int spectrum_get_step(struct spectrum *);
+struct thread_pool *spectrum_get_pool(struct spectrum *);
+
+/*
+ * Up to *n samples fit at spectrum_input(), and spectrum_commit() takes
+ * those written there.  Once a batch of segments is in, or when flushed,
+ * the segments complete are transformed, and their number returned.
+ * Their |X|^2 per bin in FFT order are then available until the next
+ * commit or flush.
+ */
+struct samplef *spectrum_input(struct spectrum *, size_t *);
+unsigned int spectrum_commit(struct spectrum *, size_t);
+unsigned int spectrum_flush(struct spectrum *);
+const float *spectrum_get_power(struct spectrum *, unsigned int);
+
+/* Drops the samples of segments in progress, as after retuning */
+void spectrum_reset(struct spectrum *);
+
+/* Factor making powers those of a rectangular window */
+double spectrum_get_power_scale(struct spectrum *);
+
+int spectrum_window_parse(const char *);
+const char *spectrum_window_name(int);
+
+#endif /* SIGNAL_SPECTRUM_H_ */
@@ -2,16 +2,26 @@
 #define SIGNAL_TRANSFORMER_TYPE_H_
 
 #include <stddef.h>
+#include <sys/types.h>
 
 /* sizes are in bytes */
 
 struct transformer_type {
     const char *name;
-    int input_elem_size;
-    int output_elem_size;
+    int input_elem_size;		/* 0 for a source */
+    int output_elem_size;		/* 0 for a sink */
+    size_t input_chunk_max_size;
+    size_t output_chunk_max_size;
 
-    int apply(struct transformer_type *,
-	void *dest, const void *src, size_t src_size, void *aux);
+    /*
+     * Consumes all of src, a whole number of input elements, and writes
+     * at most dest_size bytes to dest.  Returns the number of bytes
+     * written, or -1 on error.  A source is called with a NULL src and
+     * signals its end by returning 0.  aux is the transformer's private
+     * data.
+     */
+    ssize_t (*apply)(struct transformer_type *, void *dest, size_t dest_size,
+	const void *src, size_t src_size, void *aux);
 };
 
 #endif /* SIGNAL_TRANSFORMER_TYPE_H_ */
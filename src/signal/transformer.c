@@ -1,5 +1,6 @@
 
 #include <signal/transformer.h>
+#include <signal/transformer-type.h>
 #include <util/exception.h>
 #include <util/memory.h>
 
@@ -32,12 +33,36 @@ transformer_new(struct transformer_type *type, void *private_data) {
 
 void
 transformer_delete(struct transformer *trans) {
+    while (trans->producers != NULL) {
+	struct transformer *producer = list_car(trans->producers);
 
-	/* XXX Unlink from other transformers */
+	producer->consumers = list_delete_elt(producer->consumers, trans);
+	trans->producers = list_delete_elt(trans->producers, producer);
+    }
+    while (trans->consumers != NULL) {
+	struct transformer *consumer = list_car(trans->consumers);
+
+	consumer->producers = list_delete_elt(consumer->producers, trans);
+	trans->consumers = list_delete_elt(trans->consumers, consumer);
+    }
 
     memory_free(trans);
 }
 
+/*
+ * Feed the output of producer to consumer.
+ */
+void
+transformer_connect(struct transformer *producer,
+					struct transformer *consumer) {
+    if (producer->type->output_elem_size != consumer->type->input_elem_size)
+	EXCEPTION_RAISE(logic_error,
+	    "Connecting transformers with different element sizes");
+
+    producer->consumers = list_cons(consumer, producer->consumers);
+    consumer->producers = list_cons(producer, consumer->producers);
+}
+
 struct transformer_type *
 transformer_get_type(struct transformer *trans) {
     return trans->type;
@@ -65,7 +90,7 @@ transformer_get_input_chunk_max_size(struct transformer *trans) {
 
 size_t
 transformer_get_output_chunk_max_size(struct transformer *trans) {
-    return trans->input_chunk_max_size;
+    return trans->output_chunk_max_size;
 }
 
 void
@@ -1,15 +1,18 @@
 #ifndef SIGNAL_TRANSFORMER_H_
 #define SIGNAL_TRANSFORMER_H_
 
+#include <stddef.h>
+
 #include <util/list.h>
 
 #define TRANSFORMER_CHUNK_SIZE_UNLIMITED ((size_t) -1)
 
-struct transfomer;
+struct transformer;
 struct transformer_type;
 
 struct transformer *transformer_new(struct transformer_type *, void *);
 void transformer_delete(struct transformer *);
+void transformer_connect(struct transformer *, struct transformer *);
 struct transformer_type *transformer_get_type(struct transformer *);
 t_list transformer_get_producers(struct transformer *);
 t_list transformer_get_consumers(struct transformer *);
@@ -0,0 +1,46 @@
+#! /bin/sh
+#
+# Scans a SigMF recording of a tone through --decimate and --shift, which
+# must apply to the rate and frequency of its metadata: 8MS/s at 100MHz
+# with a tone at 101.5MHz halfway through, read as 2MS/s around 101MHz.
+#
+# usage: file-filter-test.sh SORA
+
+sora=${1:-./sora}
+dir=`mktemp -d ${TMPDIR:-/tmp}/sora-test.XXXXXX` || exit 1
+trap 'rm -rf "$dir"' 0
+
+LC_ALL=C awk 'BEGIN {
+	srand(1);
+	for (i = 0; i < 262144; i++) {
+		a = 2 * 3.14159265358979 * 1500000 / 8000000 * i;
+		g = i < 131072? 0 : 50;
+		printf "%c%c", 128 + g * cos(a) + 40 * (rand() - 0.5),
+		    128 + g * sin(a) + 40 * (rand() - 0.5);
+	}
+}' >"$dir/tone.sigmf-data"
+
+cat >"$dir/tone.sigmf-meta" <<EOF
+{
+  "global": {
+    "core:datatype": "cu8",
+    "core:sample_rate": 8000000,
+    "core:version": "1.0.0"
+  },
+  "captures": [
+    { "core:sample_start": 0, "core:frequency": 100000000 }
+  ],
+  "annotations": []
+}
+EOF
+
+"$sora" --file="$dir/tone.sigmf-data" --decimate=4 --shift=1M --scan \
+    --squelch=15 >"$dir/hits" || exit 1
+
+# The tone and its leakage, and nothing else
+if ! awk '$1 + 0 < 101.4 || $1 + 0 > 101.6 { bad = 1 }
+	END { exit bad || NR == 0 }' "$dir/hits"; then
+	echo "expected hits around 101.5MHz only:" >&2
+	head "$dir/hits" >&2
+	exit 1
+fi
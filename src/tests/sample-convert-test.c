@@ -0,0 +1,126 @@
+/*
+ * Checks that the SIMD conversions give the same samples as the scalar
+ * one, bit for bit, for every encoding, for lengths around the vector
+ * sizes and for buffers off the vector alignment.
+ */
+#include <signal/sample-convert.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NSAMPLES	1100
+#define MAX_OFFSET	7		/* in samples, off 32 byte vectors */
+#define GUARD		0xa5
+
+static const int test_encodings[] = {
+    SAMPLE_ENCODING_UC8, SAMPLE_ENCODING_SC8, SAMPLE_ENCODING_SC16,
+    SAMPLE_ENCODING_U8, SAMPLE_ENCODING_S16,
+};
+
+static const struct {
+    int which;
+    const char *name;
+} test_impls[] = {
+    { SAMPLE_CONVERT_SSE2, "sse2" },
+    { SAMPLE_CONVERT_AVX2, "avx2" },
+};
+
+static unsigned char src_buf[(MAX_NSAMPLES + MAX_OFFSET) * 4 + 32];
+static struct sample ref[MAX_NSAMPLES], out[MAX_NSAMPLES + MAX_OFFSET + 1];
+static struct samplef reff[MAX_NSAMPLES],
+    outf[MAX_NSAMPLES + MAX_OFFSET + 1];
+
+static int test_convert(int, int, const void *, size_t, size_t);
+static int test_impl(int, const char *);
+
+/*
+ * Converts n samples of src with the implementation which, at offset
+ * samples into the output, and compares them to the scalar ones.  Also
+ * checks that nothing is written past the n samples.  Returns the
+ * number of failures.
+ */
+static int
+test_convert(int which, int encoding, const void *src, size_t n,
+								size_t offset) {
+    int nfailed = 0;
+
+    sample_convert_use(SAMPLE_CONVERT_SCALAR);
+    sample_convert(encoding, src, ref, n);
+    sample_convert_float(encoding, src, reff, n);
+
+    sample_convert_use(which);
+    memset(out, GUARD, sizeof out);
+    memset(outf, GUARD, sizeof outf);
+    sample_convert(encoding, src, out + offset, n);
+    sample_convert_float(encoding, src, outf + offset, n);
+
+    if (memcmp(out + offset, ref, n * sizeof out[0]) != 0 ||
+	    ((const unsigned char *) (out + offset + n))[0] != GUARD) {
+	fprintf(stderr, "%s: %s to double, %zu samples at %zu: differs\n",
+	    sample_convert_get_implementation_name(),
+	    sample_encoding_name(encoding), n, offset);
+	nfailed++;
+    }
+    if (memcmp(outf + offset, reff, n * sizeof outf[0]) != 0 ||
+	    ((const unsigned char *) (outf + offset + n))[0] != GUARD) {
+	fprintf(stderr, "%s: %s to float, %zu samples at %zu: differs\n",
+	    sample_convert_get_implementation_name(),
+	    sample_encoding_name(encoding), n, offset);
+	nfailed++;
+    }
+
+    return nfailed;
+}
+
+/*
+ * Returns the number of failures of implementation which.
+ */
+static int
+test_impl(int which, const char *name) {
+    int nfailed = 0;
+    size_t e, n, offset, ntests = 0;
+
+    if (sample_convert_use(which) == -1) {
+	printf("%s: not supported by this CPU, skipped\n", name);
+	return 0;
+    }
+
+    for (e = 0; e < sizeof test_encodings / sizeof test_encodings[0]; e++) {
+	int encoding = test_encodings[e];
+	size_t size = sample_encoding_size(encoding);
+	size_t component = encoding < SAMPLE_ENCODING_U8? size / 2 : size;
+
+	for (n = 0; n <= MAX_NSAMPLES; n = n < 80? n + 1 : n * 2 + 3)
+	    for (offset = 0; offset <= MAX_OFFSET; offset++) {
+		/* Sources are off by whole components, as radios give them */
+		const unsigned char *src = src_buf + offset * component;
+
+		nfailed += test_convert(which, encoding, src, n, offset);
+		ntests++;
+	    }
+    }
+
+    printf("%s: %zu conversions, %d failed\n", name, ntests * 2, nfailed);
+    return nfailed;
+}
+
+int
+main(void) {
+    int nfailed = 0;
+    size_t i;
+
+    srand(1);
+    for (i = 0; i < sizeof src_buf; i++)
+	src_buf[i] = rand();
+    /* Extremes of each component size */
+    src_buf[0] = 0x00;
+    src_buf[1] = 0xff;
+    src_buf[2] = 0x80;
+    src_buf[3] = 0x7f;
+
+    for (i = 0; i < sizeof test_impls / sizeof test_impls[0]; i++)
+	nfailed += test_impl(test_impls[i].which, test_impls[i].name);
+
+    return nfailed == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,49 @@
+#! /bin/sh
+#
+# Scans recordings around 100MHz in channels of 1MS/s, 8 of them at
+# 8MS/s and 3 at 3MS/s, with a tone at 101.25MHz from halfway through:
+# the channel at 101MHz must find it where it is, not mirrored at
+# 100.75MHz nor in another channel, and starting about halfway.
+#
+# usage: scan-channels-test.sh SORA
+
+sora=${1:-./sora}
+dir=`mktemp -d ${TMPDIR:-/tmp}/sora-test.XXXXXX` || exit 1
+trap 'rm -rf "$dir"' 0
+
+# check NCHANNELS
+check() {
+	n=$1
+
+	LC_ALL=C awk -v n=$n 'BEGIN {
+		srand(1);
+		for (i = 0; i < 1048576; i++) {
+			a = 2 * 3.14159265358979 * 1250000 / (n * 1000000) * i;
+			g = i < 524288? 0 : 50;
+			printf "%c%c", 128 + g * cos(a) + 40 * (rand() - 0.5),
+			    128 + g * sin(a) + 40 * (rand() - 0.5);
+		}
+	}' >"$dir/tone.uc8"
+
+	"$sora" --file="$dir/tone.uc8" --file-encoding=uc8 -s ${n}000000 \
+	    -f 100M --scan --channels=$n --squelch=15 --scan-output=csv \
+	    >"$dir/signals" || exit 1
+
+	# start_sample and end_sample are in samples of the channel
+	if ! awk -F, -v n=$n '
+		NR > 1 && $5 <= 101250000 && $6 >= 101250000 &&
+		    $3 * n >= 500000 && $3 * n <= 524288 { found = 1 }
+		NR > 1 && $5 <= 100750000 && $6 >= 100750000 { bad = 1 }
+		NR > 1 && $7 > 30 && ($5 < 101000000 || $6 > 101500000) {
+		    bad = 1
+		}
+		END { exit bad || !found }' "$dir/signals"; then
+		echo "$n channels: expected the tone at 101.25MHz from" \
+		    "sample 524288:" >&2
+		cat "$dir/signals" >&2
+		exit 1
+	fi
+}
+
+check 8
+check 3
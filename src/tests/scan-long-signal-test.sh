@@ -0,0 +1,34 @@
+#! /bin/sh
+#
+# Scans noise with a carrier 20dB above it from sample 1000000 to 1300000
+# at 2MS/s, which must come out as one signal of 0.15s: the noise level
+# of its bins must not rise to it while it lasts.
+#
+# usage: scan-long-signal-test.sh SORA
+
+sora=${1:-./sora}
+dir=`mktemp -d ${TMPDIR:-/tmp}/sora-test.XXXXXX` || exit 1
+trap 'rm -rf "$dir"' 0
+
+LC_ALL=C awk 'BEGIN {
+	srand(1);
+	for (i = 0; i < 1500000; i++) {
+		a = 2 * 3.14159265358979 * 250000 / 2000000 * i;
+		g = i >= 1000000 && i < 1300000? 40 : 0;
+		printf "%c%c", 128 + g * cos(a) + 20 * (rand() - 0.5),
+		    128 + g * sin(a) + 20 * (rand() - 0.5);
+	}
+}' >"$dir/carrier.uc8"
+
+"$sora" --file="$dir/carrier.uc8" --file-encoding=uc8 -s 2M -f 100M \
+    --scan --scan-output=csv >"$dir/signals.csv" || exit 1
+
+# start_sample and end_sample within a frame or two of the carrier's
+if ! awk -F, 'NR > 1 && $5 <= 100250000 && $6 >= 100250000 &&
+	$3 >= 998000 && $3 <= 1000000 && $4 >= 1300000 && $4 <= 1302000 {
+	    found = 1
+	} END { exit !found }' "$dir/signals.csv"; then
+	echo "carrier not found as one signal:" >&2
+	awk -F, 'NR == 1 || $2 > 0.01' "$dir/signals.csv" >&2
+	exit 1
+fi
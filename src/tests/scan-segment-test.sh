@@ -0,0 +1,61 @@
+#! /bin/sh
+#
+# Scans noise with a carrier from sample 800000 to 2400000 at 2MS/s as a
+# recording, in segments of 1000000 samples ending while it lasts: the
+# signals and hits must be those of a scan from the start, the carrier
+# one signal of 0.8s.
+#
+# usage: scan-segment-test.sh SORA
+
+sora=${1:-./sora}
+dir=`mktemp -d ${TMPDIR:-/tmp}/sora-test.XXXXXX` || exit 1
+trap 'rm -rf "$dir"' 0
+
+LC_ALL=C awk 'BEGIN {
+	srand(1);
+	for (i = 0; i < 3000000; i++) {
+		a = 2 * 3.14159265358979 * 300000 / 2000000 * i;
+		g = i >= 800000 && i < 2400000? 50 : 0;
+		printf "%c%c", 128 + g * cos(a) + 40 * (rand() - 0.5),
+		    128 + g * sin(a) + 40 * (rand() - 0.5);
+	}
+}' >"$dir/carrier.uc8"
+
+scan() {
+	"$sora" --file-encoding=uc8 -s 2M -f 100M --squelch=15 "$@"
+}
+
+scan --file="$dir/carrier.uc8" --scan --scan-output=csv \
+    >"$dir/live.csv" || exit 1
+scan --scan-segment=1000000 --scan --scan-output=csv "$dir/carrier.uc8" \
+    >"$dir/batch.csv" || exit 1
+scan --file="$dir/carrier.uc8" --scan >"$dir/live.txt" || exit 1
+scan --scan-segment=1000000 --scan "$dir/carrier.uc8" \
+    >"$dir/batch.txt" || exit 1
+
+# Signals from start_sample on, in the same order; hits as frequency,
+# file offset and level
+for f in live batch; do
+	tail -n +2 "$dir/$f.csv" | cut -d, -f3-8 | sort >"$dir/$f.signals"
+done
+awk '{ print $1, $4, $5 }' "$dir/live.txt" >"$dir/live.hits"
+awk '{ print $1, $3, $4 }' "$dir/batch.txt" >"$dir/batch.hits"
+
+# start_sample and end_sample within a frame or two of the carrier's
+if ! awk -F, '$3 <= 100300000 && $4 >= 100300000 &&
+	$1 >= 798000 && $1 <= 800000 && $2 >= 2400000 && $2 <= 2402000 {
+	    found = 1
+	} END { exit !found }' "$dir/batch.signals"; then
+	echo "carrier not found as one signal:" >&2
+	cat "$dir/batch.signals" >&2
+	exit 1
+fi
+
+if ! diff "$dir/live.signals" "$dir/batch.signals" >&2; then
+	echo "signals differ in segments" >&2
+	exit 1
+fi
+if ! diff "$dir/live.hits" "$dir/batch.hits" >&2; then
+	echo "hits differ in segments" >&2
+	exit 1
+fi
@@ -0,0 +1,35 @@
+#! /bin/sh
+#
+# Sweeps 100MHz to 120MHz over a recording, with a steady tone 1MHz above
+# the tuned frequency for most of it.  Many more sweeps than the noise
+# backlog hold the tone: it must never become the noise level of its bin.
+#
+# usage: sweep-long-signal-test.sh SORA
+
+sora=${1:-./sora}
+dir=`mktemp -d ${TMPDIR:-/tmp}/sora-test.XXXXXX` || exit 1
+trap 'rm -rf "$dir"' 0
+
+LC_ALL=C awk 'BEGIN {
+	srand(1);
+	for (i = 0; i < 2000000; i++) {
+		a = 2 * 3.14159265358979 * 1000000 / 8000000 * i;
+		g = i < 500000? 0 : 50;
+		printf "%c%c", 128 + g * cos(a) + 40 * (rand() - 0.5),
+		    128 + g * sin(a) + 40 * (rand() - 0.5);
+	}
+}' >"$dir/tone.uc8"
+
+"$sora" --file="$dir/tone.uc8" --file-encoding=uc8 -s 8M -f 100M \
+    --sweep=100M:120M --sweep-spectrum="$dir/spectrum" >/dev/null 2>&1 ||
+    exit 1
+
+# The loudest bin of the last sweep, still well above its noise level
+if ! awk -F, '$1 != last { last = $1; max = $3; noise = $4 }
+	$3 > max { max = $3; noise = $4 }
+	END { exit !(last >= 50 && noise != "" && max - noise > 20) }' \
+	"$dir/spectrum"; then
+	echo "expected the tone above its noise level at the last sweep:" >&2
+	tail -n 5 "$dir/spectrum" >&2
+	exit 1
+fi
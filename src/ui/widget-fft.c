@@ -1,29 +1,33 @@
 
 #include <ui/widget-fft.h>
 
-#include <complex.h>
 #include <math.h>
-#include <fftw3.h>
 #include <gdk/gdkkeysyms.h>
 #include <gtk/gtk.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <radio/radio.h>
+#include <signal/spectrum.h>
 #include <ui/widget.h>
 #include <util/memory.h>
 
-#define DEFAULT_FFT_SIZE 1024
+#define DEFAULT_WIDTH 1024
 #define REFRESH_TIME_MS 20		// 20 ms = 50Hz
+#define READ_SIZE 4096			// samples, whole USB transfers
 #define MAX_PEAKS 10
 
 struct widget_fft {
     struct widget widget;
     struct radio *radio;
-    struct sample *in_buf;
-    double complex *out_buf;
-    double max_buf[DEFAULT_FFT_SIZE];
+    struct spectrum *spectrum;
+    unsigned int size;
+    struct samplef *read_buf;
+    float *power_sum;			// of the segments of a refresh
+    unsigned int nsegments;
+    double *out_buf;			// amplitudes of the last refresh
+    double *max_buf;
     double scale;
-    fftw_plan fft_plan;
     t_frequency tick_first;
     t_frequency tick_step;
     unsigned int tick_number;
@@ -41,15 +45,17 @@ static gboolean widget_fft_key_press_event(GtkWidget *, GdkEventKey *,
 	gpointer);
 
 struct widget *
-widget_fft_new(struct radio *radio) {
+widget_fft_new(struct radio *radio, const struct spectrum_params *params) {
     struct widget_fft *w = memory_alloc(sizeof *w);
-    int i;
+    unsigned int i;
 
     w->widget.gtk_widget = NULL;
     w->radio = radio;
-    w->in_buf = NULL;
+    w->size = params->size;
+    w->spectrum = NULL;
+    w->read_buf = NULL;
     w->out_buf = NULL;
-    w->fft_plan = NULL;
+    w->max_buf = NULL;
 
     w->scale = 1.0;
 
@@ -63,19 +69,16 @@ widget_fft_new(struct radio *radio) {
     if (w->widget.gtk_widget == NULL)
 	goto err;
 
-    w->in_buf = fftw_malloc(sizeof *w->in_buf * DEFAULT_FFT_SIZE);
-    if (w->in_buf == NULL)
-	goto err;
-    w->out_buf = fftw_malloc(sizeof *w->out_buf * DEFAULT_FFT_SIZE);
-    if (w->out_buf == NULL)
-	goto err;
-
-    w->fft_plan = fftw_plan_dft_1d(DEFAULT_FFT_SIZE,
-	(complex double *) w->in_buf, w->out_buf, FFTW_FORWARD, FFTW_ESTIMATE);
-    if (w->fft_plan == NULL)
+    w->spectrum = spectrum_new(params);
+    if (w->spectrum == NULL)
 	goto err;
 
-    for (i = 0; i < DEFAULT_FFT_SIZE; i++)
+    w->read_buf = memory_alloc(sizeof *w->read_buf * READ_SIZE);
+    w->power_sum = memory_alloc(sizeof *w->power_sum * w->size);
+    w->nsegments = 0;
+    w->out_buf = memory_alloc(sizeof *w->out_buf * w->size);
+    w->max_buf = memory_alloc(sizeof *w->max_buf * w->size);
+    for (i = 0; i < w->size; i++)
 	w->max_buf[i] = 0;
 
     g_signal_connect(G_OBJECT(w->widget.gtk_widget), "configure-event",
@@ -85,7 +88,7 @@ widget_fft_new(struct radio *radio) {
     g_signal_connect(G_OBJECT(w->widget.gtk_widget), "key-press-event",
 	G_CALLBACK(widget_fft_key_press_event), w);
 
-    gtk_widget_set_size_request(w->widget.gtk_widget, DEFAULT_FFT_SIZE, 300);
+    gtk_widget_set_size_request(w->widget.gtk_widget, DEFAULT_WIDTH, 300);
     gtk_widget_set_can_focus(w->widget.gtk_widget, TRUE);
     gtk_widget_set_sensitive(w->widget.gtk_widget, TRUE);
     gtk_widget_add_events(w->widget.gtk_widget, GDK_KEY_PRESS_MASK);
@@ -94,14 +97,11 @@ widget_fft_new(struct radio *radio) {
 
     if (0) {
 err:
-	if (w->fft_plan != NULL)
-	    fftw_destroy_plan(w->fft_plan);
-	if (w->out_buf != NULL)
-	    fftw_free(w->out_buf);
-	if (w->in_buf != NULL)
-	    fftw_free(w->in_buf);
+	if (w->spectrum != NULL)
+	    spectrum_delete(w->spectrum);
 	if (w->widget.gtk_widget != NULL)
 	    gtk_widget_destroy(w->widget.gtk_widget);
+	memory_free(w);
 	return NULL;
     }
 
@@ -121,7 +121,7 @@ static void
 widget_fft_compute_auto_scale(struct widget_fft *w) {
     double max = w->max_buf[0];
     size_t i;
-    for (i = 1; i < sizeof w->max_buf / sizeof w->max_buf[0]; i++) {
+    for (i = 1; i < w->size; i++) {
 	if (max < w->max_buf[i])
 	    max = w->max_buf[i];
     }
@@ -226,68 +226,133 @@ widget_fft_peaks_compare(const void *a1, const void *a2) {
 static void
 widget_fft_print_peaks(struct widget_fft *w) {
     int i;
-    struct peak peaks[DEFAULT_FFT_SIZE];
+    int size = w->size;
+    struct peak *peaks = memory_alloc(sizeof *peaks * size);
 
     printf("\n");
 
-    for (i = 1; i < DEFAULT_FFT_SIZE; i++) {
-	peaks[i-1].power = cabs(w->max_buf[i]);
+    for (i = 1; i < size; i++) {
+	peaks[i-1].power = fabs(w->max_buf[i]);
 	peaks[i-1].bin = i;
     }
 
-    qsort(peaks, DEFAULT_FFT_SIZE - 1, sizeof peaks[0],
-	widget_fft_peaks_compare);
+    qsort(peaks, size - 1, sizeof peaks[0], widget_fft_peaks_compare);
 
-    for (i = 0; i < MAX_PEAKS; i++) {
+    for (i = 0; i < MAX_PEAKS && i < size - 1; i++) {
 	char *freq;
 	int bin = peaks[i].bin;
 
-	if (bin >= DEFAULT_FFT_SIZE / 2)
-	    bin -= DEFAULT_FFT_SIZE;
+	if (bin >= size / 2)
+	    bin -= size;
 
 	freq = frequency_human_print(w->freq_center +
-		bin * (1. * w->freq_max - w->freq_min) / DEFAULT_FFT_SIZE);
+		bin * (1. * w->freq_max - w->freq_min) / size);
 	printf("Peak %2d: %s (%g)\n", i + 1, freq, peaks[i].power);
 	memory_free(freq);
     }
+
+    memory_free(peaks);
+}
+
+static void
+widget_fft_add_rows(struct widget_fft *w, unsigned int nrows) {
+    unsigned int i, j;
+
+    for (j = 0; j < nrows; j++) {
+	const float *row = spectrum_get_power(w->spectrum, j);
+
+	for (i = 0; i < w->size; i++)
+	    w->power_sum[i] += row[i];
+    }
+    w->nsegments += nrows;
+}
+
+static void
+widget_fft_push(struct widget_fft *w, size_t n) {
+    size_t done, room;
+
+    for (done = 0; done < n; done += room) {
+	struct samplef *in = spectrum_input(w->spectrum, &room);
+
+	if (room > n - done)
+	    room = n - done;
+	memcpy(in, w->read_buf + done, sizeof *in * room);
+	widget_fft_add_rows(w, spectrum_commit(w->spectrum, room));
+    }
 }
 
+/*
+ * Feeds the spectrum all the samples of a refresh period, at least a
+ * segment's worth, then takes the amplitudes of their average.
+ */
 static int
-widget_fft_read_data(struct radio *r, struct sample *in_buf, size_t size) {
-    size_t to_read = size;
-    double ignored_size_d;
-    size_t ignored_size;
-    size_t to_ignore;
+widget_fft_read_data(struct widget_fft *w) {
+    struct radio *r = w->radio;
     unsigned long srate;
-    double size_in_ms;
+    size_t to_read;
+    double scale;
+    unsigned int i;
     ssize_t ret;
 
     if (r->m->get_sample_rate(r, &srate) == -1)
 	return -1;
 
-    size_in_ms = size * 1000. / srate;
-    ignored_size_d = (REFRESH_TIME_MS - size_in_ms) * srate / 1000.;
-    ignored_size = ignored_size_d > 0? ignored_size_d : 0;
-
-    for (to_ignore = ignored_size; to_ignore != 0; to_ignore -= ret) {
-	/*
-	 * Ignore read() errors because some radios (rtlsdr at least)
-	 * refuse short reads.
-	 */
-	ret = r->m->read(r, in_buf, to_ignore > size? size : to_ignore);
-	if (ret == -1)
-	    break;
-    }
+    for (i = 0; i < w->size; i++)
+	w->power_sum[i] = 0;
+    w->nsegments = 0;
 
-    for (to_read = size; to_read != 0; to_read -= ret) {
-	ret = r->m->read(r, in_buf + size - to_read, to_read);
-	if (ret == -1)
+    to_read = (double) srate * REFRESH_TIME_MS / 1000;
+    for (;;) {
+	ret = r->m->read_float(r, w->read_buf, READ_SIZE);
+	if (ret <= 0)
 	    return -1;
+	widget_fft_push(w, ret);
+	to_read -= (size_t) ret < to_read? (size_t) ret : to_read;
+
+	if (to_read == 0) {
+	    widget_fft_add_rows(w, spectrum_flush(w->spectrum));
+	    if (w->nsegments != 0)
+		break;
+	}
     }
-    
+
+    scale = spectrum_get_power_scale(w->spectrum) / w->nsegments;
+    for (i = 0; i < w->size; i++)
+	w->out_buf[i] = sqrt(w->power_sum[i] * scale);
+
     return 0;
 }
 
+/*
+ * Draws values centered on the tuner frequency, keeping the highest of
+ * the bins falling on each pixel when there are more bins than pixels.
+ */
+static void
+widget_fft_draw_line(struct widget_fft *w, cairo_t *cr, unsigned int bottom,
+							const double *values) {
+    unsigned int width = w->widget.gtk_widget->allocation.width;
+    unsigned int stride = width != 0 && w->size > width? w->size / width : 1;
+    double peak = 0;
+    unsigned int x;
+
+    for (x = 0; x < w->size; x++) {
+	int i = (x + (w->size / 2)) % w->size;
+	double new_x = (double) (x - x % stride) * width / w->size;
+
+	if (x % stride == 0 || values[i] > peak)
+	    peak = values[i];
+	if (x % stride != stride - 1 && x != w->size - 1)
+	    continue;
+
+	if (x < stride)
+	    cairo_move_to(cr, new_x, bottom - peak * w->scale - 1);
+	else
+	    cairo_line_to(cr, new_x, bottom - peak * w->scale - 1);
+    }
+
+    cairo_stroke(cr);
+}
+
 static void
 widget_fft_draw_event(GtkWidget *widget, GdkEventExpose *event, gpointer aux) {
     struct widget_fft *w = (struct widget_fft *) aux;
@@ -298,13 +363,11 @@ widget_fft_draw_event(GtkWidget *widget, GdkEventExpose *event, gpointer aux) {
     cairo_text_extents_t extent;
     unsigned int bottom;
 
-    if (widget_fft_read_data(w->radio, w->in_buf, DEFAULT_FFT_SIZE) == -1) {
+    if (widget_fft_read_data(w) == -1) {
 	printf("EOF or error\n");
 	goto err;
     }
 
-    fftw_execute(w->fft_plan);
-
     if (!w->cumulate)
 	w->out_buf[0] = 0;
 
@@ -325,52 +388,30 @@ widget_fft_draw_event(GtkWidget *widget, GdkEventExpose *event, gpointer aux) {
     cairo_set_line_width(cr, 0.5);
     cairo_set_source_rgb(cr, 0, 0, 1);
 
-    for (x = 0; x < DEFAULT_FFT_SIZE; x++) {
-	int i = (x + (DEFAULT_FFT_SIZE / 2)) % DEFAULT_FFT_SIZE;
-	double new_y = cabs(w->out_buf[i]);
-	double new_x = (double) x * width / DEFAULT_FFT_SIZE;
-
+    for (x = 0; x < w->size; x++) {
 	if (w->cumulate)
-	    w->max_buf[i] += new_y;
-	else if (new_y > w->max_buf[i])
-	    w->max_buf[i] = new_y;
-
-	new_y *= w->scale;
-
-	if (x == 0)
-	    cairo_move_to(cr, new_x, bottom - new_y - 1);
-	else
-	    cairo_line_to(cr, new_x, bottom - new_y - 1);
+	    w->max_buf[x] += w->out_buf[x];
+	else if (w->out_buf[x] > w->max_buf[x])
+	    w->max_buf[x] = w->out_buf[x];
     }
 
-    cairo_stroke(cr);
+    widget_fft_draw_line(w, cr, bottom, w->out_buf);
 
     if (w->cumulate) {
 	double min = w->max_buf[0];
-	for (x = 0; x < DEFAULT_FFT_SIZE; x++) {
-	    int i = (x + (DEFAULT_FFT_SIZE / 2)) % DEFAULT_FFT_SIZE;
+	for (x = 0; x < w->size; x++) {
+	    int i = (x + (w->size / 2)) % w->size;
 	    if (w->max_buf[i] < min)
 		min = w->max_buf[i];
 	}
-	for (x = 0; x < DEFAULT_FFT_SIZE; x++) {
-	    int i = (x + (DEFAULT_FFT_SIZE / 2)) % DEFAULT_FFT_SIZE;
+	for (x = 0; x < w->size; x++) {
+	    int i = (x + (w->size / 2)) % w->size;
 	    w->max_buf[i] -= min;
 	}
     }
 
     cairo_set_source_rgb(cr, 1, 0, 0);
-
-    for (x = 0; x < DEFAULT_FFT_SIZE; x++) {
-	int i = (x + (DEFAULT_FFT_SIZE / 2)) % DEFAULT_FFT_SIZE;
-	double new_x = (double) x * width / DEFAULT_FFT_SIZE;
-
-	if (x == 0)
-	    cairo_move_to(cr, new_x, bottom - w->max_buf[i] * w->scale - 1);
-	else
-	    cairo_line_to(cr, new_x, bottom - w->max_buf[i] * w->scale - 1);
-    }
-
-    cairo_stroke(cr);
+    widget_fft_draw_line(w, cr, bottom, w->max_buf);
 err:
     if (cr != NULL)
 	cairo_destroy(cr);
@@ -384,7 +425,7 @@ widget_fft_key_press_event(GtkWidget *widget, GdkEventKey *event,
     unsigned long srate;
     long offset;
     int need_refresh = 1;
-    int i;
+    unsigned int i;
 
     switch (event->keyval) {
     case GDK_KEY_a:
@@ -425,7 +466,7 @@ widget_fft_key_press_event(GtkWidget *widget, GdkEventKey *event,
     }
 
     if (need_refresh) {
-	for (i = 0; i < DEFAULT_FFT_SIZE; i++)
+	for (i = 0; i < w->size; i++)
 	    w->max_buf[i] = 0;
 
 	gtk_widget_queue_resize(w->widget.gtk_widget);
@@ -2,8 +2,9 @@
 #define UI_WIDGET_FFT_H_
 
 struct radio;
+struct spectrum_params;
 struct widget;
 
-struct widget *widget_fft_new(struct radio *);
+struct widget *widget_fft_new(struct radio *, const struct spectrum_params *);
 
 #endif /* UI_WIDGET_FFT_H_ */
@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define _DEFAULT_SOURCE			/* for syscall() */
+#endif
 
 #include <util/async-buffer.h>
 
@@ -5,120 +8,265 @@
 
 #include <pthread.h>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ASYNC_BUFFER_USE_FUTEX
+#endif
+
 #include <util/memory.h>
+#include <util/mirror-buffer.h>
 
-struct async_buffer {
-    pthread_cond_t cond;
+#define CACHE_LINE_SIZE 64
+
+/*
+ * A side of the buffer which may have to sleep until the other side makes
+ * progress.  Sleeping is the slow path: the other side only pays for a
+ * wakeup when "waiting" is set.
+ */
+struct async_buffer_waiter {
+    unsigned int seq;
+    int waiting;
+#ifndef ASYNC_BUFFER_USE_FUTEX
     pthread_mutex_t mtx;
-    void *buffer;
-    size_t buffer_read_index;
-    size_t buffer_write_index;
+    pthread_cond_t cond;
+#endif
+};
+
+/*
+ * Single producer, single consumer.  Indices are byte counters which only
+ * grow (modulo SIZE_MAX + 1), each one written by one side only and kept
+ * on its own cache line.  The storage is mirrored in virtual memory so
+ * that every transfer is a single contiguous copy.
+ */
+struct async_buffer {
+    size_t read_index;			/* written by the reader */
+    char pad1[CACHE_LINE_SIZE - sizeof (size_t)];
+    size_t write_index;			/* written by the writer */
+    unsigned long overruns;
+    unsigned long long dropped_bytes;
+    char pad2[CACHE_LINE_SIZE - 2 * sizeof (size_t) -
+	sizeof (unsigned long long)];
+    struct async_buffer_waiter reader;	/* waiting for data */
+    struct async_buffer_waiter writer;	/* waiting for room */
+    struct mirror_buffer *mirror;
+    unsigned char *buffer;
     size_t buffer_size;
-    size_t buffer_room_left;
     int flags;
 };
 
+static void
+async_buffer_waiter_init(struct async_buffer_waiter *w) {
+    w->seq = 0;
+    w->waiting = 0;
+#ifndef ASYNC_BUFFER_USE_FUTEX
+    pthread_mutex_init(&w->mtx, NULL);
+    pthread_cond_init(&w->cond, NULL);
+#endif
+}
+
+static void
+async_buffer_waiter_destroy(struct async_buffer_waiter *w) {
+#ifndef ASYNC_BUFFER_USE_FUTEX
+    pthread_mutex_destroy(&w->mtx);
+    pthread_cond_destroy(&w->cond);
+#else
+    (void) w;
+#endif
+}
+
+/*
+ * Sleep until woken up, unless the condition the caller waits for already
+ * changed since it got seq.  Spurious returns are possible, the caller has
+ * to check its condition again.
+ */
+static void
+async_buffer_waiter_sleep(struct async_buffer_waiter *w, unsigned int seq) {
+#ifdef ASYNC_BUFFER_USE_FUTEX
+    syscall(SYS_futex, &w->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&w->mtx);
+    if (__atomic_load_n(&w->seq, __ATOMIC_ACQUIRE) == seq)
+	pthread_cond_wait(&w->cond, &w->mtx);
+    pthread_mutex_unlock(&w->mtx);
+#endif
+}
+
+static void
+async_buffer_waiter_wake(struct async_buffer_waiter *w) {
+    /* Pairs with the fence in async_buffer_wait_for() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&w->waiting, __ATOMIC_RELAXED))
+	return;
+
+#ifdef ASYNC_BUFFER_USE_FUTEX
+    __atomic_add_fetch(&w->seq, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&w->mtx);
+    __atomic_add_fetch(&w->seq, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mtx);
+#endif
+}
+
+/*
+ * Returns the number of bytes available for reading (reader's view) or
+ * for writing (writer's view).
+ */
+static size_t
+async_buffer_available(struct async_buffer *b, int for_reader) {
+    if (for_reader)
+	return __atomic_load_n(&b->write_index, __ATOMIC_ACQUIRE) -
+	    b->read_index;
+
+    return b->buffer_size - (b->write_index -
+	__atomic_load_n(&b->read_index, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Wait until s bytes are available for the given side.  Returns -1 if
+ * they aren't and the side isn't allowed to wait.
+ */
+static int
+async_buffer_wait_for(struct async_buffer *b, size_t s, int for_reader) {
+    struct async_buffer_waiter *w = for_reader? &b->reader : &b->writer;
+    int may_wait = b->flags & (for_reader? ASYNC_BUFFER_READER_CAN_WAIT :
+	ASYNC_BUFFER_WRITER_CAN_WAIT);
+
+    while (async_buffer_available(b, for_reader) < s) {
+	unsigned int seq;
+
+	if (!may_wait)
+	    return -1;
+
+	seq = __atomic_load_n(&w->seq, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&w->waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (async_buffer_available(b, for_reader) < s)
+	    async_buffer_waiter_sleep(w, seq);
+	__atomic_store_n(&w->waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
 struct async_buffer *
 async_buffer_new(size_t s, int flags) {
     struct async_buffer *b = memory_alloc(sizeof *b);
 
-    b->buffer = memory_alloc(s);
-    b->buffer_read_index = 0;
-    b->buffer_write_index = 0;
-    b->buffer_size = s;
-    b->buffer_room_left = s;
+    b->mirror = mirror_buffer_new(s);
+    b->buffer = mirror_buffer_get_base(b->mirror);
+    b->buffer_size = mirror_buffer_get_size(b->mirror);
+    b->read_index = 0;
+    b->write_index = 0;
+    b->overruns = 0;
+    b->dropped_bytes = 0;
 
     b->flags = flags;
 
-    pthread_cond_init(&b->cond, NULL);
-    pthread_mutex_init(&b->mtx, NULL);
+    async_buffer_waiter_init(&b->reader);
+    async_buffer_waiter_init(&b->writer);
 
     return b;
 }
 
 void
 async_buffer_delete(struct async_buffer *b) {
-    pthread_cond_destroy(&b->cond);
-    pthread_mutex_destroy(&b->mtx);
-    memory_free(b->buffer);
+    async_buffer_waiter_destroy(&b->reader);
+    async_buffer_waiter_destroy(&b->writer);
+    mirror_buffer_delete(b->mirror);
     memory_free(b);
 }
 
 ssize_t
 async_buffer_read(struct async_buffer *b, void *buf, size_t s) {
-    size_t avail;
-    size_t first_chunk_size;
+    const void *data = async_buffer_peek(b, s);
 
-    if (s > b->buffer_size)
+    if (data == NULL)
 	return -1;
 
-    pthread_mutex_lock(&b->mtx);
+    memcpy(buf, data, s);
+    async_buffer_consume(b, s);
 
-    while (avail = b->buffer_size - b->buffer_room_left, avail < s) {
-	if (b->flags & ASYNC_BUFFER_READER_CAN_WAIT)
-	    pthread_cond_wait(&b->cond, &b->mtx);
-	else {
-	    pthread_mutex_unlock(&b->mtx);
-	    return -1;
-	}
-    }
+    return s;
+}
 
-    first_chunk_size = b->buffer_size - b->buffer_read_index >= s?
-	s : b->buffer_size - b->buffer_read_index;
+/*
+ * Wait for s bytes and return a pointer to them, contiguous in memory.
+ * They stay valid until async_buffer_consume() is called.
+ */
+const void *
+async_buffer_peek(struct async_buffer *b, size_t s) {
+    if (s > b->buffer_size)
+	return NULL;
 
-    memcpy(buf, b->buffer + b->buffer_read_index, first_chunk_size);
-    memcpy(buf + first_chunk_size, b->buffer, s - first_chunk_size);
+    if (async_buffer_wait_for(b, s, 1) == -1)
+	return NULL;
 
-    b->buffer_room_left += s;
-    b->buffer_read_index = (b->buffer_read_index + s) % b->buffer_size;
-    pthread_mutex_unlock(&b->mtx);
+    return b->buffer + b->read_index % b->buffer_size;
+}
 
-    if (s != 0)
-	pthread_cond_signal(&b->cond);
+void
+async_buffer_consume(struct async_buffer *b, size_t s) {
+    __atomic_store_n(&b->read_index, b->read_index + s, __ATOMIC_RELEASE);
 
-    return s;
+    if (s != 0)
+	async_buffer_waiter_wake(&b->writer);
 }
 
 ssize_t
-async_buffer_write(struct async_buffer *b, void *buf, size_t s) {
-    size_t avail;
-    size_t first_chunk_size;
-
+async_buffer_write(struct async_buffer *b, const void *buf, size_t s) {
     if (s > b->buffer_size)
 	return -1;
 
-    pthread_mutex_lock(&b->mtx);
-
-    while (b->buffer_room_left < s) {
-	if (b->flags & ASYNC_BUFFER_WRITER_CAN_WAIT)
-	    pthread_cond_wait(&b->cond, &b->mtx);
-	else {
-	    pthread_mutex_unlock(&b->mtx);
-	    return -1;
-	}
+    if (async_buffer_wait_for(b, s, 0) == -1) {
+	__atomic_store_n(&b->overruns, b->overruns + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&b->dropped_bytes, b->dropped_bytes + s,
+	    __ATOMIC_RELAXED);
+	return -1;
     }
 
-    first_chunk_size = b->buffer_size - b->buffer_write_index >= s?
-	s : b->buffer_size - b->buffer_write_index;
-
-    memcpy(b->buffer + b->buffer_write_index, buf, first_chunk_size);
-    memcpy(b->buffer, buf + first_chunk_size, s - first_chunk_size);
+    memcpy(b->buffer + b->write_index % b->buffer_size, buf, s);
 
-    b->buffer_room_left -= s;
-    b->buffer_write_index = (b->buffer_write_index + s) % b->buffer_size;
-    pthread_mutex_unlock(&b->mtx);
+    __atomic_store_n(&b->write_index, b->write_index + s, __ATOMIC_RELEASE);
 
     if (s != 0)
-	pthread_cond_signal(&b->cond);
+	async_buffer_waiter_wake(&b->reader);
 
     return s;
 }
 
+/*
+ * Drop everything written so far.  To be called on the reader's side.
+ */
 void
 async_buffer_empty(struct async_buffer *b) {
-    pthread_mutex_lock(&b->mtx);
-    b->buffer_read_index = 0;
-    b->buffer_write_index = 0;
-    b->buffer_room_left = b->buffer_size;
-    pthread_mutex_unlock(&b->mtx);
+    __atomic_store_n(&b->read_index,
+	__atomic_load_n(&b->write_index, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+    async_buffer_waiter_wake(&b->writer);
+}
+
+/*
+ * Bytes written and not read yet.  Exact on the reader's side.
+ */
+size_t
+async_buffer_get_fill(struct async_buffer *b) {
+    return __atomic_load_n(&b->write_index, __ATOMIC_ACQUIRE) -
+	b->read_index;
+}
+
+/*
+ * Number of writes which failed for lack of room, and bytes they carried.
+ */
+unsigned long
+async_buffer_get_overruns(struct async_buffer *b) {
+    return __atomic_load_n(&b->overruns, __ATOMIC_RELAXED);
+}
+
+unsigned long long
+async_buffer_get_dropped_bytes(struct async_buffer *b) {
+    return __atomic_load_n(&b->dropped_bytes, __ATOMIC_RELAXED);
 }
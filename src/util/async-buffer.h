@@ -1,5 +1,5 @@
 /*
- * Thread-safe circular buffer
+ * Thread-safe circular buffer, for one reader and one writer
  */
 #ifndef UTIL_ASYNC_BUFFER_H_
 #define UTIL_ASYNC_BUFFER_H_
@@ -15,7 +15,15 @@ struct async_buffer *async_buffer_new(size_t, int);
 void async_buffer_delete(struct async_buffer *);
 
 ssize_t async_buffer_read(struct async_buffer *, void *, size_t);
-ssize_t async_buffer_write(struct async_buffer *, void *, size_t);
+ssize_t async_buffer_write(struct async_buffer *, const void *, size_t);
 void async_buffer_empty(struct async_buffer *);
 
+/* Zero-copy reading */
+const void *async_buffer_peek(struct async_buffer *, size_t);
+void async_buffer_consume(struct async_buffer *, size_t);
+
+size_t async_buffer_get_fill(struct async_buffer *);
+unsigned long async_buffer_get_overruns(struct async_buffer *);
+unsigned long long async_buffer_get_dropped_bytes(struct async_buffer *);
+
 #endif /* UTIL_ASYNC_BUFFER_H_ */
@@ -0,0 +1,474 @@
+#include <util/json.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/memory.h>
+
+/* Deeper documents are rejected rather than risking the stack */
+#define JSON_MAX_DEPTH	64
+
+struct json_parser {
+    const char *p;
+    const char *end;
+    unsigned int depth;
+};
+
+static struct json_value *json_new(int);
+static void json_skip_space(struct json_parser *);
+static int json_expect(struct json_parser *, const char *);
+static struct json_value *json_parse_value(struct json_parser *);
+static struct json_value *json_parse_number(struct json_parser *);
+static char *json_parse_string(struct json_parser *);
+static int json_parse_hex4(struct json_parser *, unsigned long *);
+static void json_append(struct json_value *, char *, struct json_value *);
+
+static struct json_value *
+json_new(int type) {
+    struct json_value *v = memory_alloc(sizeof *v);
+
+    v->type = type;
+    v->number = 0;
+    v->string = NULL;
+    v->nelems = 0;
+    v->elems = NULL;
+    v->keys = NULL;
+
+    return v;
+}
+
+static void
+json_skip_space(struct json_parser *jp) {
+    while (jp->p < jp->end && (*jp->p == ' ' || *jp->p == '\t' ||
+	    *jp->p == '\n' || *jp->p == '\r'))
+	jp->p++;
+}
+
+static int
+json_expect(struct json_parser *jp, const char *word) {
+    size_t len = strlen(word);
+
+    if ((size_t) (jp->end - jp->p) < len || memcmp(jp->p, word, len) != 0)
+	return 0;
+    jp->p += len;
+
+    return 1;
+}
+
+/*
+ * Checks the JSON grammar for numbers, which is stricter than strtod().
+ */
+static struct json_value *
+json_parse_number(struct json_parser *jp) {
+    const char *start = jp->p;
+    char buf[64];
+    struct json_value *v;
+
+#define JSON_DIGIT() (jp->p < jp->end && *jp->p >= '0' && *jp->p <= '9')
+    if (jp->p < jp->end && *jp->p == '-')
+	jp->p++;
+    if (!JSON_DIGIT())
+	return NULL;
+    if (*jp->p == '0')
+	jp->p++;
+    else
+	while (JSON_DIGIT())
+	    jp->p++;
+    if (jp->p < jp->end && *jp->p == '.') {
+	jp->p++;
+	if (!JSON_DIGIT())
+	    return NULL;
+	while (JSON_DIGIT())
+	    jp->p++;
+    }
+    if (jp->p < jp->end && (*jp->p == 'e' || *jp->p == 'E')) {
+	jp->p++;
+	if (jp->p < jp->end && (*jp->p == '+' || *jp->p == '-'))
+	    jp->p++;
+	if (!JSON_DIGIT())
+	    return NULL;
+	while (JSON_DIGIT())
+	    jp->p++;
+    }
+#undef JSON_DIGIT
+
+    if ((size_t) (jp->p - start) >= sizeof buf)
+	return NULL;
+    memcpy(buf, start, jp->p - start);
+    buf[jp->p - start] = '\0';
+
+    v = json_new(JSON_NUMBER);
+    v->number = strtod(buf, NULL);
+
+    return v;
+}
+
+static int
+json_parse_hex4(struct json_parser *jp, unsigned long *cp) {
+    int i;
+
+    if (jp->end - jp->p < 4)
+	return 0;
+
+    *cp = 0;
+    for (i = 0; i < 4; i++) {
+	char c = *jp->p++;
+
+	*cp <<= 4;
+	if (c >= '0' && c <= '9')
+	    *cp |= c - '0';
+	else if (c >= 'a' && c <= 'f')
+	    *cp |= c - 'a' + 10;
+	else if (c >= 'A' && c <= 'F')
+	    *cp |= c - 'A' + 10;
+	else
+	    return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Starts on the opening quote.  \u escapes come out as UTF-8, surrogate
+ * pairs included.
+ */
+static char *
+json_parse_string(struct json_parser *jp) {
+    size_t size = 16;
+    size_t len = 0;
+    char *s = memory_alloc(size);
+
+    jp->p++;
+    for (;;) {
+	unsigned long cp;
+	char c;
+
+	if (jp->p == jp->end)
+	    goto err;
+	c = *jp->p++;
+
+	/* Room for the longest UTF-8 sequence and the NUL */
+	if (len + 5 > size) {
+	    size *= 2;
+	    s = memory_realloc(s, size);
+	}
+
+	if (c == '"')
+	    break;
+	if ((unsigned char) c < 0x20)
+	    goto err;
+	if (c != '\\') {
+	    s[len++] = c;
+	    continue;
+	}
+
+	if (jp->p == jp->end)
+	    goto err;
+	switch (c = *jp->p++) {
+	case '"': case '\\': case '/':
+	    s[len++] = c;
+	    continue;
+	case 'b': s[len++] = '\b'; continue;
+	case 'f': s[len++] = '\f'; continue;
+	case 'n': s[len++] = '\n'; continue;
+	case 'r': s[len++] = '\r'; continue;
+	case 't': s[len++] = '\t'; continue;
+	case 'u':
+	    break;
+	default:
+	    goto err;
+	}
+
+	if (!json_parse_hex4(jp, &cp))
+	    goto err;
+	if (cp >= 0xd800 && cp < 0xdc00) {
+	    unsigned long low;
+
+	    if (!json_expect(jp, "\\u") || !json_parse_hex4(jp, &low) ||
+		    low < 0xdc00 || low >= 0xe000)
+		goto err;
+	    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+	} else if (cp >= 0xdc00 && cp < 0xe000)
+	    goto err;
+
+	if (cp < 0x80)
+	    s[len++] = cp;
+	else if (cp < 0x800) {
+	    s[len++] = 0xc0 | cp >> 6;
+	    s[len++] = 0x80 | (cp & 0x3f);
+	} else if (cp < 0x10000) {
+	    s[len++] = 0xe0 | cp >> 12;
+	    s[len++] = 0x80 | (cp >> 6 & 0x3f);
+	    s[len++] = 0x80 | (cp & 0x3f);
+	} else {
+	    s[len++] = 0xf0 | cp >> 18;
+	    s[len++] = 0x80 | (cp >> 12 & 0x3f);
+	    s[len++] = 0x80 | (cp >> 6 & 0x3f);
+	    s[len++] = 0x80 | (cp & 0x3f);
+	}
+    }
+
+    s[len] = '\0';
+
+    return s;
+
+err:
+    memory_free(s);
+    return NULL;
+}
+
+static void
+json_append(struct json_value *v, char *key, struct json_value *elem) {
+    /* Grow by powers of two */
+    if ((v->nelems & (v->nelems - 1)) == 0) {
+	size_t size = v->nelems == 0? 1 : 2 * v->nelems;
+
+	v->elems = memory_realloc(v->elems, size * sizeof *v->elems);
+	if (v->type == JSON_OBJECT)
+	    v->keys = memory_realloc(v->keys, size * sizeof *v->keys);
+    }
+
+    v->elems[v->nelems] = elem;
+    if (v->type == JSON_OBJECT)
+	v->keys[v->nelems] = key;
+    v->nelems++;
+}
+
+static struct json_value *
+json_parse_value(struct json_parser *jp) {
+    struct json_value *v;
+    int close;
+
+    json_skip_space(jp);
+    if (jp->p == jp->end)
+	return NULL;
+
+    switch (*jp->p) {
+    case 'n':
+	return json_expect(jp, "null")? json_new(JSON_NULL) : NULL;
+    case 'f':
+	return json_expect(jp, "false")? json_new(JSON_FALSE) : NULL;
+    case 't':
+	return json_expect(jp, "true")? json_new(JSON_TRUE) : NULL;
+    case '"': {
+	char *s = json_parse_string(jp);
+
+	if (s == NULL)
+	    return NULL;
+	v = json_new(JSON_STRING);
+	v->string = s;
+	return v;
+    }
+    case '[':
+	v = json_new(JSON_ARRAY);
+	close = ']';
+	break;
+    case '{':
+	v = json_new(JSON_OBJECT);
+	close = '}';
+	break;
+    default:
+	return json_parse_number(jp);
+    }
+
+    if (++jp->depth > JSON_MAX_DEPTH)
+	goto err;
+
+    jp->p++;
+    json_skip_space(jp);
+    if (jp->p < jp->end && *jp->p == close) {
+	jp->p++;
+	jp->depth--;
+	return v;
+    }
+
+    for (;;) {
+	struct json_value *elem;
+	char *key = NULL;
+
+	if (v->type == JSON_OBJECT) {
+	    json_skip_space(jp);
+	    if (jp->p == jp->end || *jp->p != '"' ||
+		    (key = json_parse_string(jp)) == NULL)
+		goto err;
+	    json_skip_space(jp);
+	    if (!json_expect(jp, ":")) {
+		memory_free(key);
+		goto err;
+	    }
+	}
+
+	elem = json_parse_value(jp);
+	if (elem == NULL) {
+	    if (key != NULL)
+		memory_free(key);
+	    goto err;
+	}
+	json_append(v, key, elem);
+
+	json_skip_space(jp);
+	if (jp->p == jp->end)
+	    goto err;
+	if (*jp->p == close)
+	    break;
+	if (*jp->p != ',')
+	    goto err;
+	jp->p++;
+    }
+
+    jp->p++;
+    jp->depth--;
+
+    return v;
+
+err:
+    json_delete(v);
+    return NULL;
+}
+
+/*
+ * Returns NULL if text is not exactly one JSON value.
+ */
+struct json_value *
+json_parse(const char *text, size_t len) {
+    struct json_parser jp;
+    struct json_value *v;
+
+    jp.p = text;
+    jp.end = text + len;
+    jp.depth = 0;
+
+    v = json_parse_value(&jp);
+    if (v == NULL)
+	return NULL;
+
+    json_skip_space(&jp);
+    if (jp.p != jp.end) {
+	json_delete(v);
+	return NULL;
+    }
+
+    return v;
+}
+
+/*
+ * Returns NULL with errno set, to EINVAL if the file is not JSON.
+ */
+struct json_value *
+json_parse_file(const char *name) {
+    FILE *f = fopen(name, "r");
+    size_t size = 4096;
+    size_t len = 0;
+    char *text;
+    struct json_value *v;
+
+    if (f == NULL)
+	return NULL;
+
+    text = memory_alloc(size);
+    for (;;) {
+	size_t n = fread(text + len, 1, size - len, f);
+
+	len += n;
+	if (len < size)
+	    break;
+	size *= 2;
+	text = memory_realloc(text, size);
+    }
+
+    if (ferror(f)) {
+	int saved_errno = errno;
+
+	fclose(f);
+	memory_free(text);
+	errno = saved_errno;
+	return NULL;
+    }
+    fclose(f);
+
+    v = json_parse(text, len);
+    memory_free(text);
+    if (v == NULL)
+	errno = EINVAL;
+
+    return v;
+}
+
+void
+json_delete(struct json_value *v) {
+    size_t i;
+
+    for (i = 0; i < v->nelems; i++) {
+	json_delete(v->elems[i]);
+	if (v->keys != NULL)
+	    memory_free(v->keys[i]);
+    }
+    if (v->elems != NULL)
+	memory_free(v->elems);
+    if (v->keys != NULL)
+	memory_free(v->keys);
+    if (v->string != NULL)
+	memory_free(v->string);
+    memory_free(v);
+}
+
+/*
+ * The last one wins if the key appears more than once.  NULL if v is not
+ * an object or has no such key.
+ */
+struct json_value *
+json_object_get(const struct json_value *v, const char *key) {
+    size_t i;
+
+    if (v == NULL || v->type != JSON_OBJECT)
+	return NULL;
+
+    for (i = v->nelems; i-- > 0; )
+	if (strcmp(v->keys[i], key) == 0)
+	    return v->elems[i];
+
+    return NULL;
+}
+
+const char *
+json_object_get_string(const struct json_value *v, const char *key) {
+    struct json_value *s = json_object_get(v, key);
+
+    return s != NULL && s->type == JSON_STRING? s->string : NULL;
+}
+
+/*
+ * Returns 0 and leaves *np alone if there is no such number.
+ */
+int
+json_object_get_number(const struct json_value *v, const char *key,
+								double *np) {
+    struct json_value *n = json_object_get(v, key);
+
+    if (n == NULL || n->type != JSON_NUMBER)
+	return 0;
+    *np = n->number;
+
+    return 1;
+}
+
+void
+json_print_string(FILE *out, const char *s) {
+    putc('"', out);
+    for (; *s != '\0'; s++) {
+	unsigned char c = *s;
+
+	if (c == '"' || c == '\\')
+	    fprintf(out, "\\%c", c);
+	else if (c == '\n')
+	    fputs("\\n", out);
+	else if (c == '\t')
+	    fputs("\\t", out);
+	else if (c < 0x20)
+	    fprintf(out, "\\u%04x", c);
+	else
+	    putc(c, out);
+    }
+    putc('"', out);
+}
@@ -0,0 +1,42 @@
+/*
+ * Just enough JSON to read and write metadata files
+ */
+#ifndef UTIL_JSON_H_
+#define UTIL_JSON_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define JSON_NULL	0
+#define JSON_FALSE	1
+#define JSON_TRUE	2
+#define JSON_NUMBER	3
+#define JSON_STRING	4
+#define JSON_ARRAY	5
+#define JSON_OBJECT	6
+
+/*
+ * Arrays and objects hold nelems values; objects also have one key per
+ * value, in the order of the text.
+ */
+struct json_value {
+    int type;
+    double number;
+    char *string;			/* NUL terminated, UTF-8 */
+    size_t nelems;
+    struct json_value **elems;
+    char **keys;
+};
+
+struct json_value *json_parse(const char *, size_t);
+struct json_value *json_parse_file(const char *);
+void json_delete(struct json_value *);
+
+struct json_value *json_object_get(const struct json_value *, const char *);
+const char *json_object_get_string(const struct json_value *, const char *);
+int json_object_get_number(const struct json_value *, const char *,
+	double *);
+
+void json_print_string(FILE *, const char *);
+
+#endif /* UTIL_JSON_H_ */
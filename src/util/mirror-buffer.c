@@ -0,0 +1,122 @@
+#define _DEFAULT_SOURCE			/* for MAP_ANONYMOUS, syscall() */
+
+#include <util/mirror-buffer.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifdef SYS_memfd_create
+#define MIRROR_BUFFER_USE_MEMFD
+#endif
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#include <util/exception.h>
+#include <util/memory.h>
+
+struct mirror_buffer {
+    unsigned char *base;
+    size_t size;
+};
+
+static int mirror_buffer_open_backing(size_t);
+
+/*
+ * Returns an anonymous file descriptor of the given size, -1 on error.
+ */
+static int
+mirror_buffer_open_backing(size_t size) {
+    int fd;
+
+#ifdef MIRROR_BUFFER_USE_MEMFD
+    fd = syscall(SYS_memfd_create, "mirror-buffer", 0);
+#else
+    static unsigned int counter;
+    char name[64];
+
+    do {
+	snprintf(name, sizeof name, "/mirror-buffer-%ld-%u", (long) getpid(),
+								counter++);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } while (fd == -1 && errno == EEXIST);
+    if (fd != -1)
+	shm_unlink(name);
+#endif
+
+    if (fd == -1)
+	return -1;
+
+    if (ftruncate(fd, size) == -1) {
+	close(fd);
+	return -1;
+    }
+
+    return fd;
+}
+
+struct mirror_buffer *
+mirror_buffer_new(size_t size) {
+    struct mirror_buffer *b;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    unsigned char *base;
+    int fd;
+
+    size = (size + page_size - 1) / page_size * page_size;
+    if (size == 0)
+	size = page_size;
+
+    fd = mirror_buffer_open_backing(size);
+    if (fd == -1)
+	EXCEPTION_RAISE(runtime_error, "mirror_buffer_new: no backing file");
+
+    /* Reserve the whole range first so that both halves are adjacent */
+    base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+	goto err;
+
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+							fd, 0) == MAP_FAILED ||
+	    mmap(base + size, size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+	munmap(base, 2 * size);
+	goto err;
+    }
+
+    close(fd);
+
+    b = memory_alloc(sizeof *b);
+    b->base = base;
+    b->size = size;
+
+    return b;
+
+err:
+    close(fd);
+    EXCEPTION_RAISE(runtime_error, "mirror_buffer_new: mmap failed");
+}
+
+void
+mirror_buffer_delete(struct mirror_buffer *b) {
+    munmap(b->base, 2 * b->size);
+    memory_free(b);
+}
+
+void *
+mirror_buffer_get_base(struct mirror_buffer *b) {
+    return b->base;
+}
+
+size_t
+mirror_buffer_get_size(struct mirror_buffer *b) {
+    return b->size;
+}
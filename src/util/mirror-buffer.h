@@ -0,0 +1,20 @@
+/*
+ * Circular buffer mapped twice in a row in virtual memory, so that any
+ * window of up to its size starting inside the first mapping is contiguous
+ */
+#ifndef UTIL_MIRROR_BUFFER_H_
+#define UTIL_MIRROR_BUFFER_H_
+
+#include <stddef.h>
+
+struct mirror_buffer;
+
+/* The size is rounded up to a multiple of the page size. */
+struct mirror_buffer *mirror_buffer_new(size_t);
+void mirror_buffer_delete(struct mirror_buffer *);
+
+/* Base of the mapping: base[i] and base[i + size] are the same byte. */
+void *mirror_buffer_get_base(struct mirror_buffer *);
+size_t mirror_buffer_get_size(struct mirror_buffer *);
+
+#endif /* UTIL_MIRROR_BUFFER_H_ */
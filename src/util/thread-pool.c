@@ -0,0 +1,357 @@
+#include <util/thread-pool.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <util/exception.h>
+#include <util/memory.h>
+
+#define THREAD_POOL_INITIAL_DEQUE_SIZE 64
+
+struct thread_pool_task {
+    void (*fn)(void *);
+    void *arg;
+};
+
+/*
+ * The owner pushes and pops at the bottom, thieves take from the top, so
+ * that the owner keeps working on what it produced last (and is likely
+ * still in its cache) while others take the oldest tasks.
+ */
+struct thread_pool_deque {
+    pthread_mutex_t mtx;
+    struct thread_pool_task *tasks;	/* ring of size tasks */
+    unsigned int size;
+    unsigned int top;
+    unsigned int count;
+};
+
+struct thread_pool_worker {
+    struct thread_pool *pool;
+    struct thread_pool_deque deque;
+    pthread_t thread;
+    unsigned int index;
+};
+
+/*
+ * Arguments of thread_pool_run(), taken in turn by its tasks and caller.
+ */
+struct thread_pool_batch {
+    void (*fn)(void *);
+    char *args;
+    size_t size;
+    size_t n;
+    size_t next;
+    unsigned int ntasks;		/* not done yet */
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+};
+
+struct thread_pool {
+    struct thread_pool_worker *workers;
+    unsigned int nworkers;
+    unsigned int next_worker;		/* for submissions from outside */
+    int pending;			/* tasks queued in any deque */
+    int nsleeping;
+    int shutdown;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+};
+
+static pthread_key_t thread_pool_worker_key;
+static pthread_once_t thread_pool_key_once = PTHREAD_ONCE_INIT;
+
+static void thread_pool_make_key(void);
+static void thread_pool_deque_push(struct thread_pool_deque *,
+	const struct thread_pool_task *);
+static int thread_pool_deque_pop(struct thread_pool_deque *,
+	struct thread_pool_task *);
+static int thread_pool_deque_steal(struct thread_pool_deque *,
+	struct thread_pool_task *);
+static int thread_pool_get_task(struct thread_pool_worker *,
+	struct thread_pool_task *);
+static void *thread_pool_worker_run(void *);
+static void thread_pool_batch_work(struct thread_pool_batch *);
+static void thread_pool_batch_task(void *);
+
+static void
+thread_pool_make_key(void) {
+    pthread_key_create(&thread_pool_worker_key, NULL);
+}
+
+static void
+thread_pool_deque_push(struct thread_pool_deque *d,
+				const struct thread_pool_task *task) {
+    pthread_mutex_lock(&d->mtx);
+    if (d->count == d->size) {
+	struct thread_pool_task *tasks =
+	    memory_alloc(2 * d->size * sizeof *tasks);
+	unsigned int i;
+
+	for (i = 0; i < d->count; i++)
+	    tasks[i] = d->tasks[(d->top + i) % d->size];
+	memory_free(d->tasks);
+	d->tasks = tasks;
+	d->top = 0;
+	d->size *= 2;
+    }
+    d->tasks[(d->top + d->count) % d->size] = *task;
+    __atomic_store_n(&d->count, d->count + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&d->mtx);
+}
+
+static int
+thread_pool_deque_pop(struct thread_pool_deque *d,
+					struct thread_pool_task *task) {
+    int found = 0;
+
+    pthread_mutex_lock(&d->mtx);
+    if (d->count != 0) {
+	__atomic_store_n(&d->count, d->count - 1, __ATOMIC_RELAXED);
+	*task = d->tasks[(d->top + d->count) % d->size];
+	found = 1;
+    }
+    pthread_mutex_unlock(&d->mtx);
+
+    return found;
+}
+
+static int
+thread_pool_deque_steal(struct thread_pool_deque *d,
+					struct thread_pool_task *task) {
+    int found = 0;
+
+    /* Don't even take the lock of an empty deque */
+    if (__atomic_load_n(&d->count, __ATOMIC_RELAXED) == 0)
+	return 0;
+
+    pthread_mutex_lock(&d->mtx);
+    if (d->count != 0) {
+	*task = d->tasks[d->top];
+	d->top = (d->top + 1) % d->size;
+	__atomic_store_n(&d->count, d->count - 1, __ATOMIC_RELAXED);
+	found = 1;
+    }
+    pthread_mutex_unlock(&d->mtx);
+
+    return found;
+}
+
+/*
+ * Own deque first, then steal from the others.
+ */
+static int
+thread_pool_get_task(struct thread_pool_worker *w,
+					struct thread_pool_task *task) {
+    struct thread_pool *pool = w->pool;
+    unsigned int i;
+
+    if (thread_pool_deque_pop(&w->deque, task))
+	goto found;
+
+    for (i = 1; i < pool->nworkers; i++) {
+	struct thread_pool_worker *victim =
+	    &pool->workers[(w->index + i) % pool->nworkers];
+
+	if (thread_pool_deque_steal(&victim->deque, task))
+	    goto found;
+    }
+
+    return 0;
+
+found:
+    __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+static void *
+thread_pool_worker_run(void *arg) {
+    struct thread_pool_worker *w = arg;
+    struct thread_pool *pool = w->pool;
+    struct thread_pool_task task;
+
+    pthread_setspecific(thread_pool_worker_key, w);
+
+    for (;;) {
+	if (thread_pool_get_task(w, &task)) {
+	    task.fn(task.arg);
+	    continue;
+	}
+
+	pthread_mutex_lock(&pool->mtx);
+	/* Pairs with the check of nsleeping in thread_pool_submit() */
+	__atomic_add_fetch(&pool->nsleeping, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0) {
+	    if (pool->shutdown) {
+		__atomic_sub_fetch(&pool->nsleeping, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&pool->mtx);
+		break;
+	    }
+	    pthread_cond_wait(&pool->cond, &pool->mtx);
+	}
+	__atomic_sub_fetch(&pool->nsleeping, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&pool->mtx);
+    }
+
+    return NULL;
+}
+
+struct thread_pool *
+thread_pool_new(unsigned int nworkers) {
+    struct thread_pool *pool = memory_alloc(sizeof *pool);
+    unsigned int i;
+
+    if (nworkers == 0)
+	nworkers = 1;
+
+    pthread_once(&thread_pool_key_once, thread_pool_make_key);
+
+    pool->workers = memory_alloc(nworkers * sizeof *pool->workers);
+    pool->nworkers = nworkers;
+    pool->next_worker = 0;
+    pool->pending = 0;
+    pool->nsleeping = 0;
+    pool->shutdown = 0;
+    pthread_mutex_init(&pool->mtx, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (i = 0; i < nworkers; i++) {
+	struct thread_pool_worker *w = &pool->workers[i];
+
+	w->pool = pool;
+	w->index = i;
+	pthread_mutex_init(&w->deque.mtx, NULL);
+	w->deque.size = THREAD_POOL_INITIAL_DEQUE_SIZE;
+	w->deque.tasks = memory_alloc(w->deque.size * sizeof *w->deque.tasks);
+	w->deque.top = 0;
+	w->deque.count = 0;
+    }
+
+    for (i = 0; i < nworkers; i++)
+	if (pthread_create(&pool->workers[i].thread, NULL,
+				thread_pool_worker_run, &pool->workers[i]) != 0)
+	    EXCEPTION_RAISE(runtime_error, "can't create worker thread");
+
+    return pool;
+}
+
+/*
+ * Waits until every task submitted, including those submitted by tasks,
+ * has run.
+ */
+void
+thread_pool_delete(struct thread_pool *pool) {
+    unsigned int i;
+
+    pthread_mutex_lock(&pool->mtx);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mtx);
+
+    for (i = 0; i < pool->nworkers; i++)
+	pthread_join(pool->workers[i].thread, NULL);
+
+    for (i = 0; i < pool->nworkers; i++) {
+	pthread_mutex_destroy(&pool->workers[i].deque.mtx);
+	memory_free(pool->workers[i].deque.tasks);
+    }
+    pthread_mutex_destroy(&pool->mtx);
+    pthread_cond_destroy(&pool->cond);
+    memory_free(pool->workers);
+    memory_free(pool);
+}
+
+/*
+ * From a worker, the task goes to the worker's own deque.  Can be called
+ * from any thread.
+ */
+void
+thread_pool_submit(struct thread_pool *pool, void (*fn)(void *), void *arg) {
+    struct thread_pool_worker *w = pthread_getspecific(thread_pool_worker_key);
+    struct thread_pool_task task;
+
+    if (w == NULL || w->pool != pool)
+	w = &pool->workers[__atomic_fetch_add(&pool->next_worker, 1,
+	    __ATOMIC_RELAXED) % pool->nworkers];
+
+    task.fn = fn;
+    task.arg = arg;
+    thread_pool_deque_push(&w->deque, &task);
+
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->nsleeping, __ATOMIC_SEQ_CST) != 0) {
+	pthread_mutex_lock(&pool->mtx);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mtx);
+    }
+}
+
+static void
+thread_pool_batch_work(struct thread_pool_batch *b) {
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->n)
+	b->fn(b->args + i * b->size);
+}
+
+static void
+thread_pool_batch_task(void *arg) {
+    struct thread_pool_batch *b = arg;
+
+    thread_pool_batch_work(b);
+
+    pthread_mutex_lock(&b->mtx);
+    if (--b->ntasks == 0)
+	pthread_cond_signal(&b->cond);
+    pthread_mutex_unlock(&b->mtx);
+}
+
+/*
+ * Runs fn on each of the n arguments of size bytes at args, on the
+ * workers and the calling thread, and returns once all are done.  Not
+ * to be called from a task, which would wait for its own worker.
+ */
+void
+thread_pool_run(struct thread_pool *pool, void (*fn)(void *), void *args,
+						    size_t n, size_t size) {
+    struct thread_pool_batch b;
+    unsigned int i;
+
+    if (n == 0)
+	return;
+
+    b.fn = fn;
+    b.args = args;
+    b.size = size;
+    b.n = n;
+    b.next = 0;
+    b.ntasks = n - 1 < pool->nworkers? n - 1 : pool->nworkers;
+    pthread_mutex_init(&b.mtx, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    for (i = b.ntasks; i != 0; i--)
+	thread_pool_submit(pool, thread_pool_batch_task, &b);
+    thread_pool_batch_work(&b);
+
+    pthread_mutex_lock(&b.mtx);
+    while (b.ntasks != 0)
+	pthread_cond_wait(&b.cond, &b.mtx);
+    pthread_mutex_unlock(&b.mtx);
+    pthread_mutex_destroy(&b.mtx);
+    pthread_cond_destroy(&b.cond);
+}
+
+unsigned int
+thread_pool_get_nthreads(struct thread_pool *pool) {
+    return pool->nworkers;
+}
+
+/*
+ * One thread per online processor.
+ */
+unsigned int
+thread_pool_default_nthreads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0? n : 1;
+}
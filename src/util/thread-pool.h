@@ -0,0 +1,20 @@
+/*
+ * Pool of worker threads with one task deque each and work stealing
+ */
+#ifndef UTIL_THREAD_POOL_H_
+#define UTIL_THREAD_POOL_H_
+
+#include <stddef.h>
+
+struct thread_pool;
+
+struct thread_pool *thread_pool_new(unsigned int);
+void thread_pool_delete(struct thread_pool *);
+void thread_pool_submit(struct thread_pool *, void (*)(void *), void *);
+void thread_pool_run(struct thread_pool *, void (*)(void *), void *, size_t,
+	size_t);
+unsigned int thread_pool_get_nthreads(struct thread_pool *);
+
+unsigned int thread_pool_default_nthreads(void);
+
+#endif /* UTIL_THREAD_POOL_H_ */